@@ -0,0 +1,133 @@
+/**
+ * @file assetloader.cpp
+ * @brief Loads textures and meshes on worker threads.
+ */
+
+#include "application/assetloader.hpp"
+#include "scene/material.hpp"
+#include "scene/mesh.hpp"
+
+#include <iostream>
+#include <new>
+
+namespace _462 {
+
+AssetLoader::AssetLoader( size_t num_threads )
+    : running( 0 ), failed( false ), quit( false )
+{
+    if ( num_threads == 0 ) {
+        num_threads = std::thread::hardware_concurrency();
+    }
+    // the caller is one of the threads, but only while it waits
+    for ( size_t i = 1; i < num_threads; ++i ) {
+        workers.push_back( std::thread( &AssetLoader::worker_main, this ) );
+    }
+}
+
+AssetLoader::~AssetLoader()
+{
+    wait();
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        quit = true;
+    }
+    wake.notify_all();
+    for ( size_t i = 0; i < workers.size(); ++i ) {
+        workers[i].join();
+    }
+}
+
+size_t AssetLoader::num_threads() const
+{
+    return workers.size() + 1;
+}
+
+void AssetLoader::add_material( Material* material )
+{
+    Job job;
+    job.material = material;
+    job.mesh = 0;
+    add_job( job );
+}
+
+void AssetLoader::add_mesh( Mesh* mesh )
+{
+    Job job;
+    job.material = 0;
+    job.mesh = mesh;
+    add_job( job );
+}
+
+void AssetLoader::add_job( const Job& job )
+{
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        jobs.push_back( job );
+    }
+    wake.notify_one();
+}
+
+bool AssetLoader::wait()
+{
+    std::unique_lock< std::mutex > lock( mutex );
+    run_jobs( lock );
+    while ( running > 0 ) {
+        done.wait( lock );
+    }
+    bool ok = !failed;
+    failed = false;
+    return ok;
+}
+
+void AssetLoader::worker_main()
+{
+    std::unique_lock< std::mutex > lock( mutex );
+    while ( true ) {
+        while ( jobs.empty() && !quit ) {
+            wake.wait( lock );
+        }
+        if ( quit ) {
+            return;
+        }
+        run_jobs( lock );
+    }
+}
+
+void AssetLoader::run_jobs( std::unique_lock< std::mutex >& lock )
+{
+    while ( !jobs.empty() ) {
+        Job job = jobs.front();
+        jobs.pop_front();
+        ++running;
+
+        lock.unlock();
+        bool ok = run_job( job );
+        lock.lock();
+
+        failed = failed || !ok;
+        if ( --running == 0 && jobs.empty() ) {
+            done.notify_all();
+        }
+    }
+}
+
+bool AssetLoader::run_job( const Job& job )
+{
+    try {
+        if ( job.material ) {
+            if ( !job.material->load() ) {
+                std::cout << "Error loading texture.\n";
+                return false;
+            }
+        } else if ( !job.mesh->load() ) {
+            std::cout << "Error loading mesh.\n";
+            return false;
+        }
+    } catch ( std::bad_alloc const& ) {
+        std::cout << "Out of memory error while loading assets.\n";
+        return false;
+    }
+    return true;
+}
+
+} /* _462 */
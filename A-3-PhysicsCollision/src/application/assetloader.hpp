@@ -0,0 +1,86 @@
+/**
+ * @file assetloader.hpp
+ * @brief Loads textures and meshes on worker threads.
+ */
+
+#ifndef _462_APPLICATION_ASSETLOADER_HPP_
+#define _462_APPLICATION_ASSETLOADER_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace _462 {
+
+class Material;
+class Mesh;
+
+/**
+ * Loads the textures of materials and the data of meshes in the
+ * background. Assets start loading as soon as they are added, so decoding
+ * overlaps with whatever the caller does until it calls wait(). Only the
+ * file data is loaded; creating the GL data is left to the caller once
+ * wait() returned, since it needs the thread that owns the context.
+ */
+class AssetLoader
+{
+public:
+
+    /**
+     * @param num_threads The total number of threads that load assets,
+     *  including the caller while it waits. 0 picks the number of hardware
+     *  threads, 1 loads everything on the caller inside wait().
+     */
+    explicit AssetLoader( size_t num_threads = 0 );
+    // waits for all assets added so far
+    ~AssetLoader();
+
+    size_t num_threads() const;
+
+    // the assets are not owned and must outlive the next wait()
+    void add_material( Material* material );
+    void add_mesh( Mesh* mesh );
+
+    /**
+     * Blocks until every asset added so far is loaded.
+     * @return True if all of them loaded successfully.
+     */
+    bool wait();
+
+private:
+
+    struct Job
+    {
+        Material* material;
+        Mesh* mesh;
+    };
+
+    void add_job( const Job& job );
+    void worker_main();
+    // runs queued jobs until the queue is empty, lock is held on entry/exit
+    void run_jobs( std::unique_lock< std::mutex >& lock );
+    static bool run_job( const Job& job );
+
+    std::vector< std::thread > workers;
+
+    std::mutex mutex;
+    // signals workers that jobs were queued or that they should quit
+    std::condition_variable wake;
+    // signals waiters that the last running job finished
+    std::condition_variable done;
+    std::deque< Job > jobs;
+    // jobs taken off the queue but not finished yet
+    size_t running;
+    bool failed;
+    bool quit;
+
+    // no meaningful assignment or copy
+    AssetLoader( const AssetLoader& );
+    AssetLoader& operator=( const AssetLoader& );
+};
+
+} /* _462 */
+
+#endif /* _462_APPLICATION_ASSETLOADER_HPP_ */
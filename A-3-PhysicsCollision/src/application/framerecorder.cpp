@@ -0,0 +1,252 @@
+/**
+ * @file framerecorder.cpp
+ * @brief Records the rendered frames to an image sequence.
+ */
+
+#include "application/framerecorder.hpp"
+#include "application/imageio.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace _462 {
+
+FrameRecorder::FrameRecorder()
+    : recording( false ), width( 0 ), height( 0 ), policy( DROP_FRAMES ),
+      next_read_buffer( 0 ), async_read( false ), quit( false ), write_failed( false ),
+      num_recorded( 0 ), num_dropped( 0 ), capture_ns( 0 )
+{
+    for ( size_t i = 0; i < RECORDER_NUM_READ_BUFFERS; ++i ) {
+        read_buffers[i] = 0;
+        read_pending[i] = false;
+    }
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    stop();
+}
+
+bool FrameRecorder::start( const char* pre, const char* ext, int w, int h,
+                           Policy pol, size_t num_threads )
+{
+    stop();
+    if ( w < 1 || h < 1 ) {
+        return false;
+    }
+
+    prefix = pre;
+    extension = ext;
+    width = w;
+    height = h;
+    policy = pol;
+    size_t frame_size = size_t( width ) * size_t( height ) * 4;
+
+    async_read = GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object;
+    if ( async_read ) {
+        glGenBuffers( RECORDER_NUM_READ_BUFFERS, read_buffers );
+        for ( size_t i = 0; i < RECORDER_NUM_READ_BUFFERS; ++i ) {
+            glBindBuffer( GL_PIXEL_PACK_BUFFER, read_buffers[i] );
+            glBufferData( GL_PIXEL_PACK_BUFFER, frame_size, 0, GL_STREAM_READ );
+            read_pending[i] = false;
+        }
+        glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+        next_read_buffer = 0;
+    }
+
+    frames.resize( RECORDER_NUM_FRAMES );
+    free_frames.clear();
+    for ( size_t i = 0; i < frames.size(); ++i ) {
+        frames[i].pixels.resize( frame_size );
+        free_frames.push_back( &frames[i] );
+    }
+    queued_frames.clear();
+
+    if ( num_threads == 0 ) {
+        num_threads = std::max( 1u, std::thread::hardware_concurrency() / 2 );
+    }
+    quit = false;
+    write_failed = false;
+    for ( size_t i = 0; i < num_threads; ++i ) {
+        encoders.push_back( std::thread( &FrameRecorder::encoder_main, this ) );
+    }
+
+    num_recorded = 0;
+    num_dropped = 0;
+    capture_ns = 0;
+    recording = true;
+    std::cout << "Recording frames to '" << prefix << "*" << extension << "'.\n";
+    return true;
+}
+
+void FrameRecorder::stop()
+{
+    if ( !recording ) {
+        return;
+    }
+
+    // the reads still in flight are frames like any other, oldest first
+    if ( async_read ) {
+        for ( size_t i = 0; i < RECORDER_NUM_READ_BUFFERS; ++i ) {
+            size_t read_buffer = ( next_read_buffer + i ) % RECORDER_NUM_READ_BUFFERS;
+            if ( read_pending[read_buffer] ) {
+                collect( read_buffer );
+            }
+        }
+        glDeleteBuffers( RECORDER_NUM_READ_BUFFERS, read_buffers );
+        for ( size_t i = 0; i < RECORDER_NUM_READ_BUFFERS; ++i ) {
+            read_buffers[i] = 0;
+        }
+    }
+
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        quit = true;
+    }
+    wake.notify_all();
+    for ( size_t i = 0; i < encoders.size(); ++i ) {
+        encoders[i].join();
+    }
+    encoders.clear();
+    free_frames.clear();
+    std::vector< Frame >().swap( frames );
+    recording = false;
+
+    size_t num_captured = num_recorded + num_dropped;
+    printf( "Recorded %u frames, dropped %u, capture took %f ms per frame%s.\n",
+            unsigned( num_recorded ), unsigned( num_dropped ),
+            num_captured ? capture_ns * 1e-6 / num_captured : 0.0,
+            write_failed ? ", some frames could not be written" : "" );
+}
+
+bool FrameRecorder::is_recording() const
+{
+    return recording;
+}
+
+void FrameRecorder::capture()
+{
+    if ( !recording ) {
+        return;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    if ( async_read ) {
+        // the read started this many frames ago has had plenty of time to
+        // complete, so mapping its buffer shouldn't stall
+        size_t read_buffer = next_read_buffer;
+        if ( read_pending[read_buffer] ) {
+            collect( read_buffer );
+        }
+        glBindBuffer( GL_PIXEL_PACK_BUFFER, read_buffers[read_buffer] );
+        glReadPixels( 0, 0, width, height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, 0 );
+        glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+        read_pending[read_buffer] = true;
+        next_read_buffer = ( read_buffer + 1 ) % RECORDER_NUM_READ_BUFFERS;
+    } else {
+        Frame* frame = acquire_frame();
+        if ( frame ) {
+            glReadPixels( 0, 0, width, height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, &frame->pixels[0] );
+            queue_frame( frame );
+        }
+    }
+
+    capture_ns += std::chrono::duration_cast< std::chrono::nanoseconds >(
+        std::chrono::steady_clock::now() - start ).count();
+}
+
+void FrameRecorder::collect( size_t read_buffer )
+{
+    read_pending[read_buffer] = false;
+    Frame* frame = acquire_frame();
+    if ( !frame ) {
+        return;
+    }
+
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, read_buffers[read_buffer] );
+    const void* data = glMapBuffer( GL_PIXEL_PACK_BUFFER, GL_READ_ONLY );
+    bool mapped = data != 0;
+    if ( mapped ) {
+        memcpy( &frame->pixels[0], data, frame->pixels.size() );
+        glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+    }
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+    if ( mapped ) {
+        queue_frame( frame );
+    } else {
+        std::lock_guard< std::mutex > lock( mutex );
+        free_frames.push_back( frame );
+        --num_recorded;
+        ++num_dropped;
+    }
+}
+
+FrameRecorder::Frame* FrameRecorder::acquire_frame()
+{
+    std::unique_lock< std::mutex > lock( mutex );
+    if ( policy == BLOCK ) {
+        while ( free_frames.empty() ) {
+            freed.wait( lock );
+        }
+    } else if ( free_frames.empty() ) {
+        ++num_dropped;
+        return 0;
+    }
+    Frame* frame = free_frames.back();
+    free_frames.pop_back();
+    // number the frames kept, so the sequence has no gaps
+    frame->number = num_recorded++;
+    return frame;
+}
+
+void FrameRecorder::queue_frame( Frame* frame )
+{
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        queued_frames.push_back( frame );
+    }
+    wake.notify_one();
+}
+
+void FrameRecorder::encoder_main()
+{
+    std::unique_lock< std::mutex > lock( mutex );
+    while ( true ) {
+        while ( queued_frames.empty() && !quit ) {
+            wake.wait( lock );
+        }
+        // finish the queue before quitting
+        if ( queued_frames.empty() ) {
+            return;
+        }
+        Frame* frame = queued_frames.front();
+        queued_frames.pop_front();
+        lock.unlock();
+
+        // frames are read in the framebuffer's usual layout, which is
+        // cheapest to read, and only converted to rgba here
+        std::vector< unsigned char >& pixels = frame->pixels;
+        for ( size_t i = 0; i < pixels.size(); i += 4 ) {
+            std::swap( pixels[i], pixels[i + 2] );
+        }
+
+        char number[32];
+        sprintf( number, "%06u", unsigned( frame->number ) );
+        std::string filename = prefix + number + extension;
+        bool ok = imageio_save_image( filename.c_str(), &frame->pixels[0], width, height );
+
+        lock.lock();
+        if ( !ok && !write_failed ) {
+            std::cout << "Error writing frame to '" << filename << "'.\n";
+            write_failed = true;
+        }
+        free_frames.push_back( frame );
+        freed.notify_one();
+    }
+}
+
+} /* _462 */
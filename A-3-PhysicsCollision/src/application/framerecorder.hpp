@@ -0,0 +1,131 @@
+/**
+ * @file framerecorder.hpp
+ * @brief Records the rendered frames to an image sequence.
+ */
+
+#ifndef _462_APPLICATION_FRAMERECORDER_HPP_
+#define _462_APPLICATION_FRAMERECORDER_HPP_
+
+#include "application/opengl.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace _462 {
+
+// number of pixel buffers frames are read back through; a frame is copied
+// out of its buffer this many frames after its read was started
+#define RECORDER_NUM_READ_BUFFERS 3
+
+// number of frames that can wait for or be in encoding at once
+#define RECORDER_NUM_FRAMES 8
+
+/**
+ * Writes every rendered frame to a numbered sequence of images. Frames are
+ * read back asynchronously through a ring of pixel buffer objects, so the
+ * render thread never waits for the GPU, and are encoded and written by
+ * background threads. If the encoders fall behind, new frames are either
+ * dropped or the render thread blocks until one is free, by policy.
+ * Without pixel buffer objects the read back is synchronous, but encoding
+ * still happens in the background.
+ */
+class FrameRecorder
+{
+public:
+
+    enum Policy
+    {
+        // skip frames while all frame buffers are in use
+        DROP_FRAMES,
+        // wait for the encoders, so no frame is lost
+        BLOCK
+    };
+
+    FrameRecorder();
+    // stops recording
+    ~FrameRecorder();
+
+    /**
+     * Starts recording width by height pixels from the bottom left of the
+     * framebuffer to files named prefix000000 + extension and up. The
+     * extension is ".png" or ".ppm". Requires a GL context.
+     * @param num_threads The number of encoder threads, 0 for half the
+     *  hardware threads.
+     * @return True on success.
+     */
+    bool start( const char* prefix, const char* extension, int width, int height,
+                Policy policy, size_t num_threads = 0 );
+
+    /**
+     * Writes out the frames still in flight, waits for the encoders and
+     * prints how many frames were recorded and dropped. Requires the GL
+     * context of start().
+     */
+    void stop();
+
+    bool is_recording() const;
+
+    /**
+     * Starts reading back the frame just rendered. Call after rendering and
+     * before swapping buffers.
+     */
+    void capture();
+
+private:
+
+    struct Frame
+    {
+        std::vector< unsigned char > pixels;
+        size_t number;
+    };
+
+    // copies the read buffer into a free frame and queues it for encoding
+    void collect( size_t read_buffer );
+    // takes a free frame, or returns null if frames are dropped and none is
+    Frame* acquire_frame();
+    void queue_frame( Frame* frame );
+    void encoder_main();
+
+    bool recording;
+    std::string prefix;
+    std::string extension;
+    int width, height;
+    Policy policy;
+
+    // pixel buffers that frames are read into, and whether each has a read
+    // in flight, if pixel buffer objects are supported
+    GLuint read_buffers[RECORDER_NUM_READ_BUFFERS];
+    bool read_pending[RECORDER_NUM_READ_BUFFERS];
+    size_t next_read_buffer;
+    bool async_read;
+
+    std::vector< Frame > frames;
+    std::vector< std::thread > encoders;
+
+    std::mutex mutex;
+    // signals encoders that frames were queued or that they should quit
+    std::condition_variable wake;
+    // signals the render thread that a frame became free
+    std::condition_variable freed;
+    std::vector< Frame* > free_frames;
+    std::deque< Frame* > queued_frames;
+    bool quit;
+    bool write_failed;
+
+    // frames numbered so far, those dropped and the time spent in capture()
+    size_t num_recorded;
+    size_t num_dropped;
+    long long capture_ns;
+
+    // no meaningful assignment or copy
+    FrameRecorder( const FrameRecorder& );
+    FrameRecorder& operator=( const FrameRecorder& );
+};
+
+} /* _462 */
+
+#endif /* _462_APPLICATION_FRAMERECORDER_HPP_ */
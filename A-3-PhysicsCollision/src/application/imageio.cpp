@@ -198,6 +198,35 @@ static bool _save_image_RGBA_png(const char *fileName, unsigned char *buffer,
     return true;
 }
 
+// ***** ppm related internal functions ***** //
+
+static bool _save_image_RGBA_ppm(const char *fileName, unsigned char *buffer,
+  int width, int height)
+{
+    FILE *fp = fopen(fileName, "wb");
+    if (!fp)
+        return false;
+
+    // binary rgb, dropping the alpha, rows from the top like the png
+    fprintf(fp, "P6\n%d %d\n255\n", width, height);
+    unsigned char *row = new unsigned char[width * 3];
+    bool ok = true;
+    for (int y = 0 ; y < height && ok ; y++) {
+        const unsigned char *src = buffer + (height - 1 - y) * width * 4;
+        for (int x = 0 ; x < width ; x++) {
+            row[x * 3 + 0] = src[x * 4 + 0];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        ok = fwrite(row, 3, width, fp) == (size_t) width;
+    }
+    delete [] row;
+
+    if (fclose(fp) != 0)
+        ok = false;
+    return ok;
+}
+
 // ***** external functions ***** //
 
 // Sets the width and height to the appropriate values and mallocs
@@ -221,6 +250,8 @@ bool imageio_save_image( const char *fileName, unsigned char *buffer,
 {
     if (_ends_with(fileName, ".png"))
         return _save_image_RGBA_png(fileName, buffer, width, height);
+    else if (_ends_with(fileName, ".ppm"))
+        return _save_image_RGBA_ppm(fileName, buffer, width, height);
     else
         return false;
 }
@@ -40,7 +40,7 @@ unsigned char* imageio_load_image( const char* filename, int *width, int *height
 
 // Saves image given by buffer with specicified width and height
 // to the given file name, returns true on success, false otherwise.
-// The image format is RGBA.
+// The image format is RGBA. The file is a png or ppm by its extension.
 bool imageio_save_image( const char* filename, unsigned char* buffer, int width, int height );
 
 // Writes the current opengl frame buffer to a specified file name.
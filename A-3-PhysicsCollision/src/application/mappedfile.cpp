@@ -0,0 +1,127 @@
+/**
+ * @file mappedfile.cpp
+ * @brief Read-only memory mapping of whole files.
+ */
+
+#include "application/mappedfile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace _462 {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : begin( 0 ), length( 0 ), file( INVALID_HANDLE_VALUE ), mapping( 0 ) { }
+
+bool MappedFile::open( const char* filename )
+{
+    close();
+
+    file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0 );
+    if ( file == INVALID_HANDLE_VALUE ) {
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    if ( !GetFileSizeEx( file, &file_size ) ) {
+        close();
+        return false;
+    }
+    length = size_t( file_size.QuadPart );
+    if ( length == 0 ) {
+        return true;
+    }
+
+    mapping = CreateFileMappingA( file, 0, PAGE_READONLY, 0, 0, 0 );
+    if ( !mapping ) {
+        close();
+        return false;
+    }
+    begin = static_cast< const char* >( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+    if ( !begin ) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close()
+{
+    if ( begin ) {
+        UnmapViewOfFile( begin );
+    }
+    if ( mapping ) {
+        CloseHandle( mapping );
+    }
+    if ( file != INVALID_HANDLE_VALUE ) {
+        CloseHandle( file );
+    }
+    begin = 0;
+    length = 0;
+    mapping = 0;
+    file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile() : begin( 0 ), length( 0 ), file( -1 ) { }
+
+bool MappedFile::open( const char* filename )
+{
+    close();
+
+    file = ::open( filename, O_RDONLY );
+    if ( file < 0 ) {
+        return false;
+    }
+    struct stat info;
+    if ( fstat( file, &info ) != 0 ) {
+        close();
+        return false;
+    }
+    length = size_t( info.st_size );
+    if ( length == 0 ) {
+        return true;
+    }
+
+    void* address = mmap( 0, length, PROT_READ, MAP_PRIVATE, file, 0 );
+    if ( address == MAP_FAILED ) {
+        close();
+        return false;
+    }
+    // the whole file is read front to back
+    madvise( address, length, MADV_SEQUENTIAL );
+    begin = static_cast< const char* >( address );
+    return true;
+}
+
+void MappedFile::close()
+{
+    if ( begin ) {
+        munmap( const_cast< char* >( begin ), length );
+    }
+    if ( file >= 0 ) {
+        ::close( file );
+    }
+    begin = 0;
+    length = 0;
+    file = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+} /* _462 */
@@ -0,0 +1,53 @@
+/**
+ * @file mappedfile.hpp
+ * @brief Read-only memory mapping of whole files.
+ */
+
+#ifndef _462_APPLICATION_MAPPEDFILE_HPP_
+#define _462_APPLICATION_MAPPEDFILE_HPP_
+
+#include <cstddef>
+
+namespace _462 {
+
+/**
+ * Maps a file into memory for reading, so it can be parsed in place
+ * without copying it through stream buffers. The mapping lives until
+ * close() or destruction.
+ */
+class MappedFile
+{
+public:
+
+    MappedFile();
+    ~MappedFile();
+
+    /**
+     * Maps the given file, unmapping any file mapped before.
+     * @return True on success. Empty files succeed with a null data().
+     */
+    bool open( const char* filename );
+    void close();
+
+    const char* data() const { return begin; }
+    size_t size() const { return length; }
+
+private:
+
+    const char* begin;
+    size_t length;
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#else
+    int file;
+#endif
+
+    // no meaningful assignment or copy
+    MappedFile( const MappedFile& );
+    MappedFile& operator=( const MappedFile& );
+};
+
+} /* _462 */
+
+#endif /* _462_APPLICATION_MAPPEDFILE_HPP_ */
@@ -6,6 +6,7 @@
  */
 
 #include "application/scene_loader.hpp"
+#include "application/assetloader.hpp"
 
 #include "scene/scene.hpp"
 #include "scene/sphere.hpp"
@@ -16,6 +17,7 @@
 
 #include <iostream>
 #include <map>
+#include <vector>
 #include <cstring>
 #include <exception>
 
@@ -74,6 +76,10 @@ static const char STR_ID[] = "id";
 static const char STR_SPHEREBODY[] = "sphere_body";
 static const char STR_TRIANGLEBODY[] = "triangle_body";
 static const char STR_PLANEBODY[] = "plane_body";
+static const char STR_BOXBODY[] = "box_body";
+static const char STR_CAPSULEBODY[] = "capsule_body";
+static const char STR_HALFEXTENTS[] = "half_extents";
+static const char STR_HALFHEIGHT[] = "half_height";
 static const char STR_POINTA[] = "point_a";
 static const char STR_POINTB[] = "point_b";
 static const char STR_POINTC[] = "point_c";
@@ -91,7 +97,21 @@ static const char STR_EQUILIBRIUM[] = "equilibrium";
 static const char STR_OFFSET1[] = "offset1";
 static const char STR_OFFSET2[] = "offset2";
 static const char STR_COLLISIONDAMPING[] = "collision_damping";
+static const char STR_FRICTION[] = "friction";
 static const char STR_DAMPING[] = "damping";
+static const char STR_BROADPHASE[] = "broad_phase";
+static const char STR_TYPE[] = "type";
+static const char STR_INTEGRATOR[] = "integrator";
+static const char STR_TIMESTEP[] = "time_step";
+static const char STR_CLOTH[] = "cloth";
+static const char STR_ROWS[] = "rows";
+static const char STR_COLUMNS[] = "columns";
+static const char STR_ROWOFFSET[] = "row_offset";
+static const char STR_COLUMNOFFSET[] = "column_offset";
+static const char STR_BENDCONSTANT[] = "bend_constant";
+static const char STR_PIN[] = "pin";
+static const char STR_ROW[] = "row";
+static const char STR_COLUMN[] = "column";
 
 static void print_error_header( const TiXmlElement* base )
 {
@@ -150,6 +170,19 @@ static void parse_attrib_double( const TiXmlElement* elem, bool required, const
     }
 }
 
+#ifdef MATH_SINGLE_PRECISION
+// reads through a double in single precision builds
+static void parse_attrib_double( const TiXmlElement* elem, bool required, const char* name, float* val )
+{
+    double d = 0.0;
+    parse_attrib_double( elem, required, name, &d );
+    // a missing optional attribute leaves the value as it was
+    if ( elem->Attribute( name ) ) {
+        *val = float( d );
+    }
+}
+#endif
+
 static void parse_attrib_string( const TiXmlElement* elem, bool required, const char* name, const char** val )
 {
     const char* att = elem->Attribute( name );
@@ -182,7 +215,7 @@ template<> void parse_elem< int >( const TiXmlElement* elem, int* i )
     parse_attrib_int( elem, true, "i", i );
 }
 
-template<> void parse_elem< double >( const TiXmlElement* elem, double* d )
+template<> void parse_elem< real_t >( const TiXmlElement* elem, real_t* d )
 {
     parse_attrib_double( elem, true, "v", d );
 }
@@ -355,6 +388,63 @@ static void parse_planebody( BodyMap& bodies, const TiXmlElement* elem, PlaneBod
     bodies[body->id] = body;
 }
 
+static void parse_convexbody( BodyMap& bodies, const TiXmlElement* elem, ConvexBody* body )
+{
+    parse_elem( elem, true, STR_ID, &body->id );
+    parse_elem( elem, true, STR_POSITION, &body->position );
+    parse_elem( elem, false, STR_ORIENT, &body->orientation );
+    if ( body->shape == CONVEX_CAPSULE ) {
+        parse_elem( elem, true, STR_RADIUS, &body->radius );
+        parse_elem( elem, true, STR_HALFHEIGHT, &body->half_height );
+    } else {
+        parse_elem( elem, true, STR_HALFEXTENTS, &body->half_extents );
+    }
+    bodies[body->id] = body;
+}
+
+static void parse_broad_phase( const TiXmlElement* elem, Physics* phys )
+{
+    const char* type;
+    parse_attrib_string( elem, true, STR_TYPE, &type );
+    if ( strcmp( type, "brute_force" ) == 0 ) {
+        phys->set_broad_phase( BROAD_PHASE_BRUTE_FORCE );
+    } else if ( strcmp( type, "grid" ) == 0 ) {
+        phys->set_broad_phase( BROAD_PHASE_GRID );
+    } else if ( strcmp( type, "sap" ) == 0 ) {
+        phys->set_broad_phase( BROAD_PHASE_SAP );
+    } else {
+        print_error_header( elem );
+        std::cout << "unknown broad phase '" << type << "'.\n";
+        throw std::exception();
+    }
+}
+
+static void parse_integrator( const TiXmlElement* elem, Physics* phys )
+{
+    const char* type;
+    parse_attrib_string( elem, true, STR_TYPE, &type );
+    if ( strcmp( type, "symplectic_euler" ) == 0 ) {
+        phys->set_integrator( INTEGRATOR_SYMPLECTIC_EULER );
+    } else if ( strcmp( type, "verlet" ) == 0 ) {
+        phys->set_integrator( INTEGRATOR_VERLET );
+    } else if ( strcmp( type, "rk4" ) == 0 ) {
+        phys->set_integrator( INTEGRATOR_RK4 );
+    } else {
+        print_error_header( elem );
+        std::cout << "unknown integrator '" << type << "'.\n";
+        throw std::exception();
+    }
+
+    real_t time_step = phys->get_time_step();
+    parse_attrib_double( elem, false, STR_TIMESTEP, &time_step );
+    if ( time_step <= 0.0 ) {
+        print_error_header( elem );
+        std::cout << "time_step must be positive.\n";
+        throw std::exception();
+    }
+    phys->set_time_step( time_step );
+}
+
 static void parse_geom_sphere( const MaterialMap& matmap, BodyMap& bodies, Physics* phys, const TiXmlElement* elem, Sphere* geom )
 {
     // parse base
@@ -405,28 +495,173 @@ static void parse_geom_triangle( const MaterialMap& matmap, const TriVertMap& tv
     }
 }
 
-static void parse_geom_model( const MaterialMap& matmap, const MeshMap& meshmap, const TiXmlElement* elem, Model* geom )
+static void parse_geom_model( const MaterialMap& matmap, const MeshMap& meshmap, Physics* phys, const TiXmlElement* elem, Model* geom )
 {
     parse_geom_base( matmap, elem, geom );
     parse_lookup_data( meshmap, elem, STR_MESH, &geom->mesh );
     parse_lookup_data( matmap, elem, STR_MATERIAL, &geom->material );
+    // Models with a body collide as static triangles, or as the convex hull
+    // of their vertices with type="hull"
+    const TiXmlElement* body = elem->FirstChildElement( STR_BODY );
+    if ( body ) {
+        const char* type = "triangles";
+        parse_attrib_string( body, false, STR_TYPE, &type );
+        if ( strcmp( type, "hull" ) == 0 ) {
+            phys->add_hull( geom );
+        } else if ( strcmp( type, "triangles" ) == 0 ) {
+            phys->add_model( geom );
+        } else {
+            print_error_header( body );
+            std::cout << "unknown body type '" << type << "'.\n";
+            throw std::exception();
+        }
+    }
 }
 
-static void parse_spring( BodyMap& bmap, const TiXmlElement* elem, Spring* spring )
+static Body* parse_body_ref( const BodyMap& bmap, const TiXmlElement* elem, const char* name )
 {
     int id;
+    parse_elem( elem, true, name, &id );
+    BodyMap::const_iterator iter = bmap.find( id );
+    if ( iter == bmap.end() ) {
+        print_error_header( elem );
+        std::cout << "No such body " << id << ".\n";
+        throw std::exception();
+    }
+    return iter->second;
+}
+
+static void parse_spring( BodyMap& bmap, const TiXmlElement* elem, Spring* spring )
+{
     parse_elem( elem, true, STR_CONSTANT, &spring->constant );
     parse_elem( elem, true, STR_EQUILIBRIUM, &spring->equilibrium );
-    parse_elem( elem, true, STR_BODY1, &id );
-    spring->body1 = bmap[id];
+    spring->body1 = parse_body_ref( bmap, elem, STR_BODY1 );
     parse_elem( elem, false, STR_OFFSET1, &spring->body1_offset );
-    parse_elem( elem, true, STR_BODY2, &id );
-    spring->body2 = bmap[id];
+    // without body2, offset2 is a fixed point in world space
+    if ( get_unique_child( elem, false, STR_BODY2 ) ) {
+        spring->body2 = parse_body_ref( bmap, elem, STR_BODY2 );
+    }
     parse_elem( elem, false, STR_OFFSET2, &spring->body2_offset );
     parse_elem( elem, false, STR_DAMPING, &spring->damping );
 }
 
-bool load_scene( Scene* scene, const char* filename )
+static void add_cloth_spring( Physics* phys, SphereBody* body1, SphereBody* body2, real_t constant, real_t damping )
+{
+    Spring* spring = new Spring();
+    check_mem( spring );
+    spring->constant = constant;
+    spring->damping = damping;
+    spring->body1 = body1;
+    spring->body2 = body2;
+    spring->equilibrium = distance( body1->position, body2->position );
+    phys->add_spring( spring );
+}
+
+/**
+ * A cloth is a grid of small spheres held together by springs to their
+ * neighbors along the grid (structural springs) and diagonally (shear
+ * springs), and optionally to the neighbors two nodes away (bending
+ * springs). All nodes share one body id, so the cloth does not collide
+ * with itself. Pinned nodes are held in place by springs to where they
+ * start.
+ */
+static void parse_cloth( const MaterialMap& matmap, Scene* scene, const TiXmlElement* elem )
+{
+    Physics* phys = scene->get_physics();
+    const Material* material;
+    Vector3 origin, row_offset, column_offset;
+    int rows, columns, id;
+    real_t radius, mass, constant;
+    real_t damping = 0.0;
+    real_t bend_constant = 0.0;
+
+    parse_lookup_data( matmap, elem, STR_MATERIAL, &material );
+    parse_elem( elem, true,  STR_POSITION,      &origin );
+    parse_elem( elem, true,  STR_ROWS,          &rows );
+    parse_elem( elem, true,  STR_COLUMNS,       &columns );
+    parse_elem( elem, true,  STR_ROWOFFSET,     &row_offset );
+    parse_elem( elem, true,  STR_COLUMNOFFSET,  &column_offset );
+    parse_elem( elem, true,  STR_RADIUS,        &radius );
+    parse_elem( elem, true,  STR_ID,            &id );
+    parse_elem( elem, true,  STR_MASS,          &mass );
+    parse_elem( elem, true,  STR_CONSTANT,      &constant );
+    parse_elem( elem, false, STR_DAMPING,       &damping );
+    parse_elem( elem, false, STR_BENDCONSTANT,  &bend_constant );
+    if ( rows < 1 || columns < 1 ) {
+        print_error_header( elem );
+        std::cout << "cloth needs at least one row and column.\n";
+        throw std::exception();
+    }
+
+    std::vector< SphereBody* > nodes( rows * columns );
+    for ( int r = 0; r < rows; ++r ) {
+        for ( int c = 0; c < columns; ++c ) {
+            Sphere* geom = new Sphere();
+            check_mem( geom );
+            scene->add_geometry( geom );
+            geom->position = origin + real_t( r ) * row_offset + real_t( c ) * column_offset;
+            geom->radius = radius;
+            geom->material = material;
+            SphereBody* body = new SphereBody( geom );
+            check_mem( body );
+            body->id = id;
+            body->mass = mass;
+            phys->add_sphere( body );
+            nodes[r * columns + c] = body;
+        }
+    }
+
+    for ( int r = 0; r < rows; ++r ) {
+        for ( int c = 0; c < columns; ++c ) {
+            SphereBody* node = nodes[r * columns + c];
+            if ( c + 1 < columns )
+                add_cloth_spring( phys, node, nodes[r * columns + c + 1], constant, damping );
+            if ( r + 1 < rows )
+                add_cloth_spring( phys, node, nodes[( r + 1 ) * columns + c], constant, damping );
+            if ( r + 1 < rows && c + 1 < columns ) {
+                add_cloth_spring( phys, node, nodes[( r + 1 ) * columns + c + 1], constant, damping );
+                add_cloth_spring( phys, nodes[r * columns + c + 1], nodes[( r + 1 ) * columns + c], constant, damping );
+            }
+            if ( bend_constant > 0.0 ) {
+                if ( c + 2 < columns )
+                    add_cloth_spring( phys, node, nodes[r * columns + c + 2], bend_constant, damping );
+                if ( r + 2 < rows )
+                    add_cloth_spring( phys, node, nodes[( r + 2 ) * columns + c], bend_constant, damping );
+            }
+        }
+    }
+
+    const TiXmlElement* child = elem->FirstChildElement( STR_PIN );
+    while ( child ) {
+        int r, c;
+        parse_attrib_int( child, true, STR_ROW, &r );
+        parse_attrib_int( child, true, STR_COLUMN, &c );
+        if ( r < 0 || r >= rows || c < 0 || c >= columns ) {
+            print_error_header( child );
+            std::cout << "pinned node outside the cloth.\n";
+            throw std::exception();
+        }
+        Spring* spring = new Spring();
+        check_mem( spring );
+        spring->constant = constant;
+        spring->damping = damping;
+        spring->body1 = nodes[r * columns + c];
+        spring->body2_offset = spring->body1->position;
+        phys->add_spring( spring );
+        child = child->NextSiblingElement( STR_PIN );
+    }
+}
+
+// clears the scene once the loader no longer uses its assets
+static void abort_load( Scene* scene, AssetLoader* loader )
+{
+    if ( loader ) {
+        loader->wait();
+    }
+    scene->reset();
+}
+
+bool load_scene( Scene* scene, const char* filename, AssetLoader* loader )
 {
     TiXmlDocument doc( filename );
     const TiXmlElement* root = 0;
@@ -472,6 +707,16 @@ bool load_scene( Scene* scene, const char* filename )
         parse_elem( root, false, STR_GRAVITY, &scene->get_physics()->gravity );
 		// parse damping constants
 		parse_elem( root, false, STR_COLLISIONDAMPING, &scene->get_physics()->collision_damping );
+        // parse friction coefficient
+        parse_elem( root, false, STR_FRICTION, &scene->get_physics()->friction );
+        // parse broad phase selection
+        elem = get_unique_child( root, false, STR_BROADPHASE );
+        if ( elem )
+            parse_broad_phase( elem, scene->get_physics() );
+        // parse integrator selection
+        elem = get_unique_child( root, false, STR_INTEGRATOR );
+        if ( elem )
+            parse_integrator( elem, scene->get_physics() );
 
         // parse the lights
         elem = root->FirstChildElement( STR_PLIGHT );
@@ -498,6 +743,9 @@ bool load_scene( Scene* scene, const char* filename )
                 std::cout << "Material '" << name << "' multiply defined.\n";
                 throw std::exception();
             }
+            if ( loader ) {
+                loader->add_material( mat );
+            }
             elem = elem->NextSiblingElement( STR_MATERIAL );
         }
 
@@ -516,6 +764,9 @@ bool load_scene( Scene* scene, const char* filename )
                 std::cout << "Mesh '" << name << "' multiply defined.\n";
                 throw std::exception();
             }
+            if ( loader ) {
+                loader->add_mesh( mesh );
+            }
             elem = elem->NextSiblingElement( STR_MESH );
         }
 
@@ -563,10 +814,17 @@ bool load_scene( Scene* scene, const char* filename )
             Model* geom = new Model();
             check_mem( geom );
             scene->add_geometry( geom );
-            parse_geom_model( materials, meshes, elem, geom );
+            parse_geom_model( materials, meshes, scene->get_physics(), elem, geom );
             elem = elem->NextSiblingElement( STR_MODEL );
         }
 
+        // cloths
+        elem = root->FirstChildElement( STR_CLOTH );
+        while ( elem ) {
+            parse_cloth( materials, scene, elem );
+            elem = elem->NextSiblingElement( STR_CLOTH );
+        }
+
         // TODO add you own geometries here
 
         // physical planes
@@ -579,6 +837,26 @@ bool load_scene( Scene* scene, const char* filename )
             elem = elem->NextSiblingElement( STR_PLANEBODY );
         }
 
+        // physical boxes and capsules
+        elem = root->FirstChildElement( STR_BOXBODY );
+        while ( elem ) {
+            ConvexBody* body = new ConvexBody();
+            check_mem( body );
+            body->shape = CONVEX_BOX;
+            parse_convexbody( bodies, elem, body );
+            scene->get_physics()->add_convex( body );
+            elem = elem->NextSiblingElement( STR_BOXBODY );
+        }
+        elem = root->FirstChildElement( STR_CAPSULEBODY );
+        while ( elem ) {
+            ConvexBody* body = new ConvexBody();
+            check_mem( body );
+            body->shape = CONVEX_CAPSULE;
+            parse_convexbody( bodies, elem, body );
+            scene->get_physics()->add_convex( body );
+            elem = elem->NextSiblingElement( STR_CAPSULEBODY );
+        }
+
         // springs
         elem = root->FirstChildElement( STR_SPRING );
         while ( elem ) {
@@ -591,10 +869,10 @@ bool load_scene( Scene* scene, const char* filename )
 
     } catch ( std::bad_alloc const& ) {
         std::cout << "Out of memory error while loading scene\n.";
-        scene->reset();
+        abort_load( scene, loader );
         return false;
     } catch ( ... ) {
-        scene->reset();
+        abort_load( scene, loader );
         return false;
     }
 
@@ -11,14 +11,18 @@
 namespace _462 {
 
 class Scene;
+class AssetLoader;
 
 /**
  * Loads a scene from a .scene file.
  * Clears away the old scene. Prints a message to stdout if an error occurs.
+ * If a loader is given, every material and mesh is added to it as soon as
+ * it is parsed, so their files load while the rest of the scene is parsed.
+ * Otherwise loading them is left to the caller.
  * @return True on success, false on error.
  * Will clear the scene on error.
  */
-bool load_scene( Scene* scene, const char* filename );
+bool load_scene( Scene* scene, const char* filename, AssetLoader* loader = 0 );
 
 } /* _462 */
 
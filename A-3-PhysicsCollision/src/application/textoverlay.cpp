@@ -0,0 +1,97 @@
+/**
+ * @file textoverlay.cpp
+ * @brief Draws short lines of text over the rendered frame.
+ */
+
+#include "application/textoverlay.hpp"
+#include "application/opengl.hpp"
+#include <cctype>
+#include <cstring>
+
+namespace _462 {
+
+#define GLYPH_WIDTH 3
+#define GLYPH_HEIGHT 5
+
+// 3x5 glyphs, rows top to bottom from the high bits, the left column
+// being the highest bit of a row
+static const unsigned short DigitGlyphs[10] = {
+    0x7b6f, 0x2c97, 0x73e7, 0x73cf, 0x5bc9, 0x79cf, 0x79ef, 0x7292, 0x7bef, 0x7bcf
+};
+static const unsigned short LetterGlyphs[26] = {
+    0x2bed, 0x6bae, 0x3923, 0x6b6e, 0x79a7, 0x79a4, 0x396b, 0x5bed, 0x7497, 0x126a, 0x5bad, 0x4927, 0x5fed,
+    0x6b6d, 0x2b6a, 0x6ba4, 0x2b73, 0x6bad, 0x388e, 0x7492, 0x5b6f, 0x5b6a, 0x5bfd, 0x5aad, 0x5a92, 0x72a7
+};
+
+static unsigned short glyph( char c )
+{
+    if ( isdigit( (unsigned char) c ) ) {
+        return DigitGlyphs[c - '0'];
+    }
+    if ( isalpha( (unsigned char) c ) ) {
+        return LetterGlyphs[toupper( (unsigned char) c ) - 'A'];
+    }
+    switch ( c ) {
+    case ':':
+        return 0x0410;
+    case '.':
+        return 0x0002;
+    case '/':
+        return 0x12a4;
+    default:
+        return 0;
+    }
+}
+
+void draw_overlay_text( const char* text, int x, int y, int pixel_size )
+{
+    GLint viewport[4];
+    glGetIntegerv( GL_VIEWPORT, viewport );
+
+    glPushAttrib( GL_ENABLE_BIT | GL_CURRENT_BIT );
+    glDisable( GL_LIGHTING );
+    glDisable( GL_TEXTURE_2D );
+    glDisable( GL_DEPTH_TEST );
+    glMatrixMode( GL_PROJECTION );
+    glPushMatrix();
+    glLoadIdentity();
+    // pixels, y down from the top
+    glOrtho( 0, viewport[2], viewport[3], 0, -1, 1 );
+    glMatrixMode( GL_MODELVIEW );
+    glPushMatrix();
+    glLoadIdentity();
+
+    int advance = ( GLYPH_WIDTH + 1 ) * pixel_size;
+    int length = int( strlen( text ) );
+    glColor3f( 0.0f, 0.0f, 0.0f );
+    glRecti( x, y, x + length * advance + pixel_size, y + ( GLYPH_HEIGHT + 2 ) * pixel_size );
+
+    glColor3f( 1.0f, 1.0f, 1.0f );
+    glBegin( GL_QUADS );
+    for ( int i = 0; i < length; ++i ) {
+        unsigned short bits = glyph( text[i] );
+        for ( int row = 0; row < GLYPH_HEIGHT; ++row ) {
+            for ( int column = 0; column < GLYPH_WIDTH; ++column ) {
+                int bit = ( GLYPH_HEIGHT - 1 - row ) * GLYPH_WIDTH + ( GLYPH_WIDTH - 1 - column );
+                if ( !( bits & ( 1 << bit ) ) ) {
+                    continue;
+                }
+                int px = x + i * advance + ( column + 1 ) * pixel_size;
+                int py = y + ( row + 1 ) * pixel_size;
+                glVertex2i( px, py );
+                glVertex2i( px, py + pixel_size );
+                glVertex2i( px + pixel_size, py + pixel_size );
+                glVertex2i( px + pixel_size, py );
+            }
+        }
+    }
+    glEnd();
+
+    glPopMatrix();
+    glMatrixMode( GL_PROJECTION );
+    glPopMatrix();
+    glMatrixMode( GL_MODELVIEW );
+    glPopAttrib();
+}
+
+} /* _462 */
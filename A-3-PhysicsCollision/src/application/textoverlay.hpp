@@ -0,0 +1,22 @@
+/**
+ * @file textoverlay.hpp
+ * @brief Draws short lines of text over the rendered frame.
+ */
+
+#ifndef _462_APPLICATION_TEXTOVERLAY_HPP_
+#define _462_APPLICATION_TEXTOVERLAY_HPP_
+
+namespace _462 {
+
+/**
+ * Draws text on a dark background with a tiny built in font, for debugging
+ * displays. x and y are the top left corner in pixels from the top left of
+ * the viewport, and every font pixel is pixel_size pixels wide. Knows
+ * digits, letters, drawn in upper case, and ' ', ':', '.' and '/'; other
+ * characters are blank. Leaves the gl state as it found it.
+ */
+void draw_overlay_text( const char* text, int x, int y, int pixel_size );
+
+} /* _462 */
+
+#endif /* _462_APPLICATION_TEXTOVERLAY_HPP_ */
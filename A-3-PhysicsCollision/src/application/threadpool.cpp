@@ -0,0 +1,103 @@
+/**
+ * @file threadpool.cpp
+ * @brief A pool of worker threads for data parallel loops.
+ */
+
+#include "application/threadpool.hpp"
+
+namespace _462 {
+
+ThreadPool::ThreadPool( size_t num_threads )
+    : generation( 0 ), busy( 0 ), quit( false ), func( 0 ), data( 0 ), count( 0 ), next( 0 )
+{
+    if ( num_threads == 0 ) {
+        num_threads = std::thread::hardware_concurrency();
+    }
+    // the caller is one of the threads
+    for ( size_t i = 1; i < num_threads; ++i ) {
+        workers.push_back( std::thread( &ThreadPool::worker_main, this ) );
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        quit = true;
+    }
+    wake.notify_all();
+    for ( size_t i = 0; i < workers.size(); ++i ) {
+        workers[i].join();
+    }
+}
+
+size_t ThreadPool::num_threads() const
+{
+    return workers.size() + 1;
+}
+
+void ThreadPool::parallel_for( size_t count, TaskFunc func, void* data )
+{
+    if ( workers.empty() || count < 2 ) {
+        for ( size_t i = 0; i < count; ++i ) {
+            func( data, i );
+        }
+        return;
+    }
+
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        this->func = func;
+        this->data = data;
+        this->count = count;
+        next = 0;
+        busy = workers.size();
+        ++generation;
+    }
+    wake.notify_all();
+
+    run_tasks();
+
+    std::unique_lock< std::mutex > lock( mutex );
+    while ( busy > 0 ) {
+        done.wait( lock );
+    }
+}
+
+void ThreadPool::worker_main()
+{
+    size_t seen = 0;
+
+    while ( true ) {
+        {
+            std::unique_lock< std::mutex > lock( mutex );
+            while ( generation == seen && !quit ) {
+                wake.wait( lock );
+            }
+            if ( quit ) {
+                return;
+            }
+            seen = generation;
+        }
+
+        run_tasks();
+
+        std::lock_guard< std::mutex > lock( mutex );
+        if ( --busy == 0 ) {
+            done.notify_one();
+        }
+    }
+}
+
+void ThreadPool::run_tasks()
+{
+    while ( true ) {
+        size_t i = next++;
+        if ( i >= count ) {
+            break;
+        }
+        func( data, i );
+    }
+}
+
+} /* _462 */
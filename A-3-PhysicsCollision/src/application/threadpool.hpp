@@ -0,0 +1,76 @@
+/**
+ * @file threadpool.hpp
+ * @brief A pool of worker threads for data parallel loops.
+ */
+
+#ifndef _462_APPLICATION_THREADPOOL_HPP_
+#define _462_APPLICATION_THREADPOOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace _462 {
+
+/**
+ * Runs the iterations of a loop on a fixed set of worker threads plus the
+ * calling thread. Only one loop runs at a time; parallel_for blocks until
+ * every iteration has returned. Iterations are handed out one by one, so
+ * which thread runs which iteration is unspecified.
+ */
+class ThreadPool
+{
+public:
+
+    typedef void (*TaskFunc)( void* data, size_t index );
+
+    /**
+     * @param num_threads The total number of threads that run iterations,
+     *  including the caller. 0 picks the number of hardware threads.
+     */
+    explicit ThreadPool( size_t num_threads = 0 );
+    ~ThreadPool();
+
+    /**
+     * The total number of threads that run iterations, including the caller.
+     */
+    size_t num_threads() const;
+
+    /**
+     * Calls func( data, i ) for every i in [0, count).
+     */
+    void parallel_for( size_t count, TaskFunc func, void* data );
+
+private:
+
+    void worker_main();
+    void run_tasks();
+
+    std::vector< std::thread > workers;
+
+    std::mutex mutex;
+    // signals workers that a new loop started or that they should quit
+    std::condition_variable wake;
+    // signals the caller that all workers finished the loop
+    std::condition_variable done;
+    // incremented for every loop, so workers never run the same loop twice
+    size_t generation;
+    // workers still running the current loop
+    size_t busy;
+    bool quit;
+
+    TaskFunc func;
+    void* data;
+    size_t count;
+    std::atomic< size_t > next;
+
+    // no meaningful assignment or copy
+    ThreadPool( const ThreadPool& );
+    ThreadPool& operator=( const ThreadPool& );
+};
+
+} /* _462 */
+
+#endif /* _462_APPLICATION_THREADPOOL_HPP_ */
@@ -0,0 +1,82 @@
+/**
+ * @file triplebuffer.hpp
+ * @brief A lock-free triple buffer handing values from one thread to another.
+ */
+
+#ifndef _462_APPLICATION_TRIPLEBUFFER_HPP_
+#define _462_APPLICATION_TRIPLEBUFFER_HPP_
+
+#include <atomic>
+
+namespace _462 {
+
+/**
+ * Passes the newest of a stream of values from a single writer thread to a
+ * single reader thread without either ever waiting on the other. Of the
+ * three slots the writer owns one, the reader owns one, and the third holds
+ * the last published value. Publishing and fetching swap the owned slot
+ * with the middle one, so the writer may publish faster than the reader
+ * fetches; values the reader never fetched are overwritten.
+ *
+ * The slot the writer gets back from publish() holds an old value that it
+ * must overwrite completely before publishing it again.
+ */
+template< typename T >
+class TripleBuffer
+{
+public:
+
+    TripleBuffer() : write_index( 0 ), read_index( 1 ), middle( 2 ) { }
+
+    /**
+     * The slot the writer fills before calling publish(). Writer thread only.
+     */
+    T& write_buffer() { return slots[write_index]; }
+
+    /**
+     * Makes the contents of write_buffer() the newest value, and hands the
+     * writer another slot. Writer thread only.
+     */
+    void publish()
+    {
+        write_index = middle.exchange( write_index | FRESH, std::memory_order_acq_rel ) & INDEX_MASK;
+    }
+
+    /**
+     * Moves the newest published value, if the reader doesn't hold it yet,
+     * into read_buffer(). Returns whether it did. Reader thread only.
+     */
+    bool fetch()
+    {
+        if ( !( middle.load( std::memory_order_relaxed ) & FRESH ) ) {
+            return false;
+        }
+        read_index = middle.exchange( read_index, std::memory_order_acq_rel ) & INDEX_MASK;
+        return true;
+    }
+
+    /**
+     * The value of the last successful fetch(). Reader thread only.
+     */
+    const T& read_buffer() const { return slots[read_index]; }
+
+private:
+
+    // set in middle when it holds a value the reader hasn't fetched
+    static const unsigned int FRESH = 4;
+    static const unsigned int INDEX_MASK = 3;
+
+    T slots[3];
+    unsigned int write_index;
+    unsigned int read_index;
+    // index of the middle slot, and the FRESH bit
+    std::atomic< unsigned int > middle;
+
+    // no meaningful assignment or copy
+    TripleBuffer( const TripleBuffer& );
+    TripleBuffer& operator=( const TripleBuffer& );
+};
+
+} /* _462 */
+
+#endif /* _462_APPLICATION_TRIPLEBUFFER_HPP_ */
@@ -0,0 +1,53 @@
+/**
+ * @file frustum.cpp
+ * @brief The volume seen by a camera.
+ */
+
+#include "math/frustum.hpp"
+
+namespace _462 {
+
+Frustum::Frustum()
+{
+    // contains everything
+    for ( size_t i = 0; i < 6; ++i ) {
+        normals[i] = Vector3::Zero;
+        offsets[i] = 0.0;
+    }
+}
+
+Frustum::Frustum( const Camera& camera )
+{
+    const Vector3& eye = camera.get_position();
+    Vector3 forward = camera.get_direction();
+    Vector3 up = camera.get_up();
+    Vector3 right = normalize( cross( forward, up ) );
+    // the fov is vertical, like gluPerspective's
+    real_t tan_y = tan( camera.get_fov_radians() / 2 );
+    real_t tan_x = tan_y * camera.get_aspect_ratio();
+
+    // the side planes pass through the eye
+    normals[0] = normalize( forward * tan_x + right );
+    normals[1] = normalize( forward * tan_x - right );
+    normals[2] = normalize( forward * tan_y + up );
+    normals[3] = normalize( forward * tan_y - up );
+    for ( size_t i = 0; i < 4; ++i ) {
+        offsets[i] = dot( normals[i], eye );
+    }
+    normals[4] = forward;
+    offsets[4] = dot( forward, eye ) + camera.get_near_clip();
+    normals[5] = -forward;
+    offsets[5] = -dot( forward, eye ) - camera.get_far_clip();
+}
+
+bool Frustum::intersects_sphere( const Vector3& center, real_t radius ) const
+{
+    for ( size_t i = 0; i < 6; ++i ) {
+        if ( dot( normals[i], center ) - offsets[i] < -radius ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} /* _462 */
@@ -0,0 +1,39 @@
+/**
+ * @file frustum.hpp
+ * @brief The volume seen by a camera.
+ */
+
+#ifndef _462_MATH_FRUSTUM_HPP_
+#define _462_MATH_FRUSTUM_HPP_
+
+#include "math/camera.hpp"
+
+namespace _462 {
+
+/**
+ * The six planes bounding what a camera sees, in world space, with normals
+ * pointing inwards.
+ */
+class Frustum
+{
+public:
+
+    Frustum();
+    explicit Frustum( const Camera& camera );
+
+    /**
+     * Whether any part of the sphere might be visible. Conservative, some
+     * spheres just outside the corners pass.
+     */
+    bool intersects_sphere( const Vector3& center, real_t radius ) const;
+
+private:
+
+    // a point p is inside if dot( normals[i], p ) >= offsets[i] for all i
+    Vector3 normals[6];
+    real_t offsets[6];
+};
+
+} /* _462 */
+
+#endif /* _462_MATH_FRUSTUM_HPP_ */
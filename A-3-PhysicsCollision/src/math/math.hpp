@@ -12,10 +12,36 @@
 #include <algorithm>
 #include <cmath>
 
+/*
+Floating point precision is set by the real_t typedef below, double unless
+the build defines MATH_SINGLE_PRECISION. Single precision builds targeting
+SSE also get MATH_SSE, which computes Vector4, Matrix4 and Quaternion four
+floats at a time. Those classes are then 16 byte aligned, as heap blocks
+are on 64 bit targets; define MATH_NO_SSE to keep them scalar.
+*/
+#if defined( MATH_SINGLE_PRECISION ) && !defined( MATH_NO_SSE ) && \
+    ( defined( __SSE__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 1 ) )
+#define MATH_SSE
+#include <xmmintrin.h>
+#endif
+
+// aligns a class for loading it into sse registers
+#if !defined( MATH_SSE )
+#define MATH_ALIGN16
+#elif defined( _MSC_VER )
+#define MATH_ALIGN16 __declspec( align( 16 ) )
+#else
+#define MATH_ALIGN16 __attribute__(( aligned( 16 ) ))
+#endif
+
 namespace _462 {
 
 // floating point precision set by this typedef
+#ifdef MATH_SINGLE_PRECISION
+typedef float real_t;
+#else
 typedef double real_t;
+#endif
 
 class Color3;
 
@@ -32,4 +58,3 @@ inline T clamp( T val, T min, T max )
 } /* _462 */
 
 #endif /* _462_MATH_MATH_HPP_ */
-
@@ -80,29 +80,6 @@ Matrix3& Matrix3::operator-=( const Matrix3& rhs )
     return *this;
 }
 
-Matrix3 Matrix3::operator*( const Matrix3& rhs ) const
-{
-    Matrix3 product;
-    for ( int i = 0; i < DIM; ++i )
-        for ( int j = 0; j < DIM; ++j )
-            product._m[i][j] =
-                _m[0][j] * rhs._m[i][0] + _m[1][j] * rhs._m[i][1] +
-                _m[2][j] * rhs._m[i][2];
-    return product;
-}
-
-Vector3 Matrix3::operator*( const Vector3& v ) const
-{
-    return Vector3( _m[0][0]*v.x + _m[1][0]*v.y + _m[2][0]*v.z,
-                    _m[0][1]*v.x + _m[1][1]*v.y + _m[2][1]*v.z,
-                    _m[0][2]*v.x + _m[1][2]*v.y + _m[2][2]*v.z );
-}
-
-Matrix3& Matrix3::operator*=( const Matrix3& rhs )
-{
-    return *this = operator*( rhs );
-}
-
 Matrix3 Matrix3::operator*( real_t r ) const
 {
     Matrix3 rv;
@@ -256,30 +233,6 @@ Matrix4& Matrix4::operator-=( const Matrix4& rhs )
     return *this;
 }
 
-Matrix4 Matrix4::operator*( const Matrix4& rhs ) const
-{
-    Matrix4 product;
-    for ( int i = 0; i < DIM; ++i )
-        for ( int j = 0; j < DIM; ++j )
-            product._m[i][j] =
-                _m[0][j] * rhs._m[i][0] + _m[1][j] * rhs._m[i][1] +
-                _m[2][j] * rhs._m[i][2] + _m[3][j] * rhs._m[i][3];
-    return product;
-}
-
-Vector4 Matrix4::operator*( const Vector4& v ) const
-{
-    return Vector4( _m[0][0]*v.x + _m[1][0]*v.y + _m[2][0]*v.z + _m[3][0]*v.w,
-                    _m[0][1]*v.x + _m[1][1]*v.y + _m[2][1]*v.z + _m[3][1]*v.w,
-                    _m[0][2]*v.x + _m[1][2]*v.y + _m[2][2]*v.z + _m[3][2]*v.w,
-                    _m[0][3]*v.x + _m[1][3]*v.y + _m[2][3]*v.z + _m[3][3]*v.w );
-}
-
-Matrix4& Matrix4::operator*=( const Matrix4& rhs )
-{
-    return *this = operator*( rhs );
-}
-
 Matrix4 Matrix4::operator*( real_t r ) const
 {
     Matrix4 rv;
@@ -330,70 +283,55 @@ bool Matrix4::operator!=( const Matrix4& rhs ) const
     return !operator==( rhs );
 }
 
-static void make_translation_matrix( Matrix4* mat, const Vector3& pos )
-{
-    *mat = Matrix4(
-        1.0, 0.0, 0.0, pos.x,
-        0.0, 1.0, 0.0, pos.y,
-        0.0, 0.0, 1.0, pos.z,
-        0.0, 0.0, 0.0, 1.0 );
-}
-
-static void make_scaling_matrix( Matrix4* mat, const Vector3& scl )
-{
-    *mat = Matrix4(
-        scl.x, 0.0,   0.0,   0.0,
-        0.0,   scl.y, 0.0,   0.0,
-        0.0,   0.0,   scl.z, 0.0,
-        0.0,   0.0,   0.0,   1.0 );
-}
-
-
-void make_transformation_matrix(
-    Matrix4* mat, const Vector3& pos, const Quaternion& ori, const Vector3& scl )
-{
-    Matrix4 sclmat, orimat;
-
-    ori.to_matrix( &orimat );
-    make_scaling_matrix( &sclmat, scl );
-    *mat = orimat * sclmat;
-    // don't need to actually do the multiplication, can take shortcut
-    // since we're multiplying translation by a linear matrix
-    mat->m[12] = pos.x;
-    mat->m[13] = pos.y;
-    mat->m[14] = pos.z;
-}
-
-void make_inverse_transformation_matrix(
-    Matrix4* mat, const Vector3& pos, const Quaternion& ori, const Vector3& scl )
-{
-    // assumes orientation is normalized
-    Matrix4 sclmat, orimat, trnmat;
-
-    make_scaling_matrix( &sclmat, Vector3( 1.0 / scl.x, 1.0 / scl.y, 1.0 / scl.z ) );
-    conjugate( ori ).to_matrix( &orimat );
-    make_translation_matrix( &trnmat, -pos );
-
-    *mat = sclmat * orimat * trnmat;
-}
-
-/** algorithm from:  http://www.mathwords.com/c/cofactor.htm **/
-void make_normal_matrix( Matrix3* rv, const Matrix4& tmat )
-{
-    Matrix3 tmp1, tmp2;
-
-    tmp1._m[0][0] = tmat._m[0][0];
-    tmp1._m[0][1] = tmat._m[0][1];
-    tmp1._m[0][2] = tmat._m[0][2];
-    tmp1._m[1][0] = tmat._m[1][0];
-    tmp1._m[1][1] = tmat._m[1][1];
-    tmp1._m[1][2] = tmat._m[1][2];
-    tmp1._m[2][0] = tmat._m[2][0];
-    tmp1._m[2][1] = tmat._m[2][1];
-    tmp1._m[2][2] = tmat._m[2][2];
-
-    inverse( &tmp2, tmp1 );
-    transpose( rv, tmp2 );
+void transform_points( const Matrix4& mat, const Vector3* in, Vector3* out, size_t n )
+{
+    size_t i = 0;
+#ifdef MATH_SSE
+    // four points at a time: load their 12 floats into 3 registers, sort
+    // them into a register per coordinate, transform all four at once and
+    // interleave them again. Every element of the matrix stays in a
+    // register of its own.
+    __m128 m00 = _mm_set1_ps( mat._m[0][0] ), m01 = _mm_set1_ps( mat._m[0][1] ), m02 = _mm_set1_ps( mat._m[0][2] );
+    __m128 m10 = _mm_set1_ps( mat._m[1][0] ), m11 = _mm_set1_ps( mat._m[1][1] ), m12 = _mm_set1_ps( mat._m[1][2] );
+    __m128 m20 = _mm_set1_ps( mat._m[2][0] ), m21 = _mm_set1_ps( mat._m[2][1] ), m22 = _mm_set1_ps( mat._m[2][2] );
+    __m128 m30 = _mm_set1_ps( mat._m[3][0] ), m31 = _mm_set1_ps( mat._m[3][1] ), m32 = _mm_set1_ps( mat._m[3][2] );
+    for ( ; i + 4 <= n; i += 4 ) {
+        const float* src = &in[i].x;
+        __m128 a = _mm_loadu_ps( src );     // x0 y0 z0 x1
+        __m128 b = _mm_loadu_ps( src + 4 ); // y1 z1 x2 y2
+        __m128 c = _mm_loadu_ps( src + 8 ); // z2 x3 y3 z3
+
+        __m128 x = _mm_shuffle_ps( a, _mm_shuffle_ps( b, c, _MM_SHUFFLE( 1, 1, 2, 2 ) ), _MM_SHUFFLE( 2, 0, 3, 0 ) );
+        __m128 y = _mm_shuffle_ps( _mm_shuffle_ps( a, b, _MM_SHUFFLE( 0, 0, 1, 1 ) ),
+                                   _mm_shuffle_ps( b, c, _MM_SHUFFLE( 2, 2, 3, 3 ) ), _MM_SHUFFLE( 2, 0, 2, 0 ) );
+        __m128 z = _mm_shuffle_ps( _mm_shuffle_ps( a, b, _MM_SHUFFLE( 1, 1, 2, 2 ) ),
+                                   _mm_shuffle_ps( c, c, _MM_SHUFFLE( 3, 3, 0, 0 ) ), _MM_SHUFFLE( 2, 0, 2, 0 ) );
+
+        __m128 tx = _mm_add_ps( _mm_add_ps( _mm_mul_ps( m00, x ), _mm_mul_ps( m10, y ) ),
+                                _mm_add_ps( _mm_mul_ps( m20, z ), m30 ) );
+        __m128 ty = _mm_add_ps( _mm_add_ps( _mm_mul_ps( m01, x ), _mm_mul_ps( m11, y ) ),
+                                _mm_add_ps( _mm_mul_ps( m21, z ), m31 ) );
+        __m128 tz = _mm_add_ps( _mm_add_ps( _mm_mul_ps( m02, x ), _mm_mul_ps( m12, y ) ),
+                                _mm_add_ps( _mm_mul_ps( m22, z ), m32 ) );
+
+        float* dst = &out[i].x;
+        _mm_storeu_ps( dst, _mm_shuffle_ps( _mm_shuffle_ps( tx, ty, _MM_SHUFFLE( 0, 0, 0, 0 ) ),
+                                            _mm_shuffle_ps( tz, tx, _MM_SHUFFLE( 1, 1, 0, 0 ) ),
+                                            _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+        _mm_storeu_ps( dst + 4, _mm_shuffle_ps( _mm_shuffle_ps( ty, tz, _MM_SHUFFLE( 1, 1, 1, 1 ) ),
+                                                _mm_shuffle_ps( tx, ty, _MM_SHUFFLE( 2, 2, 2, 2 ) ),
+                                                _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+        _mm_storeu_ps( dst + 8, _mm_shuffle_ps( _mm_shuffle_ps( tz, tx, _MM_SHUFFLE( 3, 3, 2, 2 ) ),
+                                                _mm_shuffle_ps( ty, tz, _MM_SHUFFLE( 3, 3, 3, 3 ) ),
+                                                _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+    }
+#endif
+    for ( ; i < n; ++i ) {
+        Vector3 p = in[i];
+        out[i] = Vector3( mat._m[0][0] * p.x + mat._m[1][0] * p.y + mat._m[2][0] * p.z + mat._m[3][0],
+                          mat._m[0][1] * p.x + mat._m[1][1] * p.y + mat._m[2][1] * p.z + mat._m[3][1],
+                          mat._m[0][2] * p.x + mat._m[1][2] * p.y + mat._m[2][2] * p.z + mat._m[3][2] );
+    }
 }
 
 std::ostream& operator<<( std::ostream& os, const Matrix3& mat ) 
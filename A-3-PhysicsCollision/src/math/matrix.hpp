@@ -11,17 +11,18 @@
 
 #include "math/math.hpp"
 #include "math/vector.hpp"
+#include "math/quaternion.hpp"
 #include <cassert>
 
 namespace _462 {
 
 /*
 This file defines 2 matrix classes: 3x3 and 4x4.
-Each comes with several operators and functions.
+Each comes with several operators and functions. Products with matrices and
+vectors and building transformations are inline, as rendering and physics
+do them per object and per ray.
 */
 
-class Quaternion;
-
 /**
  * A 3x3 matrix.
  *
@@ -136,6 +137,26 @@ inline Matrix3 operator*( real_t r, const Matrix3& m ) {
     return m * r;
 }
 
+inline Matrix3 Matrix3::operator*( const Matrix3& rhs ) const {
+    Matrix3 product;
+    for ( int i = 0; i < DIM; ++i )
+        for ( int j = 0; j < DIM; ++j )
+            product._m[i][j] =
+                _m[0][j] * rhs._m[i][0] + _m[1][j] * rhs._m[i][1] +
+                _m[2][j] * rhs._m[i][2];
+    return product;
+}
+
+inline Vector3 Matrix3::operator*( const Vector3& v ) const {
+    return Vector3( _m[0][0]*v.x + _m[1][0]*v.y + _m[2][0]*v.z,
+                    _m[0][1]*v.x + _m[1][1]*v.y + _m[2][1]*v.z,
+                    _m[0][2]*v.x + _m[1][2]*v.y + _m[2][2]*v.z );
+}
+
+inline Matrix3& Matrix3::operator*=( const Matrix3& rhs ) {
+    return *this = operator*( rhs );
+}
+
 /**
  * A 4x4 matrix.
  *
@@ -155,8 +176,10 @@ inline Matrix3 operator*( real_t r, const Matrix3& m ) {
  * The matrix is meant for use in transformations. Transformations must
  * be combined right-to-left, so if you want to apply A then B the C to a
  * vector V, you would use C*B*A*V.
+ *
+ * With MATH_SSE, products work on a column at a time.
  */
-class Matrix4
+class MATH_ALIGN16 Matrix4
 {
 public:
     /**
@@ -236,6 +259,15 @@ public:
         return _m[col][row];
     }
 
+#ifdef MATH_SSE
+    /**
+     * Column i as an sse register, row 0 in the lowest lane.
+     */
+    __m128 column( int i ) const {
+        return _mm_load_ps( m + DIM * i );
+    }
+#endif
+
     /**
      * Transforms the given vector as if it were a point.
      * That is, returns the projection of (x,y,z,1) transformed
@@ -259,19 +291,100 @@ inline Matrix4 operator*( real_t r, const Matrix4& m ) {
     return m * r;
 }
 
+#ifdef MATH_SSE
+// the columns of m weighted by the components of v and summed
+inline __m128 combine_columns( const Matrix4& m, real_t x, real_t y, real_t z, real_t w ) {
+    __m128 r = _mm_mul_ps( m.column( 0 ), _mm_set1_ps( x ) );
+    r = _mm_add_ps( r, _mm_mul_ps( m.column( 1 ), _mm_set1_ps( y ) ) );
+    r = _mm_add_ps( r, _mm_mul_ps( m.column( 2 ), _mm_set1_ps( z ) ) );
+    return _mm_add_ps( r, _mm_mul_ps( m.column( 3 ), _mm_set1_ps( w ) ) );
+}
+#endif
+
+inline Matrix4 Matrix4::operator*( const Matrix4& rhs ) const {
+    Matrix4 product;
+#ifdef MATH_SSE
+    // every column of the product is this matrix times that column of rhs
+    for ( int i = 0; i < DIM; ++i )
+        _mm_store_ps( product._m[i], combine_columns( *this, rhs._m[i][0], rhs._m[i][1],
+                                                      rhs._m[i][2], rhs._m[i][3] ) );
+#else
+    for ( int i = 0; i < DIM; ++i )
+        for ( int j = 0; j < DIM; ++j )
+            product._m[i][j] =
+                _m[0][j] * rhs._m[i][0] + _m[1][j] * rhs._m[i][1] +
+                _m[2][j] * rhs._m[i][2] + _m[3][j] * rhs._m[i][3];
+#endif
+    return product;
+}
+
+inline Vector4 Matrix4::operator*( const Vector4& v ) const {
+#ifdef MATH_SSE
+    return Vector4( combine_columns( *this, v.x, v.y, v.z, v.w ) );
+#else
+    return Vector4( _m[0][0]*v.x + _m[1][0]*v.y + _m[2][0]*v.z + _m[3][0]*v.w,
+                    _m[0][1]*v.x + _m[1][1]*v.y + _m[2][1]*v.z + _m[3][1]*v.w,
+                    _m[0][2]*v.x + _m[1][2]*v.y + _m[2][2]*v.z + _m[3][2]*v.w,
+                    _m[0][3]*v.x + _m[1][3]*v.y + _m[2][3]*v.z + _m[3][3]*v.w );
+#endif
+}
+
+inline Matrix4& Matrix4::operator*=( const Matrix4& rhs ) {
+    return *this = operator*( rhs );
+}
+
+/**
+ * Transforms n points by a matrix whose last row is (0 0 0 1), such as
+ * those of make_transformation_matrix. Gives the same as transform_point on
+ * each of them, without the projection. in and out may be the same array.
+ */
+void transform_points( const Matrix4& mat, const Vector3* in, Vector3* out, size_t n );
+
 /**
  * Creates a transformation matrix that will transform a point
  * by the given scale, then orientation, then position.
  */
-void make_transformation_matrix(
-    Matrix4* rv, const Vector3& pos, const Quaternion& ori, const Vector3& scl );
+inline void make_transformation_matrix(
+    Matrix4* rv, const Vector3& pos, const Quaternion& ori, const Vector3& scl ) {
+    // the rotated axes scaled are the columns, no need to multiply out
+    // the rotation and scaling matrices
+    Vector3 axes[3];
+    ori.to_axes( axes );
+    for ( int i = 0; i < 3; ++i ) {
+        Vector3 axis = axes[i] * scl[i];
+        rv->_m[i][0] = axis.x;
+        rv->_m[i][1] = axis.y;
+        rv->_m[i][2] = axis.z;
+        rv->_m[i][3] = 0;
+    }
+    rv->_m[3][0] = pos.x;
+    rv->_m[3][1] = pos.y;
+    rv->_m[3][2] = pos.z;
+    rv->_m[3][3] = 1;
+}
 
 /**
  * Create a transformation matrix that is the inverse of that
  * generated by make_transformation_matrix.
  */
-void make_inverse_transformation_matrix(
-    Matrix4* rv, const Vector3& pos, const Quaternion& ori, const Vector3& scl );
+inline void make_inverse_transformation_matrix(
+    Matrix4* rv, const Vector3& pos, const Quaternion& ori, const Vector3& scl ) {
+    // assumes orientation is normalized, so the rows are the rotated axes
+    // divided by the scale, and the last column takes pos to the origin
+    Vector3 axes[3];
+    ori.to_axes( axes );
+    for ( int i = 0; i < 3; ++i ) {
+        Vector3 row = axes[i] * real_t( 1.0 / scl[i] );
+        rv->_m[0][i] = row.x;
+        rv->_m[1][i] = row.y;
+        rv->_m[2][i] = row.z;
+        rv->_m[3][i] = -dot( row, pos );
+    }
+    rv->_m[0][3] = 0;
+    rv->_m[1][3] = 0;
+    rv->_m[2][3] = 0;
+    rv->_m[3][3] = 1;
+}
 
 /**
  * Create a normal transformation matrix that corresponds with the given
@@ -281,7 +394,17 @@ void make_inverse_transformation_matrix(
  *   produce non-unit vectors. You MUST NORMALIZE the resulting vectors
  *   after multiplying them by the normal matrix.
  */
-void make_normal_matrix( Matrix3* rv, const Matrix4& tmat );
+inline void make_normal_matrix( Matrix3* rv, const Matrix4& tmat ) {
+    // the inverse transpose of the linear part is its cofactor matrix over
+    // its determinant, and the cofactor columns are cross products of the
+    // columns
+    Vector3 a( tmat._m[0][0], tmat._m[0][1], tmat._m[0][2] );
+    Vector3 b( tmat._m[1][0], tmat._m[1][1], tmat._m[1][2] );
+    Vector3 c( tmat._m[2][0], tmat._m[2][1], tmat._m[2][2] );
+    Vector3 bc = cross( b, c );
+    real_t invdet = real_t( 1.0 / dot( a, bc ) );
+    *rv = Matrix3( bc * invdet, cross( c, a ) * invdet, cross( a, b ) * invdet );
+}
 
 std::ostream& operator<<( std::ostream& os, const Matrix3& mat );
 
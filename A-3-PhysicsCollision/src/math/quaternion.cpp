@@ -114,28 +114,6 @@ Quaternion::Quaternion( const Matrix4& mat )
     }
 }
 
-Quaternion Quaternion::operator*( const Quaternion& rhs ) const
-{
-    return Quaternion(
-       w * rhs.w - x * rhs.x - y * rhs.y - z * rhs.z,
-       w * rhs.x + x * rhs.w + y * rhs.z - z * rhs.y,
-       w * rhs.y + y * rhs.w + z * rhs.x - x * rhs.z,
-       w * rhs.z + z * rhs.w + x * rhs.y - y * rhs.x
-    );
-}
-
-Vector3 Quaternion::operator*( const Vector3& v ) const
-{
-    // nVidia SDK implementation
-    Vector3 qvec( x, y, z );
-    Vector3 uv = cross( qvec, v );
-    Vector3 uuv = cross( qvec, uv );
-    uv *= ( 2.0 * w );
-    uuv *= 2.0;
-
-    return v + uv + uuv;
-}
-
 void Quaternion::to_axis_angle( Vector3* axis, real_t* angle ) const
 {
     // The quaternion representing the rotation is
@@ -154,60 +132,30 @@ void Quaternion::to_axis_angle( Vector3* axis, real_t* angle ) const
     }
 }
 
-static void rotate_axes( const Quaternion& quat,
-                         real_t ax[3], real_t ay[3], real_t az[3] )
+void Quaternion::to_matrix( Matrix3* mat ) const
 {
-    real_t x2  = 2.0 * quat.x;
-    real_t y2  = 2.0 * quat.y;
-    real_t z2  = 2.0 * quat.z;
-    real_t xw2 = x2 * quat.w;
-    real_t yw2 = y2 * quat.w;
-    real_t zw2 = z2 * quat.w;
-    real_t xx2 = x2 * quat.x;
-    real_t xy2 = y2 * quat.x;
-    real_t xz2 = z2 * quat.x;
-    real_t yy2 = y2 * quat.y;
-    real_t yz2 = z2 * quat.y;
-    real_t zz2 = z2 * quat.z;
-
-    ax[0] = 1.0 - ( yy2 + zz2 );
-    ax[1] = xy2 + zw2;
-    ax[2] = xz2 - yw2;
-
-    ay[0] = xy2 - zw2;
-    ay[1] = 1.0 - ( xx2 + zz2 );
-    ay[2] = yz2 + xw2;
-
-    az[0] = xz2 + yw2;
-    az[1] = yz2 - xw2;
-    az[2] = 1.0 - ( xx2 + yy2 );
-}
-
-void Quaternion::to_matrix( Matrix3* matp ) const
-{
-    Matrix3& mat = *matp;
-    rotate_axes( *this, &mat( 0, 0 ), &mat( 1, 0 ), &mat( 2, 0 ) );
+    Vector3 axes[3];
+    to_axes( axes );
+    *mat = Matrix3( axes[0], axes[1], axes[2] );
 }
 
 void Quaternion::to_matrix( Matrix4* matp ) const
 {
     Matrix4& mat = *matp;
-    rotate_axes( *this, &mat( 0, 0 ), &mat( 1, 0 ), &mat( 2, 0 ) );
-
-    mat( 0, 3 ) = 0;
-    mat( 1, 3 ) = 0;
-    mat( 2, 3 ) = 0;
+    Vector3 axes[3];
+    to_axes( axes );
+    for ( int i = 0; i < 3; ++i ) {
+        mat( i, 0 ) = axes[i].x;
+        mat( i, 1 ) = axes[i].y;
+        mat( i, 2 ) = axes[i].z;
+        mat( i, 3 ) = 0;
+    }
     mat( 3, 0 ) = 0;
     mat( 3, 1 ) = 0;
     mat( 3, 2 ) = 0;
     mat( 3, 3 ) = 1;
 }
 
-void Quaternion::to_axes( Vector3 axes[3] ) const
-{
-    rotate_axes( *this, &axes[0][0], &axes[1][0], &axes[2][0] );
-}
-
 Quaternion normalize( const Quaternion& q )
 {
     Quaternion rv( q );
@@ -215,9 +163,33 @@ Quaternion normalize( const Quaternion& q )
     return rv;
 }
 
-Quaternion conjugate( const Quaternion& q )
+Quaternion slerp( const Quaternion& lhs, const Quaternion& rhs, real_t t )
 {
-    return Quaternion( q.w, -q.x, -q.y, -q.z );
+    real_t cosine = lhs.w * rhs.w + lhs.x * rhs.x + lhs.y * rhs.y + lhs.z * rhs.z;
+    Quaternion end( rhs );
+
+    // q and -q are the same rotation, take the shorter way
+    if ( cosine < 0.0 ) {
+        cosine = -cosine;
+        end = -1.0 * rhs;
+    }
+
+    real_t a, b;
+    if ( cosine > 0.9995 ) {
+        // nearly parallel, linear interpolation is accurate and stable
+        a = 1.0 - t;
+        b = t;
+    } else {
+        real_t angle = acos( cosine );
+        real_t sine = sin( angle );
+        a = sin( ( 1.0 - t ) * angle ) / sine;
+        b = sin( t * angle ) / sine;
+    }
+
+    return normalize( Quaternion( a * lhs.w + b * end.w,
+                                  a * lhs.x + b * end.x,
+                                  a * lhs.y + b * end.y,
+                                  a * lhs.z + b * end.z ) );
 }
 
 std::ostream& operator <<( std::ostream& o, const Quaternion& q )
@@ -36,8 +36,10 @@ class Matrix4;
  * For example, an axis of (1,0,0) and an angle of PI/2 represents the rotation
  * that leaves the x-axis the same, takes the y-axis to the z-axis, and takes
  * the z-axis to the negative y-axis.
+ *
+ * With MATH_SSE, products and scaling work on all four components at once.
  */
-class Quaternion
+class MATH_ALIGN16 Quaternion
 {
 public:
 
@@ -64,6 +66,22 @@ public:
     Quaternion( real_t w, real_t x, real_t y, real_t z )
         : w( w ), x( x ), y( y ), z( z ) { }
 
+#ifdef MATH_SSE
+    /**
+     * Construct a quaternion from the lanes of an sse register, w first.
+     */
+    explicit Quaternion( __m128 v ) {
+        _mm_store_ps( &w, v );
+    }
+
+    /**
+     * The components as an sse register, w in the lowest lane.
+     */
+    __m128 simd() const {
+        return _mm_load_ps( &w );
+    }
+#endif
+
     /**
      * Constructs a quaternion representing a rotation about the given axis
      * by the given angle.
@@ -80,23 +98,55 @@ public:
      */
     explicit Quaternion( const Matrix4& mat );
 
-    Quaternion operator*( const Quaternion& rhs ) const;
+    Quaternion operator*( const Quaternion& rhs ) const {
+#ifdef MATH_SSE
+        // the w * rhs terms, then the rest of every component in three
+        // products of shuffled lanes, negated where w subtracts them
+        __m128 a = simd();
+        __m128 b = rhs.simd();
+        __m128 sign_w = _mm_set_ps( 0.0f, 0.0f, 0.0f, -0.0f );
+        __m128 p = _mm_mul_ps( _mm_shuffle_ps( a, a, _MM_SHUFFLE( 0, 0, 0, 0 ) ), b );
+        __m128 q = _mm_mul_ps( _mm_shuffle_ps( a, a, _MM_SHUFFLE( 3, 2, 1, 1 ) ),
+                               _mm_shuffle_ps( b, b, _MM_SHUFFLE( 0, 0, 0, 1 ) ) );
+        q = _mm_add_ps( q, _mm_mul_ps( _mm_shuffle_ps( a, a, _MM_SHUFFLE( 1, 3, 2, 2 ) ),
+                                       _mm_shuffle_ps( b, b, _MM_SHUFFLE( 2, 1, 3, 2 ) ) ) );
+        __m128 r = _mm_mul_ps( _mm_shuffle_ps( a, a, _MM_SHUFFLE( 2, 1, 3, 3 ) ),
+                               _mm_shuffle_ps( b, b, _MM_SHUFFLE( 1, 3, 2, 3 ) ) );
+        return Quaternion( _mm_sub_ps( _mm_add_ps( p, _mm_xor_ps( q, sign_w ) ), r ) );
+#else
+        return Quaternion(
+           w * rhs.w - x * rhs.x - y * rhs.y - z * rhs.z,
+           w * rhs.x + x * rhs.w + y * rhs.z - z * rhs.y,
+           w * rhs.y + y * rhs.w + z * rhs.x - x * rhs.z,
+           w * rhs.z + z * rhs.w + x * rhs.y - y * rhs.x
+        );
+#endif
+    }
 
     /**
      * Rotate a vector by this quaternion.
      */
-    Vector3 operator*( const Vector3& rhs ) const;
+    Vector3 operator*( const Vector3& v ) const {
+        // nVidia SDK implementation
+        Vector3 qvec( x, y, z );
+        Vector3 uv = cross( qvec, v );
+        Vector3 uuv = cross( qvec, uv );
+        uv *= ( 2 * w );
+        uuv *= 2;
+
+        return v + uv + uuv;
+    }
 
     Quaternion operator*( real_t s ) const {
+#ifdef MATH_SSE
+        return Quaternion( _mm_mul_ps( simd(), _mm_set1_ps( s ) ) );
+#else
         return Quaternion( w * s, x * s, y * s, z * s );
+#endif
     }
 
     Quaternion& operator*=( real_t s ) {
-        w *= s;
-        x *= s;
-        y *= s;
-        z *= s;
-        return *this;
+        return *this = *this * s;
     }
 
     bool operator==( const Quaternion& rhs ) const {
@@ -127,7 +177,24 @@ public:
     /**
      * Returns the X,Y,Z axes rotated by this quaternion.
      */
-    void to_axes( Vector3 axes[3] ) const;
+    void to_axes( Vector3 axes[3] ) const {
+        real_t x2  = 2 * x;
+        real_t y2  = 2 * y;
+        real_t z2  = 2 * z;
+        real_t xw2 = x2 * w;
+        real_t yw2 = y2 * w;
+        real_t zw2 = z2 * w;
+        real_t xx2 = x2 * x;
+        real_t xy2 = y2 * x;
+        real_t xz2 = z2 * x;
+        real_t yy2 = y2 * y;
+        real_t yz2 = z2 * y;
+        real_t zz2 = z2 * z;
+
+        axes[0] = Vector3( 1 - ( yy2 + zz2 ), xy2 + zw2, xz2 - yw2 );
+        axes[1] = Vector3( xy2 - zw2, 1 - ( xx2 + zz2 ), yz2 + xw2 );
+        axes[2] = Vector3( xz2 + yw2, yz2 - xw2, 1 - ( xx2 + yy2 ) );
+    }
 };
 
 inline real_t norm( const Quaternion& q ) {
@@ -140,7 +207,15 @@ inline Quaternion operator*( real_t s, const Quaternion& rhs ) {
 
 Quaternion normalize( const Quaternion& q );
 
-Quaternion conjugate( const Quaternion& q );
+inline Quaternion conjugate( const Quaternion& q ) {
+    return Quaternion( q.w, -q.x, -q.y, -q.z );
+}
+
+/**
+ * Spherical linear interpolation between two unit quaternions, along the
+ * shorter arc. Returns lhs for t = 0 and rhs for t = 1.
+ */
+Quaternion slerp( const Quaternion& lhs, const Quaternion& rhs, real_t t );
 
 std::ostream& operator <<( std::ostream& o, const Quaternion& q );
 
@@ -481,9 +481,10 @@ inline Vector3 operator*( real_t s, const Vector3& rhs ) {
 std::ostream& operator<<( std::ostream& os, const Vector3& rhs );
 
 /**
- * A 4d vector.
+ * A 4d vector. With MATH_SSE, its arithmetic works on all four components
+ * at once.
  */
-class Vector4
+class MATH_ALIGN16 Vector4
 {
 public:
 
@@ -544,60 +545,74 @@ public:
     Vector4( const Vector3& v, real_t w )
         : x( v.x ), y( v.y ), z( v.z ), w( w ) {}
 
+#ifdef MATH_SSE
+    /**
+     * Create a vector from the lanes of an sse register, x first.
+     */
+    explicit Vector4( __m128 v ) {
+        _mm_store_ps( &x, v );
+    }
+
+    /**
+     * The components as an sse register, x in the lowest lane.
+     */
+    __m128 simd() const {
+        return _mm_load_ps( &x );
+    }
+#endif
+
     // also uses default copy and assignment
 
     Vector4 operator+( const Vector4& rhs ) const {
+#ifdef MATH_SSE
+        return Vector4( _mm_add_ps( simd(), rhs.simd() ) );
+#else
         return Vector4( x + rhs.x, y + rhs.y, z + rhs.z, w + rhs.w );
+#endif
     }
 
     Vector4& operator+=( const Vector4& rhs ) {
-        x += rhs.x;
-        y += rhs.y;
-        z += rhs.z;
-        w += rhs.w;
-        return *this;
+        return *this = *this + rhs;
     }
 
     Vector4 operator-( const Vector4& rhs ) const {
+#ifdef MATH_SSE
+        return Vector4( _mm_sub_ps( simd(), rhs.simd() ) );
+#else
         return Vector4( x - rhs.x, y - rhs.y, z - rhs.z, w - rhs.w );
+#endif
     }
 
     Vector4& operator-=( const Vector4& rhs ) {
-        x -= rhs.x;
-        y -= rhs.y;
-        z -= rhs.z;
-        w -= rhs.w;
-        return *this;
+        return *this = *this - rhs;
     }
 
     Vector4 operator*( real_t s ) const {
+#ifdef MATH_SSE
+        return Vector4( _mm_mul_ps( simd(), _mm_set1_ps( s ) ) );
+#else
         return Vector4( x * s, y * s, z * s, w * s );
+#endif
     }
 
     Vector4& operator*=( real_t s ) {
-        x *= s;
-        y *= s;
-        z *= s;
-        w *= s;
-        return *this;
+        return *this = *this * s;
     }
 
     Vector4 operator/( real_t s ) const {
-        real_t inv = 1.0 / s;
-        return Vector4( x * inv, y * inv, z * inv, w * inv );
+        return *this * real_t( 1.0 / s );
     }
 
     Vector4& operator/=( real_t s ) {
-        real_t inv = 1.0 / s;
-        x *= inv;
-        y *= inv;
-        z *= inv;
-        w *= inv;
-        return *this;
+        return *this = *this / s;
     }
 
     Vector4 operator-() const {
+#ifdef MATH_SSE
+        return Vector4( _mm_sub_ps( _mm_setzero_ps(), simd() ) );
+#else
         return Vector4( -x, -y, -z, -w );
+#endif
     }
 
     /**
@@ -654,14 +669,22 @@ inline Vector3 project( const Vector4& v ) {
  * Returns the dot product of two vectors
  */
 inline real_t dot( const Vector4& lhs, const Vector4& rhs ) {
+#ifdef MATH_SSE
+    // add the lanes pairwise, then the two sums
+    __m128 p = _mm_mul_ps( lhs.simd(), rhs.simd() );
+    p = _mm_add_ps( p, _mm_movehl_ps( p, p ) );
+    p = _mm_add_ss( p, _mm_shuffle_ps( p, p, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+    return _mm_cvtss_f32( p );
+#else
     return lhs.x * rhs.x + lhs.y * rhs.y + lhs.z * rhs.z + lhs.w * rhs.w;
+#endif
 }
 
 /**
  * Efficiency function: does not require square root operation.
  */
 inline real_t squared_length( const Vector4& v ) {
-    return v.x * v.x + v.y * v.y + v.z * v.z + v.w * v.w;
+    return dot( v, v );
 }
 
 /**
@@ -704,24 +727,32 @@ inline Vector4 vabs( const Vector4& v ) {
  * Returns the element-wise maximum of the two vectors.
  */
 inline Vector4 vmax( const Vector4& lhs, const Vector4& rhs ) {
+#ifdef MATH_SSE
+    return Vector4( _mm_max_ps( lhs.simd(), rhs.simd() ) );
+#else
     return Vector4(
         std::max( lhs.x, rhs.x ),
         std::max( lhs.y, rhs.y ),
         std::max( lhs.z, rhs.z ),
         std::max( lhs.w, rhs.w )
     );
+#endif
 }
 
 /**
  * Returns the element-wise minimum of the two vectors.
  */
 inline Vector4 vmin( const Vector4& lhs, const Vector4& rhs ) {
+#ifdef MATH_SSE
+    return Vector4( _mm_min_ps( lhs.simd(), rhs.simd() ) );
+#else
     return Vector4(
         std::min( lhs.x, rhs.x ),
         std::min( lhs.y, rhs.y ),
         std::min( lhs.z, rhs.z ),
         std::min( lhs.w, rhs.w )
     );
+#endif
 }
 
 inline Vector4 operator*( real_t s, const Vector4& rhs ) {
@@ -0,0 +1,698 @@
+/**
+ * @file benchmark.cpp
+ * @brief Benchmarks and runs of the simulator without a window.
+ */
+
+#include "physics/benchmark.hpp"
+#include "physics/physics.hpp"
+#include "physics/trace.hpp"
+#include "physics/collisions.hpp"
+#include "physics/gjk.hpp"
+#include "application/scene_loader.hpp"
+#include "application/assetloader.hpp"
+#include "application/imageio.hpp"
+#include "scene/scene.hpp"
+#include "scene/sphere.hpp"
+#include "scene/raytracer.hpp"
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+
+namespace _462 {
+
+#define BUFFER_SIZE(w,h) ( (size_t) ( 4 * (w) * (h) ) )
+
+// total sphere steps taken by the benchmark per sphere count and integrator
+#define BENCHMARK_SPHERE_STEPS 10000000
+// shape pair queries of every kind run by the collision benchmark
+#define BENCHMARK_PAIR_QUERIES 1000000
+// objects and points transformed by the math benchmark per pass, and passes
+#define BENCHMARK_MATH_OBJECTS 4096
+#define BENCHMARK_MATH_POINTS 65536
+#define BENCHMARK_MATH_PASSES 256
+// step size of the sleep check, and steps it lets the spheres settle for
+#define SLEEP_CHECK_TIME_STEP ( 1.0 / 64.0 )
+#define SLEEP_CHECK_SETTLE_STEPS 256
+// number of headless steps between two progress reports
+#define HEADLESS_PRINT_STEPS 1200
+
+static const size_t BenchmarkCounts[] = { 10000, 100000, 1000000 };
+static const size_t NUM_BENCHMARK_COUNTS = 3;
+
+static const IntegratorType BenchmarkIntegrators[] = {
+    INTEGRATOR_SYMPLECTIC_EULER, INTEGRATOR_VERLET, INTEGRATOR_RK4
+};
+static const char* BenchmarkIntegratorNames[] = {
+    "symplectic_euler", "verlet", "rk4"
+};
+static const size_t NUM_BENCHMARK_INTEGRATORS = 3;
+
+/**
+ * Measures how many spheres per millisecond Physics::integrate advances,
+ * for each integrator and a range of sphere counts. Collision detection is
+ * not included.
+ */
+int run_integration_benchmark()
+{
+    printf( "integration benchmark, %s kernels\n", soa_kernel_name() );
+
+    for ( size_t c = 0; c < NUM_BENCHMARK_COUNTS; ++c ) {
+        size_t count = BenchmarkCounts[c];
+        size_t steps = std::max( size_t( 4 ), size_t( BENCHMARK_SPHERE_STEPS / count ) );
+
+        try {
+            std::vector< Sphere > geoms( count );
+            Physics phys;
+            phys.gravity = Vector3( 0.0, -9.8, 0.0 );
+
+            // a cube of spheres, all moving apart
+            size_t side = size_t( ceil( pow( double( count ), 1.0 / 3.0 ) ) );
+            for ( size_t i = 0; i < count; ++i ) {
+                Sphere& geom = geoms[i];
+                geom.position = Vector3( real_t( i % side ), real_t( i / side % side ), real_t( i / side / side ) ) * 2.0;
+                geom.orientation = Quaternion::Identity;
+                geom.radius = 0.5;
+                SphereBody* body = new SphereBody( &geom );
+                body->mass = 1.0;
+                body->velocity = geom.position * 0.01;
+                phys.add_sphere( body );
+            }
+
+            printf( "%8u spheres:", unsigned( count ) );
+            for ( size_t k = 0; k < NUM_BENCHMARK_INTEGRATORS; ++k ) {
+                phys.set_integrator( BenchmarkIntegrators[k] );
+                // first call packs the bodies into the store
+                phys.integrate( 0.001 );
+
+                clock_t start = clock();
+                for ( size_t i = 0; i < steps; ++i ) {
+                    phys.integrate( 0.001 );
+                }
+                double ms = std::max( 1.0, 1000.0 * double( clock() - start ) / CLOCKS_PER_SEC );
+                printf( " %s %.0f bodies/ms", BenchmarkIntegratorNames[k], double( count ) * steps / ms );
+                fflush( stdout );
+            }
+            printf( "\n" );
+        } catch ( std::bad_alloc const& ) {
+            printf( "%8u spheres: out of memory\n", unsigned( count ) );
+        }
+    }
+
+    return 0;
+}
+
+// times a benchmark loop, in seconds of cpu time
+static double seconds_since( clock_t start )
+{
+    return std::max( 1e-3, double( clock() - start ) / CLOCKS_PER_SEC );
+}
+
+/**
+ * Measures how many shape pair queries per second GJK answers, against
+ * approximating the box by spheres as scenes had to before convex bodies:
+ * a sphere against a box, then a box against a box. The moving shape
+ * follows a smooth path around and through the fixed box, so the simplex
+ * cache of the pair works as it does in a simulation. GJK also runs with
+ * the cache cleared before every query for comparison.
+ */
+int run_collision_benchmark()
+{
+    // a 2 x 1 x 1 box, and a grid of 16 spheres filling it
+    ConvexShape box;
+    box.type = CONVEX_BOX;
+    box.half_extents = Vector3( 1.0, 0.5, 0.5 );
+    const real_t part_radius = 0.25;
+    std::vector< Vector3 > parts;
+    for ( int x = 0; x < 4; ++x ) {
+        for ( int y = 0; y < 2; ++y ) {
+            for ( int z = 0; z < 2; ++z ) {
+                parts.push_back( Vector3( -0.75 + 0.5 * x, -0.25 + 0.5 * y, -0.25 + 0.5 * z ) );
+            }
+        }
+    }
+    size_t num_parts = parts.size();
+
+    size_t n = BENCHMARK_PAIR_QUERIES;
+    std::vector< Vector3 > path( n );
+    std::vector< Quaternion > turn( n );
+    Vector3 spin_axis = normalize( Vector3( 1.0, 2.0, 3.0 ) );
+    for ( size_t i = 0; i < n; ++i ) {
+        real_t t = real_t( i ) * 1e-3;
+        path[i] = Vector3( 1.8 * cos( t ), 0.8 * sin( 3.1 * t ), 0.8 * sin( 1.3 * t ) );
+        turn[i] = Quaternion( spin_axis, 0.7 * t );
+    }
+
+    printf( "collision benchmark, %u queries per pair and method\n", unsigned( n ) );
+    Vector3 normal;
+    real_t depth;
+    int iterations;
+
+    // sphere against box
+    {
+        const real_t radius = 0.5;
+        size_t hits[3] = { 0, 0, 0 };
+        size_t total_iterations[2] = { 0, 0 };
+        double seconds[3];
+
+        ConvexCache cache;
+        clock_t start = clock();
+        for ( size_t i = 0; i < n; ++i ) {
+            hits[0] += convex_contact( convex_sphere( path[i], radius ), box, &cache, &normal, &depth, &iterations );
+            total_iterations[0] += iterations;
+        }
+        seconds[0] = seconds_since( start );
+
+        start = clock();
+        for ( size_t i = 0; i < n; ++i ) {
+            ConvexCache cold;
+            hits[1] += convex_contact( convex_sphere( path[i], radius ), box, &cold, &normal, &depth, &iterations );
+            total_iterations[1] += iterations;
+        }
+        seconds[1] = seconds_since( start );
+
+        start = clock();
+        for ( size_t i = 0; i < n; ++i ) {
+            bool hit = false;
+            for ( size_t k = 0; k < num_parts; ++k ) {
+                hit |= sphere_sphere_contact( path[i], radius, parts[k], part_radius, &normal, &depth );
+            }
+            hits[2] += hit;
+        }
+        seconds[2] = seconds_since( start );
+
+        printf( "sphere-box: GJK cached %.0f queries/s (%.2f iterations), GJK cold %.0f queries/s (%.2f iterations)\n",
+            n / seconds[0], double( total_iterations[0] ) / n, n / seconds[1], double( total_iterations[1] ) / n );
+        printf( "            %u spheres %.0f queries/s (%.0f sphere pairs/s); touching in %u, %u and %u queries\n",
+            unsigned( num_parts ), n / seconds[2], n * num_parts / seconds[2],
+            unsigned( hits[0] ), unsigned( hits[1] ), unsigned( hits[2] ) );
+    }
+
+    // box against box, the moving one turning as it goes
+    {
+        size_t hits[3] = { 0, 0, 0 };
+        size_t total_iterations[2] = { 0, 0 };
+        double seconds[3];
+        ConvexShape moving = box;
+
+        ConvexCache cache;
+        clock_t start = clock();
+        for ( size_t i = 0; i < n; ++i ) {
+            moving.position = path[i];
+            moving.orientation = turn[i];
+            hits[0] += convex_contact( moving, box, &cache, &normal, &depth, &iterations );
+            total_iterations[0] += iterations;
+        }
+        seconds[0] = seconds_since( start );
+
+        start = clock();
+        for ( size_t i = 0; i < n; ++i ) {
+            moving.position = path[i];
+            moving.orientation = turn[i];
+            ConvexCache cold;
+            hits[1] += convex_contact( moving, box, &cold, &normal, &depth, &iterations );
+            total_iterations[1] += iterations;
+        }
+        seconds[1] = seconds_since( start );
+
+        std::vector< Vector3 > moved( num_parts );
+        start = clock();
+        for ( size_t i = 0; i < n; ++i ) {
+            for ( size_t k = 0; k < num_parts; ++k ) {
+                moved[k] = path[i] + turn[i] * parts[k];
+            }
+            bool hit = false;
+            for ( size_t k = 0; k < num_parts; ++k ) {
+                for ( size_t m = 0; m < num_parts; ++m ) {
+                    hit |= sphere_sphere_contact( moved[k], part_radius, parts[m], part_radius, &normal, &depth );
+                }
+            }
+            hits[2] += hit;
+        }
+        seconds[2] = seconds_since( start );
+
+        printf( "box-box:    GJK cached %.0f queries/s (%.2f iterations), GJK cold %.0f queries/s (%.2f iterations)\n",
+            n / seconds[0], double( total_iterations[0] ) / n, n / seconds[1], double( total_iterations[1] ) / n );
+        printf( "            %u spheres %.0f queries/s (%.0f sphere pairs/s); touching in %u, %u and %u queries\n",
+            unsigned( num_parts ), n / seconds[2], n * num_parts * num_parts / seconds[2],
+            unsigned( hits[0] ), unsigned( hits[1] ), unsigned( hits[2] ) );
+    }
+
+    return 0;
+}
+
+// a random number in [lo, hi)
+static real_t benchmark_random( real_t lo, real_t hi )
+{
+    return lo + ( hi - lo ) * real_t( rand() ) / ( real_t( RAND_MAX ) + 1 );
+}
+
+/**
+ * Measures the math the renderer and raytracer do per object and per
+ * vertex: composing transformation matrices down a chain of objects,
+ * building the inverse and normal matrices, multiplying quaternions, and
+ * transforming points one at a time and in batches. Reports nanoseconds
+ * per operation for the precision and instruction set of the build.
+ */
+int run_math_benchmark()
+{
+#if defined( MATH_SSE )
+    const char* kind = "float, sse";
+#elif defined( MATH_SINGLE_PRECISION )
+    const char* kind = "float";
+#else
+    const char* kind = "double";
+#endif
+    printf( "math benchmark, %s\n", kind );
+
+    size_t n = BENCHMARK_MATH_OBJECTS;
+    std::vector< Vector3 > positions( n );
+    std::vector< Quaternion > orientations( n );
+    std::vector< Vector3 > scales( n );
+    srand( 462 );
+    for ( size_t i = 0; i < n; ++i ) {
+        positions[i] = Vector3( benchmark_random( -1, 1 ), benchmark_random( -1, 1 ), benchmark_random( -1, 1 ) );
+        Vector3 axis( benchmark_random( -1, 1 ), benchmark_random( -1, 1 ), benchmark_random( -1, 1 ) );
+        orientations[i] = Quaternion( axis, benchmark_random( 0, real_t( PI ) ) );
+        scales[i] = Vector3( benchmark_random( 0.5, 2 ), benchmark_random( 0.5, 2 ), benchmark_random( 0.5, 2 ) );
+    }
+    std::vector< Vector3 > points( BENCHMARK_MATH_POINTS );
+    for ( size_t i = 0; i < points.size(); ++i ) {
+        points[i] = Vector3( benchmark_random( -1, 1 ), benchmark_random( -1, 1 ), benchmark_random( -1, 1 ) );
+    }
+    std::vector< Vector3 > transformed( points.size() );
+    size_t passes = BENCHMARK_MATH_PASSES;
+    double operations = double( n ) * passes;
+    // results are summed and stored so no loop is optimized away
+    real_t sum = 0;
+
+    // every object's world matrix is its parent's times its own, down a
+    // chain as deep as the objects
+    clock_t start = clock();
+    for ( size_t pass = 0; pass < passes; ++pass ) {
+        Matrix4 world = Matrix4::Identity;
+        for ( size_t i = 0; i < n; ++i ) {
+            Matrix4 local;
+            make_transformation_matrix( &local, positions[i], orientations[i], Vector3::Ones );
+            world = world * local;
+        }
+        sum += world.m[12];
+    }
+    double seconds = seconds_since( start );
+    printf( "compose transformations: %.1f ns each\n", seconds * 1e9 / operations );
+
+    // what the raytracer builds for every sphere in every image
+    start = clock();
+    for ( size_t pass = 0; pass < passes; ++pass ) {
+        for ( size_t i = 0; i < n; ++i ) {
+            Matrix4 transform, inverse;
+            Matrix3 normal_matrix;
+            make_transformation_matrix( &transform, positions[i], orientations[i], scales[i] );
+            make_inverse_transformation_matrix( &inverse, positions[i], orientations[i], scales[i] );
+            make_normal_matrix( &normal_matrix, transform );
+            sum += inverse.m[12] + normal_matrix.m[0];
+        }
+    }
+    seconds = seconds_since( start );
+    printf( "transform, inverse and normal matrices: %.1f ns per object\n", seconds * 1e9 / operations );
+
+    // every orientation turned by the same rotation, as bodies are
+    std::vector< Quaternion > turned( n );
+    start = clock();
+    for ( size_t pass = 0; pass < passes; ++pass ) {
+        for ( size_t i = 0; i < n; ++i ) {
+            turned[i] = orientations[pass] * orientations[i];
+        }
+        sum += turned[pass].w;
+    }
+    seconds = seconds_since( start );
+    printf( "quaternion products: %.1f ns each\n", seconds * 1e9 / operations );
+
+    Matrix4 transform;
+    make_transformation_matrix( &transform, positions[0], orientations[0], scales[0] );
+    double point_operations = double( points.size() ) * passes;
+
+    start = clock();
+    for ( size_t pass = 0; pass < passes; ++pass ) {
+        for ( size_t i = 0; i < points.size(); ++i ) {
+            transformed[i] = transform.transform_point( points[i] );
+        }
+        sum += transformed[pass].x;
+    }
+    seconds = seconds_since( start );
+    printf( "transform points one at a time: %.2f ns per point\n", seconds * 1e9 / point_operations );
+
+    start = clock();
+    for ( size_t pass = 0; pass < passes; ++pass ) {
+        transform_points( transform, &points[0], &transformed[0], points.size() );
+        sum += transformed[pass].x;
+    }
+    seconds = seconds_since( start );
+    printf( "transform points in a batch: %.2f ns per point\n", seconds * 1e9 / point_operations );
+
+    volatile real_t sink = sum;
+    (void)sink;
+    return 0;
+}
+
+static void sleep_check_stats_hook( const PhysicsStats& stats, void* data )
+{
+    *static_cast< PhysicsStats* >( data ) = stats;
+}
+
+// prints the outcome of one check of run_sleep_check, returns whether it passed
+static bool sleep_check( const char* what, bool passed )
+{
+    printf( "%s: %s\n", what, passed ? "ok" : "FAILED" );
+    return passed;
+}
+
+/**
+ * Checks that a force applied to a sleeping sphere wakes its island, and
+ * only its island, and moves it. Two touching spheres and a lone one far
+ * away settle on the ground and fall asleep, then one of the two is pushed
+ * away from the other. Returns 1 if any check fails.
+ */
+int run_sleep_check()
+{
+    printf( "sleep check\n" );
+
+    const Vector3 start[] = {
+        Vector3( 0.0, 0.5, 0.0 ), Vector3( 0.99, 0.5, 0.0 ), Vector3( 10.0, 0.5, 0.0 )
+    };
+    const size_t count = 3;
+    std::vector< Sphere > geoms( count );
+    std::vector< SphereBody* > bodies( count );
+    Physics phys;
+    phys.gravity = Vector3( 0.0, -9.8, 0.0 );
+    phys.friction = 0.5;
+    phys.set_time_step( SLEEP_CHECK_TIME_STEP );
+    PhysicsStats stats;
+    phys.set_stats_hook( sleep_check_stats_hook, &stats );
+
+    PlaneBody* ground = new PlaneBody();
+    ground->id = 0;
+    ground->position = Vector3::Zero;
+    ground->normal = Vector3::UnitY;
+    phys.add_plane( ground );
+    for ( size_t i = 0; i < count; ++i ) {
+        Sphere& geom = geoms[i];
+        geom.position = start[i];
+        geom.orientation = Quaternion::Identity;
+        geom.radius = 0.5;
+        bodies[i] = new SphereBody( &geom );
+        bodies[i]->id = int( i + 1 );
+        bodies[i]->mass = 1.0;
+        phys.add_sphere( bodies[i] );
+    }
+
+    for ( size_t i = 0; i < SLEEP_CHECK_SETTLE_STEPS; ++i ) {
+        phys.update( SLEEP_CHECK_TIME_STEP );
+    }
+    bool passed = sleep_check( "all spheres fall asleep", stats.sleeping_spheres == count );
+    Vector3 pushed = bodies[0]->position;
+    Vector3 lone = bodies[2]->position;
+
+    bodies[0]->apply_force( Vector3( -20.0, 0.0, 0.0 ), Vector3::Zero );
+    phys.update( SLEEP_CHECK_TIME_STEP );
+    passed &= sleep_check( "a pushed sphere wakes its island", stats.awake_spheres == 2 );
+    for ( size_t i = 0; i < 8; ++i ) {
+        phys.update( SLEEP_CHECK_TIME_STEP );
+    }
+    passed &= sleep_check( "the pushed sphere moves", bodies[0]->position.x < pushed.x - 0.01 );
+    passed &= sleep_check( "other islands stay asleep", bodies[2]->position == lone );
+
+    return passed ? 0 : 1;
+}
+
+/**
+ * Phase timings summed over a headless run.
+ */
+struct HeadlessTotals
+{
+    long long broad_phase_ns;
+    long long narrow_phase_ns;
+    long long solver_ns;
+    long long springs_ns;
+    long long integrate_ns;
+    size_t sphere_pairs;
+    size_t triangle_pairs;
+    size_t contacts;
+    size_t cached_contacts;
+    size_t islands;
+    size_t solver_iterations;
+    size_t max_solver_iterations;
+    size_t impacts;
+    size_t awake_spheres;
+    size_t spring_iterations;
+    // spring solves cut off by the iteration cap, and the largest residual
+    size_t spring_capped;
+    real_t spring_residual;
+    size_t convex_pairs;
+    size_t gjk_iterations;
+};
+
+static void headless_stats_hook( const PhysicsStats& stats, void* data )
+{
+    HeadlessTotals* totals = static_cast< HeadlessTotals* >( data );
+    totals->broad_phase_ns += stats.broad_phase_ns;
+    totals->narrow_phase_ns += stats.narrow_phase_ns;
+    totals->solver_ns += stats.solver_ns;
+    totals->springs_ns += stats.springs_ns;
+    totals->integrate_ns += stats.integrate_ns;
+    totals->spring_iterations += stats.spring_iterations;
+    totals->spring_capped += stats.spring_converged ? 0 : 1;
+    totals->spring_residual = std::max( totals->spring_residual, stats.spring_residual );
+    totals->sphere_pairs += stats.sphere_pairs;
+    totals->triangle_pairs += stats.triangle_pairs;
+    totals->contacts += stats.contacts;
+    totals->cached_contacts += stats.cached_contacts;
+    totals->islands += stats.islands;
+    totals->solver_iterations += stats.solver_iterations;
+    totals->max_solver_iterations = std::max( totals->max_solver_iterations, stats.max_solver_iterations );
+    totals->impacts += stats.impacts;
+    totals->awake_spheres += stats.awake_spheres;
+    totals->convex_pairs += stats.convex_pairs;
+    totals->gjk_iterations += stats.gjk_iterations;
+}
+
+/**
+ * Loads the scene and steps its physics at a fixed step size, without a
+ * window or opengl context, then prints the time spent per step in each
+ * phase. Long runs report their progress every HEADLESS_PRINT_STEPS steps. The state after every step is optionally recorded to a trace, or
+ * compared bit for bit against a recorded one.
+ */
+int run_headless( const HeadlessOptions& opt )
+{
+    Scene scene;
+    AssetLoader loader;
+    if ( !load_scene( &scene, opt.input_filename, &loader ) ) {
+        std::cout << "Error loading scene " << opt.input_filename << ". Aborting.\n";
+        return 1;
+    }
+    // mesh colliders need the mesh data, but nothing needs opengl
+    if ( !loader.wait() ) {
+        std::cout << "Error loading assets, aborting.\n";
+        return 1;
+    }
+
+    Physics* phys = scene.get_physics();
+    real_t dt = opt.time_step > 0.0 ? opt.time_step : phys->get_time_step();
+    size_t steps = opt.steps;
+    std::vector< real_t > state( phys->state_size() );
+    std::vector< real_t > expected( phys->state_size() );
+
+    TraceFile trace;
+    if ( opt.record_filename ) {
+        if ( !trace.create( opt.record_filename, state.size(), dt ) ) {
+            std::cout << "Error creating trace " << opt.record_filename << ".\n";
+            return 1;
+        }
+    } else if ( opt.verify_filename ) {
+        if ( !trace.open( opt.verify_filename ) ) {
+            std::cout << "Error opening trace " << opt.verify_filename << ".\n";
+            return 1;
+        }
+        if ( trace.frame_size() != state.size() ) {
+            std::cout << "Trace was recorded with a different number of spheres.\n";
+            return 1;
+        }
+        // replay with the recorded step size, a different one can't match
+        dt = trace.time_step();
+        steps = std::min( steps, trace.num_frames() );
+    }
+
+    HeadlessTotals totals;
+    memset( &totals, 0, sizeof totals );
+    phys->set_stats_hook( headless_stats_hook, &totals );
+
+    printf( "%s: %u spheres, %u triangles, %u planes, %u convex bodies, %u steps of %g s\n", opt.input_filename,
+        unsigned( phys->num_spheres() ), unsigned( phys->num_triangles() ), unsigned( phys->num_planes() ),
+        unsigned( phys->num_convexes() + phys->num_hulls() ), unsigned( steps ), dt );
+
+    bool failed = false;
+    clock_t start = clock();
+    for ( size_t i = 0; i < steps && !failed; ++i ) {
+        phys->step( dt );
+        if ( ( i + 1 ) % HEADLESS_PRINT_STEPS == 0 ) {
+            const PhysicsStats& stats = phys->get_stats();
+            double elapsed = std::max( 1e-3, double( clock() - start ) / CLOCKS_PER_SEC );
+            printf( "step %u: %.1f steps per cpu second, %u spheres awake, %u asleep, energy %f\n",
+                unsigned( i + 1 ), ( i + 1 ) / elapsed, unsigned( stats.awake_spheres ),
+                unsigned( stats.sleeping_spheres ), stats.energy );
+        }
+        if ( !opt.record_filename && !opt.verify_filename ) {
+            continue;
+        }
+
+        phys->save_state( state.empty() ? 0 : &state[0] );
+        if ( opt.record_filename ) {
+            if ( !trace.write_frame( state.empty() ? 0 : &state[0] ) ) {
+                std::cout << "Error writing trace " << opt.record_filename << ".\n";
+                return 1;
+            }
+        } else if ( opt.verify_filename ) {
+            if ( !trace.read_frame( expected.empty() ? 0 : &expected[0] ) ) {
+                std::cout << "Error reading trace " << opt.verify_filename << ".\n";
+                return 1;
+            }
+            for ( size_t k = 0; k < state.size(); ++k ) {
+                if ( memcmp( &state[k], &expected[k], sizeof( real_t ) ) != 0 ) {
+                    printf( "replay diverged at step %u, sphere %u, value %u: %.17g instead of %.17g\n",
+                        unsigned( i ), unsigned( k / PHYSICS_STATE_REALS ), unsigned( k % PHYSICS_STATE_REALS ),
+                        state[k], expected[k] );
+                    failed = true;
+                    break;
+                }
+            }
+        }
+    }
+    double seconds = double( clock() - start ) / CLOCKS_PER_SEC;
+
+    double n = double( std::max( steps, size_t( 1 ) ) );
+    printf( "ns per step: broad phase %.0f, narrow phase %.0f, solver %.0f, springs %.0f, integration %.0f\n",
+        totals.broad_phase_ns / n, totals.narrow_phase_ns / n, totals.solver_ns / n, totals.springs_ns / n,
+        totals.integrate_ns / n );
+    printf( "total %.3f s cpu, %.0f ns per step; %.2f contacts and %.2f swept impacts per step; energy %f\n",
+        seconds, seconds * 1e9 / n, totals.contacts / n, totals.impacts / n, phys->get_stats().energy );
+    printf( "candidate pairs per step: %.2f sphere-sphere, %.2f sphere-triangle\n",
+        totals.sphere_pairs / n, totals.triangle_pairs / n );
+    if ( totals.contacts > 0 ) {
+        printf( "%.1f%% of contacts warm started; %.2f solver iterations per island, at most %u\n",
+            100.0 * totals.cached_contacts / totals.contacts,
+            totals.islands > 0 ? double( totals.solver_iterations ) / totals.islands : 0.0,
+            unsigned( totals.max_solver_iterations ) );
+    }
+    if ( totals.convex_pairs > 0 ) {
+        printf( "%.2f sphere-convex pairs per step, %.2f GJK iterations per pair\n",
+            totals.convex_pairs / n, double( totals.gjk_iterations ) / totals.convex_pairs );
+    }
+    printf( "%.2f spheres awake per step, %u asleep at the end\n",
+        totals.awake_spheres / n, unsigned( phys->get_stats().sleeping_spheres ) );
+    if ( phys->num_springs() > 0 ) {
+        printf( "%u springs, %.2f spring solver iterations per step\n",
+            unsigned( phys->num_springs() ), totals.spring_iterations / n );
+        if ( totals.spring_capped > 0 ) {
+            printf( "spring solve stopped at the iteration cap in %u steps, residual up to %g\n",
+                unsigned( totals.spring_capped ), double( totals.spring_residual ) );
+        }
+    }
+
+    if ( opt.record_filename ) {
+        printf( "recorded %u steps to %s\n", unsigned( trace.num_frames() ), opt.record_filename );
+    } else if ( opt.verify_filename && !failed ) {
+        printf( "replay matches %s for %u steps\n", opt.verify_filename, unsigned( steps ) );
+    }
+    return failed ? 1 : 0;
+}
+
+/**
+ * Loads the scene and raytraces it to the output file without a window or
+ * opengl context. With steps, the physics is stepped that many times and
+ * every nth state is traced to a numbered image sequence, the output file
+ * being the prefix of the names.
+ */
+int run_raytrace( const RaytraceOptions& opt )
+{
+    Scene scene;
+    AssetLoader loader( opt.threads );
+    if ( !load_scene( &scene, opt.input_filename, &loader ) ) {
+        std::cout << "Error loading scene " << opt.input_filename << ". Aborting.\n";
+        return 1;
+    }
+    if ( !loader.wait() ) {
+        std::cout << "Error loading assets, aborting.\n";
+        return 1;
+    }
+
+    // default names are timestamped like the screenshots
+    char default_name[64];
+    time_t timer;
+    time( &timer );
+    strftime( default_name, sizeof default_name,
+              opt.steps > 0 ? "raytrace%y%m%d%H%M%S_" : "raytrace%y%m%d%H%M%S.png",
+              localtime( &timer ) );
+    std::string prefix = opt.output_filename ? opt.output_filename : default_name;
+    std::string extension = ".png";
+    if ( opt.steps > 0 ) {
+        size_t dot = prefix.rfind( '.' );
+        if ( dot != std::string::npos && prefix.find( '/', dot ) == std::string::npos &&
+             prefix.find( '\\', dot ) == std::string::npos ) {
+            extension = prefix.substr( dot );
+            prefix.erase( dot );
+        }
+    }
+
+    Raytracer raytracer( opt.threads );
+    raytracer.initialize( &scene );
+    std::vector< unsigned char > buffer( BUFFER_SIZE( opt.width, opt.height ) );
+
+    Physics* phys = scene.get_physics();
+    PhysicsSnapshot snapshot;
+    real_t dt = phys->get_time_step();
+    size_t every = std::max( opt.every, size_t( 1 ) );
+    size_t num_images = 0;
+    double trace_seconds = 0.0;
+
+    for ( size_t i = 0; i <= opt.steps; ++i ) {
+        if ( i > 0 ) {
+            phys->step( dt );
+            if ( i % every != 0 ) {
+                continue;
+            }
+            // step() leaves the geometries where they were
+            phys->save_snapshot( &snapshot );
+            phys->sync_geometry( snapshot, snapshot, 1.0 );
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        raytracer.raytrace( &buffer[0], opt.width, opt.height );
+        trace_seconds += std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+
+        std::string filename = prefix;
+        if ( opt.steps > 0 ) {
+            char number[32];
+            sprintf( number, "%06u", unsigned( num_images ) );
+            filename += number + extension;
+        }
+        if ( !imageio_save_image( filename.c_str(), &buffer[0], opt.width, opt.height ) ) {
+            std::cout << "Error writing image " << filename << ".\n";
+            return 1;
+        }
+        ++num_images;
+    }
+
+    printf( "raytraced %u images of %dx%d in %.3f s each, %u threads\n",
+        unsigned( num_images ), opt.width, opt.height, trace_seconds / num_images,
+        unsigned( raytracer.num_threads() ) );
+    return 0;
+}
+
+} /* _462 */
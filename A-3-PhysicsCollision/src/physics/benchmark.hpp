@@ -0,0 +1,92 @@
+/**
+ * @file benchmark.hpp
+ * @brief Benchmarks and runs of the simulator without a window.
+ *
+ * Everything main() can do besides opening the interactive simulator: the
+ * benchmarks and checks of -b, the headless simulation of -s and the
+ * offline raytracing of -r. Each prints its results to stdout and returns
+ * the exit code of the program.
+ */
+
+#ifndef _462_PHYSICS_BENCHMARK_HPP_
+#define _462_PHYSICS_BENCHMARK_HPP_
+
+#include "math/math.hpp"
+#include <cstddef>
+
+namespace _462 {
+
+/**
+ * Options of a headless run.
+ */
+struct HeadlessOptions
+{
+    // scene to simulate
+    const char* input_filename;
+    // steps to simulate
+    size_t steps;
+    // step size, or 0 for the one of the scene
+    real_t time_step;
+    // trace to record the run to, or null
+    const char* record_filename;
+    // trace to compare the run against, or null
+    const char* verify_filename;
+};
+
+/**
+ * Options of an offline raytrace.
+ */
+struct RaytraceOptions
+{
+    // scene to raytrace
+    const char* input_filename;
+    // image to write, or prefix of the image sequence, or null for a
+    // timestamped name
+    const char* output_filename;
+    // threads loading assets and raytracing, 0 for one per core
+    size_t threads;
+    // physics steps to take and how many steps apart the images are, or 0
+    // to only raytrace the loaded scene
+    size_t steps;
+    size_t every;
+    // image dimensions
+    int width, height;
+};
+
+/**
+ * Measures how many spheres per millisecond Physics::integrate advances,
+ * for each integrator and a range of sphere counts.
+ */
+int run_integration_benchmark();
+
+/**
+ * Measures GJK queries against approximating boxes by spheres.
+ */
+int run_collision_benchmark();
+
+/**
+ * Measures the transformation math of the renderer and raytracer.
+ */
+int run_math_benchmark();
+
+/**
+ * Checks that a force applied to a sleeping sphere wakes it. Returns 1 if
+ * it doesn't.
+ */
+int run_sleep_check();
+
+/**
+ * Simulates a scene at a fixed step size and prints the time per step,
+ * optionally recording or replaying a trace. Returns 1 if the replay
+ * diverges.
+ */
+int run_headless( const HeadlessOptions& opt );
+
+/**
+ * Raytraces a scene, or a sequence of its simulated states, to images.
+ */
+int run_raytrace( const RaytraceOptions& opt );
+
+} /* _462 */
+
+#endif /* _462_PHYSICS_BENCHMARK_HPP_ */
@@ -8,6 +8,18 @@
 
 namespace _462 {
 
+/**
+ * Returns orientation rotated by angular_velocity (radians per second, in
+ * the body frame) over dt.
+ */
+inline Quaternion integrate_orientation( const Quaternion& orientation, const Vector3& angular_velocity, real_t dt )
+{
+    real_t speed = length( angular_velocity );
+    if ( speed == 0.0 )
+        return orientation;
+    return normalize( orientation * Quaternion( angular_velocity / speed, speed * dt ) );
+}
+
 class Body
 {
 public:
@@ -0,0 +1,503 @@
+/**
+ * @file broadphase.cpp
+ * @brief Broad phase collision culling.
+ */
+
+#include "physics/broadphase.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace _462 {
+
+// static proxies covering more cells than this are not put in the grid
+#define GRID_MAX_STATIC_CELLS 4096
+// nor are dynamic ones covering more than this, since they move every step
+#define GRID_MAX_DYNAMIC_CELLS 64
+// how far the median proxy extent may drift from the cell size
+#define GRID_RESIZE_FACTOR 2.0
+// cell coordinates are clamped to 21 bits so they can be packed into a key
+#define GRID_COORD_LIMIT ( 1 << 20 )
+// how much more the proxies must spread along another axis for sweep and
+// prune to switch to it
+#define SAP_AXIS_SWITCH_FACTOR 1.5
+
+static unsigned long long cell_key( int x, int y, int z )
+{
+    const unsigned long long mask = ( 1ull << 21 ) - 1;
+    return ( ( (unsigned long long) x & mask ) << 42 ) |
+           ( ( (unsigned long long) y & mask ) << 21 ) |
+           ( (unsigned long long) z & mask );
+}
+
+static int cell_coord( real_t v, real_t inv_cell_size )
+{
+    real_t c = floor( v * inv_cell_size );
+    c = clamp( c, real_t( -GRID_COORD_LIMIT ), real_t( GRID_COORD_LIMIT - 1 ) );
+    return int( c );
+}
+
+static double cell_count( const int min[3], const int max[3] )
+{
+    return double( max[0] - min[0] + 1 ) * double( max[1] - min[1] + 1 ) * double( max[2] - min[2] + 1 );
+}
+
+static void assign_groups( std::vector< int >* out, const int* groups, size_t count )
+{
+    if ( groups ) {
+        out->assign( groups, groups + count );
+    } else {
+        out->assign( count, BROAD_PHASE_NO_GROUP );
+    }
+}
+
+// ***** BruteForceBroadPhase ***** //
+
+void BruteForceBroadPhase::set_static( const AABB* boxes, const int* groups, size_t count )
+{
+    statics.assign( boxes, boxes + count );
+    assign_groups( &static_groups, groups, count );
+}
+
+void BruteForceBroadPhase::update( const AABB* boxes, const int* groups, size_t count )
+{
+    dynamics.assign( boxes, boxes + count );
+    assign_groups( &dynamic_groups, groups, count );
+}
+
+void BruteForceBroadPhase::find_pairs( ProxyPairList* dynamic_pairs, ProxyPairList* static_pairs )
+{
+    for ( size_t i = 0; i < dynamics.size(); ++i ) {
+        for ( size_t j = 0; j < statics.size(); ++j ) {
+            if ( may_pair( dynamic_groups[i], static_groups[j] ) && overlaps( dynamics[i], statics[j] ) ) {
+                ProxyPair p = { unsigned( i ), unsigned( j ) };
+                static_pairs->push_back( p );
+            }
+        }
+        for ( size_t j = i + 1; j < dynamics.size(); ++j ) {
+            if ( may_pair( dynamic_groups[i], dynamic_groups[j] ) && overlaps( dynamics[i], dynamics[j] ) ) {
+                ProxyPair p = { unsigned( i ), unsigned( j ) };
+                dynamic_pairs->push_back( p );
+            }
+        }
+    }
+}
+
+// ***** SpatialHashGrid ***** //
+
+bool SpatialHashGrid::CellRange::operator==( const CellRange& rhs ) const
+{
+    return min[0] == rhs.min[0] && min[1] == rhs.min[1] && min[2] == rhs.min[2] &&
+           max[0] == rhs.max[0] && max[1] == rhs.max[1] && max[2] == rhs.max[2];
+}
+
+SpatialHashGrid::SpatialHashGrid( real_t cell_size )
+    : cell_size( cell_size ), inv_cell_size( cell_size > 0 ? 1.0 / cell_size : 0.0 ),
+      auto_cell_size( cell_size <= 0 ), statics_dirty( false ) { }
+
+void SpatialHashGrid::compute_range( const AABB& box, CellRange* range ) const
+{
+    for ( int i = 0; i < 3; ++i ) {
+        range->min[i] = cell_coord( box.min[i], inv_cell_size );
+        range->max[i] = cell_coord( box.max[i], inv_cell_size );
+    }
+}
+
+void SpatialHashGrid::insert( CellMap& map, unsigned int index, const CellRange& range )
+{
+    for ( int x = range.min[0]; x <= range.max[0]; ++x )
+        for ( int y = range.min[1]; y <= range.max[1]; ++y )
+            for ( int z = range.min[2]; z <= range.max[2]; ++z )
+                map[cell_key( x, y, z )].push_back( index );
+}
+
+void SpatialHashGrid::remove( CellMap& map, unsigned int index, const CellRange& range )
+{
+    for ( int x = range.min[0]; x <= range.max[0]; ++x ) {
+        for ( int y = range.min[1]; y <= range.max[1]; ++y ) {
+            for ( int z = range.min[2]; z <= range.max[2]; ++z ) {
+                CellMap::iterator cell = map.find( cell_key( x, y, z ) );
+                assert( cell != map.end() );
+                IndexList& list = cell->second;
+                IndexList::iterator iter = std::find( list.begin(), list.end(), index );
+                assert( iter != list.end() );
+                // order within a cell does not matter, so swap with the back
+                *iter = list.back();
+                list.pop_back();
+                // empty cells would pile up in the map as proxies move on
+                if ( list.empty() ) {
+                    map.erase( cell );
+                }
+            }
+        }
+    }
+}
+
+void SpatialHashGrid::set_static( const AABB* boxes, const int* groups, size_t count )
+{
+    statics.resize( count );
+    for ( size_t i = 0; i < count; ++i ) {
+        statics[i].box = boxes[i];
+        statics[i].group = groups ? groups[i] : BROAD_PHASE_NO_GROUP;
+    }
+    // cells are filled in update(), once the cell size is known
+    statics_dirty = true;
+}
+
+void SpatialHashGrid::rebuild_static()
+{
+    static_cells.clear();
+    oversized_statics.clear();
+    for ( size_t i = 0; i < statics.size(); ++i ) {
+        Proxy& proxy = statics[i];
+        compute_range( proxy.box, &proxy.range );
+        proxy.oversized = cell_count( proxy.range.min, proxy.range.max ) > GRID_MAX_STATIC_CELLS;
+        if ( proxy.oversized ) {
+            oversized_statics.push_back( unsigned( i ) );
+        } else {
+            insert( static_cells, unsigned( i ), proxy.range );
+        }
+    }
+    statics_dirty = false;
+}
+
+void SpatialHashGrid::update( const AABB* boxes, const int* groups, size_t count )
+{
+    bool rebuild_dynamic = count != dynamics.size();
+
+    if ( auto_cell_size && count > 0 ) {
+        // Follow the median proxy extent, so most proxies touch at most 8
+        // cells and a few large ones don't make every cell huge. Proxies
+        // grow and shrink with their speed, the cells are only resized once
+        // it is off by more than GRID_RESIZE_FACTOR.
+        extents.resize( count );
+        for ( size_t i = 0; i < count; ++i ) {
+            Vector3 extent = boxes[i].max - boxes[i].min;
+            extents[i] = std::max( extent.x, std::max( extent.y, extent.z ) );
+        }
+        std::nth_element( extents.begin(), extents.begin() + count / 2, extents.end() );
+        real_t size = extents[count / 2] > 0 ? extents[count / 2] : 1.0;
+        if ( cell_size <= 0 || size > cell_size * GRID_RESIZE_FACTOR || size * GRID_RESIZE_FACTOR < cell_size ) {
+            cell_size = size;
+            inv_cell_size = 1.0 / cell_size;
+            statics_dirty = true;
+            rebuild_dynamic = true;
+        }
+    }
+    if ( cell_size <= 0 ) {
+        // nothing to size the cells from yet
+        return;
+    }
+
+    if ( statics_dirty ) {
+        rebuild_static();
+    }
+
+    if ( rebuild_dynamic ) {
+        dynamic_cells.clear();
+        oversized_dynamics.clear();
+        dynamics.resize( count );
+    }
+
+    // Place every proxy after a rebuild, otherwise only touch the proxies
+    // that changed cells
+    for ( size_t i = 0; i < count; ++i ) {
+        Proxy& proxy = dynamics[i];
+        CellRange range;
+        proxy.box = boxes[i];
+        proxy.group = groups ? groups[i] : BROAD_PHASE_NO_GROUP;
+        compute_range( boxes[i], &range );
+        if ( !rebuild_dynamic && range == proxy.range ) {
+            continue;
+        }
+        bool oversized = cell_count( range.min, range.max ) > GRID_MAX_DYNAMIC_CELLS;
+        if ( !rebuild_dynamic ) {
+            if ( !proxy.oversized ) {
+                remove( dynamic_cells, unsigned( i ), proxy.range );
+            } else if ( !oversized ) {
+                IndexList::iterator iter = std::find( oversized_dynamics.begin(), oversized_dynamics.end(), unsigned( i ) );
+                *iter = oversized_dynamics.back();
+                oversized_dynamics.pop_back();
+            }
+        }
+        if ( !oversized ) {
+            insert( dynamic_cells, unsigned( i ), range );
+        } else if ( rebuild_dynamic || !proxy.oversized ) {
+            oversized_dynamics.push_back( unsigned( i ) );
+        }
+        proxy.range = range;
+        proxy.oversized = oversized;
+    }
+}
+
+void SpatialHashGrid::find_pairs( ProxyPairList* dynamic_pairs, ProxyPairList* static_pairs )
+{
+    for ( size_t i = 0; i < dynamics.size(); ++i ) {
+        const Proxy& proxy = dynamics[i];
+        const CellRange& r = proxy.range;
+        if ( proxy.oversized ) {
+            continue;
+        }
+
+        for ( int x = r.min[0]; x <= r.max[0]; ++x ) {
+            for ( int y = r.min[1]; y <= r.max[1]; ++y ) {
+                for ( int z = r.min[2]; z <= r.max[2]; ++z ) {
+                    unsigned long long key = cell_key( x, y, z );
+
+                    // A pair sharing several cells is only reported from the
+                    // first cell they share, i.e. the max of their min corners.
+                    CellMap::const_iterator iter = dynamic_cells.find( key );
+                    if ( iter != dynamic_cells.end() ) {
+                        const IndexList& list = iter->second;
+                        for ( size_t k = 0; k < list.size(); ++k ) {
+                            unsigned int j = list[k];
+                            if ( j <= i || !may_pair( proxy.group, dynamics[j].group ) )
+                                continue;
+                            const CellRange& o = dynamics[j].range;
+                            if ( std::max( r.min[0], o.min[0] ) != x ||
+                                 std::max( r.min[1], o.min[1] ) != y ||
+                                 std::max( r.min[2], o.min[2] ) != z )
+                                continue;
+                            if ( overlaps( proxy.box, dynamics[j].box ) ) {
+                                ProxyPair p = { unsigned( i ), j };
+                                dynamic_pairs->push_back( p );
+                            }
+                        }
+                    }
+
+                    iter = static_cells.find( key );
+                    if ( iter != static_cells.end() ) {
+                        const IndexList& list = iter->second;
+                        for ( size_t k = 0; k < list.size(); ++k ) {
+                            unsigned int j = list[k];
+                            if ( !may_pair( proxy.group, statics[j].group ) )
+                                continue;
+                            const CellRange& o = statics[j].range;
+                            if ( std::max( r.min[0], o.min[0] ) != x ||
+                                 std::max( r.min[1], o.min[1] ) != y ||
+                                 std::max( r.min[2], o.min[2] ) != z )
+                                continue;
+                            if ( overlaps( proxy.box, statics[j].box ) ) {
+                                ProxyPair p = { unsigned( i ), j };
+                                static_pairs->push_back( p );
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        for ( size_t k = 0; k < oversized_statics.size(); ++k ) {
+            unsigned int j = oversized_statics[k];
+            if ( may_pair( proxy.group, statics[j].group ) && overlaps( proxy.box, statics[j].box ) ) {
+                ProxyPair p = { unsigned( i ), j };
+                static_pairs->push_back( p );
+            }
+        }
+    }
+
+    // Oversized dynamic proxies test every proxy, and a pair of two of
+    // them is reported by the lower one
+    for ( size_t k = 0; k < oversized_dynamics.size(); ++k ) {
+        unsigned int i = oversized_dynamics[k];
+        const AABB& box = dynamics[i].box;
+        int group = dynamics[i].group;
+        for ( size_t j = 0; j < dynamics.size(); ++j ) {
+            if ( j == i || ( dynamics[j].oversized && j < i ) || !may_pair( group, dynamics[j].group ) )
+                continue;
+            if ( overlaps( box, dynamics[j].box ) ) {
+                ProxyPair p = { std::min( i, unsigned( j ) ), std::max( i, unsigned( j ) ) };
+                dynamic_pairs->push_back( p );
+            }
+        }
+        for ( size_t j = 0; j < statics.size(); ++j ) {
+            if ( may_pair( group, statics[j].group ) && overlaps( box, statics[j].box ) ) {
+                ProxyPair p = { i, unsigned( j ) };
+                static_pairs->push_back( p );
+            }
+        }
+    }
+}
+
+// ***** SweepAndPrune ***** //
+
+struct EntryCompare
+{
+    template< typename T >
+    bool operator()( const T& lhs, const T& rhs ) const
+    {
+        return lhs.min < rhs.min;
+    }
+};
+
+SweepAndPrune::SweepAndPrune() : axis( 0 )
+{
+    for ( int k = 0; k < 3; ++k ) {
+        static_sum[k] = 0.0;
+        static_sum2[k] = 0.0;
+    }
+}
+
+bool SweepAndPrune::choose_axis()
+{
+    real_t sum[3], sum2[3];
+    for ( int k = 0; k < 3; ++k ) {
+        sum[k] = static_sum[k];
+        sum2[k] = static_sum2[k];
+    }
+    for ( size_t i = 0; i < dynamics.size(); ++i ) {
+        for ( int k = 0; k < 3; ++k ) {
+            real_t c = ( dynamics[i].min[k] + dynamics[i].max[k] ) * 0.5;
+            sum[k] += c;
+            sum2[k] += c * c;
+        }
+    }
+    size_t count = statics.size() + dynamics.size();
+    if ( count == 0 ) {
+        return false;
+    }
+
+    // variance of the box centers along every axis
+    real_t variance[3];
+    for ( int k = 0; k < 3; ++k ) {
+        real_t mean = sum[k] / count;
+        variance[k] = sum2[k] / count - mean * mean;
+    }
+    int best = axis;
+    for ( int k = 0; k < 3; ++k ) {
+        if ( variance[k] > variance[best] ) {
+            best = k;
+        }
+    }
+    if ( best == axis || variance[best] <= variance[axis] * SAP_AXIS_SWITCH_FACTOR ) {
+        return false;
+    }
+    axis = best;
+    return true;
+}
+
+void SweepAndPrune::rebuild()
+{
+    sorted.clear();
+    sorted.reserve( statics.size() + dynamics.size() );
+    for ( size_t i = 0; i < statics.size(); ++i ) {
+        Entry e = { statics[i].min[axis], statics[i].max[axis], unsigned( i ), static_groups[i], true };
+        sorted.push_back( e );
+    }
+    for ( size_t i = 0; i < dynamics.size(); ++i ) {
+        Entry e = { dynamics[i].min[axis], dynamics[i].max[axis], unsigned( i ), dynamic_groups[i], false };
+        sorted.push_back( e );
+    }
+    std::sort( sorted.begin(), sorted.end(), EntryCompare() );
+}
+
+void SweepAndPrune::set_static( const AABB* boxes, const int* groups, size_t count )
+{
+    statics.assign( boxes, boxes + count );
+    assign_groups( &static_groups, groups, count );
+    for ( int k = 0; k < 3; ++k ) {
+        static_sum[k] = 0.0;
+        static_sum2[k] = 0.0;
+        for ( size_t i = 0; i < count; ++i ) {
+            real_t c = ( boxes[i].min[k] + boxes[i].max[k] ) * 0.5;
+            static_sum[k] += c;
+            static_sum2[k] += c * c;
+        }
+    }
+    choose_axis();
+    rebuild();
+}
+
+void SweepAndPrune::update( const AABB* boxes, const int* groups, size_t count )
+{
+    if ( count != dynamics.size() ) {
+        dynamics.assign( boxes, boxes + count );
+        assign_groups( &dynamic_groups, groups, count );
+        choose_axis();
+        rebuild();
+        return;
+    }
+
+    std::copy( boxes, boxes + count, dynamics.begin() );
+    assign_groups( &dynamic_groups, groups, count );
+    if ( choose_axis() ) {
+        // the old order says nothing about the new axis
+        rebuild();
+        return;
+    }
+
+    // refresh keys, then repair the order with an insertion sort
+    for ( size_t i = 0; i < sorted.size(); ++i ) {
+        Entry& e = sorted[i];
+        if ( !e.is_static ) {
+            e.min = dynamics[e.index].min[axis];
+            e.max = dynamics[e.index].max[axis];
+            e.group = dynamic_groups[e.index];
+        }
+    }
+    for ( size_t i = 1; i < sorted.size(); ++i ) {
+        Entry e = sorted[i];
+        size_t j = i;
+        while ( j > 0 && e.min < sorted[j - 1].min ) {
+            sorted[j] = sorted[j - 1];
+            --j;
+        }
+        sorted[j] = e;
+    }
+}
+
+void SweepAndPrune::find_pairs( ProxyPairList* dynamic_pairs, ProxyPairList* static_pairs )
+{
+    active.clear();
+
+    for ( size_t i = 0; i < sorted.size(); ++i ) {
+        const Entry& e = sorted[i];
+        const AABB& box = e.is_static ? statics[e.index] : dynamics[e.index];
+
+        for ( size_t k = 0; k < active.size(); ) {
+            const Entry& a = active[k];
+
+            if ( a.max < e.min ) {
+                // interval closed, can never overlap anything later
+                active[k] = active.back();
+                active.pop_back();
+                continue;
+            }
+            ++k;
+
+            if ( ( a.is_static && e.is_static ) || !may_pair( a.group, e.group ) )
+                continue;
+            const AABB& abox = a.is_static ? statics[a.index] : dynamics[a.index];
+            if ( !overlaps( box, abox ) )
+                continue;
+
+            if ( a.is_static ) {
+                ProxyPair p = { e.index, a.index };
+                static_pairs->push_back( p );
+            } else if ( e.is_static ) {
+                ProxyPair p = { a.index, e.index };
+                static_pairs->push_back( p );
+            } else {
+                ProxyPair p = { std::min( a.index, e.index ), std::max( a.index, e.index ) };
+                dynamic_pairs->push_back( p );
+            }
+        }
+
+        active.push_back( e );
+    }
+}
+
+BroadPhase* create_broad_phase( BroadPhaseType type )
+{
+    switch ( type )
+    {
+    case BROAD_PHASE_BRUTE_FORCE:
+        return new BruteForceBroadPhase();
+    case BROAD_PHASE_SAP:
+        return new SweepAndPrune();
+    case BROAD_PHASE_GRID:
+    default:
+        return new SpatialHashGrid();
+    }
+}
+
+} /* _462 */
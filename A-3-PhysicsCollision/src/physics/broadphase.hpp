@@ -0,0 +1,257 @@
+/**
+ * @file broadphase.hpp
+ * @brief Broad phase collision culling.
+ *
+ * The broad phase reduces the set of body pairs that must go through the
+ * narrow phase collides() tests. Every proxy is an axis aligned bounding
+ * box; a pair is reported whenever the boxes of its two proxies overlap,
+ * unless both proxies are in the same collision group, so the reported set
+ * is always a superset of the colliding pairs.
+ */
+
+#ifndef _462_PHYSICS_BROADPHASE_HPP_
+#define _462_PHYSICS_BROADPHASE_HPP_
+
+#include "math/vector.hpp"
+#include <vector>
+#include <unordered_map>
+
+namespace _462 {
+
+/**
+ * An axis aligned bounding box.
+ */
+struct AABB
+{
+    Vector3 min;
+    Vector3 max;
+};
+
+/**
+ * Returns true if the two boxes overlap. Touching boxes overlap, since the
+ * narrow phase tests are inclusive too.
+ */
+inline bool overlaps( const AABB& lhs, const AABB& rhs )
+{
+    return lhs.min.x <= rhs.max.x && rhs.min.x <= lhs.max.x &&
+           lhs.min.y <= rhs.max.y && rhs.min.y <= lhs.max.y &&
+           lhs.min.z <= rhs.max.z && rhs.min.z <= lhs.max.z;
+}
+
+/**
+ * A candidate pair of proxies, by index. For dynamic-dynamic pairs first is
+ * always less than second. For dynamic-static pairs first is the dynamic
+ * proxy and second the static one.
+ */
+struct ProxyPair
+{
+    unsigned int first;
+    unsigned int second;
+
+    bool operator<( const ProxyPair& rhs ) const {
+        return first == rhs.first ? second < rhs.second : first < rhs.first;
+    }
+};
+
+typedef std::vector< ProxyPair > ProxyPairList;
+
+// collision group of proxies that may pair with any other proxy
+#define BROAD_PHASE_NO_GROUP ( -1 )
+
+/**
+ * Returns true if proxies of the two collision groups may be paired.
+ */
+inline bool may_pair( int lhs, int rhs )
+{
+    return lhs != rhs || lhs == BROAD_PHASE_NO_GROUP;
+}
+
+enum BroadPhaseType
+{
+    BROAD_PHASE_BRUTE_FORCE,
+    BROAD_PHASE_GRID,
+    BROAD_PHASE_SAP
+};
+
+/**
+ * Interface of all broad phase implementations.
+ * Static proxies (triangles) are set once, dynamic proxies (spheres) are
+ * updated every step. Implementations are free to exploit temporal coherence
+ * between two update() calls with the same proxy count.
+ *
+ * Every proxy may be given a collision group, such as the id of the body it
+ * belongs to. Proxies of the same group never collide with each other, as
+ * the nodes of a cloth, and are never paired.
+ */
+class BroadPhase
+{
+public:
+
+    virtual ~BroadPhase() { }
+
+    /**
+     * Replaces all static proxies. groups holds the collision group of
+     * every proxy, or is null to leave them all in BROAD_PHASE_NO_GROUP.
+     */
+    virtual void set_static( const AABB* boxes, const int* groups, size_t count ) = 0;
+
+    /**
+     * Moves the dynamic proxies to the given boxes, and sets their groups
+     * as set_static() does. If count differs from the previous call, all
+     * dynamic proxies are rebuilt.
+     */
+    virtual void update( const AABB* boxes, const int* groups, size_t count ) = 0;
+
+    /**
+     * Appends all overlapping dynamic-dynamic pairs to dynamic_pairs and all
+     * overlapping dynamic-static pairs to static_pairs. Order is unspecified.
+     */
+    virtual void find_pairs( ProxyPairList* dynamic_pairs, ProxyPairList* static_pairs ) = 0;
+};
+
+/**
+ * Tests every proxy against every other one. Reference implementation.
+ */
+class BruteForceBroadPhase : public BroadPhase
+{
+public:
+
+    virtual void set_static( const AABB* boxes, const int* groups, size_t count );
+    virtual void update( const AABB* boxes, const int* groups, size_t count );
+    virtual void find_pairs( ProxyPairList* dynamic_pairs, ProxyPairList* static_pairs );
+
+private:
+
+    std::vector< AABB > statics;
+    std::vector< AABB > dynamics;
+    std::vector< int > static_groups;
+    std::vector< int > dynamic_groups;
+};
+
+/**
+ * Uniform grid stored in a spatial hash. Dynamic proxies are only moved
+ * between cells when their covered cell range changes, which for small
+ * time steps is rare. Proxies covering too many cells are kept out of the
+ * grid and tested against every other proxy instead.
+ */
+class SpatialHashGrid : public BroadPhase
+{
+public:
+
+    /**
+     * @param cell_size The edge length of a cell. If zero, the median
+     *  dynamic proxy extent is used, and picked again whenever the median
+     *  drifts too far from it.
+     */
+    explicit SpatialHashGrid( real_t cell_size = 0.0 );
+
+    virtual void set_static( const AABB* boxes, const int* groups, size_t count );
+    virtual void update( const AABB* boxes, const int* groups, size_t count );
+    virtual void find_pairs( ProxyPairList* dynamic_pairs, ProxyPairList* static_pairs );
+
+private:
+
+    struct CellRange
+    {
+        int min[3];
+        int max[3];
+
+        bool operator==( const CellRange& rhs ) const;
+        bool operator!=( const CellRange& rhs ) const { return !operator==( rhs ); }
+    };
+
+    struct Proxy
+    {
+        AABB box;
+        CellRange range;
+        // collision group of the proxy
+        int group;
+        // kept out of the cells, in the oversized list
+        bool oversized;
+    };
+
+    typedef std::vector< unsigned int > IndexList;
+
+    // cell key -> proxies overlapping that cell
+    typedef std::unordered_map< unsigned long long, IndexList > CellMap;
+
+    void compute_range( const AABB& box, CellRange* range ) const;
+    void insert( CellMap& map, unsigned int index, const CellRange& range );
+    void remove( CellMap& map, unsigned int index, const CellRange& range );
+    void rebuild_static();
+
+    real_t cell_size;
+    real_t inv_cell_size;
+    // whether cell_size follows the dynamic proxies
+    bool auto_cell_size;
+    // set when the static proxies changed since they were put in cells
+    bool statics_dirty;
+
+    std::vector< Proxy > statics;
+    std::vector< Proxy > dynamics;
+    // proxies spanning too many cells, tested against everything
+    IndexList oversized_statics;
+    IndexList oversized_dynamics;
+    CellMap static_cells;
+    CellMap dynamic_cells;
+    // scratch of update, to find the median extent
+    std::vector< real_t > extents;
+};
+
+/**
+ * Sweep and prune along the axis the proxies are spread the most along, so
+ * few intervals overlap on it. The sorted endpoint order is kept between
+ * updates and repaired with an insertion sort, which is close to linear
+ * when bodies move little per step. A new axis is only picked once the
+ * spread along it clearly exceeds that along the current one.
+ */
+class SweepAndPrune : public BroadPhase
+{
+public:
+
+    SweepAndPrune();
+
+    virtual void set_static( const AABB* boxes, const int* groups, size_t count );
+    virtual void update( const AABB* boxes, const int* groups, size_t count );
+    virtual void find_pairs( ProxyPairList* dynamic_pairs, ProxyPairList* static_pairs );
+
+private:
+
+    struct Entry
+    {
+        // extent of the box along the sweep axis
+        real_t min;
+        real_t max;
+        // index into dynamics or statics
+        unsigned int index;
+        // collision group of the proxy
+        int group;
+        bool is_static;
+    };
+
+    void rebuild();
+    bool choose_axis();
+
+    std::vector< AABB > statics;
+    std::vector< AABB > dynamics;
+    std::vector< int > static_groups;
+    std::vector< int > dynamic_groups;
+    std::vector< Entry > sorted;
+    // entries whose interval along the axis is still open, copied so the
+    // sweep doesn't chase indices
+    std::vector< Entry > active;
+    // index of the sweep axis
+    int axis;
+    // sums of the static box centers and of their squares, per axis
+    real_t static_sum[3];
+    real_t static_sum2[3];
+};
+
+/**
+ * Creates a broad phase of the given type. Caller owns the result.
+ */
+BroadPhase* create_broad_phase( BroadPhaseType type );
+
+} /* _462 */
+
+#endif /* _462_PHYSICS_BROADPHASE_HPP_ */
@@ -2,24 +2,208 @@
 
 namespace _462 {
 
-bool collides(SphereBody& body1, SphereBody& body2, real_t collision_damping)
+// First t in [0, 1] at which p + d * t is inside the sphere of radius r
+// around the origin while moving towards its center
+static bool ray_sphere_toi(const Vector3& p, const Vector3& d, real_t r, real_t* t)
+{
+    real_t a = dot(d, d);
+    real_t b = dot(p, d);
+    real_t c = dot(p, p) - r * r;
+    // Not moving closer
+    if (b >= 0)
+        return false;
+    // Inside already, e.g. impacts at the same time as the last one
+    if (c <= 0) {
+        *t = 0;
+        return true;
+    }
+    real_t disc = b * b - a * c;
+    if (disc < 0)
+        return false;
+    real_t s = (-b - sqrt(disc)) / a;
+    if (s > 1)
+        return false;
+    *t = s;
+    return true;
+}
+
+bool sphere_sphere_contact(const Vector3& p1, real_t r1, const Vector3& p2, real_t r2, Vector3* normal, real_t* depth)
 {
-    // TODO detect collision. If there is one, update velocity
-    Vector3 p1 = body1.position, p2 = body2.position;
     real_t dist = distance(p1, p2);
-    if (body1.id == body2.id)
+
+    // Distance test, concentric spheres have no meaningful normal
+    if (dist >= r1 + r2 || dist == 0)
         return false;
 
+    *normal = (p1 - p2) / dist;
+    *depth = r1 + r2 - dist;
+    return true;
+}
+
+bool sphere_triangle_contact(const Vector3& p, real_t r, const StaticTriangle& tri, Vector3* normal, real_t* depth)
+{
     // Distance test
-    if (dist >= body1.radius + body2.radius)
+    real_t d = dot(p - tri.vertices[0], tri.normal);
+    if (fabs(d) > r)
+        return false;
+
+    // Inside test
+    if (tri.contains(p)) {
+        // Either side of the triangle is solid
+        *normal = d < 0 ? -tri.normal : tri.normal;
+        *depth = r - fabs(d);
+        return true;
+    }
+
+    // Otherwise the closest point is on an edge or a corner, as in
+    // sphere_triangle_toi. Without these, spheres fall through the creases
+    // between the triangles of a mesh.
+    real_t best = r * r;
+    Vector3 closest = p;
+    bool hit = false;
+    for (int i = 0; i < 3; i++) {
+        Vector3 m = p - tri.vertices[i];
+        real_t u = clamp(dot(m, tri.edges[i]) * tri.inv_edge_length2[i], real_t(0), real_t(1));
+        Vector3 q = tri.vertices[i] + tri.edges[i] * u;
+        real_t dist2 = squared_length(p - q);
+        if (dist2 < best) {
+            best = dist2;
+            closest = q;
+            hit = true;
+        }
+    }
+    // Centers on the edge have no meaningful normal
+    if (!hit || best == 0)
+        return false;
+    real_t dist = sqrt(best);
+    *normal = (p - closest) / dist;
+    *depth = r - dist;
+    return true;
+}
+
+bool sphere_plane_contact(const Vector3& p, real_t r, const PlaneBody& plane, Vector3* normal, real_t* depth)
+{
+    // Distance test
+    real_t d = dot(p - plane.position, plane.normal);
+    if (fabs(d) > r)
+        return false;
+
+    // Infinity plane, skip inside test
+    *normal = d < 0 ? -plane.normal : plane.normal;
+    *depth = r - fabs(d);
+    return true;
+}
+
+bool sphere_sphere_toi(const Vector3& p1, const Vector3& d1, real_t r1, const Vector3& p2, const Vector3& d2, real_t r2, real_t* t, Vector3* normal)
+{
+    // Relative motion of sphere 1 against a sphere of both radii
+    Vector3 p = p1 - p2;
+    Vector3 d = d1 - d2;
+    if (!ray_sphere_toi(p, d, r1 + r2, t))
+        return false;
+    *normal = normalize(p + d * *t);
+    return true;
+}
+
+bool sphere_triangle_toi(const Vector3& p, const Vector3& d, real_t r, const StaticTriangle& tri, real_t* t, Vector3* normal)
+{
+    const Vector3 *v = tri.vertices;
+    const Vector3 &n = tri.normal;
+
+    // Face: the center reaches distance r from the plane of the triangle
+    // and is above the triangle then
+    real_t s0 = dot(p - v[0], n);
+    real_t dn = dot(d, n);
+    real_t side = s0 < 0 ? -1 : 1;
+    if (fabs(s0) > r) {
+        // Edges and corners lie in the plane, they can't be hit either
+        if (side * dn >= 0)
+            return false;
+        real_t s = (fabs(s0) - r) / -(side * dn);
+        if (s > 1)
+            return false;
+        if (tri.contains(p + d * s)) {
+            *t = s;
+            *normal = side * n;
+            return true;
+        }
+    } else if (tri.contains(p)) {
+        // Touching the face already
+        if (side * dn >= 0)
+            return false;
+        *t = 0;
+        *normal = side * n;
+        return true;
+    }
+
+    // Otherwise the sphere can only hit an edge or a corner first
+    bool hit = false;
+    real_t s;
+    for (int i = 0; i < 3; i++) {
+        // Edge: infinite cylinder of radius r around it, then clamp
+        const Vector3 &e = tri.edges[i];
+        real_t inv_ee = tri.inv_edge_length2[i];
+        Vector3 m = p - v[i];
+        Vector3 mp = m - e * (dot(m, e) * inv_ee);
+        Vector3 dp = d - e * (dot(d, e) * inv_ee);
+        if (ray_sphere_toi(mp, dp, r, &s) && (!hit || s < *t)) {
+            real_t u = dot(m + d * s, e) * inv_ee;
+            if (u >= 0 && u <= 1) {
+                *t = s;
+                *normal = normalize(mp + dp * s);
+                hit = true;
+            }
+        }
+        // Corner
+        if (ray_sphere_toi(m, d, r, &s) && (!hit || s < *t)) {
+            *t = s;
+            *normal = normalize(m + d * s);
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+bool sphere_plane_toi(const Vector3& p, const Vector3& d, real_t r, const PlaneBody& plane, real_t* t, Vector3* normal)
+{
+    real_t s0 = dot(p - plane.position, plane.normal);
+    real_t dn = dot(d, plane.normal);
+    real_t side = s0 < 0 ? -1 : 1;
+    // Not moving closer
+    if (side * dn >= 0)
+        return false;
+    if (fabs(s0) <= r) {
+        *t = 0;
+        *normal = side * plane.normal;
+        return true;
+    }
+    real_t s = (fabs(s0) - r) / -(side * dn);
+    if (s > 1)
+        return false;
+    *t = s;
+    *normal = side * plane.normal;
+    return true;
+}
+
+bool collides(SphereBody& body1, SphereBody& body2, real_t collision_damping)
+{
+    // TODO detect collision. If there is one, update velocity
+    Vector3 direction;
+    real_t depth;
+    if (body1.id == body2.id)
+        return false;
+    if (!sphere_sphere_contact(body1.position, body1.radius, body2.position, body2.radius, &direction, &depth))
         return false;
 
     // Collided, update with Conservation of Momentum (m1 * v1_old + m2 * v2_old = m1 * v1_new + m2 * v2_new)
     real_t m1 = body1.mass;
     real_t m2 = body2.mass;
-    Vector3 direction = (p1 - p2) / dist;
     Vector3 v1_old = body1.velocity;
     Vector3 v2_old = body2.velocity;
+    // Already separating, e.g. still overlapping the step after a bounce.
+    // Resolving again would push them back together
+    if (dot(v1_old - v2_old, direction) >= 0)
+        return false;
     Vector3 v2_new = v2_old + (2 * (m1 / (m1 + m2)) * dot(v1_old - v2_old, direction) * direction);
     Vector3 v1_new = (m1 * v1_old + m2 * v2_old - m2 * v2_new) / m1;
     // Energy loss is simulated by velocity damping
@@ -33,22 +217,16 @@ bool collides(SphereBody& body1, SphereBody& body2, real_t collision_damping)
 bool collides(SphereBody& body1, TriangleBody& body2, real_t collision_damping)
 {
     // TODO detect collision. If there is one, update velocity
-    Vector3 p = body1.position;
-    Vector3 p1 = body2.vertices[0];
-    Vector3 p2 = body2.vertices[1];
-    Vector3 p3 = body2.vertices[2];
-    Vector3 normal = normalize(cross(p2 - p1, p3 - p1));
-
-    // Distance test
-    real_t d = dot(p - p1, normal);
-    if (abs(d) > body1.radius)
+    Vector3 normal;
+    real_t depth;
+    StaticTriangle tri;
+    if (!tri.init(body2.vertices[0], body2.vertices[1], body2.vertices[2]))
+        return false;
+    if (!sphere_triangle_contact(body1.position, body1.radius, tri, &normal, &depth))
         return false;
 
-    // Inside test
-    Vector3 w = cross(p1 - p, p2 - p);
-    Vector3 u = cross(p2 - p, p3 - p);
-    Vector3 v = cross(p3 - p, p1 - p);
-    if (dot(w, u) < 0 || dot(w, v) < 0 || dot(u, v) < 0)
+    // Moving away from the triangle already, don't pull it back in
+    if (dot(body1.velocity, normal) >= 0)
         return false;
 
     // Collided, update with Reflection Law
@@ -64,19 +242,17 @@ bool collides(SphereBody& body1, TriangleBody& body2, real_t collision_damping)
 bool collides(SphereBody& body1, PlaneBody& body2, real_t collision_damping)
 {
     // TODO detect collision. If there is one, update velocity
-    Vector3 p1 = body1.position;
-    Vector3 p2 = body2.position;
-    Vector3 normal = body2.normal;
-
-    // Distance test
-    real_t d = dot(p1 - p2, normal);
-    if (abs(d) > body1.radius)
+    Vector3 normal;
+    real_t depth;
+    if (!sphere_plane_contact(body1.position, body1.radius, body2, &normal, &depth))
         return false;
 
-    // Infinity plane, skip inside test
+    // Moving away from the plane already, don't pull it back in
+    if (dot(body1.velocity, normal) >= 0)
+        return false;
 
     // Collided, update with Reflection Law
-    body1.velocity = (body1.velocity - 2.0*dot(body1.velocity, body2.normal) * body2.normal);
+    body1.velocity = (body1.velocity - 2.0*dot(body1.velocity, normal) * normal);
     // Energy loss is simulated by velocity damping
     // And only on normal direction to support rolling on the plane
     // Use "body1.velocity = (1 - collision_damping) * body1.velocity" directly if you want to simulate friction too
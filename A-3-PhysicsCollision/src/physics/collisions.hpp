@@ -5,9 +5,34 @@
 #include "physics/spherebody.hpp"
 #include "physics/trianglebody.hpp"
 #include "physics/planebody.hpp"
+#include "physics/triangletree.hpp"
 
 namespace _462 {
 
+/*
+   Contact tests. If the sphere at p touches the other body, they return true
+   and store the unit contact normal, pointing towards the sphere, and the
+   penetration depth.
+ */
+bool sphere_sphere_contact( const Vector3& p1, real_t r1, const Vector3& p2, real_t r2, Vector3* normal, real_t* depth );
+bool sphere_triangle_contact( const Vector3& p, real_t r, const StaticTriangle& tri, Vector3* normal, real_t* depth );
+bool sphere_plane_contact( const Vector3& p, real_t r, const PlaneBody& plane, Vector3* normal, real_t* depth );
+
+/*
+   Time of impact queries. The sphere centers move from p to p + d over the
+   step. If the sphere hits the other body during the step, they return true
+   and store the fraction of the step at the first touch in [0, 1] and the
+   contact normal there, pointing towards the sphere. Bodies touching at the
+   start hit at 0 if they are approaching, and not at all otherwise.
+ */
+bool sphere_sphere_toi( const Vector3& p1, const Vector3& d1, real_t r1, const Vector3& p2, const Vector3& d2, real_t r2, real_t* t, Vector3* normal );
+bool sphere_triangle_toi( const Vector3& p, const Vector3& d, real_t r, const StaticTriangle& tri, real_t* t, Vector3* normal );
+bool sphere_plane_toi( const Vector3& p, const Vector3& d, real_t r, const PlaneBody& plane, real_t* t, Vector3* normal );
+
+/*
+   Contact tests and immediate response, changing the velocities of the
+   bodies if they touch and are approaching.
+ */
 bool collides( SphereBody& body1, SphereBody& body2, real_t collision_damping );
 bool collides( SphereBody& body1, TriangleBody& body2, real_t collision_damping );
 bool collides( SphereBody& body1, PlaneBody& body2, real_t collision_damping );
@@ -0,0 +1,352 @@
+/**
+ * @file contacts.cpp
+ * @brief Contact list and island based sequential impulse solver.
+ */
+
+#include "physics/contacts.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace _462 {
+
+// islands are grouped into tasks of at least this many contacts
+#define SOLVER_BATCH_CONTACTS 256
+
+static const unsigned int NO_ISLAND = ~0u;
+
+size_t ContactCache::warm_start( ContactList* contacts ) const
+{
+    size_t found = 0;
+    for ( size_t i = 0; i < contacts->size(); ++i ) {
+        Contact& c = ( *contacts )[i];
+        EntryMap::const_iterator entry = entries.find( c.key );
+        if ( entry == entries.end() ) {
+            c.impulse = 0.0;
+            c.friction_impulse = Vector3::Zero;
+        } else {
+            c.impulse = entry->second.impulse;
+            c.friction_impulse = entry->second.friction_impulse;
+            found++;
+        }
+    }
+    return found;
+}
+
+void ContactCache::store( const ContactList& contacts )
+{
+    entries.clear();
+    for ( size_t i = 0; i < contacts.size(); ++i ) {
+        const Contact& c = contacts[i];
+        Entry entry = { c.impulse, c.friction_impulse };
+        entries[c.key] = entry;
+    }
+}
+
+void ContactCache::clear()
+{
+    entries.clear();
+}
+
+// angular velocity of a body in world space
+static Vector3 world_spin( const SolverBodies& bodies, unsigned int i )
+{
+    Vector3 spin( bodies.angular_velocity[0][i], bodies.angular_velocity[1][i], bodies.angular_velocity[2][i] );
+    return bodies.orientation[i] * spin;
+}
+
+// adds a world space change of angular velocity to a body
+static void add_world_spin( const SolverBodies& bodies, unsigned int i, const Vector3& change )
+{
+    Vector3 local = conjugate( bodies.orientation[i] ) * change;
+    for ( int k = 0; k < 3; ++k ) {
+        bodies.angular_velocity[k][i] += local[k];
+    }
+}
+
+// velocity of body1 relative to body2 where they touch
+static Vector3 contact_velocity( const SolverBodies& bodies, const Contact& c )
+{
+    real_t* const* v = bodies.velocity;
+    unsigned int a = c.body1;
+    unsigned int b = c.body2;
+    Vector3 relative = Vector3( v[0][a], v[1][a], v[2][a] ) - cross( world_spin( bodies, a ), c.normal * bodies.radius[a] );
+    if ( b != CONTACT_STATIC ) {
+        relative -= Vector3( v[0][b], v[1][b], v[2][b] ) + cross( world_spin( bodies, b ), c.normal * bodies.radius[b] );
+    }
+    return relative;
+}
+
+// applies an impulse in the tangent plane to body1 and its opposite to body2
+static void apply_friction( const SolverBodies& bodies, const Contact& c, const Vector3& p )
+{
+    real_t* const* v = bodies.velocity;
+    unsigned int a = c.body1;
+    unsigned int b = c.body2;
+    for ( int k = 0; k < 3; ++k ) {
+        v[k][a] += p[k] * bodies.inv_mass[a];
+    }
+    // body1 is touched at -normal * radius, body2 at normal * radius
+    add_world_spin( bodies, a, cross( c.normal, p ) * ( -bodies.radius[a] * bodies.inv_inertia[a] ) );
+    if ( b != CONTACT_STATIC ) {
+        for ( int k = 0; k < 3; ++k ) {
+            v[k][b] -= p[k] * bodies.inv_mass[b];
+        }
+        add_world_spin( bodies, b, cross( c.normal, p ) * ( -bodies.radius[b] * bodies.inv_inertia[b] ) );
+    }
+}
+
+// applies an impulse along the normal to body1 and its opposite to body2
+static void apply_normal( const SolverBodies& bodies, const Contact& c, real_t lambda )
+{
+    real_t* const* v = bodies.velocity;
+    Vector3 p = c.normal * lambda;
+    for ( int k = 0; k < 3; ++k ) {
+        v[k][c.body1] += p[k] * bodies.inv_mass[c.body1];
+    }
+    if ( c.body2 != CONTACT_STATIC ) {
+        for ( int k = 0; k < 3; ++k ) {
+            v[k][c.body2] -= p[k] * bodies.inv_mass[c.body2];
+        }
+    }
+}
+
+ContactSolver::ContactSolver( size_t num_threads )
+    : pool( new ThreadPool( num_threads ) ), largest( 0 ), iterations( 0 ), most_iterations( 0 ), solve_contacts( 0 ) { }
+
+ContactSolver::~ContactSolver()
+{
+    delete pool;
+}
+
+void ContactSolver::set_num_threads( size_t num_threads )
+{
+    delete pool;
+    pool = new ThreadPool( num_threads );
+}
+
+size_t ContactSolver::get_num_threads() const
+{
+    return pool->num_threads();
+}
+
+unsigned int ContactSolver::find_root( unsigned int body )
+{
+    while ( parent[body] != body ) {
+        // path halving
+        parent[body] = parent[parent[body]];
+        body = parent[body];
+    }
+    return body;
+}
+
+void ContactSolver::build_islands( ContactList* contacts, size_t num_bodies )
+{
+    parent.resize( num_bodies );
+    for ( size_t i = 0; i < num_bodies; ++i ) {
+        parent[i] = unsigned( i );
+    }
+
+    // static bodies have infinite mass, they don't connect anything
+    for ( size_t i = 0; i < contacts->size(); ++i ) {
+        const Contact& c = ( *contacts )[i];
+        if ( c.body2 == CONTACT_STATIC )
+            continue;
+        unsigned int a = find_root( c.body1 );
+        unsigned int b = find_root( c.body2 );
+        // the smaller index wins so the forest only depends on the contacts
+        if ( a < b ) {
+            parent[b] = a;
+        } else if ( b < a ) {
+            parent[a] = b;
+        }
+    }
+
+    // number islands in order of their first contact and count contacts
+    island_of.assign( num_bodies, NO_ISLAND );
+    islands.clear();
+    for ( size_t i = 0; i < contacts->size(); ++i ) {
+        unsigned int root = find_root( ( *contacts )[i].body1 );
+        if ( island_of[root] == NO_ISLAND ) {
+            island_of[root] = unsigned( islands.size() );
+            Island island = { 0, 0, 0 };
+            islands.push_back( island );
+        }
+        islands[island_of[root]].count++;
+    }
+
+    largest = 0;
+    size_t first = 0;
+    for ( size_t i = 0; i < islands.size(); ++i ) {
+        islands[i].first = first;
+        first += islands[i].count;
+        largest = std::max( largest, islands[i].count );
+        // reused as the fill cursor below
+        islands[i].count = 0;
+    }
+
+    // stable bucket sort, each island keeps the generation order
+    sorted.resize( contacts->size() );
+    for ( size_t i = 0; i < contacts->size(); ++i ) {
+        const Contact& c = ( *contacts )[i];
+        Island& island = islands[island_of[find_root( c.body1 )]];
+        sorted[island.first + island.count++] = c;
+    }
+    contacts->swap( sorted );
+
+    batches.clear();
+    for ( size_t i = 0; i < islands.size(); ) {
+        Batch batch = { i, 0 };
+        size_t batch_contacts = 0;
+        while ( i < islands.size() && batch_contacts < SOLVER_BATCH_CONTACTS ) {
+            batch_contacts += islands[i].count;
+            batch.count++;
+            i++;
+        }
+        batches.push_back( batch );
+    }
+}
+
+void ContactSolver::solve_island( Island* island )
+{
+    Contact* contacts = solve_contacts + island->first;
+    const SolverBodies& bodies = solve_bodies;
+    real_t* const* v = bodies.velocity;
+    const real_t* inv_mass = bodies.inv_mass;
+    const SolverSettings& settings = solve_settings;
+
+    for ( size_t i = 0; i < island->count; ++i ) {
+        Contact& c = contacts[i];
+        unsigned int a = c.body1;
+        unsigned int b = c.body2;
+        Vector3 relative( v[0][a], v[1][a], v[2][a] );
+        real_t inv = inv_mass[a];
+        real_t tangent_inv = inv + bodies.radius[a] * bodies.radius[a] * bodies.inv_inertia[a];
+        if ( b != CONTACT_STATIC ) {
+            relative -= Vector3( v[0][b], v[1][b], v[2][b] );
+            inv += inv_mass[b];
+            tangent_inv += inv_mass[b] + bodies.radius[b] * bodies.radius[b] * bodies.inv_inertia[b];
+        }
+
+        real_t vn = dot( relative, c.normal );
+        c.normal_mass = inv > 0.0 ? 1.0 / inv : 0.0;
+        c.tangent_mass = tangent_inv > 0.0 ? 1.0 / tangent_inv : 0.0;
+        // bounce back if approaching, otherwise just stop closing in
+        c.target_velocity = vn < 0.0 ? -settings.restitution * vn : 0.0;
+    }
+
+    // Apply the impulses of the last step once all target velocities are
+    // known. The normal may have turned since, so the friction impulse is
+    // projected onto the new tangent plane and clamped again.
+    for ( size_t i = 0; i < island->count; ++i ) {
+        Contact& c = contacts[i];
+        if ( settings.friction > 0.0 ) {
+            Vector3 f = c.friction_impulse - c.normal * dot( c.friction_impulse, c.normal );
+            real_t limit = settings.friction * c.impulse;
+            real_t magnitude = length( f );
+            if ( magnitude > limit ) {
+                f *= limit / magnitude;
+            }
+            c.friction_impulse = f;
+            apply_friction( bodies, c, f );
+        } else {
+            c.friction_impulse = Vector3::Zero;
+        }
+        apply_normal( bodies, c, c.impulse );
+    }
+
+    int iter = 0;
+    while ( iter < settings.iterations ) {
+        iter++;
+        // largest change of a relative velocity in this pass
+        real_t change = 0.0;
+        for ( size_t i = 0; i < island->count; ++i ) {
+            Contact& c = contacts[i];
+
+            // friction first, limited by the normal impulse so far
+            if ( settings.friction > 0.0 && c.tangent_mass > 0.0 ) {
+                Vector3 relative = contact_velocity( bodies, c );
+                Vector3 slip = relative - c.normal * dot( relative, c.normal );
+                Vector3 f = c.friction_impulse - slip * c.tangent_mass;
+                real_t limit = settings.friction * c.impulse;
+                real_t magnitude = length( f );
+                if ( magnitude > limit ) {
+                    f *= limit / magnitude;
+                }
+                Vector3 p = f - c.friction_impulse;
+                c.friction_impulse = f;
+                apply_friction( bodies, c, p );
+                change = std::max( change, length( p ) / c.tangent_mass );
+            }
+
+            unsigned int a = c.body1;
+            unsigned int b = c.body2;
+            Vector3 relative( v[0][a], v[1][a], v[2][a] );
+            if ( b != CONTACT_STATIC ) {
+                relative -= Vector3( v[0][b], v[1][b], v[2][b] );
+            }
+
+            // contacts can only push, so clamp the accumulated impulse
+            real_t lambda = ( c.target_velocity - dot( relative, c.normal ) ) * c.normal_mass;
+            real_t impulse = std::max( c.impulse + lambda, real_t( 0.0 ) );
+            lambda = impulse - c.impulse;
+            c.impulse = impulse;
+            apply_normal( bodies, c, lambda );
+            if ( c.normal_mass > 0.0 ) {
+                change = std::max( change, std::fabs( lambda ) / c.normal_mass );
+            }
+        }
+        if ( change <= settings.tolerance )
+            break;
+    }
+    island->iterations = iter;
+
+    // Resolve penetration by moving the bodies rather than by a velocity
+    // bias, which would turn every deep contact into a kick of extra energy
+    real_t* const* x = bodies.position;
+    for ( size_t i = 0; i < island->count; ++i ) {
+        const Contact& c = contacts[i];
+        real_t push = settings.correction * std::max( c.depth - settings.allowed_depth, real_t( 0.0 ) ) * c.normal_mass;
+        if ( push <= 0.0 )
+            continue;
+
+        Vector3 p = c.normal * push;
+        for ( int k = 0; k < 3; ++k ) {
+            x[k][c.body1] += p[k] * inv_mass[c.body1];
+        }
+        if ( c.body2 != CONTACT_STATIC ) {
+            for ( int k = 0; k < 3; ++k ) {
+                x[k][c.body2] -= p[k] * inv_mass[c.body2];
+            }
+        }
+    }
+}
+
+void ContactSolver::solve_batch( void* data, size_t index )
+{
+    ContactSolver* solver = static_cast< ContactSolver* >( data );
+    const Batch& batch = solver->batches[index];
+    for ( size_t i = 0; i < batch.count; ++i ) {
+        solver->solve_island( &solver->islands[batch.first + i] );
+    }
+}
+
+void ContactSolver::solve( ContactList* contacts, const SolverBodies& bodies, const SolverSettings& settings )
+{
+    build_islands( contacts, bodies.count );
+    iterations = 0;
+    most_iterations = 0;
+    if ( contacts->empty() )
+        return;
+
+    solve_contacts = &( *contacts )[0];
+    solve_bodies = bodies;
+    solve_settings = settings;
+    pool->parallel_for( batches.size(), solve_batch, this );
+
+    for ( size_t i = 0; i < islands.size(); ++i ) {
+        iterations += islands[i].iterations;
+        most_iterations = std::max( most_iterations, islands[i].iterations );
+    }
+}
+
+} /* _462 */
@@ -0,0 +1,223 @@
+/**
+ * @file contacts.hpp
+ * @brief Contact list and island based sequential impulse solver.
+ *
+ * Collision response is split in two: contact generation fills a
+ * ContactList, then ContactSolver resolves all contacts together. Bodies
+ * connected by contacts form an island, and islands share no bodies, so
+ * they are solved concurrently. The contacts of one island are always
+ * solved in generation order, so results do not depend on the number of
+ * threads.
+ *
+ * Contacts carry a key naming the pair of bodies, and ContactCache keeps
+ * the impulses they accumulated from one step to the next. A contact that
+ * persists starts the solve with last step's impulses already applied, so
+ * resting contacts converge in a pass or two and the solver stops early.
+ */
+
+#ifndef _462_PHYSICS_CONTACTS_HPP_
+#define _462_PHYSICS_CONTACTS_HPP_
+
+#include "math/vector.hpp"
+#include "math/quaternion.hpp"
+#include "application/threadpool.hpp"
+#include <vector>
+#include <unordered_map>
+
+namespace _462 {
+
+// body2 of a contact against a static body (plane or triangle)
+#define CONTACT_STATIC ( ~0u )
+
+/**
+ * A touching pair of bodies.
+ */
+struct Contact
+{
+    // identifies the pair of bodies across steps, see ContactCache
+    unsigned long long key;
+    // index of the first (dynamic) body
+    unsigned int body1;
+    // index of the second body, or CONTACT_STATIC
+    unsigned int body2;
+    // unit normal pointing from body2 towards body1
+    Vector3 normal;
+    // penetration depth
+    real_t depth;
+
+    // solver state
+    // relative normal velocity the solver drives the contact towards
+    real_t target_velocity;
+    // 1 / (inverse mass of body1 + inverse mass of body2)
+    real_t normal_mass;
+    // the same for impulses in the tangent plane, which also spin the bodies
+    real_t tangent_mass;
+    // total impulse applied along the normal, never negative. Holds the
+    // impulse of the last step going into the solve if the contact persisted.
+    real_t impulse;
+    // total friction impulse on body1, in the tangent plane
+    Vector3 friction_impulse;
+};
+
+typedef std::vector< Contact > ContactList;
+
+/**
+ * Impulses of the contacts of the last step, by contact key. Keys must
+ * name the same pair of bodies from step to step, with the same body as
+ * body1, or the cache must be cleared.
+ */
+class ContactCache
+{
+public:
+
+    /**
+     * Sets the impulses of every contact to those it had in the last
+     * step, and to zero for new contacts. Returns the number of contacts
+     * found in the cache.
+     */
+    size_t warm_start( ContactList* contacts ) const;
+    /**
+     * Replaces the cached impulses with those of the given contacts, so
+     * pairs that stopped touching are dropped.
+     */
+    void store( const ContactList& contacts );
+    void clear();
+    size_t size() const { return entries.size(); }
+
+private:
+
+    struct Entry
+    {
+        real_t impulse;
+        Vector3 friction_impulse;
+    };
+
+    typedef std::unordered_map< unsigned long long, Entry > EntryMap;
+    EntryMap entries;
+};
+
+/**
+ * Positions, velocities and mass properties of the bodies the contacts
+ * refer to, as separate arrays indexed by body.
+ */
+struct SolverBodies
+{
+    real_t* position[3];
+    real_t* velocity[3];
+    // in the body frame
+    real_t* angular_velocity[3];
+    const Quaternion* orientation;
+    const real_t* inv_mass;
+    const real_t* inv_inertia;
+    const real_t* radius;
+    size_t count;
+};
+
+/**
+ * Tuning of ContactSolver.
+ */
+struct SolverSettings
+{
+    // fraction of the approach speed kept after a collision
+    real_t restitution;
+    // Coulomb friction coefficient, 0 for frictionless contacts
+    real_t friction;
+    // most passes over the contacts of an island
+    int iterations;
+    // an island is solved once no pass changes a relative velocity by more
+    // than this
+    real_t tolerance;
+    // fraction of the penetration removed per step by moving bodies apart
+    real_t correction;
+    // penetration left alone, so resting contacts don't jitter
+    real_t allowed_depth;
+};
+
+class ContactSolver
+{
+public:
+
+    /**
+     * @param num_threads Threads solving islands, 0 for one per hardware
+     *  thread.
+     */
+    explicit ContactSolver( size_t num_threads = 0 );
+    ~ContactSolver();
+
+    /**
+     * Changes the number of solver threads.
+     */
+    void set_num_threads( size_t num_threads );
+    size_t get_num_threads() const;
+
+    /**
+     * Applies contact impulses to the body velocities, then moves
+     * penetrating bodies apart. Starts from the impulses the contacts
+     * hold, which is how they are warm started. The order of contacts in
+     * the list may change.
+     */
+    void solve( ContactList* contacts, const SolverBodies& bodies, const SolverSettings& settings );
+
+    // islands found by the last solve, and the most contacts in any of them
+    size_t num_islands() const { return islands.size(); }
+    size_t largest_island() const { return largest; }
+    // passes over the contacts in the last solve, summed over all islands,
+    // and the most any island took
+    size_t total_iterations() const { return iterations; }
+    int max_iterations() const { return most_iterations; }
+
+    /**
+     * Returns the body representing the island of the given body in the
+     * last solve. Bodies without contacts are their own island.
+     */
+    unsigned int island_root( unsigned int body ) { return find_root( body ); }
+
+private:
+
+    struct Island
+    {
+        // range in the sorted contact list
+        size_t first;
+        size_t count;
+        // passes the solve took
+        int iterations;
+    };
+
+    struct Batch
+    {
+        // range of islands solved by one task
+        size_t first;
+        size_t count;
+    };
+
+    unsigned int find_root( unsigned int body );
+    void build_islands( ContactList* contacts, size_t num_bodies );
+    void solve_island( Island* island );
+    static void solve_batch( void* data, size_t index );
+
+    ThreadPool* pool;
+
+    // union-find forest over the bodies
+    std::vector< unsigned int > parent;
+    // island of every root body
+    std::vector< unsigned int > island_of;
+    std::vector< Island > islands;
+    std::vector< Batch > batches;
+    ContactList sorted;
+    size_t largest;
+    size_t iterations;
+    int most_iterations;
+
+    // arguments of the solve in progress, read by the tasks
+    Contact* solve_contacts;
+    SolverBodies solve_bodies;
+    SolverSettings solve_settings;
+
+    // no meaningful assignment or copy
+    ContactSolver( const ContactSolver& );
+    ContactSolver& operator=( const ContactSolver& );
+};
+
+} /* _462 */
+
+#endif /* _462_PHYSICS_CONTACTS_HPP_ */
@@ -0,0 +1,47 @@
+#include "physics/convexbody.hpp"
+
+namespace _462 {
+
+ConvexBody::ConvexBody()
+{
+    orientation = Quaternion::Identity;
+    velocity = Vector3::Zero;
+    angular_velocity = Vector3::Zero;
+    shape = CONVEX_BOX;
+    half_extents = Vector3( 0.5, 0.5, 0.5 );
+    half_height = 0.5;
+    radius = 0.5;
+    type = 400;
+}
+
+Vector3 ConvexBody::step_position( real_t /*dt*/, real_t /*motion_damping*/ )
+{
+    return Vector3::Zero;
+}
+
+Vector3 ConvexBody::step_orientation( real_t /*dt*/, real_t /*motion_damping*/ )
+{
+    return Vector3::Zero;
+}
+
+void ConvexBody::apply_force( const Vector3& /*f*/, const Vector3& /*offset*/ )
+{
+    return;
+}
+
+ConvexShape ConvexBody::get_shape() const
+{
+    ConvexShape s;
+    s.type = shape;
+    s.position = position;
+    s.orientation = orientation;
+    if ( shape == CONVEX_CAPSULE ) {
+        s.half_height = half_height;
+        s.radius = radius;
+    } else {
+        s.half_extents = half_extents;
+    }
+    return s;
+}
+
+}
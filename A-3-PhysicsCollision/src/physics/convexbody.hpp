@@ -0,0 +1,40 @@
+#ifndef _462_PHYSICS_CONVEXBODY_HPP_
+#define _462_PHYSICS_CONVEXBODY_HPP_
+
+#include "physics/body.hpp"
+#include "physics/gjk.hpp"
+#include "math/vector.hpp"
+#include "math/quaternion.hpp"
+
+namespace _462 {
+
+/**
+ * A static box or capsule, placed by its position and orientation. Spheres
+ * collide with it through GJK.
+ */
+class ConvexBody : public Body
+{
+public:
+    ConvexBody();
+    virtual ~ConvexBody() { }
+    virtual Vector3 step_position( real_t dt, real_t motion_damping );
+    virtual Vector3 step_orientation( real_t dt, real_t motion_damping );
+    virtual void apply_force( const Vector3& f, const Vector3& offset );
+
+    // the shape placed at the body
+    ConvexShape get_shape() const;
+
+    // CONVEX_BOX or CONVEX_CAPSULE
+    ConvexType shape;
+    // box: half the size along each local axis
+    Vector3 half_extents;
+    // capsule: half the distance between the centers of the caps, along the
+    // local y axis, and the radius
+    real_t half_height;
+    real_t radius;
+};
+
+}
+
+#endif
+
@@ -0,0 +1,624 @@
+/**
+ * @file gjk.cpp
+ * @brief Convex shapes and GJK/EPA distance, penetration and time of impact
+ *  queries between them.
+ */
+
+#include "physics/gjk.hpp"
+#include "math/math.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace _462 {
+
+// most GJK iterations, only reached by degenerate input
+#define GJK_MAX_ITERATIONS 64
+// GJK stops once a new support point gets the squared distance less than
+// this fraction closer
+#define GJK_RELATIVE_TOLERANCE 1e-6
+// squared distance between the cores below which they overlap
+#define GJK_OVERLAP_TOLERANCE 1e-12
+// limits of the polytope EPA grows
+#define EPA_MAX_VERTICES 64
+#define EPA_MAX_FACES 128
+#define EPA_MAX_EDGES 96
+// EPA stops once a new support point is less than this fraction farther
+// out than the closest face
+#define EPA_RELATIVE_TOLERANCE 1e-6
+// most conservative advancement steps of a time of impact query
+#define TOI_MAX_ITERATIONS 32
+// gap, as a fraction of the radii, at which the shapes count as touching
+#define TOI_TOLERANCE 1e-3
+
+ConvexShape::ConvexShape()
+    : type( CONVEX_POINT ), position( Vector3::Zero ), orientation( Quaternion::Identity ),
+      half_extents( Vector3::Zero ), half_height( 0.0 ), radius( 0.0 ), vertices( 0 ), num_vertices( 0 ) { }
+
+Vector3 ConvexShape::support( const Vector3& direction ) const
+{
+    if ( type == CONVEX_POINT )
+        return position;
+
+    Vector3 d = conjugate( orientation ) * direction;
+    Vector3 local = Vector3::Zero;
+    switch ( type ) {
+    case CONVEX_BOX:
+        local = Vector3( d.x < 0.0 ? -half_extents.x : half_extents.x,
+                         d.y < 0.0 ? -half_extents.y : half_extents.y,
+                         d.z < 0.0 ? -half_extents.z : half_extents.z );
+        break;
+    case CONVEX_CAPSULE:
+        local.y = d.y < 0.0 ? -half_height : half_height;
+        break;
+    case CONVEX_HULL:
+    default:
+        if ( num_vertices > 0 ) {
+            // the farthest vertex of the cloud is a vertex of its hull
+            size_t best = 0;
+            real_t best_dot = dot( vertices[0], d );
+            for ( size_t i = 1; i < num_vertices; ++i ) {
+                real_t vd = dot( vertices[i], d );
+                if ( vd > best_dot ) {
+                    best_dot = vd;
+                    best = i;
+                }
+            }
+            local = vertices[best];
+        }
+        break;
+    }
+    return position + orientation * local;
+}
+
+AABB ConvexShape::bounds() const
+{
+    Vector3 extent = Vector3::Zero;
+    Vector3 center = position;
+    switch ( type ) {
+    case CONVEX_BOX: {
+        Vector3 axes[3];
+        orientation.to_axes( axes );
+        extent = vabs( axes[0] ) * half_extents.x + vabs( axes[1] ) * half_extents.y + vabs( axes[2] ) * half_extents.z;
+        break;
+    }
+    case CONVEX_CAPSULE:
+        extent = vabs( orientation * Vector3( 0.0, half_height, 0.0 ) );
+        break;
+    case CONVEX_HULL:
+        if ( num_vertices > 0 ) {
+            Vector3 lo = orientation * vertices[0];
+            Vector3 hi = lo;
+            for ( size_t i = 1; i < num_vertices; ++i ) {
+                Vector3 p = orientation * vertices[i];
+                lo = vmin( lo, p );
+                hi = vmax( hi, p );
+            }
+            center = position + ( lo + hi ) * 0.5;
+            extent = ( hi - lo ) * 0.5;
+        }
+        break;
+    case CONVEX_POINT:
+    default:
+        break;
+    }
+    extent += Vector3( radius, radius, radius );
+    AABB box;
+    box.min = center - extent;
+    box.max = center + extent;
+    return box;
+}
+
+ConvexShape convex_sphere( const Vector3& center, real_t radius )
+{
+    ConvexShape shape;
+    shape.type = CONVEX_POINT;
+    shape.position = center;
+    shape.radius = radius;
+    return shape;
+}
+
+// a vertex of a GJK simplex: a point of the Minkowski difference a - b of
+// the cores, with the points of a and b it came from
+struct SimplexVertex
+{
+    Vector3 w;
+    Vector3 a;
+    Vector3 b;
+};
+
+struct Simplex
+{
+    SimplexVertex points[4];
+    int count;
+};
+
+static SimplexVertex support( const ConvexShape& a, const ConvexShape& b, const Vector3& d )
+{
+    SimplexVertex v;
+    v.a = a.support( d );
+    v.b = b.support( -d );
+    v.w = v.a - v.b;
+    return v;
+}
+
+// Closest point to the origin on a segment or triangle of the simplex.
+// These reduce the simplex to the vertices of the feature holding it.
+static Vector3 closest_segment( Simplex* s )
+{
+    Vector3 a = s->points[0].w;
+    Vector3 ab = s->points[1].w - a;
+    real_t length2 = squared_length( ab );
+    real_t t = length2 > 0.0 ? -dot( a, ab ) / length2 : 0.0;
+    if ( t <= 0.0 ) {
+        s->count = 1;
+        return a;
+    }
+    if ( t >= 1.0 ) {
+        s->points[0] = s->points[1];
+        s->count = 1;
+        return s->points[0].w;
+    }
+    return a + ab * t;
+}
+
+static Vector3 closest_triangle( Simplex* s )
+{
+    // Ericson, Real-Time Collision Detection 5.1.5, with the origin as the
+    // query point
+    Vector3 a = s->points[0].w;
+    Vector3 b = s->points[1].w;
+    Vector3 c = s->points[2].w;
+    Vector3 ab = b - a;
+    Vector3 ac = c - a;
+
+    real_t d1 = -dot( ab, a );
+    real_t d2 = -dot( ac, a );
+    if ( d1 <= 0.0 && d2 <= 0.0 ) {
+        s->count = 1;
+        return a;
+    }
+
+    real_t d3 = -dot( ab, b );
+    real_t d4 = -dot( ac, b );
+    if ( d3 >= 0.0 && d4 <= d3 ) {
+        s->points[0] = s->points[1];
+        s->count = 1;
+        return b;
+    }
+
+    real_t vc = d1 * d4 - d3 * d2;
+    if ( vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0 ) {
+        s->count = 2;
+        return a + ab * ( d1 / ( d1 - d3 ) );
+    }
+
+    real_t d5 = -dot( ab, c );
+    real_t d6 = -dot( ac, c );
+    if ( d6 >= 0.0 && d5 <= d6 ) {
+        s->points[0] = s->points[2];
+        s->count = 1;
+        return c;
+    }
+
+    real_t vb = d5 * d2 - d1 * d6;
+    if ( vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0 ) {
+        s->points[1] = s->points[2];
+        s->count = 2;
+        return a + ac * ( d2 / ( d2 - d6 ) );
+    }
+
+    real_t va = d3 * d6 - d5 * d4;
+    if ( va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0 ) {
+        s->points[0] = s->points[2];
+        s->count = 2;
+        return b + ( c - b ) * ( ( d4 - d3 ) / ( ( d4 - d3 ) + ( d5 - d6 ) ) );
+    }
+
+    real_t sum = va + vb + vc;
+    if ( sum <= 0.0 ) {
+        // degenerate triangle, the closest edge will do
+        s->count = 2;
+        return closest_segment( s );
+    }
+    return a + ab * ( vb / sum ) + ac * ( vc / sum );
+}
+
+// Closest point to the origin on the tetrahedron of the simplex. Returns
+// zero without reducing if the origin is inside.
+static Vector3 closest_tetrahedron( Simplex* s )
+{
+    static const int Faces[4][4] = {
+        // three vertices of a face, then the one opposite
+        { 0, 1, 2, 3 }, { 0, 2, 3, 1 }, { 0, 3, 1, 2 }, { 1, 3, 2, 0 }
+    };
+
+    const SimplexVertex* p = s->points;
+    Vector3 e1 = p[1].w - p[0].w;
+    Vector3 e2 = p[2].w - p[0].w;
+    Vector3 e3 = p[3].w - p[0].w;
+    real_t volume = dot( e1, cross( e2, e3 ) );
+    real_t scale = squared_length( e1 ) + squared_length( e2 ) + squared_length( e3 );
+    bool flat = std::fabs( volume ) <= 1e-9 * scale * std::sqrt( scale );
+
+    bool inside = true;
+    real_t best2 = 0.0;
+    Simplex best;
+    best.count = 0;
+    Vector3 closest = Vector3::Zero;
+    for ( int f = 0; f < 4; ++f ) {
+        const Vector3& a = p[Faces[f][0]].w;
+        Vector3 n = cross( p[Faces[f][1]].w - a, p[Faces[f][2]].w - a );
+        // outside if the origin and the opposite vertex are on different
+        // sides. Every face of a flat tetrahedron is a candidate.
+        if ( !flat && -dot( a, n ) * dot( p[Faces[f][3]].w - a, n ) >= 0.0 )
+            continue;
+        inside = false;
+
+        Simplex face;
+        face.points[0] = p[Faces[f][0]];
+        face.points[1] = p[Faces[f][1]];
+        face.points[2] = p[Faces[f][2]];
+        face.count = 3;
+        Vector3 q = closest_triangle( &face );
+        real_t q2 = squared_length( q );
+        if ( best.count == 0 || q2 < best2 ) {
+            best = face;
+            best2 = q2;
+            closest = q;
+        }
+    }
+    if ( inside )
+        return Vector3::Zero;
+    *s = best;
+    return closest;
+}
+
+// closest point to the origin on the simplex, which gets reduced to the
+// feature holding it. Returns false if the origin is inside.
+static bool closest_point( Simplex* s, Vector3* closest )
+{
+    switch ( s->count ) {
+    case 1:
+        *closest = s->points[0].w;
+        return true;
+    case 2:
+        *closest = closest_segment( s );
+        return true;
+    case 3:
+        *closest = closest_triangle( s );
+        return true;
+    default:
+        *closest = closest_tetrahedron( s );
+        return s->count < 4;
+    }
+}
+
+/**
+ * Runs GJK on the cores of a and b, starting from the simplex in the
+ * cache. Returns the squared distance between them, and the closest point
+ * of a - b to the origin in v. If the cores overlap, returns 0 and leaves a
+ * simplex containing the origin for EPA.
+ */
+static real_t gjk( const ConvexShape& a, const ConvexShape& b, ConvexCache* cache, Vector3* v, Simplex* simplex, int* iterations )
+{
+    Vector3 closest;
+    bool overlap = false;
+    int iter = 0;
+    if ( cache->count > 0 ) {
+        // the same features as last time, where the shapes are now
+        simplex->count = cache->count;
+        for ( int i = 0; i < cache->count; ++i ) {
+            SimplexVertex& p = simplex->points[i];
+            p.a = a.position + a.orientation * cache->local_a[i];
+            p.b = b.position + b.orientation * cache->local_b[i];
+            p.w = p.a - p.b;
+        }
+        overlap = !closest_point( simplex, &closest );
+    } else {
+        Vector3 axis = a.position - b.position;
+        if ( squared_length( axis ) == 0.0 )
+            axis = Vector3::UnitX;
+        simplex->points[0] = support( a, b, -axis );
+        simplex->count = 1;
+        closest = simplex->points[0].w;
+        iter = 1;
+    }
+
+    real_t dist2 = overlap ? 0.0 : squared_length( closest );
+    while ( iter < GJK_MAX_ITERATIONS && dist2 > GJK_OVERLAP_TOLERANCE ) {
+        SimplexVertex w = support( a, b, -closest );
+        iter++;
+        // converged when w gets no closer along the closest point
+        if ( dist2 - dot( closest, w.w ) <= GJK_RELATIVE_TOLERANCE * dist2 )
+            break;
+        bool duplicate = false;
+        for ( int i = 0; i < simplex->count; ++i ) {
+            duplicate = duplicate || simplex->points[i].w == w.w;
+        }
+        if ( duplicate )
+            break;
+
+        Simplex next = *simplex;
+        next.points[next.count++] = w;
+        Vector3 q;
+        if ( !closest_point( &next, &q ) ) {
+            *simplex = next;
+            dist2 = 0.0;
+            break;
+        }
+        // rounding can keep it from getting closer, then the last is as
+        // good as it gets
+        real_t q2 = squared_length( q );
+        if ( q2 >= dist2 )
+            break;
+        *simplex = next;
+        closest = q;
+        dist2 = q2;
+    }
+
+    cache->count = simplex->count;
+    for ( int i = 0; i < simplex->count; ++i ) {
+        const SimplexVertex& p = simplex->points[i];
+        cache->local_a[i] = conjugate( a.orientation ) * ( p.a - a.position );
+        cache->local_b[i] = conjugate( b.orientation ) * ( p.b - b.position );
+    }
+
+    if ( iterations )
+        *iterations = iter;
+    *v = closest;
+    return dist2 <= GJK_OVERLAP_TOLERANCE ? 0.0 : dist2;
+}
+
+// a face of the EPA polytope, with its outward unit normal and distance
+// from the origin
+struct EpaFace
+{
+    int vertices[3];
+    Vector3 normal;
+    real_t distance;
+};
+
+struct EpaEdge
+{
+    int from, to;
+};
+
+static bool make_face( const Vector3* points, int i, int j, int k, EpaFace* face )
+{
+    Vector3 n = cross( points[j] - points[i], points[k] - points[i] );
+    real_t len = length( n );
+    if ( len <= 0.0 )
+        return false;
+    face->vertices[0] = i;
+    face->vertices[1] = j;
+    face->vertices[2] = k;
+    face->normal = n / len;
+    face->distance = dot( face->normal, points[i] );
+    return true;
+}
+
+// Grows the simplex GJK ended on, which contains or touches the origin,
+// into a tetrahedron. Fails if a - b is flat.
+static bool grow_simplex( const ConvexShape& a, const ConvexShape& b, Simplex* s )
+{
+    const Vector3 axes[6] = {
+        Vector3::UnitX, -Vector3::UnitX, Vector3::UnitY, -Vector3::UnitY, Vector3::UnitZ, -Vector3::UnitZ
+    };
+    const real_t epsilon = 1e-12;
+
+    if ( s->count == 1 ) {
+        for ( int i = 0; i < 6 && s->count == 1; ++i ) {
+            SimplexVertex w = support( a, b, axes[i] );
+            if ( squared_distance( w.w, s->points[0].w ) > epsilon )
+                s->points[s->count++] = w;
+        }
+    }
+    if ( s->count == 2 ) {
+        // turn around the segment until a point off its line turns up
+        Vector3 d = normalize( s->points[1].w - s->points[0].w );
+        Vector3 e = std::fabs( d.x ) < std::fabs( d.y ) ? ( std::fabs( d.x ) < std::fabs( d.z ) ? Vector3::UnitX : Vector3::UnitZ )
+                                                        : ( std::fabs( d.y ) < std::fabs( d.z ) ? Vector3::UnitY : Vector3::UnitZ );
+        Vector3 n = normalize( cross( d, e ) );
+        Quaternion turn( d, PI / 3.0 );
+        for ( int i = 0; i < 6 && s->count == 2; ++i ) {
+            SimplexVertex w = support( a, b, n );
+            if ( squared_length( cross( w.w - s->points[0].w, d ) ) > epsilon )
+                s->points[s->count++] = w;
+            n = turn * n;
+        }
+    }
+    if ( s->count == 3 ) {
+        Vector3 n = cross( s->points[1].w - s->points[0].w, s->points[2].w - s->points[0].w );
+        real_t len = length( n );
+        if ( len <= 0.0 )
+            return false;
+        n /= len;
+        SimplexVertex w = support( a, b, n );
+        if ( std::fabs( dot( w.w - s->points[0].w, n ) ) <= 1e-9 )
+            w = support( a, b, -n );
+        if ( std::fabs( dot( w.w - s->points[0].w, n ) ) <= 1e-9 )
+            return false;
+        s->points[s->count++] = w;
+    }
+    return s->count == 4;
+}
+
+/**
+ * Finds the penetration of the overlapping cores of a and b by expanding
+ * the polytope of the GJK simplex towards the boundary of a - b. Stores
+ * the unit normal of the closest boundary face of a - b and its distance
+ * from the origin; moving a by -normal * depth separates the cores.
+ */
+static bool epa( const ConvexShape& a, const ConvexShape& b, Simplex simplex, Vector3* normal, real_t* depth )
+{
+    if ( !grow_simplex( a, b, &simplex ) )
+        return false;
+
+    Vector3 points[EPA_MAX_VERTICES];
+    EpaFace faces[EPA_MAX_FACES];
+    EpaEdge edges[EPA_MAX_EDGES];
+    int num_points = 4;
+    int num_faces = 0;
+    for ( int i = 0; i < 4; ++i ) {
+        points[i] = simplex.points[i].w;
+    }
+
+    // wind the faces of the tetrahedron so their normals point outwards
+    static const int Faces[4][4] = {
+        { 0, 1, 2, 3 }, { 0, 3, 1, 2 }, { 0, 2, 3, 1 }, { 1, 3, 2, 0 }
+    };
+    for ( int f = 0; f < 4; ++f ) {
+        int i = Faces[f][0], j = Faces[f][1], k = Faces[f][2];
+        if ( dot( cross( points[j] - points[i], points[k] - points[i] ), points[Faces[f][3]] - points[i] ) > 0.0 )
+            std::swap( j, k );
+        if ( !make_face( points, i, j, k, &faces[num_faces] ) )
+            return false;
+        num_faces++;
+    }
+
+    // the closest face so far, kept apart since growing removes faces
+    Vector3 best_normal;
+    real_t best_distance = 0.0;
+    while ( true ) {
+        int closest = 0;
+        for ( int f = 1; f < num_faces; ++f ) {
+            if ( faces[f].distance < faces[closest].distance )
+                closest = f;
+        }
+        best_normal = faces[closest].normal;
+        best_distance = faces[closest].distance;
+        Vector3 w = support( a, b, best_normal ).w;
+        real_t dw = dot( w, best_normal );
+        if ( dw - best_distance <= EPA_RELATIVE_TOLERANCE * std::max( dw, real_t( 1e-9 ) ) ||
+             num_points == EPA_MAX_VERTICES )
+            break;
+        int p = num_points++;
+        points[p] = w;
+
+        // remove the faces w sees, keeping the edges on their horizon
+        int num_edges = 0;
+        bool overflow = false;
+        for ( int f = 0; f < num_faces && !overflow; ) {
+            if ( dot( faces[f].normal, w - points[faces[f].vertices[0]] ) <= 0.0 ) {
+                f++;
+                continue;
+            }
+            for ( int e = 0; e < 3; ++e ) {
+                EpaEdge edge = { faces[f].vertices[e], faces[f].vertices[( e + 1 ) % 3] };
+                // an edge shared with another removed face is inside
+                int shared = -1;
+                for ( int k = 0; k < num_edges; ++k ) {
+                    if ( edges[k].from == edge.to && edges[k].to == edge.from )
+                        shared = k;
+                }
+                if ( shared >= 0 ) {
+                    edges[shared] = edges[--num_edges];
+                } else if ( num_edges < EPA_MAX_EDGES ) {
+                    edges[num_edges++] = edge;
+                } else {
+                    overflow = true;
+                }
+            }
+            faces[f] = faces[--num_faces];
+        }
+        if ( overflow || num_faces + num_edges > EPA_MAX_FACES )
+            break;
+
+        for ( int e = 0; e < num_edges; ++e ) {
+            if ( make_face( points, edges[e].from, edges[e].to, p, &faces[num_faces] ) )
+                num_faces++;
+        }
+        if ( num_faces == 0 )
+            break;
+    }
+
+    *normal = best_normal;
+    *depth = std::max( best_distance, real_t( 0.0 ) );
+    return true;
+}
+
+// contact normal of overlapping cores, pointing from b towards a
+static Vector3 overlap_normal( const ConvexShape& a, const ConvexShape& b, const Simplex& simplex, real_t* depth )
+{
+    Vector3 n;
+    if ( epa( a, b, simplex, &n, depth ) )
+        return -n;
+    // a - b is flat, e.g. a point on a segment, so it has no inside. The
+    // centers at least say which way to go.
+    *depth = 0.0;
+    n = a.position - b.position;
+    return squared_length( n ) > 0.0 ? normalize( n ) : Vector3::UnitY;
+}
+
+bool convex_contact( const ConvexShape& a, const ConvexShape& b, ConvexCache* cache,
+                     Vector3* normal, real_t* depth, int* iterations )
+{
+    Simplex simplex;
+    Vector3 v;
+    real_t dist2 = gjk( a, b, cache, &v, &simplex, iterations );
+    real_t margin = a.radius + b.radius;
+
+    if ( dist2 > 0.0 ) {
+        real_t dist = std::sqrt( dist2 );
+        if ( dist > margin )
+            return false;
+        *normal = v / dist;
+        *depth = margin - dist;
+        return true;
+    }
+
+    real_t core_depth;
+    *normal = overlap_normal( a, b, simplex, &core_depth );
+    *depth = core_depth + margin;
+    return true;
+}
+
+bool convex_toi( const ConvexShape& a, const Vector3& d, const ConvexShape& b, ConvexCache* cache,
+                 real_t* t, Vector3* normal )
+{
+    real_t margin = a.radius + b.radius;
+    real_t tolerance = TOI_TOLERANCE * margin;
+    ConvexShape moved = a;
+    real_t time = 0.0;
+
+    for ( int iter = 0; iter < TOI_MAX_ITERATIONS; ++iter ) {
+        moved.position = a.position + d * time;
+        Simplex simplex;
+        Vector3 v;
+        real_t dist2 = gjk( moved, b, cache, &v, &simplex, 0 );
+
+        Vector3 n;
+        real_t gap;
+        if ( dist2 > 0.0 ) {
+            real_t dist = std::sqrt( dist2 );
+            n = v / dist;
+            gap = dist - margin;
+        } else {
+            real_t core_depth;
+            n = overlap_normal( moved, b, simplex, &core_depth );
+            gap = -core_depth - margin;
+        }
+
+        // touching: a hit unless it only happens at the start and a is
+        // already moving away
+        if ( gap <= tolerance ) {
+            if ( time == 0.0 && dot( d, n ) >= 0.0 )
+                return false;
+            *t = time;
+            *normal = n;
+            return true;
+        }
+
+        // b lies behind the plane through its closest point, so a can move
+        // at least until it reaches that plane
+        real_t approach = -dot( d, n );
+        if ( approach <= 0.0 )
+            return false;
+        time += gap / approach;
+        if ( time > 1.0 )
+            return false;
+    }
+    return false;
+}
+
+} /* _462 */
@@ -0,0 +1,106 @@
+/**
+ * @file gjk.hpp
+ * @brief Convex shapes and GJK/EPA distance, penetration and time of impact
+ *  queries between them.
+ *
+ * A convex shape is a core given by its support mapping (a point, a box, a
+ * segment or the hull of a point cloud) grown by a radius, so spheres and
+ * capsules are points and segments with a radius. GJK finds the distance
+ * between the cores; only when the cores themselves overlap does EPA search
+ * the penetration depth.
+ *
+ * GJK converges from wherever it starts, so every query of a pair starts
+ * from the simplex the last query of the pair ended on. For bodies that
+ * moved little since, its features are still the closest ones and GJK
+ * stops after a single iteration.
+ */
+
+#ifndef _462_PHYSICS_GJK_HPP_
+#define _462_PHYSICS_GJK_HPP_
+
+#include "math/vector.hpp"
+#include "math/quaternion.hpp"
+#include "physics/broadphase.hpp"
+
+namespace _462 {
+
+enum ConvexType
+{
+    CONVEX_POINT,
+    CONVEX_BOX,
+    CONVEX_CAPSULE,
+    CONVEX_HULL
+};
+
+/**
+ * A convex core placed in the world and grown by a radius.
+ */
+struct ConvexShape
+{
+    ConvexType type;
+    Vector3 position;
+    Quaternion orientation;
+    // box: half the size along each local axis
+    Vector3 half_extents;
+    // capsule: half the length of the core segment, along the local y axis
+    real_t half_height;
+    // distance the core is grown by
+    real_t radius;
+    // hull: the points whose convex hull is the core, in local space. Not
+    // owned.
+    const Vector3* vertices;
+    size_t num_vertices;
+
+    ConvexShape();
+
+    // the point of the core farthest in the given world space direction
+    Vector3 support( const Vector3& direction ) const;
+    // world space bounds of the shape, radius included
+    AABB bounds() const;
+};
+
+/**
+ * The simplex a GJK query ended on, as the points of the two shapes it was
+ * made of in their local frames. Keeps the features of a pair that were
+ * closest from one query to the next.
+ */
+struct ConvexCache
+{
+    Vector3 local_a[4];
+    Vector3 local_b[4];
+    // 0 for a pair not queried yet
+    int count;
+
+    ConvexCache() : count( 0 ) { }
+};
+
+/**
+ * A sphere, as a shape to test against the others.
+ */
+ConvexShape convex_sphere( const Vector3& center, real_t radius );
+
+/**
+ * Contact test. If the shapes touch, returns true and stores the unit
+ * contact normal, pointing from b towards a, and the penetration depth.
+ *
+ * GJK starts from the cache of the pair, which is updated for the next
+ * query. iterations, if not null, receives the number of GJK iterations
+ * taken, each evaluating one support point.
+ */
+bool convex_contact( const ConvexShape& a, const ConvexShape& b, ConvexCache* cache,
+                     Vector3* normal, real_t* depth, int* iterations );
+
+/**
+ * Time of impact query by conservative advancement. a moves by d over the
+ * step, b stays. If they touch during the step, returns true and stores
+ * the fraction of the step at the first touch in [0, 1] and the contact
+ * normal there, pointing towards a. Shapes touching at the start hit at 0
+ * if they are approaching, and not at all otherwise. cache is as for
+ * convex_contact.
+ */
+bool convex_toi( const ConvexShape& a, const Vector3& d, const ConvexShape& b, ConvexCache* cache,
+                 real_t* t, Vector3* normal );
+
+} /* _462 */
+
+#endif /* _462_PHYSICS_GJK_HPP_ */
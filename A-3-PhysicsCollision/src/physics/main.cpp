@@ -11,20 +11,33 @@
 #include "application/camera_roam.hpp"
 #include "application/imageio.hpp"
 #include "application/scene_loader.hpp"
+#include "application/assetloader.hpp"
+#include "application/framerecorder.hpp"
+#include "application/textoverlay.hpp"
 #include "application/opengl.hpp"
 #include "scene/scene.hpp"
+#include "scene/sphere.hpp"
+#include "scene/sphererenderer.hpp"
+#include "scene/renderqueue.hpp"
+#include "physics/physicsthread.hpp"
+#include "physics/benchmark.hpp"
 
 #include <iostream>
+#include <cstdio>
 #include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <chrono>
 
 namespace _462 {
 
 #define DEFAULT_WIDTH 800
 #define DEFAULT_HEIGHT 600
 
-#define BUFFER_SIZE(w,h) ( (size_t) ( 4 * (w) * (h) ) )
-
 #define KEY_SCREENSHOT SDLK_f
+#define KEY_INSTANCING SDLK_i
+#define KEY_RECORD SDLK_c
+#define KEY_OVERLAY SDLK_o
 
 // pretty sure these are sequential, but use an array just in case
 static const GLenum LightConstants[] = {
@@ -33,16 +46,47 @@ static const GLenum LightConstants[] = {
 };
 static const size_t NUM_GL_LIGHTS = 8;
 
-// renders a scene using opengl
-static void render_scene( const Scene& scene );
+// renders a scene using opengl, spheres through the sphere renderer and
+// all other geometries through the queue
+static void render_scene( const Scene& scene, SphereRenderer* sphere_renderer,
+                          RenderQueue* render_queue, RenderState* state );
+
+enum BenchmarkType
+{
+    BENCHMARK_INTEGRATION,
+    BENCHMARK_COLLISION,
+    BENCHMARK_MATH,
+    BENCHMARK_SLEEP
+};
 
 /**
  * Struct of the program options.
  */
 struct Options
 {
+    // whether to run a benchmark instead of a scene, and which
+    bool benchmark;
+    BenchmarkType benchmark_type;
+    // steps to simulate without a window, or 0 to open the simulator
+    size_t headless_steps;
+    // step size of the headless run, or 0 for the one of the scene
+    real_t headless_time_step;
+    // trace to record the headless run to, or null
+    const char* record_filename;
+    // trace to compare the headless run against, or null
+    const char* verify_filename;
+    // threads loading textures and meshes, 1 to load them one by one
+    size_t load_threads;
+    // extension of recorded frames, and whether recording drops frames
+    // rather than wait for the encoders
+    const char* record_extension;
+    FrameRecorder::Policy record_policy;
     // whether to open a window or just render without one
     bool open_window;
+    // physics steps to take without a window and how many steps apart
+    // the raytraced images are, or 0 to only raytrace the loaded scene
+    size_t raytrace_steps;
+    size_t raytrace_every;
     // not allocated, pointed it to something static
     const char* input_filename;
     // not allocated, pointed it to something static
@@ -56,8 +100,8 @@ class PhysicsApplication : public Application
 public:
 
     PhysicsApplication( const Options& opt )
-        : options( opt ), buffer( 0 ), buf_width( 0 ), buf_height( 0 ) { }
-    virtual ~PhysicsApplication() { free( buffer ); }
+        : options( opt ), asset_loader( opt.load_threads ), show_overlay( false ) { }
+    virtual ~PhysicsApplication() { }
 
     virtual bool initialize();
     virtual void destroy();
@@ -65,22 +109,39 @@ public:
     virtual void render();
     virtual void handle_event( const SDL_Event& event );
 
+    // starts recording frames to a sequence named after the current time
+    void start_recording();
+
     // the scene to render
     Scene scene;
 
     // options
     Options options;
 
+    // loads the textures and meshes while the scene is parsed
+    AssetLoader asset_loader;
+    // when loading the scene started and when parsing it finished
+    std::chrono::steady_clock::time_point load_start;
+    std::chrono::steady_clock::time_point load_parsed;
+
     // the camera
     CameraRoamControl camera_control;
 
+    // steps the scene's physics while the main thread renders
+    PhysicsThread physics_thread;
+
+    // draws all spheres of the scene
+    SphereRenderer sphere_renderer;
+    // draws the geometries that aren't spheres
+    RenderQueue render_queue;
+    // gl state shared by both, and what they drew last frame
+    RenderState render_state;
+    // whether the render stats are shown over the frame
+    bool show_overlay;
+    // records the rendered frames while toggled on
+    FrameRecorder recorder;
     bool pause;
     real_t speed;
-
-    // the image buffer for raytracing
-    unsigned char* buffer;
-    // width and height of the buffer
-    int buf_width, buf_height;
 };
 
 bool PhysicsApplication::initialize()
@@ -91,23 +152,28 @@ bool PhysicsApplication::initialize()
     pause = false;
     speed = 1.0;
 
+    // the loader started on the textures and meshes while the scene was
+    // parsed, the gl data can only be created once they're all done
+    if ( !asset_loader.wait() ) {
+        std::cout << "Error loading assets, aborting.\n";
+        return false;
+    }
+    std::chrono::steady_clock::time_point loaded = std::chrono::steady_clock::now();
+
     try {
 
         Material* const* materials = scene.get_materials();
         Mesh* const* meshes = scene.get_meshes();
 
-        // load all textures
-        for ( size_t i = 0; i < scene.num_materials(); ++i ) {
-            if ( !materials[i]->load() || ( load_gl && !materials[i]->create_gl_data() ) ) {
-                std::cout << "Error loading texture, aborting.\n";
+        for ( size_t i = 0; load_gl && i < scene.num_materials(); ++i ) {
+            if ( !materials[i]->create_gl_data() ) {
+                std::cout << "Error creating texture, aborting.\n";
                 return false;
             }
         }
-
-        // load all meshes
-        for ( size_t i = 0; i < scene.num_meshes(); ++i ) {
-            if ( !meshes[i]->load() || ( load_gl && !meshes[i]->create_gl_data() ) ) {
-                std::cout << "Error loading mesh, aborting.\n";
+        for ( size_t i = 0; load_gl && i < scene.num_meshes(); ++i ) {
+            if ( !meshes[i]->create_gl_data() ) {
+                std::cout << "Error creating mesh buffers, aborting.\n";
                 return false;
             }
         }
@@ -117,6 +183,15 @@ bool PhysicsApplication::initialize()
         return false;
     }
 
+    typedef std::chrono::duration< double, std::milli > Milliseconds;
+    std::chrono::steady_clock::time_point uploaded = std::chrono::steady_clock::now();
+    printf( "startup: parsed scene in %.1f ms, assets done %.1f ms later, "
+            "gl data created in %.1f ms (%u loader threads)\n",
+            Milliseconds( load_parsed - load_start ).count(),
+            Milliseconds( loaded - load_parsed ).count(),
+            Milliseconds( uploaded - loaded ).count(),
+            unsigned( asset_loader.num_threads() ) );
+
     // set the gl state
     if ( load_gl ) {
         float arr[4];
@@ -145,14 +220,34 @@ bool PhysicsApplication::initialize()
         }
 
         glLightModeli( GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE );
+
+        Geometry* const* geometries = scene.get_geometries();
+        for ( size_t i = 0; i < scene.num_geometries(); ++i ) {
+            const Sphere* sphere = dynamic_cast< const Sphere* >( geometries[i] );
+            if ( sphere ) {
+                sphere_renderer.add_sphere( sphere );
+            } else {
+                render_queue.add_geometry( geometries[i] );
+            }
+        }
+        if ( !sphere_renderer.create_gl_data() ) {
+            std::cout << "Error creating sphere buffers, aborting.\n";
+            return false;
+        }
     }
 
+    // meshes are loaded, so the physics can start using them
+    physics_thread.start( scene.get_physics() );
+
     return true;
 }
 
 void PhysicsApplication::destroy()
 {
-
+    physics_thread.stop();
+    recorder.stop();
+    sphere_renderer.destroy_gl_data();
+    Sphere::destroy_gl_data();
 }
 
 void PhysicsApplication::update( real_t delta_time )
@@ -161,15 +256,8 @@ void PhysicsApplication::update( real_t delta_time )
     camera_control.update( delta_time );
     scene.camera = camera_control.camera;
 
-    static const size_t NUM_ITER = 20;
-
-    // step the simulation
-    if ( !pause ) {
-        real_t step_size = delta_time / NUM_ITER;
-        for ( size_t i = 0; i < NUM_ITER; i++ ) {
-            scene.update( step_size * speed );
-        }
-    }
+    // the simulation steps on its own thread, just show its latest state
+    physics_thread.sync_geometry();
 }
 
 void PhysicsApplication::render()
@@ -193,9 +281,32 @@ void PhysicsApplication::render()
     glMatrixMode( GL_MODELVIEW );
     glLoadIdentity();
 
-    glPushAttrib( GL_ALL_ATTRIB_BITS );
-    render_scene( scene );
-    glPopAttrib();
+    render_scene( scene, &sphere_renderer, &render_queue, &render_state );
+
+    if ( show_overlay ) {
+        char text[128];
+        sprintf( text, "draws %u  state changes %u  culled %u",
+                 unsigned( render_state.stats.draw_calls ),
+                 unsigned( render_state.stats.state_changes ),
+                 unsigned( render_state.stats.culled ) );
+        draw_overlay_text( text, 4, 4, 2 );
+    }
+
+    recorder.capture();
+}
+
+void PhysicsApplication::start_recording()
+{
+    char prefix[64];
+    time_t timer;
+    time( &timer );
+    strftime( prefix, sizeof prefix, "rec%y%m%d%H%M%S_", localtime( &timer ) );
+
+    int width, height;
+    get_dimension( &width, &height );
+    if ( !recorder.start( prefix, options.record_extension, width, height, options.record_policy ) ) {
+        std::cout << "Error starting to record frames.\n";
+    }
 }
 
 void PhysicsApplication::handle_event( const SDL_Event& event )
@@ -210,14 +321,33 @@ void PhysicsApplication::handle_event( const SDL_Event& event )
         case KEY_SCREENSHOT:
             take_screenshot();
             break;
+        case KEY_RECORD:
+            if ( recorder.is_recording() ) {
+                recorder.stop();
+            } else {
+                start_recording();
+            }
+            break;
+        case KEY_OVERLAY:
+            show_overlay = !show_overlay;
+            break;
+        case KEY_INSTANCING:
+            if ( sphere_renderer.is_instancing_supported() ) {
+                sphere_renderer.set_instancing( !sphere_renderer.get_instancing() );
+                std::cout << "Instanced sphere rendering " << ( sphere_renderer.get_instancing() ? "on" : "off" ) << ".\n";
+            }
+            break;
         case SDLK_UP:
             speed *= 2;
+            physics_thread.set_speed( speed );
             break;
         case SDLK_DOWN:
             speed /= 2;
+            physics_thread.set_speed( speed );
             break;
         case SDLK_SPACE:
             pause = !pause;
+            physics_thread.set_paused( pause );
             break;
         default:
             break;
@@ -227,11 +357,14 @@ void PhysicsApplication::handle_event( const SDL_Event& event )
     }
 }
 
-static void render_scene( const Scene& scene )
+static void render_scene( const Scene& scene, SphereRenderer* sphere_renderer,
+                          RenderQueue* render_queue, RenderState* state )
 {
-    // backup state so it doesn't mess up raytrace image rendering
-    glPushAttrib( GL_ALL_ATTRIB_BITS );
-    glPushClientAttrib( GL_CLIENT_ALL_ATTRIB_BITS );
+    // All state used is set here or through the cache every frame, so
+    // there's nothing to save and restore. Just forget what the cache
+    // thinks is bound, in case anything else rebound it.
+    state->invalidate();
+    state->reset_stats();
 
     glClearColor(
         scene.background_color.r,
@@ -288,29 +421,15 @@ static void render_scene( const Scene& scene )
         light.position.to_array( arr );
         glLightfv( LightConstants[i], GL_POSITION, arr );
     }
-    // render each object
-
-    Geometry* const* geometries = scene.get_geometries();
-
-    for ( size_t i = 0; i < scene.num_geometries(); ++i ) {
-        const Geometry& geom = *geometries[i];
-        Vector3 axis;
-        real_t angle;
-
-        glPushMatrix();
-
-        glTranslated( geom.position.x, geom.position.y, geom.position.z );
-        geom.orientation.to_axis_angle( &axis, &angle );
-        glRotated( angle * ( 180.0 / PI ), axis.x, axis.y, axis.z );
-        glScaled( geom.scale.x, geom.scale.y, geom.scale.z );
-
-        geom.render();
+    Frustum frustum( camera );
 
-        glPopMatrix();
-    }
+    // render all spheres at once
+    GLint viewport[4];
+    glGetIntegerv( GL_VIEWPORT, viewport );
+    sphere_renderer->render( camera, frustum, viewport[3], std::min( NUM_GL_LIGHTS, scene.num_lights() ), state );
 
-    glPopClientAttrib();
-    glPopAttrib();
+    // render every other object, sorted by state
+    render_queue->render( frustum, state );
 }
 
 } /* _462 */
@@ -322,13 +441,43 @@ using namespace _462;
  */
 static void print_usage( const char* progname )
 {
-    std::cout << "Usage: " << progname << " [-r] [-d width height] input_scene [output_file]\n"
+    std::cout << "Usage: " << progname << " [-j threads] [-c png|ppm drop|block] [-r [-n steps every]] [-d width height] input_scene [output_file]\n"
+        "       " << progname << " -s steps [-t time_step] [-w trace | -v trace] input_scene\n"
+        "       " << progname << " -b [collision|math|sleep]\n"
         "\n" \
         "Options:\n" \
         "\n" \
+        "\t-b [collision|math|sleep]:\n" \
+        "\t\tRuns the integration benchmark, or with collision the convex\n" \
+        "\t\tcollision benchmark, or with math the transformation\n" \
+        "\t\tbenchmark, and exits. With sleep, checks that a force applied\n" \
+        "\t\tto a sleeping sphere wakes it, and exits with 1 if not.\n" \
+        "\t-s steps\n" \
+        "\t\tSimulates the scene for the given number of steps without a\n" \
+        "\t\twindow, prints the time spent per step and exits.\n" \
+        "\t-t time_step\n" \
+        "\t\tThe step size of -s. Defaults to the one of the scene.\n" \
+        "\t-w trace\n" \
+        "\t\tRecords the state of all spheres after every step of -s.\n" \
+        "\t-v trace\n" \
+        "\t\tReplays a trace recorded with -w and checks every step\n" \
+        "\t\tmatches bit for bit.\n" \
+        "\t-j threads\n" \
+        "\t\tThe number of threads loading textures and meshes. 1 loads\n" \
+        "\t\tthem one after another, and with -r, raytracing. Defaults to\n" \
+        "\t\tone per core.\n" \
+        "\t-c png|ppm drop|block\n" \
+        "\t\tThe format of frames recorded with 'c', and whether frames\n" \
+        "\t\tare dropped or the simulator waits when writing them falls\n" \
+        "\t\tbehind. Defaults to png and drop.\n" \
         "\t-r:\n" \
         "\t\tRaytraces the scene and saves to the output file without\n" \
         "\t\tloading a window or creating an opengl context.\n" \
+        "\t-n steps every\n" \
+        "\t\tWith -r, simulates the scene for the given number of steps\n" \
+        "\t\tand raytraces the first and then every nth step to a numbered\n" \
+        "\t\timage sequence, named by inserting the number before the\n" \
+        "\t\textension of the output file.\n" \
         "\t-d width height\n" \
         "\t\tThe dimensions of image to raytrace (and window if using\n" \
         "\t\tand opengl context. Defaults to width=800, height=600.\n" \
@@ -342,7 +491,10 @@ static void print_usage( const char* progname )
         "\n" \
         "\tPress 'r' to raytrace the scene. Press 'r' again to go back to\n" \
         "\tgo back to OpenGL rendering. Press 'f' to dump the most recently\n" \
-        "\traytraced image to the output file.\n" \
+        "\traytraced image to the output file. Press 'c' to start\n" \
+        "\tor stop recording every frame to a numbered image sequence.\n" \
+        "\tPress 'o' to show or hide the draw calls, state changes and\n" \
+        "\tculled objects of every frame.\n" \
         "\n" \
         "\tUse the mouse and 'w', 'a', 's', 'd', 'q', and 'e' to move the\n" \
         "\tcamera around. The keys translate the camera, and left and right\n" \
@@ -366,9 +518,122 @@ static bool parse_args( Options* opt, int argc, char* argv[] )
         return false;
     }
 
-    if ( strcmp( argv[1], "-r" ) == 0 ) {
+    if ( strcmp( argv[1], "-b" ) == 0 ) {
+        opt->benchmark = true;
+        opt->benchmark_type = BENCHMARK_INTEGRATION;
+        if ( argc > 2 && strcmp( argv[2], "collision" ) == 0 ) {
+            opt->benchmark_type = BENCHMARK_COLLISION;
+        } else if ( argc > 2 && strcmp( argv[2], "math" ) == 0 ) {
+            opt->benchmark_type = BENCHMARK_MATH;
+        } else if ( argc > 2 && strcmp( argv[2], "sleep" ) == 0 ) {
+            opt->benchmark_type = BENCHMARK_SLEEP;
+        }
+        return true;
+    }
+    opt->benchmark = false;
+    opt->headless_steps = 0;
+    opt->headless_time_step = 0.0;
+    opt->record_filename = 0;
+    opt->verify_filename = 0;
+    opt->load_threads = 0;
+
+    if ( strcmp( argv[1], "-s" ) == 0 ) {
+        unsigned int steps = 0;
+        if ( argc < 4 || sscanf( argv[2], "%u", &steps ) != 1 || steps == 0 ) {
+            print_usage( argv[0] );
+            return false;
+        }
+        opt->headless_steps = steps;
+
+        for ( input_index = 3; input_index + 1 < argc; input_index += 2 ) {
+            const char* value = argv[input_index + 1];
+            if ( strcmp( argv[input_index], "-t" ) == 0 ) {
+                double dt = 0.0;
+                if ( sscanf( value, "%lf", &dt ) != 1 || dt <= 0.0 ) {
+                    std::cout << "Invalid time step\n";
+                    return false;
+                }
+                opt->headless_time_step = dt;
+            } else if ( strcmp( argv[input_index], "-w" ) == 0 ) {
+                opt->record_filename = value;
+            } else if ( strcmp( argv[input_index], "-v" ) == 0 ) {
+                opt->verify_filename = value;
+            } else {
+                break;
+            }
+        }
+
+        if ( input_index + 1 != argc || ( opt->record_filename && opt->verify_filename ) ) {
+            print_usage( argv[0] );
+            return false;
+        }
+        opt->input_filename = argv[input_index];
+        return true;
+    }
+
+    opt->record_extension = ".png";
+    opt->record_policy = FrameRecorder::DROP_FRAMES;
+
+    while ( argc > input_index + 1 ) {
+        if ( strcmp( argv[input_index], "-j" ) == 0 ) {
+            unsigned int threads = 0;
+            if ( sscanf( argv[input_index + 1], "%u", &threads ) != 1 || threads == 0 ) {
+                print_usage( argv[0] );
+                return false;
+            }
+            opt->load_threads = threads;
+            input_index += 2;
+        } else if ( strcmp( argv[input_index], "-c" ) == 0 ) {
+            if ( argc <= input_index + 2 ) {
+                print_usage( argv[0] );
+                return false;
+            }
+            const char* format = argv[input_index + 1];
+            const char* policy = argv[input_index + 2];
+            if ( strcmp( format, "png" ) == 0 ) {
+                opt->record_extension = ".png";
+            } else if ( strcmp( format, "ppm" ) == 0 ) {
+                opt->record_extension = ".ppm";
+            } else {
+                std::cout << "Invalid recording format " << format << "\n";
+                return false;
+            }
+            if ( strcmp( policy, "drop" ) == 0 ) {
+                opt->record_policy = FrameRecorder::DROP_FRAMES;
+            } else if ( strcmp( policy, "block" ) == 0 ) {
+                opt->record_policy = FrameRecorder::BLOCK;
+            } else {
+                std::cout << "Invalid recording policy " << policy << "\n";
+                return false;
+            }
+            input_index += 3;
+        } else {
+            break;
+        }
+    }
+
+    if ( argc <= input_index ) {
+        print_usage( argv[0] );
+        return false;
+    }
+
+    opt->raytrace_steps = 0;
+    opt->raytrace_every = 1;
+    if ( strcmp( argv[input_index], "-r" ) == 0 ) {
         opt->open_window = false;
         ++input_index;
+
+        if ( argc > input_index + 2 && strcmp( argv[input_index], "-n" ) == 0 ) {
+            unsigned int steps = 0, every = 0;
+            if ( sscanf( argv[input_index + 1], "%u", &steps ) != 1 || steps == 0 ||
+                 sscanf( argv[input_index + 2], "%u", &every ) != 1 || every == 0 ) {
+                print_usage( argv[0] );
+                return false;
+            }
+            opt->raytrace_steps = steps;
+            opt->raytrace_every = every;
+            input_index += 3;
+        }
     } else {
         opt->open_window = true;
     }
@@ -432,13 +697,49 @@ int main( int argc, char* argv[] )
         return 1;
     }
 
+    if ( opt.benchmark ) {
+        switch ( opt.benchmark_type ) {
+        case BENCHMARK_COLLISION:
+            return run_collision_benchmark();
+        case BENCHMARK_MATH:
+            return run_math_benchmark();
+        case BENCHMARK_SLEEP:
+            return run_sleep_check();
+        default:
+            return run_integration_benchmark();
+        }
+    }
+    if ( opt.headless_steps > 0 ) {
+        HeadlessOptions headless;
+        headless.input_filename = opt.input_filename;
+        headless.steps = opt.headless_steps;
+        headless.time_step = opt.headless_time_step;
+        headless.record_filename = opt.record_filename;
+        headless.verify_filename = opt.verify_filename;
+        return run_headless( headless );
+    }
+    if ( !opt.open_window ) {
+        RaytraceOptions raytrace;
+        raytrace.input_filename = opt.input_filename;
+        raytrace.output_filename = opt.output_filename;
+        raytrace.threads = opt.load_threads;
+        raytrace.steps = opt.raytrace_steps;
+        raytrace.every = opt.raytrace_every;
+        raytrace.width = opt.width;
+        raytrace.height = opt.height;
+        return run_raytrace( raytrace );
+    }
+
     PhysicsApplication app( opt );
 
-    // load the given scene
-    if ( !load_scene( &app.scene, opt.input_filename ) ) {
+    // load the given scene, the assets keep loading in the background
+    // until the application initializes
+    app.load_start = std::chrono::steady_clock::now();
+    if ( !load_scene( &app.scene, opt.input_filename, &app.asset_loader ) ) {
         std::cout << "Error loading scene " << opt.input_filename << ". Aborting.\n";
         return 1;
     }
+    app.load_parsed = std::chrono::steady_clock::now();
 
     // setup running the physics simulation
     real_t fps = 30.0;
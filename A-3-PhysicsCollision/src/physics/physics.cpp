@@ -1,81 +1,1077 @@
 #include "physics/physics.hpp"
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+// the most simulated time consumed by a single Physics::update
+#define PHYSICS_MAX_FRAME_TIME 0.25
+// default fixed step size of Physics::update
+#define PHYSICS_DEFAULT_TIME_STEP ( 1.0 / 120.0 )
+// most sequential impulse passes over every island
+#define PHYSICS_SOLVER_ITERATIONS 8
+// change in relative velocity below which an island counts as solved
+#define PHYSICS_SOLVER_TOLERANCE 1e-4
+// fraction of the penetration removed per step
+#define PHYSICS_CONTACT_CORRECTION 0.5
+// penetration depth that is not corrected
+#define PHYSICS_ALLOWED_DEPTH 0.001
+// spheres moving more than this fraction of their radius in a step are swept
+#define PHYSICS_SWEEP_THRESHOLD 0.25
+// impacts resolved within one step per swept sphere, before the remaining
+// ones are stopped
+#define PHYSICS_MAX_IMPACTS 4
+// spheres slower than this, on top of the speed gravity adds in a step, may
+// fall asleep
+#define PHYSICS_SLEEP_VELOCITY 0.05
+// spin in radians per second below which spheres may fall asleep
+#define PHYSICS_SLEEP_SPIN 0.1
+// seconds all spheres of an island must stay slow before it falls asleep
+#define PHYSICS_SLEEP_TIME 0.5
+// most conjugate gradient iterations of the spring solve per step. Stiff
+// cloth needs more to reach the tolerance; cut off here it runs in real time
+// but damped more than a converged step would. Stats report such steps.
+#define PHYSICS_SPRING_ITERATIONS 30
+// residual of the spring solve, relative to the forces, that is good enough
+#define PHYSICS_SPRING_TOLERANCE 1e-3
 
 namespace _462 {
 
-Physics::Physics() {
+static const size_t NO_INDEX = size_t(-1);
+static const unsigned int NO_ISLAND = ~0u;
+
+// The key of a contact holds the sphere index of body1 in the high half
+// and the other body in the low half, tagged by its type
+static const unsigned int CONTACT_KEY_CONVEX = 0x40000000u;
+static const unsigned int CONTACT_KEY_TRIANGLE = 0x80000000u;
+static const unsigned int CONTACT_KEY_PLANE = 0xc0000000u;
+
+static unsigned long long contact_key(unsigned int sphere, unsigned int other) {
+    return ((unsigned long long)sphere << 32) | other;
+}
+
+// monotonic time for the step phase timings
+static long long elapsed_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// arrays of Physics::scratch
+enum ScratchArray {
+    // position at the start of a step
+    SCRATCH_X0 = 0,
+    // linear and angular velocity at the start of a step
+    SCRATCH_V0 = 3,
+    // weighted sums of the RK4 slopes of position/orientation and velocity
+    SCRATCH_SX = 9,
+    SCRATCH_SV = 15,
+    SCRATCH_NUM_ARRAYS = 21
+};
+
+// arrays of Physics::sweep
+enum SweepArray {
+    // start of the current segment
+    SWEEP_X = 0,
+    // displacement over the whole step
+    SWEEP_D = 3,
+    // time the segment starts at
+    SWEEP_T = 6,
+    // velocity at the start of the step
+    SWEEP_V = 7,
+    SWEEP_NUM_ARRAYS = 10
+};
+
+// kinds of SweptPair::other
+enum SweptType {
+    SWEPT_SPHERE,
+    SWEPT_TRIANGLE,
+    SWEPT_PLANE,
+    SWEPT_CONVEX
+};
+
+// orders vertices so duplicates end up next to each other
+struct VertexLess
+{
+    bool operator()(const Vector3& a, const Vector3& b) const {
+        if (a.x != b.x)
+            return a.x < b.x;
+        if (a.y != b.y)
+            return a.y < b.y;
+        return a.z < b.z;
+    }
+};
+
+Physics::Physics() : previous(3), scratch(SCRATCH_NUM_ARRAYS), broad_phase(0), sweep(SWEEP_NUM_ARRAYS), stats_hook(0), stats_hook_data(0) {
     reset();
 }
 
 Physics::~Physics() {
     reset();
+    delete broad_phase;
 }
 
-void Physics::step(real_t dt) {
-    // TODO step the world forward by dt. Need to detect collisions, apply
-    // forces, and integrate positions and orientations.
-    //
-    // Note: put RK4 here, not in any of the physics bodies
-    //
-    // Must use the functions that you implemented
-    //
-    // Note, when you change the position/orientation of a physics object,
-    // change the position/orientation of the graphical object that represents
-    // it
+void Physics::update_broad_phase(real_t dt) {
+    if (statics_dirty) {
+        build_triangle_tree();
+        build_convex_shapes();
+        statics_dirty = false;
+    }
+    if (sleepers_dirty)
+        update_sleepers();
+
+    // Swept bounds cover everywhere the sphere can get to during the step,
+    // in every direction since contacts may turn it around
+    real_t fall = continuous_collision ? length(gravity) * dt * dt : 0.0;
+    boxes.resize(num_awake);
+    box_groups.resize(num_awake);
+    for (size_t i = 0; i < num_awake; i++) {
+        real_t r = store[STORE_RADIUS][i];
+        if (continuous_collision)
+            r += length(store.get(i, STORE_VX)) * dt + fall;
+        Vector3 p = store.get(i, STORE_PX);
+        Vector3 extent(r, r, r);
+        boxes[i].min = p - extent;
+        boxes[i].max = p + extent;
+        box_groups[i] = spheres[slot_sphere[i]]->id;
+    }
+    broad_phase->update(boxes.empty() ? NULL : &boxes[0], box_groups.empty() ? NULL : &box_groups[0], boxes.size());
+
+    sphere_pairs.clear();
+    sleeper_pairs.clear();
+    triangle_pairs.clear();
+    broad_phase->find_pairs(&sphere_pairs, &sleeper_pairs);
+    // Sort so collisions are resolved in the same order as testing every pair,
+    // independent of the broad phase in use
+    std::sort(sphere_pairs.begin(), sphere_pairs.end());
+
+    // Triangles are culled by the tree instead, which yields the pairs of
+    // each sphere in turn
+    for (size_t i = 0; i < num_awake; i++) {
+        tree_hits.clear();
+        triangle_tree.query(boxes[i], &tree_hits);
+        std::sort(tree_hits.begin(), tree_hits.end());
+        for (unsigned int j : tree_hits) {
+            ProxyPair pair = { unsigned(i), j };
+            triangle_pairs.push_back(pair);
+        }
+    }
+
+    // Convex colliders are few, so every sphere is checked against all
+    convex_pairs.clear();
+    for (size_t i = 0; i < num_awake; i++) {
+        for (size_t j = 0; j < convex_boxes.size(); j++) {
+            if (overlaps(boxes[i], convex_boxes[j])) {
+                ProxyPair pair = { unsigned(i), unsigned(j) };
+                convex_pairs.push_back(pair);
+            }
+        }
+    }
+
+    stats.sphere_pairs = sphere_pairs.size();
+    stats.triangle_pairs = triangle_pairs.size();
+    stats.convex_pairs = convex_pairs.size();
+}
+
+void Physics::build_triangle_tree() {
+    // cached contacts refer to triangles by their index in the tree
+    contact_cache.clear();
+    triangle_tree.clear();
+    for (const TriangleBody *t : triangles)
+        triangle_tree.add(t->vertices[0], t->vertices[1], t->vertices[2]);
+    for (const Model *model : models) {
+        // Scale, then orientation, then position, as Geometry is rendered
+        const Mesh *mesh = model->mesh;
+        const MeshVertex *v = mesh->get_vertices();
+        const MeshTriangle *tri = mesh->get_triangles();
+        const Vector3 &scale = model->scale;
+        for (size_t i = 0; i < mesh->num_triangles(); i++) {
+            Vector3 p[3];
+            for (int k = 0; k < 3; k++) {
+                const Vector3 &q = v[tri[i].vertices[k]].position;
+                p[k] = model->position + model->orientation * Vector3(q.x * scale.x, q.y * scale.y, q.z * scale.z);
+            }
+            triangle_tree.add(p[0], p[1], p[2]);
+        }
+    }
+    triangle_tree.build();
+}
+
+void Physics::build_convex_shapes() {
+    // cached simplices refer to shapes by their index
+    convex_caches.clear();
+    convex_shapes.clear();
+    hull_vertices.clear();
+    for (const ConvexBody *c : convexes)
+        convex_shapes.push_back(c->get_shape());
 
-    // Get environment interactive (get force like collision, gravity)
-    for (SphereBody *body : spheres)
-        for (PlaneBody *pb : planes)
-            collides(*body, *pb, collision_damping);
-    for (SphereBody *body : spheres)
-        for (TriangleBody *tb : triangles)
-            collides(*body, *tb, collision_damping);
-    for (real_t i = 0; i < spheres.size(); i++)
-        for (real_t j = i + 1; j < spheres.size(); j++)
-            collides(*spheres[i], *spheres[j], collision_damping);
+    // Hulls keep the scaled mesh vertices, since the support of the points
+    // is that of their hull. Their pointers are set once all are in place.
+    std::vector<size_t> first;
+    for (const Model *model : hull_models) {
+        const Mesh *mesh = model->mesh;
+        const MeshVertex *v = mesh->get_vertices();
+        const Vector3 &scale = model->scale;
+        size_t start = hull_vertices.size();
+        for (size_t i = 0; i < mesh->num_vertices(); i++) {
+            const Vector3 &q = v[i].position;
+            hull_vertices.push_back(Vector3(q.x * scale.x, q.y * scale.y, q.z * scale.z));
+        }
+        std::sort(hull_vertices.begin() + start, hull_vertices.end(), VertexLess());
+        hull_vertices.erase(std::unique(hull_vertices.begin() + start, hull_vertices.end()), hull_vertices.end());
+        first.push_back(start);
+
+        ConvexShape shape;
+        shape.type = CONVEX_HULL;
+        shape.position = model->position;
+        shape.orientation = model->orientation;
+        shape.num_vertices = hull_vertices.size() - start;
+        convex_shapes.push_back(shape);
+    }
+    for (size_t i = 0; i < hull_models.size(); i++) {
+        ConvexShape &shape = convex_shapes[convexes.size() + i];
+        shape.vertices = shape.num_vertices > 0 ? &hull_vertices[first[i]] : NULL;
+    }
+
+    convex_boxes.resize(convex_shapes.size());
+    for (size_t i = 0; i < convex_shapes.size(); i++)
+        convex_boxes[i] = convex_shapes[i].bounds();
+}
+
+void Physics::update_sleepers() {
+    // Sleeping spheres are the static proxies of the broad phase, so it
+    // never pairs two of them
+    size_t count = store.size() - num_awake;
+    sleeper_boxes.resize(count);
+    sleeper_groups.resize(count);
+    sleeper_energy = 0.0;
+    for (size_t k = 0; k < count; k++) {
+        size_t i = num_awake + k;
+        real_t r = store[STORE_RADIUS][i];
+        Vector3 p = store.get(i, STORE_PX);
+        Vector3 extent(r, r, r);
+        sleeper_boxes[k].min = p - extent;
+        sleeper_boxes[k].max = p + extent;
+        sleeper_groups[k] = spheres[slot_sphere[i]]->id;
+        sleeper_energy -= dot(gravity, p) / store[STORE_INV_MASS][i];
+    }
+    broad_phase->set_static(sleeper_boxes.empty() ? NULL : &sleeper_boxes[0], sleeper_groups.empty() ? NULL : &sleeper_groups[0], count);
+    sleepers_dirty = false;
+}
+
+void Physics::swap_slots(size_t a, size_t b) {
+    if (a == b)
+        return;
+    for (size_t k = 0; k < STORE_NUM_FIELDS; k++)
+        std::swap(store[k][a], store[k][b]);
+    std::swap(store.orientation[a], store.orientation[b]);
+    if (previous.size() == store.size()) {
+        for (size_t k = 0; k < 3; k++)
+            std::swap(previous[k][a], previous[k][b]);
+        std::swap(previous_orientation[a], previous_orientation[b]);
+    }
+    std::swap(idle_time[a], idle_time[b]);
+    std::swap(sleep_island[a], sleep_island[b]);
+    std::swap(never_sleep[a], never_sleep[b]);
+    std::swap(slot_sphere[a], slot_sphere[b]);
+    sphere_slot[slot_sphere[a]] = unsigned(a);
+    sphere_slot[slot_sphere[b]] = unsigned(b);
+}
+
+bool Physics::wake_touched() {
+    // Waking on overlapping bounds rather than on contact also wakes what
+    // fast spheres may hit during the step
+    wake_islands.clear();
+    for (const ProxyPair &pair : sleeper_pairs) {
+        size_t j = num_awake + pair.second;
+        if (spheres[slot_sphere[pair.first]]->id != spheres[slot_sphere[j]]->id)
+            wake_islands.push_back(sleep_island[j]);
+    }
+    return wake_listed();
+}
 
-    for (SphereBody *body : spheres) {
-        body->apply_force(gravity, Vector3::Zero);
+bool Physics::wake_forced() {
+    // Forces are only applied to awake spheres, one pushing a sleeping
+    // sphere wakes its island rather than waiting on it
+    wake_islands.clear();
+    for (size_t i = num_awake; i < store.size(); i++) {
+        const SphereBody *body = spheres[slot_sphere[i]];
+        if (body->force != Vector3::Zero || body->torque != Vector3::Zero)
+            wake_islands.push_back(sleep_island[i]);
     }
+    return wake_listed();
+}
+
+bool Physics::wake_listed() {
+    if (wake_islands.empty())
+        return false;
+    std::sort(wake_islands.begin(), wake_islands.end());
+    wake_islands.erase(std::unique(wake_islands.begin(), wake_islands.end()), wake_islands.end());
 
-    // Hack: newtons_cradle
-    if (springs.size() > 1) {
-        real_t x = 4;
-        for (Spring *sp : springs) {
-            sp->body2_offset = Vector3(x, 4.0, 0.0);
-            x -= 2.0;
-            sp->step(dt);
+    for (size_t i = num_awake; i < store.size(); i++) {
+        if (std::binary_search(wake_islands.begin(), wake_islands.end(), sleep_island[i])) {
+            idle_time[i] = 0.0;
+            swap_slots(i, num_awake);
+            num_awake++;
         }
     }
-    // Hack: spring_rotation
-    if (springs.size() == 1) {
-        for (Spring *sp : springs) {
-            sp->body2_offset = Vector3(0, 4.0, 0.0);
-            sp->step(dt);
+    sleepers_dirty = true;
+    return true;
+}
+
+void Physics::update_sleep(real_t dt) {
+    if (!sleeping)
+        return;
+
+    // Resting contacts take out the speed gravity adds every step, and with
+    // restitution bounce some of it back, so that much is left on spheres
+    // at rest
+    real_t max_speed = PHYSICS_SLEEP_VELOCITY + length(gravity) * dt;
+    real_t max_spin = PHYSICS_SLEEP_SPIN;
+    island_idle.assign(num_awake, real_t(PHYSICS_SLEEP_TIME));
+    for (size_t i = 0; i < num_awake; i++) {
+        bool slow = !never_sleep[i] &&
+            squared_length(store.get(i, STORE_VX)) <= max_speed * max_speed &&
+            squared_length(store.get(i, STORE_WX)) <= max_spin * max_spin;
+        idle_time[i] = slow ? idle_time[i] + dt : 0.0;
+        unsigned int root = solver.island_root(unsigned(i));
+        island_idle[root] = std::min(island_idle[root], idle_time[i]);
+    }
+
+    // Whole islands fall asleep together, so nothing rests on a sleeping
+    // sphere that is still moving. Go backwards so the swaps only move
+    // slots that were visited already.
+    island_tag.assign(num_awake, NO_ISLAND);
+    for (size_t i = num_awake; i-- > 0;) {
+        unsigned int root = solver.island_root(unsigned(i));
+        if (island_idle[root] < PHYSICS_SLEEP_TIME)
+            continue;
+        if (island_tag[root] == NO_ISLAND)
+            island_tag[root] = next_sleep_island++;
+        sleep_island[i] = island_tag[root];
+        store.set(i, STORE_VX, Vector3::Zero);
+        store.set(i, STORE_WX, Vector3::Zero);
+        num_awake--;
+        swap_slots(i, num_awake);
+        sleepers_dirty = true;
+    }
+}
+
+void Physics::load_store() {
+    // Spheres are only ever appended, so keep the state of the old ones
+    size_t first = store.size();
+    store.resize(spheres.size());
+    slot_sphere.resize(spheres.size());
+    sphere_slot.resize(spheres.size());
+    idle_time.resize(spheres.size(), 0.0);
+    sleep_island.resize(spheres.size(), 0);
+    never_sleep.resize(spheres.size(), 0);
+    for (size_t i = first; i < spheres.size(); i++) {
+        const SphereBody *body = spheres[i];
+        store.set(i, STORE_PX, body->position);
+        store.set(i, STORE_VX, body->velocity);
+        store.set(i, STORE_WX, body->angular_velocity);
+        store.set(i, STORE_FX, Vector3::Zero);
+        store.set(i, STORE_TX, Vector3::Zero);
+        store[STORE_INV_MASS][i] = 1 / body->mass;
+        // solid sphere, I = 2/5 m r^2
+        store[STORE_INV_INERTIA][i] = 1 / (2 / 5.0 * body->mass * body->radius * body->radius);
+        store[STORE_RADIUS][i] = body->radius;
+        store.orientation[i] = body->orientation;
+        slot_sphere[i] = unsigned(i);
+        sphere_slot[i] = unsigned(i);
+    }
+    // New bodies and springs may touch sleeping spheres anywhere
+    wake_all();
+
+    load_springs();
+    // Springs keep pulling, their spheres never rest for long
+    never_sleep.assign(spheres.size(), 0);
+    for (size_t i = 0; i < spring_network.num_nodes(); i++)
+        never_sleep[sphere_slot[spring_network.node_body(i)]] = 1;
+
+    store_dirty = false;
+}
+
+void Physics::load_springs() {
+    std::unordered_map<const Body*, size_t> index;
+    for (size_t i = 0; i < spheres.size(); i++)
+        index[spheres[i]] = i;
+
+    spring_network.clear();
+    for (const Spring *sp : springs) {
+        std::unordered_map<const Body*, size_t>::const_iterator b1 = index.find(sp->body1);
+        std::unordered_map<const Body*, size_t>::const_iterator b2 = index.find(sp->body2);
+        SpringLink link;
+        link.stiffness = sp->constant;
+        link.rest_length = sp->equilibrium;
+        link.damping = sp->damping;
+        // body1 of the link is always a sphere
+        const Body *other;
+        if (b1 != index.end()) {
+            link.body1 = unsigned(b1->second);
+            link.offset1 = sp->body1_offset;
+            link.offset2 = sp->body2_offset;
+            other = sp->body2;
+        } else if (b2 != index.end()) {
+            link.body1 = unsigned(b2->second);
+            link.offset1 = sp->body2_offset;
+            link.offset2 = sp->body1_offset;
+            other = sp->body1;
+        } else {
+            // neither end can move
+            continue;
+        }
+        if (b1 != index.end() && b2 != index.end()) {
+            link.body2 = unsigned(b2->second);
+        } else {
+            // Bodies other than spheres don't move, the spring hangs from
+            // a fixed point on them
+            link.body2 = SPRING_ANCHOR;
+            if (other)
+                link.offset2 = other->position + other->orientation * link.offset2;
         }
+        spring_network.add(link);
+    }
+}
+
+SpringBodies Physics::spring_bodies() {
+    SpringBodies bodies;
+    for (int k = 0; k < 3; k++) {
+        bodies.position[k] = store[STORE_PX + k];
+        bodies.velocity[k] = store[STORE_VX + k];
+        bodies.angular_velocity[k] = store[STORE_WX + k];
     }
+    bodies.orientation = store.orientation.empty() ? NULL : &store.orientation[0];
+    bodies.inv_mass = store[STORE_INV_MASS];
+    bodies.inv_inertia = store[STORE_INV_INERTIA];
+    bodies.slot = sphere_slot.empty() ? NULL : &sphere_slot[0];
+    return bodies;
+}
+
+void Physics::store_to_body(size_t slot) {
+    SphereBody *body = spheres[slot_sphere[slot]];
+    body->position = store.get(slot, STORE_PX);
+    body->velocity = store.get(slot, STORE_VX);
+    body->angular_velocity = store.get(slot, STORE_WX);
+    body->orientation = store.orientation[slot];
+}
 
-    // update
-    for (SphereBody *body : spheres) {
-        body->velocity += body->force / body->mass * dt;
+void Physics::find_contacts() {
+    contacts.clear();
 
-        // Hack: simulate spring_rotation
-        if (spheres.size() == 1) {
-            body->angular_velocity = body->torque / (1 / 5.0 * body->mass * body->radius * body->radius);
-            body->angular_velocity.x = 0;
+    // Keys use sphere indices, which unlike slots don't change when spheres
+    // fall asleep or wake up
+    Contact c;
+    c.body2 = CONTACT_STATIC;
+    // Planes are infinite, so there is nothing for the broad phase to cull
+    for (size_t i = 0; i < num_awake; i++) {
+        Vector3 p = store.get(i, STORE_PX);
+        real_t r = store[STORE_RADIUS][i];
+        for (size_t j = 0; j < planes.size(); j++) {
+            if (sphere_plane_contact(p, r, *planes[j], &c.normal, &c.depth)) {
+                c.key = contact_key(slot_sphere[i], CONTACT_KEY_PLANE | unsigned(j));
+                c.body1 = unsigned(i);
+                contacts.push_back(c);
+            }
         }
+    }
+    for (const ProxyPair &pair : triangle_pairs) {
+        size_t i = pair.first;
+        if (sphere_triangle_contact(store.get(i, STORE_PX), store[STORE_RADIUS][i], triangle_tree[pair.second], &c.normal, &c.depth)) {
+            c.key = contact_key(slot_sphere[i], CONTACT_KEY_TRIANGLE | pair.second);
+            c.body1 = pair.first;
+            contacts.push_back(c);
+        }
+    }
+    // Each pair's GJK starts from the simplex it ended on last step, and
+    // pairs no longer tested drop out of the cache
+    next_convex_caches.clear();
+    stats.gjk_iterations = 0;
+    for (const ProxyPair &pair : convex_pairs) {
+        size_t i = pair.first;
+        unsigned long long key = contact_key(slot_sphere[i], CONTACT_KEY_CONVEX | pair.second);
+        ConvexCache &cache = next_convex_caches[key];
+        ConvexCacheMap::const_iterator last = convex_caches.find(key);
+        if (last != convex_caches.end())
+            cache = last->second;
+        int iterations;
+        if (convex_contact(convex_sphere(store.get(i, STORE_PX), store[STORE_RADIUS][i]), convex_shapes[pair.second], &cache, &c.normal, &c.depth, &iterations)) {
+            c.key = key;
+            c.body1 = pair.first;
+            contacts.push_back(c);
+        }
+        stats.gjk_iterations += iterations;
+    }
+    convex_caches.swap(next_convex_caches);
 
-        body->step_position(dt, 1.0);
-        body->step_orientation(dt/4, 1.0); // dt for scene spring_rotation is bad, use dt/4 or some else instead.
+    for (const ProxyPair &pair : sphere_pairs) {
+        // body1 is the sphere with the lower index, so friction impulses
+        // keep their direction in the cache whatever order the pair came in
+        size_t i = pair.first, j = pair.second;
+        if (slot_sphere[j] < slot_sphere[i])
+            std::swap(i, j);
+        if (spheres[slot_sphere[i]]->id == spheres[slot_sphere[j]]->id)
+            continue;
+        if (sphere_sphere_contact(store.get(i, STORE_PX), store[STORE_RADIUS][i], store.get(j, STORE_PX), store[STORE_RADIUS][j], &c.normal, &c.depth)) {
+            c.key = contact_key(slot_sphere[i], slot_sphere[j]);
+            c.body1 = unsigned(i);
+            c.body2 = unsigned(j);
+            contacts.push_back(c);
+        }
     }
+}
 
-    // Reset environment interactive (because we have consume it to compute position, orientation etc.)
-    for (SphereBody *body : spheres) {
+void Physics::load_forces() {
+    // Forces applied to the bodies since the last step act, unchanged, over
+    // this one and are used up by it. Gravity is added by
+    // accumulate_acceleration and springs are integrated on their own.
+    for (size_t i = 0; i < num_awake; i++) {
+        SphereBody *body = spheres[slot_sphere[i]];
+        store.set(i, STORE_FX, body->force);
+        // angular velocity is kept in the body frame, so is torque
+        store.set(i, STORE_TX, conjugate(store.orientation[i]) * body->torque);
         body->reset_force();
     }
 }
 
+void Physics::accumulate_acceleration(real_t* const out[6], real_t dt) {
+    // out[k] += (force / mass + gravity) * dt, linear then angular
+    for (int k = 0; k < 6; k++) {
+        const real_t *inv = store[k < 3 ? STORE_INV_MASS : STORE_INV_INERTIA];
+        soa_kick(out[k], store[STORE_FX + k], inv, k < 3 ? gravity[k] : 0.0, dt, num_awake);
+    }
+}
+
+void Physics::kick(real_t dt) {
+    real_t* const v[6] = {
+        store[STORE_VX], store[STORE_VY], store[STORE_VZ],
+        store[STORE_WX], store[STORE_WY], store[STORE_WZ]
+    };
+    accumulate_acceleration(v, dt);
+}
+
+void Physics::drift(real_t dt) {
+    for (int k = 0; k < 3; k++)
+        soa_madd(store[STORE_PX + k], store[STORE_PX + k], store[STORE_VX + k], dt, num_awake);
+
+    for (size_t i = 0; i < num_awake; i++) {
+        Vector3 spin = store.get(i, STORE_WX);
+        if (spin != Vector3::Zero)
+            store.orientation[i] = integrate_orientation(store.orientation[i], spin, dt);
+    }
+}
+
+void Physics::integrate_rk4(real_t dt) {
+    size_t n = num_awake;
+    scratch.resize(n);
+
+    // state at the start of the step
+    real_t* const v0[6] = {
+        scratch[SCRATCH_V0], scratch[SCRATCH_V0 + 1], scratch[SCRATCH_V0 + 2],
+        scratch[SCRATCH_V0 + 3], scratch[SCRATCH_V0 + 4], scratch[SCRATCH_V0 + 5]
+    };
+    // weighted sums of the four slopes of x and v
+    real_t* const sx[6] = {
+        scratch[SCRATCH_SX], scratch[SCRATCH_SX + 1], scratch[SCRATCH_SX + 2],
+        scratch[SCRATCH_SX + 3], scratch[SCRATCH_SX + 4], scratch[SCRATCH_SX + 5]
+    };
+    real_t* const sv[6] = {
+        scratch[SCRATCH_SV], scratch[SCRATCH_SV + 1], scratch[SCRATCH_SV + 2],
+        scratch[SCRATCH_SV + 3], scratch[SCRATCH_SV + 4], scratch[SCRATCH_SV + 5]
+    };
+    for (int k = 0; k < 3; k++)
+        soa_copy(scratch[SCRATCH_X0 + k], store[STORE_PX + k], n);
+    for (int k = 0; k < 6; k++) {
+        soa_copy(v0[k], store[STORE_VX + k], n);
+        soa_copy(sx[k], store[STORE_VX + k], n);
+        soa_zero(sv[k], n);
+    }
+
+    // Orientations stay at the start of the step during the stages, the
+    // forces do not depend on them. The averaged spin rotates them at the end.
+    static const real_t weight[4] = { 1, 2, 2, 1 };
+    static const real_t stage[3] = { 0.5, 0.5, 1.0 };
+    for (int s = 0; s < 4; s++) {
+        accumulate_acceleration(sv, weight[s]);
+        if (s == 3)
+            break;
+
+        // move to the next stage: x = x0 + v * h, then v = v0 + a * h
+        real_t h = stage[s] * dt;
+        for (int k = 0; k < 3; k++)
+            soa_madd(store[STORE_PX + k], scratch[SCRATCH_X0 + k], store[STORE_VX + k], h, n);
+        for (int k = 0; k < 6; k++)
+            soa_copy(store[STORE_VX + k], v0[k], n);
+        kick(h);
+
+        for (int k = 0; k < 6; k++)
+            soa_madd(sx[k], sx[k], store[STORE_VX + k], weight[s + 1], n);
+    }
+
+    for (int k = 0; k < 3; k++)
+        soa_madd(store[STORE_PX + k], scratch[SCRATCH_X0 + k], sx[k], dt / 6, n);
+    for (int k = 0; k < 6; k++)
+        soa_madd(store[STORE_VX + k], v0[k], sv[k], dt / 6, n);
+
+    for (size_t i = 0; i < n; i++) {
+        Vector3 spin(sx[3][i], sx[4][i], sx[5][i]);
+        if (spin != Vector3::Zero)
+            store.orientation[i] = integrate_orientation(store.orientation[i], spin / 6, dt);
+    }
+}
+
+void Physics::integrate(real_t dt) {
+    if (store_dirty)
+        load_store();
+
+    load_forces();
+
+    // Stiff springs would need tiny steps with any explicit integrator,
+    // they take an implicit step of their own instead, which may leave
+    // part of the velocity change until the spheres have moved
+    long long start = elapsed_ns();
+    SpringSettings settings;
+    settings.max_iterations = PHYSICS_SPRING_ITERATIONS;
+    settings.tolerance = PHYSICS_SPRING_TOLERANCE;
+    spring_network.solve(spring_bodies(), dt, settings);
+    stats.spring_iterations = spring_network.iterations();
+    stats.spring_residual = spring_network.residual();
+    stats.spring_converged = spring_network.converged();
+    stats.springs_ns = elapsed_ns() - start;
+
+    switch (integrator) {
+    case INTEGRATOR_RK4:
+        integrate_rk4(dt);
+        break;
+    case INTEGRATOR_VERLET:
+        // kick half a step, drift a full step, then kick again with the
+        // acceleration at the new position
+        kick(dt / 2);
+        drift(dt);
+        kick(dt / 2);
+        break;
+    case INTEGRATOR_SYMPLECTIC_EULER:
+    default:
+        // update velocities first and move with the new ones
+        kick(dt);
+        drift(dt);
+        break;
+    }
+
+    start = elapsed_ns();
+    spring_network.finish(spring_bodies());
+    stats.springs_ns += elapsed_ns() - start;
+}
+
+void Physics::step(real_t dt) {
+    if (store_dirty)
+        load_store();
+    // Sleeping spheres rest on what holds them up against the old gravity
+    if (gravity != sleep_gravity) {
+        wake_all();
+        sleep_gravity = gravity;
+    }
+    wake_forced();
+
+    long long start = elapsed_ns();
+    update_broad_phase(dt);
+    // Awake spheres close to sleeping ones wake their islands, then look
+    // again, since those may be close to other sleeping islands
+    while (wake_touched())
+        update_broad_phase(dt);
+    long long broad_phase_done = elapsed_ns();
+
+    // Get environment interactive. All contacts are found first and then
+    // resolved together, island by island
+    find_contacts();
+    long long contacts_done = elapsed_ns();
+
+    SolverBodies bodies;
+    for (int k = 0; k < 3; k++) {
+        bodies.position[k] = store[STORE_PX + k];
+        bodies.velocity[k] = store[STORE_VX + k];
+        bodies.angular_velocity[k] = store[STORE_WX + k];
+    }
+    bodies.orientation = store.orientation.empty() ? NULL : &store.orientation[0];
+    bodies.inv_mass = store[STORE_INV_MASS];
+    bodies.inv_inertia = store[STORE_INV_INERTIA];
+    bodies.radius = store[STORE_RADIUS];
+    bodies.count = num_awake;
+
+    SolverSettings settings;
+    settings.restitution = 1 - collision_damping;
+    settings.friction = friction;
+    settings.iterations = PHYSICS_SOLVER_ITERATIONS;
+    settings.tolerance = PHYSICS_SOLVER_TOLERANCE;
+    settings.correction = PHYSICS_CONTACT_CORRECTION;
+    settings.allowed_depth = PHYSICS_ALLOWED_DEPTH;
+    // Contacts that persist start from last step's impulses, which are
+    // nearly right for anything resting
+    stats.cached_contacts = contact_cache.warm_start(&contacts);
+    solver.solve(&contacts, bodies, settings);
+    contact_cache.store(contacts);
+    long long solve_done = elapsed_ns();
+
+    stats.contacts = contacts.size();
+    stats.islands = solver.num_islands();
+    stats.largest_island = solver.largest_island();
+    stats.solver_iterations = solver.total_iterations();
+    stats.max_solver_iterations = solver.max_iterations();
+
+    // Islands that stayed slow long enough fall asleep before they move
+    update_sleep(dt);
+    stats.awake_spheres = num_awake;
+    stats.sleeping_spheres = store.size() - num_awake;
+
+    if (continuous_collision) {
+        sweep.resize(num_awake);
+        for (int k = 0; k < 3; k++) {
+            soa_copy(sweep[SWEEP_X + k], store[STORE_PX + k], num_awake);
+            soa_copy(sweep[SWEEP_V + k], store[STORE_VX + k], num_awake);
+        }
+    }
+
+    // Springs are integrated first, then gravity and the applied forces by
+    // the integrator
+    integrate(dt);
+    long long integrate_done = elapsed_ns();
+
+    // Contacts were only found where the spheres started, catch what they
+    // hit on the way
+    stats.impacts = 0;
+    if (continuous_collision)
+        resolve_impacts(dt);
+    long long impacts_done = elapsed_ns();
+
+    stats.broad_phase_ns = broad_phase_done - start;
+    stats.narrow_phase_ns = (contacts_done - broad_phase_done) + (impacts_done - integrate_done);
+    stats.solver_ns = solve_done - contacts_done;
+    stats.integrate_ns = integrate_done - solve_done - stats.springs_ns;
+
+    stats.num_steps++;
+    stats.energy = compute_energy();
+    if (stats_hook)
+        stats_hook(stats, stats_hook_data);
+}
+
+Vector3 Physics::swept_position(size_t i, real_t time) const {
+    Vector3 x(sweep[SWEEP_X][i], sweep[SWEEP_X + 1][i], sweep[SWEEP_X + 2][i]);
+    Vector3 d(sweep[SWEEP_D][i], sweep[SWEEP_D + 1][i], sweep[SWEEP_D + 2][i]);
+    return x + d * (time - sweep[SWEEP_T][i]);
+}
+
+Vector3 Physics::impact_velocity(size_t i, real_t time) const {
+    // Velocity changes linearly over the step under constant acceleration
+    Vector3 v0(sweep[SWEEP_V][i], sweep[SWEEP_V + 1][i], sweep[SWEEP_V + 2][i]);
+    return v0 + (store.get(i, STORE_VX) - v0) * time;
+}
+
+bool Physics::sweep_pair(const SweptPair& pair, real_t now, real_t* time, Vector3* normal) const {
+    // Sweep over the rest of the step
+    size_t a = pair.sphere;
+    Vector3 pa = swept_position(a, now);
+    Vector3 da = Vector3(sweep[SWEEP_D][a], sweep[SWEEP_D + 1][a], sweep[SWEEP_D + 2][a]) * (1 - now);
+    real_t r = store[STORE_RADIUS][a];
+    real_t s;
+    bool hit;
+    if (pair.type == SWEPT_SPHERE) {
+        size_t b = pair.other;
+        Vector3 pb = swept_position(b, now);
+        Vector3 db = Vector3(sweep[SWEEP_D][b], sweep[SWEEP_D + 1][b], sweep[SWEEP_D + 2][b]) * (1 - now);
+        hit = sphere_sphere_toi(pa, da, r, pb, db, store[STORE_RADIUS][b], &s, normal);
+    } else if (pair.type == SWEPT_TRIANGLE) {
+        hit = sphere_triangle_toi(pa, da, r, triangle_tree[pair.other], &s, normal);
+    } else if (pair.type == SWEPT_CONVEX) {
+        ConvexCache cache;
+        hit = convex_toi(convex_sphere(pa, r), da, convex_shapes[pair.other], &cache, &s, normal);
+    } else {
+        hit = sphere_plane_toi(pa, da, r, *planes[pair.other], &s, normal);
+    }
+    *time = now + s * (1 - now);
+    return hit;
+}
+
+void Physics::rebase_sweep(size_t i, real_t now) {
+    Vector3 x = swept_position(i, now);
+    for (int k = 0; k < 3; k++)
+        sweep[SWEEP_X + k][i] = x[k];
+    sweep[SWEEP_T][i] = now;
+    impact_bodies.push_back(unsigned(i));
+}
+
+void Physics::cover_sweep(size_t i, real_t now) {
+    // The broad phase box of a sphere only covers where it could get to on
+    // its own. An impact can send it further, then look for what else it
+    // may hit the slow way.
+    real_t r = store[STORE_RADIUS][i];
+    Vector3 extent(r, r, r);
+    Vector3 p0 = swept_position(i, now);
+    Vector3 p1 = swept_position(i, 1.0);
+    AABB box;
+    box.min = vmin(p0, p1) - extent;
+    box.max = vmax(p0, p1) + extent;
+    AABB &old = boxes[i];
+    if (old.min.x <= box.min.x && old.min.y <= box.min.y && old.min.z <= box.min.z &&
+        old.max.x >= box.max.x && old.max.y >= box.max.y && old.max.z >= box.max.z)
+        return;
+    old.min = vmin(old.min, box.min);
+    old.max = vmax(old.max, box.max);
+
+    SweptPair sp;
+    sp.sphere = unsigned(i);
+    if (!fast_spheres[i]) {
+        fast_spheres[i] = 1;
+        sp.type = SWEPT_PLANE;
+        for (size_t j = 0; j < planes.size(); j++) {
+            sp.other = unsigned(j);
+            swept_pairs.push_back(sp);
+        }
+    }
+    sp.type = SWEPT_TRIANGLE;
+    tree_hits.clear();
+    triangle_tree.query(old, &tree_hits);
+    std::sort(tree_hits.begin(), tree_hits.end());
+    for (unsigned int j : tree_hits) {
+        sp.other = j;
+        swept_pairs.push_back(sp);
+    }
+    sp.type = SWEPT_CONVEX;
+    for (size_t j = 0; j < convex_boxes.size(); j++) {
+        if (overlaps(old, convex_boxes[j])) {
+            sp.other = unsigned(j);
+            swept_pairs.push_back(sp);
+        }
+    }
+    sp.type = SWEPT_SPHERE;
+    for (size_t j = 0; j < num_awake; j++) {
+        if (j != i && spheres[slot_sphere[i]]->id != spheres[slot_sphere[j]]->id && overlaps(old, boxes[j])) {
+            sp.other = unsigned(j);
+            swept_pairs.push_back(sp);
+        }
+    }
+}
+
+void Physics::resolve_impacts(real_t dt) {
+    size_t n = num_awake;
+    const real_t *inv_mass = store[STORE_INV_MASS];
+
+    // Slow spheres can't pass through anything between two steps, the
+    // contacts of the next step catch their collisions
+    fast_spheres.assign(n, 0);
+    size_t max_impacts = 0;
+    for (size_t i = 0; i < n; i++) {
+        real_t length2 = 0.0;
+        for (int k = 0; k < 3; k++) {
+            real_t d = store[STORE_PX + k][i] - sweep[SWEEP_X + k][i];
+            sweep[SWEEP_D + k][i] = d;
+            length2 += d * d;
+        }
+        sweep[SWEEP_T][i] = 0.0;
+        real_t threshold = PHYSICS_SWEEP_THRESHOLD * store[STORE_RADIUS][i];
+        if (length2 > threshold * threshold) {
+            fast_spheres[i] = 1;
+            max_impacts += PHYSICS_MAX_IMPACTS;
+        }
+    }
+    if (max_impacts == 0)
+        return;
+
+    swept_pairs.clear();
+    SweptPair sp;
+    sp.type = SWEPT_PLANE;
+    for (size_t i = 0; i < n; i++) {
+        if (!fast_spheres[i])
+            continue;
+        sp.sphere = unsigned(i);
+        for (size_t j = 0; j < planes.size(); j++) {
+            sp.other = unsigned(j);
+            swept_pairs.push_back(sp);
+        }
+    }
+    sp.type = SWEPT_TRIANGLE;
+    for (const ProxyPair &pair : triangle_pairs) {
+        if (!fast_spheres[pair.first])
+            continue;
+        sp.sphere = pair.first;
+        sp.other = pair.second;
+        swept_pairs.push_back(sp);
+    }
+    sp.type = SWEPT_CONVEX;
+    for (const ProxyPair &pair : convex_pairs) {
+        if (!fast_spheres[pair.first])
+            continue;
+        sp.sphere = pair.first;
+        sp.other = pair.second;
+        swept_pairs.push_back(sp);
+    }
+    sp.type = SWEPT_SPHERE;
+    for (const ProxyPair &pair : sphere_pairs) {
+        if (!fast_spheres[pair.first] && !fast_spheres[pair.second])
+            continue;
+        if (spheres[slot_sphere[pair.first]]->id == spheres[slot_sphere[pair.second]]->id)
+            continue;
+        sp.sphere = pair.first;
+        sp.other = pair.second;
+        swept_pairs.push_back(sp);
+    }
+
+    // Advance to the earliest impact, resolve it, and sweep the rest of the
+    // step again. Only the spheres involved are moved to the impact, the
+    // others keep moving along their first segment.
+    real_t restitution = 1 - collision_damping;
+    real_t now = 0.0;
+    impact_bodies.clear();
+    while (true) {
+        size_t first = NO_INDEX;
+        real_t first_time = 1.0;
+        Vector3 first_normal;
+        for (size_t k = 0; k < swept_pairs.size(); k++) {
+            real_t time;
+            Vector3 normal;
+            if (sweep_pair(swept_pairs[k], now, &time, &normal) && (first == NO_INDEX || time < first_time)) {
+                first = k;
+                first_time = time;
+                first_normal = normal;
+            }
+        }
+        if (first == NO_INDEX)
+            break;
+
+        now = first_time;
+        if (stats.impacts == max_impacts) {
+            // Out of budget. Stop every sphere that would still hit something
+            // where it is, rather than let it pass through.
+            for (const SweptPair &pair : swept_pairs) {
+                real_t time;
+                Vector3 normal;
+                if (!sweep_pair(pair, now, &time, &normal))
+                    continue;
+                size_t body[2] = { pair.sphere, pair.type == SWEPT_SPHERE ? pair.other : NO_INDEX };
+                for (int m = 0; m < 2 && body[m] != NO_INDEX; m++) {
+                    rebase_sweep(body[m], now);
+                    for (int k = 0; k < 3; k++)
+                        sweep[SWEEP_D + k][body[m]] = 0.0;
+                }
+            }
+            break;
+        }
+        stats.impacts++;
+
+        const SweptPair pair = swept_pairs[first];
+        size_t a = pair.sphere;
+        size_t b = pair.type == SWEPT_SPHERE ? pair.other : NO_INDEX;
+        rebase_sweep(a, now);
+        if (b != NO_INDEX)
+            rebase_sweep(b, now);
+
+        // Bounce with the velocity at the impact, not the one at the end of
+        // the step, or every bounce would also reflect what gravity adds
+        // after it. The impulse is split like the contact solver does.
+        size_t body[2] = { a, b };
+        real_t share[2] = { 1.0, 0.0 };
+        Vector3 rel_v = impact_velocity(a, now);
+        if (b != NO_INDEX) {
+            real_t inv = inv_mass[a] + inv_mass[b];
+            share[0] = inv_mass[a] / inv;
+            share[1] = -inv_mass[b] / inv;
+            rel_v -= impact_velocity(b, now);
+        }
+        Vector3 impulse = -(1 + restitution) * std::min(dot(rel_v, first_normal), real_t(0.0)) * first_normal;
+        Vector3 rel_d = Vector3::Zero;
+        Vector3 rel_end = Vector3::Zero;
+        for (int m = 0; m < 2 && body[m] != NO_INDEX; m++) {
+            size_t i = body[m];
+            Vector3 v0(sweep[SWEEP_V][i], sweep[SWEEP_V + 1][i], sweep[SWEEP_V + 2][i]);
+            Vector3 v1 = store.get(i, STORE_VX);
+            Vector3 hit = impact_velocity(i, now) + impulse * share[m];
+            // Remaining motion under the same acceleration as before
+            Vector3 d = hit * dt + (v1 - v0) * (0.5 * (1 - now) * dt);
+            for (int k = 0; k < 3; k++) {
+                sweep[SWEEP_D + k][i] = d[k];
+                sweep[SWEEP_V + k][i] += impulse[k] * share[m];
+                store[STORE_VX + k][i] += impulse[k] * share[m];
+            }
+            rel_d += m == 0 ? d : -d;
+            rel_end += m == 0 ? store.get(i, STORE_VX) : -store.get(i, STORE_VX);
+        }
+
+        // Acceleration into the other body, e.g. gravity on a sphere that
+        // lands, is held off for the rest of the step
+        real_t dn = std::min(dot(rel_d, first_normal), real_t(0.0));
+        real_t vn = std::min(dot(rel_end, first_normal), real_t(0.0));
+        for (int m = 0; m < 2 && body[m] != NO_INDEX; m++) {
+            size_t i = body[m];
+            for (int k = 0; k < 3; k++) {
+                sweep[SWEEP_D + k][i] -= dn * share[m] * first_normal[k];
+                store[STORE_VX + k][i] -= vn * share[m] * first_normal[k];
+            }
+            cover_sweep(i, now);
+        }
+    }
+
+    for (unsigned int i : impact_bodies) {
+        Vector3 x = swept_position(i, 1.0);
+        for (int k = 0; k < 3; k++)
+            store[STORE_PX + k][i] = x[k];
+    }
+}
+
+void Physics::update(real_t frame_dt) {
+    if (store_dirty)
+        load_store();
+
+    // Don't try to catch up after long stalls (e.g. dragging the window),
+    // or every frame would take longer than the last
+    accumulator += std::min(frame_dt, real_t(PHYSICS_MAX_FRAME_TIME));
+
+    while (accumulator >= time_step) {
+        previous.resize(store.size());
+        for (int k = 0; k < 3; k++)
+            soa_copy(previous[k], store[STORE_PX + k], store.size());
+        previous_orientation = store.orientation;
+
+        step(time_step);
+        accumulator -= time_step;
+    }
+
+    sync_geometry(accumulator / time_step);
+}
+
+void Physics::sync_geometry(real_t alpha) {
+    // no previous step to blend with yet
+    if (previous.size() != store.size())
+        alpha = 1.0;
+
+    for (size_t i = 0; i < store.size(); i++) {
+        SphereBody *body = spheres[slot_sphere[i]];
+        store_to_body(i);
+        if (alpha >= 1.0) {
+            body->sphere->position = body->position;
+            body->sphere->orientation = body->orientation;
+        } else {
+            Vector3 p(previous[0][i], previous[1][i], previous[2][i]);
+            body->sphere->position = p + (body->position - p) * alpha;
+            body->sphere->orientation = slerp(previous_orientation[i], body->orientation, alpha);
+        }
+    }
+}
+
+real_t Physics::compute_energy() {
+    if (sleepers_dirty)
+        update_sleepers();
+    real_t energy = sleeper_energy;
+    for (size_t i = 0; i < num_awake; i++) {
+        real_t mass = 1 / store[STORE_INV_MASS][i];
+        real_t inertia = 1 / store[STORE_INV_INERTIA][i];
+        energy += 0.5 * mass * squared_length(store.get(i, STORE_VX));
+        energy += 0.5 * inertia * squared_length(store.get(i, STORE_WX));
+        energy -= mass * dot(gravity, store.get(i, STORE_PX));
+    }
+    energy += spring_network.potential_energy(spring_bodies());
+    return energy;
+}
+
 void Physics::add_sphere(SphereBody* b) {
     spheres.push_back(b);
+    store_dirty = true;
 }
 
 size_t Physics::num_spheres() const {
@@ -92,20 +1088,169 @@ size_t Physics::num_planes() const {
 
 void Physics::add_triangle(TriangleBody* t) {
     triangles.push_back(t);
+    statics_dirty = true;
 }
 
 size_t Physics::num_triangles() const {
     return triangles.size();
 }
 
+void Physics::add_model(const Model* m) {
+    models.push_back(m);
+    statics_dirty = true;
+}
+
+size_t Physics::num_models() const {
+    return models.size();
+}
+
+void Physics::add_convex(ConvexBody* c) {
+    convexes.push_back(c);
+    statics_dirty = true;
+}
+
+size_t Physics::num_convexes() const {
+    return convexes.size();
+}
+
+void Physics::add_hull(const Model* m) {
+    hull_models.push_back(m);
+    statics_dirty = true;
+}
+
+size_t Physics::num_hulls() const {
+    return hull_models.size();
+}
+
 void Physics::add_spring(Spring* s) {
     springs.push_back(s);
+    store_dirty = true;
 }
 
 size_t Physics::num_springs() const {
     return springs.size();
 }
 
+void Physics::set_broad_phase(BroadPhaseType type) {
+    delete broad_phase;
+    broad_phase = create_broad_phase(type);
+    broad_phase_type = type;
+    sleepers_dirty = true;
+}
+
+BroadPhaseType Physics::get_broad_phase() const {
+    return broad_phase_type;
+}
+
+void Physics::set_integrator(IntegratorType type) {
+    integrator = type;
+}
+
+IntegratorType Physics::get_integrator() const {
+    return integrator;
+}
+
+void Physics::set_time_step(real_t dt) {
+    time_step = dt;
+}
+
+real_t Physics::get_time_step() const {
+    return time_step;
+}
+
+void Physics::set_continuous_collision(bool enabled) {
+    continuous_collision = enabled;
+}
+
+bool Physics::get_continuous_collision() const {
+    return continuous_collision;
+}
+
+void Physics::set_sleeping(bool enabled) {
+    sleeping = enabled;
+    if (!sleeping)
+        wake_all();
+}
+
+bool Physics::get_sleeping() const {
+    return sleeping;
+}
+
+void Physics::wake_all() {
+    for (size_t i = num_awake; i < store.size(); i++)
+        idle_time[i] = 0.0;
+    if (num_awake != store.size())
+        sleepers_dirty = true;
+    num_awake = store.size();
+}
+
+void Physics::set_solver_threads(size_t num_threads) {
+    solver.set_num_threads(num_threads);
+}
+
+size_t Physics::get_solver_threads() const {
+    return solver.get_num_threads();
+}
+
+size_t Physics::state_size() const {
+    return spheres.size() * PHYSICS_STATE_REALS;
+}
+
+void Physics::save_state(real_t* state) const {
+    for (size_t i = 0; i < store.size(); i++) {
+        real_t *out = state + i * PHYSICS_STATE_REALS;
+        size_t slot = sphere_slot[i];
+        for (int k = 0; k < 3; k++) {
+            out[k] = store[STORE_PX + k][slot];
+            out[3 + k] = store[STORE_VX + k][slot];
+            out[6 + k] = store[STORE_WX + k][slot];
+        }
+        const Quaternion &q = store.orientation[slot];
+        out[9] = q.w;
+        out[10] = q.x;
+        out[11] = q.y;
+        out[12] = q.z;
+    }
+}
+
+void Physics::save_snapshot(PhysicsSnapshot* snapshot) const {
+    snapshot->num_steps = stats.num_steps;
+    snapshot->positions.resize(store.size());
+    snapshot->orientations.resize(store.size());
+    for (size_t i = 0; i < store.size(); i++) {
+        size_t slot = sphere_slot[i];
+        snapshot->positions[i] = store.get(slot, STORE_PX);
+        snapshot->orientations[i] = store.orientation[slot];
+    }
+}
+
+void Physics::sync_geometry(const PhysicsSnapshot& older, const PhysicsSnapshot& newer, real_t alpha) {
+    // spheres added in between have nothing to blend with
+    if (older.positions.size() != newer.positions.size())
+        alpha = 1.0;
+
+    for (size_t i = 0; i < newer.positions.size() && i < spheres.size(); i++) {
+        Sphere *sphere = spheres[i]->sphere;
+        if (alpha >= 1.0) {
+            sphere->position = newer.positions[i];
+            sphere->orientation = newer.orientations[i];
+        } else {
+            const Vector3 &p = older.positions[i];
+            sphere->position = p + (newer.positions[i] - p) * alpha;
+            sphere->orientation = slerp(older.orientations[i], newer.orientations[i], alpha);
+        }
+    }
+}
+
+const PhysicsStats& Physics::get_stats() const {
+    return stats;
+}
+
+void Physics::set_stats_hook(PhysicsStatsHook hook, void* data) {
+    stats_hook = hook;
+    stats_hook_data = data;
+}
+
 void Physics::reset() {
     for (SphereList::iterator i = spheres.begin(); i != spheres.end(); i++) {
         delete *i;
@@ -119,14 +1264,73 @@ void Physics::reset() {
     for (SpringList::iterator i = springs.begin(); i != springs.end(); i++) {
         delete *i;
     }
+    for (ConvexList::iterator i = convexes.begin(); i != convexes.end(); i++) {
+        delete *i;
+    }
 
     spheres.clear();
     planes.clear();
     triangles.clear();
     springs.clear();
+    models.clear();
+    convexes.clear();
+    hull_models.clear();
+    triangle_tree.clear();
+    convex_shapes.clear();
+    convex_boxes.clear();
+    hull_vertices.clear();
+    convex_caches.clear();
+    statics_dirty = true;
+    contact_cache.clear();
 
     gravity = Vector3::Zero;
     collision_damping = 0.0;
+    friction = 0.0;
+
+    set_broad_phase(BROAD_PHASE_GRID);
+    integrator = INTEGRATOR_VERLET;
+    time_step = PHYSICS_DEFAULT_TIME_STEP;
+    accumulator = 0.0;
+    store.resize(0);
+    num_awake = 0;
+    slot_sphere.clear();
+    sphere_slot.clear();
+    store_dirty = false;
+    spring_network.clear();
+    previous.resize(0);
+    continuous_collision = true;
+    sleeping = true;
+    idle_time.clear();
+    sleep_island.clear();
+    never_sleep.clear();
+    next_sleep_island = 0;
+    sleep_gravity = Vector3::Zero;
+    sleepers_dirty = true;
+    sleeper_energy = 0.0;
+
+    stats.num_steps = 0;
+    stats.sphere_pairs = 0;
+    stats.triangle_pairs = 0;
+    stats.convex_pairs = 0;
+    stats.gjk_iterations = 0;
+    stats.contacts = 0;
+    stats.islands = 0;
+    stats.largest_island = 0;
+    stats.cached_contacts = 0;
+    stats.solver_iterations = 0;
+    stats.max_solver_iterations = 0;
+    stats.impacts = 0;
+    stats.awake_spheres = 0;
+    stats.sleeping_spheres = 0;
+    stats.spring_iterations = 0;
+    stats.spring_residual = 0.0;
+    stats.spring_converged = true;
+    stats.broad_phase_ns = 0;
+    stats.narrow_phase_ns = 0;
+    stats.solver_ns = 0;
+    stats.springs_ns = 0;
+    stats.integrate_ns = 0;
+    stats.energy = 0.0;
 }
 
 }
@@ -8,32 +8,212 @@
 #include "physics/spherebody.hpp"
 #include "physics/trianglebody.hpp"
 #include "physics/planebody.hpp"
+#include "physics/convexbody.hpp"
 #include "physics/spring.hpp"
 #include "physics/collisions.hpp"
+#include "physics/broadphase.hpp"
+#include "physics/spherestore.hpp"
+#include "physics/contacts.hpp"
+#include "physics/springnetwork.hpp"
+#include "physics/triangletree.hpp"
+#include "physics/gjk.hpp"
+#include "scene/model.hpp"
 
 #include <vector>
 
 namespace _462 {
 
+/**
+ * Time integration schemes usable by Physics::step.
+ */
+enum IntegratorType
+{
+    // v += a * dt, then x += v * dt. First order, but energy stays bounded.
+    INTEGRATOR_SYMPLECTIC_EULER,
+    // velocity Verlet. Second order, energy stays bounded.
+    INTEGRATOR_VERLET,
+    // classic fourth order Runge-Kutta over the whole body state vector
+    INTEGRATOR_RK4
+};
+
+// reals per sphere written by Physics::save_state
+#define PHYSICS_STATE_REALS 13
+
+/**
+ * Counters describing the last call to Physics::step.
+ */
+struct PhysicsStats
+{
+    // number of steps taken since the last reset
+    size_t num_steps;
+    // sphere-sphere candidate pairs reported by the broad phase
+    size_t sphere_pairs;
+    // sphere-triangle candidate pairs found in the triangle tree
+    size_t triangle_pairs;
+    // sphere-convex candidate pairs, and the GJK iterations their contact
+    // tests took
+    size_t convex_pairs;
+    size_t gjk_iterations;
+    // contacts passed to the solver, and the islands they formed
+    size_t contacts;
+    size_t islands;
+    // most contacts in a single island
+    size_t largest_island;
+    // contacts that persisted from the last step and were warm started
+    size_t cached_contacts;
+    // solver passes summed over the islands, and the most any island took
+    size_t solver_iterations;
+    size_t max_solver_iterations;
+    // impacts found by sweeping fast spheres and resolved within the step
+    size_t impacts;
+    // spheres simulated by the step, and spheres asleep after it
+    size_t awake_spheres;
+    size_t sleeping_spheres;
+    // conjugate gradient iterations of the spring solve, the residual it
+    // stopped at relative to the forces, and whether that reached the
+    // tolerance or the solve was cut off by the iteration cap
+    size_t spring_iterations;
+    real_t spring_residual;
+    bool spring_converged;
+    // wall clock time of the phases of the step, in nanoseconds. The narrow
+    // phase includes finding contacts and sweeping fast spheres
+    long long broad_phase_ns;
+    long long narrow_phase_ns;
+    long long solver_ns;
+    long long springs_ns;
+    long long integrate_ns;
+    // total mechanical energy (kinetic, gravitational and spring) after the step
+    real_t energy;
+};
+
+/**
+ * Position and orientation of every sphere after some step, by sphere
+ * index. Lets another thread draw the spheres while the next steps are
+ * taken.
+ */
+struct PhysicsSnapshot
+{
+    // steps taken when the snapshot was saved
+    size_t num_steps;
+    std::vector< Vector3 > positions;
+    std::vector< Quaternion > orientations;
+};
+
+/**
+ * Invoked at the end of every step with the stats of that step.
+ */
+typedef void (*PhysicsStatsHook)( const PhysicsStats& stats, void* data );
+
 class Physics
 {
 public:
     Vector3 gravity;
     real_t collision_damping;
+    // Coulomb friction coefficient of all contacts
+    real_t friction;
 
     Physics();
     ~Physics();
 
+    /**
+     * Advances the simulation by frame_dt using as many fixed size steps as
+     * fit, carrying the remainder over to the next call. Geometries are set
+     * to the body state interpolated between the last two steps.
+     */
+    void update( real_t frame_dt );
+    /**
+     * Takes a single step of size dt. Geometries and SphereBody fields are
+     * only brought up to date by update().
+     */
     void step( real_t dt );
+    /**
+     * Integrates all spheres over dt, without collision detection. Springs
+     * are integrated implicitly around the selected integrator, which moves
+     * the spheres under gravity and the forces applied to the awake bodies
+     * since the last step.
+     */
+    void integrate( real_t dt );
     void add_sphere( SphereBody* s );
     size_t num_spheres() const;
     void add_plane( PlaneBody* p );
     size_t num_planes() const;
     void add_triangle( TriangleBody* t );
     size_t num_triangles() const;
+    /**
+     * Adds the triangles of the model's mesh as static colliders, placed by
+     * the model's transform. The model is not owned and must stay alive,
+     * and its mesh must be loaded before the next step.
+     */
+    void add_model( const Model* m );
+    size_t num_models() const;
+    void add_convex( ConvexBody* c );
+    size_t num_convexes() const;
+    /**
+     * Adds the convex hull of the vertices of the model's mesh as a static
+     * collider, placed by the model's transform. Far cheaper than the
+     * triangles of add_model for convex meshes. The same requirements as
+     * for add_model apply.
+     */
+    void add_hull( const Model* m );
+    size_t num_hulls() const;
     void add_spring( Spring* s );
     size_t num_springs() const;
 
+    void set_broad_phase( BroadPhaseType type );
+    BroadPhaseType get_broad_phase() const;
+
+    void set_integrator( IntegratorType type );
+    IntegratorType get_integrator() const;
+    // the fixed step size used by update()
+    void set_time_step( real_t dt );
+    real_t get_time_step() const;
+
+    // whether fast spheres are swept along their motion, so they can't
+    // tunnel through thin bodies at large time steps
+    void set_continuous_collision( bool enabled );
+    bool get_continuous_collision() const;
+
+    // Whether islands of spheres that stayed slow for a while fall asleep.
+    // Sleeping spheres are skipped by every phase of the step until an
+    // awake sphere comes close to them.
+    void set_sleeping( bool enabled );
+    bool get_sleeping() const;
+    /**
+     * Wakes all sleeping spheres. Spheres attached to springs never sleep,
+     * changing gravity wakes everything by itself and a force applied to a
+     * sleeping sphere wakes its island at the next step.
+     */
+    void wake_all();
+
+    // threads used to solve contact islands, 0 for one per hardware thread
+    void set_solver_threads( size_t num_threads );
+    size_t get_solver_threads() const;
+
+    /**
+     * Number of reals written by save_state, PHYSICS_STATE_REALS per sphere.
+     */
+    size_t state_size() const;
+    /**
+     * Writes the position, velocity, angular velocity and orientation
+     * (w, x, y, z) of every sphere as of the last step.
+     */
+    void save_state( real_t* state ) const;
+    /**
+     * Writes the position and orientation of every sphere as of the last
+     * step.
+     */
+    void save_snapshot( PhysicsSnapshot* snapshot ) const;
+    /**
+     * Sets the sphere geometries to the state interpolated between two
+     * snapshots, alpha 0 giving older and 1 newer. Only touches the
+     * geometries, not the SphereBody fields, so it may run while another
+     * thread is calling step().
+     */
+    void sync_geometry( const PhysicsSnapshot& older, const PhysicsSnapshot& newer, real_t alpha );
+
+    const PhysicsStats& get_stats() const;
+    void set_stats_hook( PhysicsStatsHook hook, void* data );
+
     void reset();
 
 private:
@@ -41,11 +221,150 @@ private:
     typedef std::vector< SphereBody* > SphereList;
     typedef std::vector< PlaneBody* > PlaneList;
     typedef std::vector< TriangleBody* > TriangleList;
+    typedef std::vector< const Model* > ModelList;
+    typedef std::vector< ConvexBody* > ConvexList;
+    typedef std::unordered_map< unsigned long long, ConvexCache > ConvexCacheMap;
 
     SpringList springs;
     SphereList spheres;
     PlaneList planes;
     TriangleList triangles;
+    ModelList models;
+    ConvexList convexes;
+    ModelList hull_models;
+
+    IntegratorType integrator;
+    real_t time_step;
+    // simulated time not yet consumed by update()
+    real_t accumulator;
+
+    // Packed state of all spheres. Loaded from the SphereBody objects as
+    // they are added, written back by update(). Slots [0, num_awake) hold
+    // the awake spheres, so the integrators and the broad phase only run
+    // over a prefix of the store; the sleeping spheres follow.
+    SphereStore store;
+    size_t num_awake;
+    // index into spheres of every store slot, and the slot of every sphere
+    std::vector< unsigned int > slot_sphere;
+    std::vector< unsigned int > sphere_slot;
+    // set when spheres or springs were added since the last step
+    bool store_dirty;
+    // all springs, referring to spheres by index into spheres
+    SpringNetwork spring_network;
+    // positions and orientations before the last step, for interpolation
+    SoABuffer previous;
+    std::vector< Quaternion > previous_orientation;
+    // scratch arrays of the integrators
+    SoABuffer scratch;
+
+    BroadPhaseType broad_phase_type;
+    BroadPhase* broad_phase;
+    // set when triangles or models were added since the last step
+    bool statics_dirty;
+    // all static triangles, of triangle bodies first and then of models
+    TriangleTree triangle_tree;
+    std::vector< unsigned int > tree_hits;
+    std::vector< AABB > boxes;
+    // body id of every awake slot, so spheres of one body never pair
+    std::vector< int > box_groups;
+    ProxyPairList sphere_pairs;
+    ProxyPairList triangle_pairs;
+
+    // all convex colliders, of convex bodies first and then of hulls, with
+    // their bounds. Built along with the triangle tree.
+    std::vector< ConvexShape > convex_shapes;
+    std::vector< AABB > convex_boxes;
+    // local space vertices of the hulls, referred to by their shapes
+    std::vector< Vector3 > hull_vertices;
+    ProxyPairList convex_pairs;
+    // GJK simplex of every sphere-convex pair tested in the last step, and
+    // of those tested in this one, by contact key
+    ConvexCacheMap convex_caches;
+    ConvexCacheMap next_convex_caches;
+
+    ContactList contacts;
+    ContactSolver solver;
+    // impulses of the last step's contacts
+    ContactCache contact_cache;
+
+    // a fast sphere and a body it may hit while moving over a step
+    struct SweptPair
+    {
+        unsigned int sphere;
+        unsigned int other;
+        // SWEPT_SPHERE, SWEPT_TRIANGLE, SWEPT_PLANE or SWEPT_CONVEX
+        int type;
+    };
+
+    bool continuous_collision;
+    // Motion of the spheres over the step, split in segments at impacts,
+    // with times as fractions of the step
+    SoABuffer sweep;
+    std::vector< SweptPair > swept_pairs;
+    // set for spheres moving far enough to be swept
+    std::vector< char > fast_spheres;
+    // spheres moved by resolve_impacts
+    std::vector< unsigned int > impact_bodies;
+
+    // Sleeping, all by store slot
+    bool sleeping;
+    // time each slot has stayed slow enough to sleep
+    std::vector< real_t > idle_time;
+    // island a sleeping slot fell asleep with. Islands wake up together.
+    std::vector< unsigned int > sleep_island;
+    // set for slots that must stay awake
+    std::vector< char > never_sleep;
+    unsigned int next_sleep_island;
+    // gravity the sleeping spheres fell asleep under
+    Vector3 sleep_gravity;
+    // set when spheres fell asleep or woke up since the last step
+    bool sleepers_dirty;
+    std::vector< AABB > sleeper_boxes;
+    std::vector< int > sleeper_groups;
+    // awake-sleeping candidate pairs, by awake slot and sleeping index
+    ProxyPairList sleeper_pairs;
+    // potential energy of the sleeping spheres, which don't move
+    real_t sleeper_energy;
+    // scratch of update_sleep, by island root
+    std::vector< real_t > island_idle;
+    std::vector< unsigned int > island_tag;
+    std::vector< unsigned int > wake_islands;
+
+    PhysicsStats stats;
+    PhysicsStatsHook stats_hook;
+    void* stats_hook_data;
+
+    void update_broad_phase( real_t dt );
+    void build_triangle_tree();
+    void build_convex_shapes();
+    void load_store();
+    void store_to_body( size_t slot );
+    void load_springs();
+    SpringBodies spring_bodies();
+    void swap_slots( size_t a, size_t b );
+    void update_sleepers();
+    bool wake_touched();
+    bool wake_forced();
+    bool wake_listed();
+    void update_sleep( real_t dt );
+    void find_contacts();
+    void resolve_impacts( real_t dt );
+    Vector3 swept_position( size_t i, real_t time ) const;
+    Vector3 impact_velocity( size_t i, real_t time ) const;
+    bool sweep_pair( const SweptPair& pair, real_t now, real_t* time, Vector3* normal ) const;
+    void rebase_sweep( size_t i, real_t now );
+    void cover_sweep( size_t i, real_t now );
+    void load_forces();
+    void accumulate_acceleration( real_t* const out[6], real_t dt );
+    void kick( real_t dt );
+    void drift( real_t dt );
+    void integrate_rk4( real_t dt );
+    void sync_geometry( real_t alpha );
+    real_t compute_energy();
+
+    // no meaningful assignment or copy
+    Physics( const Physics& );
+    Physics& operator=( const Physics& );
 };
 
 }
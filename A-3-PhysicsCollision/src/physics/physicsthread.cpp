@@ -0,0 +1,168 @@
+/**
+ * @file physicsthread.cpp
+ * @brief Runs the simulation on its own thread, decoupled from rendering.
+ */
+
+#include "physics/physicsthread.hpp"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+namespace _462 {
+
+// how far, in seconds, the thread may fall behind the wall clock before it
+// gives up catching up and carries on from the present
+#define PHYSICS_THREAD_MAX_LAG 0.25
+
+typedef std::chrono::steady_clock Clock;
+
+static long long now_ns()
+{
+    return std::chrono::duration_cast< std::chrono::nanoseconds >( Clock::now().time_since_epoch() ).count();
+}
+
+static Clock::duration to_duration( real_t seconds )
+{
+    return std::chrono::duration_cast< Clock::duration >( std::chrono::duration< double >( seconds ) );
+}
+
+PhysicsThread::PhysicsThread()
+    : physics( 0 ), quit( false ), paused( false ), speed( 1.0 ), rescheduled( false )
+{
+    older.time_ns = 0;
+    newer.time_ns = 0;
+}
+
+PhysicsThread::~PhysicsThread()
+{
+    stop();
+}
+
+void PhysicsThread::start( Physics* p )
+{
+    assert( p );
+    stop();
+    physics = p;
+    quit = false;
+    rescheduled = true;
+    older.snapshot.positions.clear();
+    newer.snapshot.positions.clear();
+    thread = std::thread( &PhysicsThread::run, this );
+}
+
+void PhysicsThread::stop()
+{
+    if ( !thread.joinable() ) {
+        return;
+    }
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        quit = true;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+bool PhysicsThread::is_running() const
+{
+    return thread.joinable();
+}
+
+void PhysicsThread::set_speed( real_t s )
+{
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        speed = s;
+        rescheduled = true;
+    }
+    wake.notify_one();
+}
+
+real_t PhysicsThread::get_speed() const
+{
+    std::lock_guard< std::mutex > lock( mutex );
+    return speed;
+}
+
+void PhysicsThread::set_paused( bool p )
+{
+    {
+        std::lock_guard< std::mutex > lock( mutex );
+        paused = p;
+        rescheduled = true;
+    }
+    wake.notify_one();
+}
+
+bool PhysicsThread::get_paused() const
+{
+    std::lock_guard< std::mutex > lock( mutex );
+    return paused;
+}
+
+void PhysicsThread::run()
+{
+    real_t dt = physics->get_time_step();
+    std::unique_lock< std::mutex > lock( mutex );
+
+    // step number steps is due at start + steps * dt / speed
+    Clock::time_point start;
+    size_t steps = 0;
+    while ( !quit ) {
+        if ( rescheduled ) {
+            start = Clock::now();
+            steps = 0;
+            rescheduled = false;
+        }
+        if ( paused || speed <= 0.0 ) {
+            wake.wait( lock );
+            continue;
+        }
+
+        Clock::time_point now = Clock::now();
+        Clock::time_point due = start + to_duration( steps * dt / speed );
+        if ( now < due ) {
+            wake.wait_until( lock, due );
+            continue;
+        }
+        // Steps take longer than the time they simulate, don't pile up
+        // debt that would only be paid back by running too fast later
+        if ( now - due > to_duration( PHYSICS_THREAD_MAX_LAG ) ) {
+            start = now;
+            steps = 0;
+        }
+
+        lock.unlock();
+        physics->step( dt );
+        Frame& frame = frames.write_buffer();
+        physics->save_snapshot( &frame.snapshot );
+        frame.time_ns = now_ns();
+        frames.publish();
+        lock.lock();
+        ++steps;
+    }
+}
+
+void PhysicsThread::sync_geometry()
+{
+    if ( frames.fetch() ) {
+        // swapping keeps the capacity of both, so copying doesn't allocate
+        std::swap( older, newer );
+        newer = frames.read_buffer();
+    }
+    if ( newer.snapshot.positions.empty() ) {
+        return;
+    }
+
+    // Show the state one snapshot interval in the past, which lies between
+    // the two snapshots until the next one is late
+    real_t alpha = 1.0;
+    long long interval = newer.time_ns - older.time_ns;
+    if ( !older.snapshot.positions.empty() && interval > 0 ) {
+        alpha = real_t( now_ns() - newer.time_ns ) / real_t( interval );
+        alpha = std::min( std::max( alpha, real_t( 0.0 ) ), real_t( 1.0 ) );
+    }
+    physics->sync_geometry( older.snapshot, newer.snapshot, alpha );
+}
+
+} /* _462 */
@@ -0,0 +1,94 @@
+/**
+ * @file physicsthread.hpp
+ * @brief Runs the simulation on its own thread, decoupled from rendering.
+ */
+
+#ifndef _462_PHYSICS_PHYSICSTHREAD_HPP_
+#define _462_PHYSICS_PHYSICSTHREAD_HPP_
+
+#include "physics/physics.hpp"
+#include "application/triplebuffer.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace _462 {
+
+/**
+ * Steps a Physics on a separate thread at its fixed time step, paced by the
+ * wall clock, so a slow frame doesn't slow down the simulation and a slow
+ * step doesn't stall the frame. After every step the sphere transforms are
+ * published through a triple buffer. The render thread draws the state
+ * interpolated between the last two snapshots it got, which trails the
+ * simulation by at most one snapshot but moves smoothly whatever the two
+ * rates are.
+ */
+class PhysicsThread
+{
+public:
+
+    PhysicsThread();
+    // stops the thread if it is running
+    ~PhysicsThread();
+
+    /**
+     * Starts stepping physics on a new thread. Until stop() returns, the
+     * caller must not touch physics other than through sync_geometry().
+     */
+    void start( Physics* physics );
+    /**
+     * Stops stepping and waits for the thread to finish its step.
+     */
+    void stop();
+    bool is_running() const;
+
+    // simulated time per wall clock time
+    void set_speed( real_t speed );
+    real_t get_speed() const;
+    // while paused no steps are taken and the last snapshot stays on screen
+    void set_paused( bool paused );
+    bool get_paused() const;
+
+    /**
+     * Sets the sphere geometries to the state interpolated between the last
+     * two snapshots, as of now. Render thread only.
+     */
+    void sync_geometry();
+
+private:
+
+    // a snapshot and the wall clock time it was published at
+    struct Frame
+    {
+        PhysicsSnapshot snapshot;
+        long long time_ns;
+    };
+
+    void run();
+
+    Physics* physics;
+    std::thread thread;
+
+    // guards everything up to frames
+    mutable std::mutex mutex;
+    // signals the thread that it should quit or that the controls changed
+    std::condition_variable wake;
+    bool quit;
+    bool paused;
+    real_t speed;
+    // set when the controls changed, so the thread starts pacing over
+    bool rescheduled;
+
+    TripleBuffer< Frame > frames;
+    // last two frames fetched by the render thread
+    Frame older;
+    Frame newer;
+
+    // no meaningful assignment or copy
+    PhysicsThread( const PhysicsThread& );
+    PhysicsThread& operator=( const PhysicsThread& );
+};
+
+} /* _462 */
+
+#endif /* _462_PHYSICS_PHYSICSTHREAD_HPP_ */
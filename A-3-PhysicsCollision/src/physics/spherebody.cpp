@@ -32,8 +32,8 @@ Vector3 SphereBody::step_position( real_t dt, real_t motion_damping )
 Vector3 SphereBody::step_orientation( real_t dt, real_t motion_damping )
 {
     // https://stackoverflow.com/a/46924782/11702338
-    // Angular velocity was integrate as quaternion rotation in Quaternion(this->angular_velocity, dt)
-    this->orientation = motion_damping * this->orientation * Quaternion(this->angular_velocity, dt);
+    // Angular velocity was integrate as quaternion rotation by |angular_velocity| * dt
+    this->orientation = integrate_orientation(this->orientation, motion_damping * this->angular_velocity, dt);
     this->sphere->orientation = this->orientation;
     return Vector3::Zero; // Return nothing. (I don't understand why they need return value here)
 }
@@ -45,7 +45,8 @@ Vector3 SphereBody::get_force()
 
 void SphereBody::apply_force( const Vector3& f, const Vector3& offset )
 {
-    // TODO apply force/torque to sphere
+    // Held until the next physics step, which applies it over the whole
+    // step and resets it
     this->force += f;
     if (offset != Vector3::Zero)
         this->torque += cross(offset, f);
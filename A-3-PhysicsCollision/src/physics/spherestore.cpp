@@ -0,0 +1,151 @@
+/**
+ * @file spherestore.cpp
+ * @brief Packed structure-of-arrays storage of sphere body state.
+ */
+
+#include "physics/spherestore.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#define SOA_USE_AVX2
+#endif
+
+// the AVX2 kernels are written once against these, so they run on either
+// precision of real_t
+#if defined( SOA_USE_AVX2 ) && defined( MATH_SINGLE_PRECISION )
+typedef __m256 soa_vec;
+#define soa_set1 _mm256_set1_ps
+#define soa_load _mm256_load_ps
+#define soa_store _mm256_store_ps
+#define soa_add _mm256_add_ps
+#define soa_mul _mm256_mul_ps
+#elif defined( SOA_USE_AVX2 )
+typedef __m256d soa_vec;
+#define soa_set1 _mm256_set1_pd
+#define soa_load _mm256_load_pd
+#define soa_store _mm256_store_pd
+#define soa_add _mm256_add_pd
+#define soa_mul _mm256_mul_pd
+#endif
+
+namespace _462 {
+
+// arrays start on a register boundary
+#define SOA_ALIGNMENT ( SOA_WIDTH * sizeof( real_t ) )
+
+static size_t round_up( size_t n )
+{
+    return ( n + SOA_WIDTH - 1 ) / SOA_WIDTH * SOA_WIDTH;
+}
+
+SoABuffer::SoABuffer( size_t num_arrays )
+    : num_arrays( num_arrays ), count( 0 ), capacity( 0 ), data( 0 ), block( 0 ) { }
+
+SoABuffer::~SoABuffer()
+{
+    free( block );
+}
+
+void SoABuffer::resize( size_t new_count )
+{
+    if ( new_count > capacity ) {
+        // grow geometrically so adding bodies one by one stays linear
+        size_t new_capacity = round_up( std::max( new_count, capacity * 2 ) );
+        size_t bytes = num_arrays * new_capacity * sizeof( real_t );
+        void* new_block = malloc( bytes + SOA_ALIGNMENT );
+        if ( !new_block )
+            throw std::bad_alloc();
+
+        real_t* new_data = (real_t*) ( ( (size_t) new_block + SOA_ALIGNMENT - 1 ) & ~(size_t) ( SOA_ALIGNMENT - 1 ) );
+        memset( new_data, 0, bytes );
+        // an empty store has no block to copy from yet
+        for ( size_t i = 0; count > 0 && i < num_arrays; ++i ) {
+            memcpy( new_data + i * new_capacity, data + i * capacity, count * sizeof( real_t ) );
+        }
+
+        free( block );
+        block = new_block;
+        data = new_data;
+        capacity = new_capacity;
+    } else if ( new_count > count ) {
+        // the padding may hold stale values, clear what becomes visible
+        for ( size_t i = 0; i < num_arrays; ++i ) {
+            memset( data + i * capacity + count, 0, ( new_count - count ) * sizeof( real_t ) );
+        }
+    }
+    count = new_count;
+}
+
+void soa_zero( real_t* out, size_t n )
+{
+    memset( out, 0, n * sizeof( real_t ) );
+}
+
+void soa_copy( real_t* out, const real_t* in, size_t n )
+{
+    memmove( out, in, n * sizeof( real_t ) );
+}
+
+#if defined( SOA_USE_AVX2 )
+
+void soa_madd( real_t* out, const real_t* a, const real_t* b, real_t s, size_t n )
+{
+    soa_vec vs = soa_set1( s );
+    size_t i = 0;
+    for ( ; i + SOA_WIDTH <= n; i += SOA_WIDTH ) {
+        soa_vec va = soa_load( a + i );
+        soa_vec vb = soa_load( b + i );
+        soa_store( out + i, soa_add( va, soa_mul( vb, vs ) ) );
+    }
+    for ( ; i < n; ++i ) {
+        out[i] = a[i] + b[i] * s;
+    }
+}
+
+void soa_kick( real_t* v, const real_t* f, const real_t* inv_mass, real_t g, real_t dt, size_t n )
+{
+    soa_vec vg = soa_set1( g );
+    soa_vec vdt = soa_set1( dt );
+    size_t i = 0;
+    for ( ; i + SOA_WIDTH <= n; i += SOA_WIDTH ) {
+        soa_vec acc = soa_add( soa_mul( soa_load( f + i ), soa_load( inv_mass + i ) ), vg );
+        soa_store( v + i, soa_add( soa_load( v + i ), soa_mul( acc, vdt ) ) );
+    }
+    for ( ; i < n; ++i ) {
+        v[i] += ( f[i] * inv_mass[i] + g ) * dt;
+    }
+}
+
+const char* soa_kernel_name()
+{
+    return "avx2";
+}
+
+#else
+
+void soa_madd( real_t* out, const real_t* a, const real_t* b, real_t s, size_t n )
+{
+    for ( size_t i = 0; i < n; ++i ) {
+        out[i] = a[i] + b[i] * s;
+    }
+}
+
+void soa_kick( real_t* v, const real_t* f, const real_t* inv_mass, real_t g, real_t dt, size_t n )
+{
+    for ( size_t i = 0; i < n; ++i ) {
+        v[i] += ( f[i] * inv_mass[i] + g ) * dt;
+    }
+}
+
+const char* soa_kernel_name()
+{
+    return "scalar";
+}
+
+#endif
+
+} /* _462 */
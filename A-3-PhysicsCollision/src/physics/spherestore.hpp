@@ -0,0 +1,138 @@
+/**
+ * @file spherestore.hpp
+ * @brief Packed structure-of-arrays storage of sphere body state.
+ *
+ * Physics integrates spheres out of a SphereStore instead of walking the
+ * SphereBody objects. Every field lives in its own contiguous array, so the
+ * per-step work is a handful of streaming loops that the kernels below run
+ * 4 doubles, or 8 floats, at a time when built with AVX2.
+ */
+
+#ifndef _462_PHYSICS_SPHERESTORE_HPP_
+#define _462_PHYSICS_SPHERESTORE_HPP_
+
+#include "math/math.hpp"
+#include "math/quaternion.hpp"
+#include <vector>
+
+namespace _462 {
+
+// every array is padded to a multiple of this many elements, those that
+// fit a 256 bit register
+#ifdef MATH_SINGLE_PRECISION
+#define SOA_WIDTH 8
+#else
+#define SOA_WIDTH 4
+#endif
+
+/**
+ * A fixed number of real_t arrays of equal length sharing one 32 byte
+ * aligned allocation. Arrays are stride() elements apart and padded to a
+ * multiple of SOA_WIDTH, so consecutive arrays can be processed by one
+ * kernel call over a multiple of stride() elements.
+ */
+class SoABuffer
+{
+public:
+
+    explicit SoABuffer( size_t num_arrays );
+    ~SoABuffer();
+
+    /**
+     * Sets the length of every array, keeping the contents of the first
+     * min(size(), count) elements. New elements are zero.
+     */
+    void resize( size_t count );
+    size_t size() const { return count; }
+    // distance between the starts of two consecutive arrays
+    size_t stride() const { return capacity; }
+
+    real_t* operator[]( size_t array ) { return data + array * capacity; }
+    const real_t* operator[]( size_t array ) const { return data + array * capacity; }
+
+private:
+
+    size_t num_arrays;
+    size_t count;
+    size_t capacity;
+    real_t* data;
+    void* block;
+
+    // no meaningful assignment or copy
+    SoABuffer( const SoABuffer& );
+    SoABuffer& operator=( const SoABuffer& );
+};
+
+/**
+ * The arrays of a SphereStore. The velocity-like fields (linear, then
+ * angular) are consecutive and in the same order as the force-like fields
+ * (force, then torque), so STORE_VX + k is integrated with STORE_FX + k.
+ */
+enum SphereField
+{
+    STORE_PX, STORE_PY, STORE_PZ,
+    STORE_VX, STORE_VY, STORE_VZ,
+    STORE_WX, STORE_WY, STORE_WZ,
+    STORE_FX, STORE_FY, STORE_FZ,
+    STORE_TX, STORE_TY, STORE_TZ,
+    STORE_INV_MASS,
+    STORE_INV_INERTIA,
+    STORE_RADIUS,
+    STORE_NUM_FIELDS
+};
+
+/**
+ * State of all simulated spheres. Orientations are kept as an array of
+ * quaternions next to the packed fields since they are only touched for
+ * spinning spheres.
+ */
+class SphereStore : public SoABuffer
+{
+public:
+
+    SphereStore() : SoABuffer( STORE_NUM_FIELDS ) { }
+
+    void resize( size_t count )
+    {
+        SoABuffer::resize( count );
+        orientation.resize( count, Quaternion::Identity );
+    }
+
+    Vector3 get( size_t i, SphereField x ) const
+    {
+        return Vector3( ( *this )[x][i], ( *this )[x + 1][i], ( *this )[x + 2][i] );
+    }
+
+    void set( size_t i, SphereField x, const Vector3& v )
+    {
+        ( *this )[x][i] = v.x;
+        ( *this )[x + 1][i] = v.y;
+        ( *this )[x + 2][i] = v.z;
+    }
+
+    std::vector< Quaternion > orientation;
+};
+
+/*
+   Kernels over packed arrays, which must start 32 byte aligned. n need not
+   be a multiple of SOA_WIDTH and elements from n on are never written, so
+   a kernel can run over the first n elements of arrays that hold more.
+ */
+
+// out[i] = 0
+void soa_zero( real_t* out, size_t n );
+// out[i] = in[i]
+void soa_copy( real_t* out, const real_t* in, size_t n );
+// out[i] = a[i] + b[i] * s. out may alias a or b.
+void soa_madd( real_t* out, const real_t* a, const real_t* b, real_t s, size_t n );
+// v[i] += ( f[i] * inv_mass[i] + g ) * dt
+void soa_kick( real_t* v, const real_t* f, const real_t* inv_mass, real_t g, real_t dt, size_t n );
+
+/**
+ * Returns the name of the kernel implementation compiled in.
+ */
+const char* soa_kernel_name();
+
+} /* _462 */
+
+#endif /* _462_PHYSICS_SPHERESTORE_HPP_ */
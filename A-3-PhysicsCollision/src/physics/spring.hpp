@@ -5,18 +5,23 @@
 
 namespace _462 {
 
+/**
+ * A damped spring between two bodies, as declared by the scene. Physics
+ * gathers all springs into a SpringNetwork and integrates them together.
+ */
 class Spring
 {
 public:
     Spring();
     virtual ~Spring() {};
-    void step( real_t dt );
 
     real_t constant;
     real_t equilibrium;
     real_t damping;
     Body* body1;
+    // null to attach body1 to the fixed point body2_offset
     Body* body2;
+    // attachment points in the frame of each body
     Vector3 body1_offset;
     Vector3 body2_offset;
 };
@@ -0,0 +1,398 @@
+/**
+ * @file springnetwork.cpp
+ * @brief Implicit integration of networks of damped springs.
+ */
+
+#include "physics/springnetwork.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace _462 {
+
+// springs shorter than this have no direction
+#define SPRING_MIN_LENGTH 1e-9
+// Phase, in radians, the fastest mode of a network may turn per step for
+// the network to take midpoint steps. Past it, the mode is too fast for the
+// step to follow and is better damped out by backward Euler.
+#define SPRING_STIFF_PHASE 2.0
+// The same for the fastest spin of a body from springs attached off its
+// center. Spin takes explicit steps, which gain energy well before they
+// blow up.
+#define SPRING_SPIN_PHASE 1.0
+// most Newton iterations of a midpoint step
+#define SPRING_NEWTON_ITERATIONS 4
+
+// m * v for a symmetric m, without the call of Matrix3::operator*
+static inline Vector3 multiply_symmetric( const Matrix3& m, const Vector3& v )
+{
+    return Vector3( m._m[0][0] * v.x + m._m[1][0] * v.y + m._m[2][0] * v.z,
+                    m._m[0][1] * v.x + m._m[1][1] * v.y + m._m[2][1] * v.z,
+                    m._m[0][2] * v.x + m._m[1][2] * v.y + m._m[2][2] * v.z );
+}
+
+static real_t dot_all( const std::vector< Vector3 >& a, const std::vector< Vector3 >& b )
+{
+    real_t sum = 0.0;
+    for ( size_t i = 0; i < a.size(); ++i ) {
+        sum += dot( a[i], b[i] );
+    }
+    return sum;
+}
+
+SpringNetwork::SpringNetwork() : last_iterations( 0 ), last_residual( 0.0 ), last_converged( true ), last_stiff( false ) { }
+
+void SpringNetwork::clear()
+{
+    links.clear();
+    node_bodies.clear();
+    body_nodes.clear();
+    delta_velocity.clear();
+    last_iterations = 0;
+    last_residual = 0.0;
+    last_converged = true;
+    last_stiff = false;
+}
+
+unsigned int SpringNetwork::add_node( unsigned int body )
+{
+    std::pair< std::unordered_map< unsigned int, unsigned int >::iterator, bool > inserted =
+        body_nodes.insert( std::make_pair( body, unsigned( node_bodies.size() ) ) );
+    if ( inserted.second ) {
+        node_bodies.push_back( body );
+    }
+    return inserted.first->second;
+}
+
+void SpringNetwork::add( const SpringLink& link )
+{
+    assert( link.body1 != SPRING_ANCHOR );
+    Link l;
+    l.node1 = add_node( link.body1 );
+    l.node2 = link.body2 == SPRING_ANCHOR ? SPRING_ANCHOR : add_node( link.body2 );
+    l.offset1 = link.offset1;
+    l.offset2 = link.offset2;
+    l.stiffness = link.stiffness;
+    l.rest_length = link.rest_length;
+    l.damping = link.damping;
+    links.push_back( l );
+}
+
+void SpringNetwork::attachment( const SpringBodies& bodies, unsigned int node, const Vector3& offset,
+                                Vector3* point, Vector3* velocity ) const
+{
+    if ( node == SPRING_ANCHOR ) {
+        *point = offset;
+        *velocity = Vector3::Zero;
+        return;
+    }
+    size_t i = bodies.slot[node_bodies[node]];
+    const Quaternion& q = bodies.orientation[i];
+    Vector3 x( bodies.position[0][i], bodies.position[1][i], bodies.position[2][i] );
+    Vector3 v( bodies.velocity[0][i], bodies.velocity[1][i], bodies.velocity[2][i] );
+    *point = x;
+    *velocity = v;
+    if ( offset != Vector3::Zero ) {
+        *point += q * offset;
+        Vector3 w( bodies.angular_velocity[0][i], bodies.angular_velocity[1][i], bodies.angular_velocity[2][i] );
+        *velocity += q * cross( w, offset );
+    }
+}
+
+void SpringNetwork::multiply( const std::vector< Vector3 >& x, std::vector< Vector3 >* result ) const
+{
+    std::vector< Vector3 >& out = *result;
+    for ( size_t i = 0; i < x.size(); ++i ) {
+        out[i] = node_mass[i] * x[i];
+    }
+    for ( size_t k = 0; k < blocks.size(); ++k ) {
+        const Block& block = blocks[k];
+        Vector3 u = x[block.node1];
+        if ( block.node2 != SPRING_ANCHOR ) {
+            u -= x[block.node2];
+        }
+        Vector3 bu = block.alpha * u + block.beta * dot( block.direction, u ) * block.direction;
+        out[block.node1] += bu;
+        if ( block.node2 != SPRING_ANCHOR ) {
+            out[block.node2] -= bu;
+        }
+    }
+}
+
+void SpringNetwork::halfway( unsigned int node, real_t h, Vector3* point, Vector3* velocity ) const
+{
+    if ( node == SPRING_ANCHOR ) {
+        return;
+    }
+    // the attachment moves along its velocity, spin included to first order
+    Vector3 dv = 0.5 * delta_velocity[node];
+    *velocity += dv;
+    *point += 0.5 * h * *velocity;
+}
+
+void SpringNetwork::linearize( const SpringBodies& bodies, real_t h, real_t theta, bool at_halfway )
+{
+    size_t n = node_bodies.size();
+
+    // diagonal blocks start out as the masses
+    std::vector< Matrix3 >& diagonal = preconditioner;
+    for ( size_t i = 0; i < n; ++i ) {
+        diagonal[i] = Matrix3::Identity * node_mass[i];
+        rhs[i] = at_halfway ? -node_mass[i] * delta_velocity[i] : Vector3::Zero;
+    }
+    // Spin takes an explicit step with the torque at the start of the step,
+    // which keeps the energy along with a midpoint step of the rest
+    bool spin = !at_halfway;
+    if ( spin ) {
+        std::fill( torque.begin(), torque.end(), Vector3::Zero );
+    }
+
+    for ( size_t k = 0; k < links.size(); ++k ) {
+        const Link& link = links[k];
+        Block& block = blocks[k];
+        Vector3 p1, v1, p2, v2;
+        attachment( bodies, link.node1, link.offset1, &p1, &v1 );
+        attachment( bodies, link.node2, link.offset2, &p2, &v2 );
+        if ( at_halfway ) {
+            halfway( link.node1, h, &p1, &v1 );
+            halfway( link.node2, h, &p2, &v2 );
+        }
+        Vector3 delta = p1 - p2;
+        Vector3 u = v1 - v2;
+        real_t l = length( delta );
+
+        // K = k s I + k (1 - s) d d^T with s = 1 - rest / l. A compressed
+        // spring has s < 0 and K indefinite, clamping s keeps the system
+        // positive definite at the cost of some accuracy.
+        real_t k_s = link.stiffness;
+        real_t s;
+        Vector3 d;
+        if ( l > SPRING_MIN_LENGTH ) {
+            d = delta / l;
+            s = std::max( real_t( 0.0 ), 1 - link.rest_length / l );
+        } else {
+            d = Vector3::Zero;
+            s = 1.0;
+        }
+        Vector3 f = -( k_s * ( l - link.rest_length ) + link.damping * dot( d, u ) ) * d;
+        Vector3 g = h * f;
+        if ( !at_halfway ) {
+            Vector3 ku = k_s * s * u + k_s * ( 1 - s ) * dot( d, u ) * d;
+            g -= theta * h * h * ku;
+        }
+
+        block.node1 = link.node1;
+        block.node2 = link.node2;
+        block.direction = d;
+        block.alpha = theta * theta * h * h * k_s * s;
+        block.beta = theta * h * link.damping + theta * theta * h * h * k_s * ( 1 - s );
+        Matrix3 b = Matrix3::Identity * block.alpha;
+        for ( int c = 0; c < 3; ++c ) {
+            for ( int r = 0; r < 3; ++r ) {
+                b._m[c][r] += block.beta * d[c] * d[r];
+            }
+        }
+
+        rhs[link.node1] += g;
+        diagonal[link.node1] += b;
+        if ( spin && link.offset1 != Vector3::Zero ) {
+            size_t i = bodies.slot[node_bodies[link.node1]];
+            torque[link.node1] += cross( link.offset1, conjugate( bodies.orientation[i] ) * f );
+        }
+        if ( link.node2 != SPRING_ANCHOR ) {
+            rhs[link.node2] -= g;
+            diagonal[link.node2] += b;
+            if ( spin && link.offset2 != Vector3::Zero ) {
+                size_t i = bodies.slot[node_bodies[link.node2]];
+                torque[link.node2] -= cross( link.offset2, conjugate( bodies.orientation[i] ) * f );
+            }
+        }
+    }
+    for ( size_t i = 0; i < n; ++i ) {
+        Matrix3 inv;
+        inverse( &inv, diagonal[i] );
+        preconditioner[i] = inv;
+    }
+}
+
+int SpringNetwork::conjugate_gradient( std::vector< Vector3 >* solution, const SpringSettings& settings )
+{
+    std::vector< Vector3 >& x = *solution;
+    size_t n = x.size();
+    real_t rhs_norm2 = dot_all( rhs, rhs );
+    if ( rhs_norm2 == 0.0 ) {
+        std::fill( x.begin(), x.end(), Vector3::Zero );
+        last_residual = 0.0;
+        return 0;
+    }
+
+    multiply( x, &product );
+    for ( size_t i = 0; i < n; ++i ) {
+        residuals[i] = rhs[i] - product[i];
+        preconditioned[i] = multiply_symmetric( preconditioner[i], residuals[i] );
+        direction[i] = preconditioned[i];
+    }
+    real_t rz = dot_all( residuals, preconditioned );
+    real_t r2 = dot_all( residuals, residuals );
+    real_t tolerance2 = settings.tolerance * settings.tolerance * rhs_norm2;
+    int iteration = 0;
+    while ( r2 > tolerance2 && iteration < settings.max_iterations ) {
+        multiply( direction, &product );
+        real_t pq = dot_all( direction, product );
+        if ( pq <= 0.0 ) {
+            break;
+        }
+        real_t a = rz / pq;
+        real_t rz_next = 0.0;
+        r2 = 0.0;
+        for ( size_t i = 0; i < n; ++i ) {
+            x[i] += a * direction[i];
+            residuals[i] -= a * product[i];
+            preconditioned[i] = multiply_symmetric( preconditioner[i], residuals[i] );
+            rz_next += dot( residuals[i], preconditioned[i] );
+            r2 += squared_length( residuals[i] );
+        }
+        real_t b = rz_next / rz;
+        for ( size_t i = 0; i < n; ++i ) {
+            direction[i] = preconditioned[i] + b * direction[i];
+        }
+        rz = rz_next;
+        ++iteration;
+    }
+    last_residual = sqrt( r2 / rhs_norm2 );
+    if ( r2 > tolerance2 ) {
+        last_converged = false;
+    }
+    return iteration;
+}
+
+void SpringNetwork::solve( const SpringBodies& bodies, real_t dt, const SpringSettings& settings )
+{
+    size_t n = node_bodies.size();
+    // A solve cut off by the iteration cap leaves slow modes unresolved,
+    // and warm starting from it would carry them into every later step
+    bool warm = last_converged;
+    last_iterations = 0;
+    last_residual = 0.0;
+    last_converged = true;
+    last_stiff = false;
+    if ( n == 0 ) {
+        return;
+    }
+
+    node_mass.resize( n );
+    preconditioner.resize( n );
+    rhs.resize( n );
+    torque.resize( n );
+    delta_velocity.resize( n, Vector3::Zero );
+    residuals.resize( n );
+    preconditioned.resize( n );
+    direction.resize( n );
+    product.resize( n );
+    blocks.resize( links.size() );
+    for ( size_t i = 0; i < n; ++i ) {
+        node_mass[i] = 1 / bodies.inv_mass[bodies.slot[node_bodies[i]]];
+    }
+
+    // The squared frequency of the fastest mode is at most the largest row
+    // sum of M^-1/2 K M^-1/2 (Gershgorin), taking every spring at its full
+    // stiffness. That of the fastest spin is bounded the same way.
+    node_rate.assign( n, 0.0 );
+    node_spin_rate.assign( n, 0.0 );
+    for ( size_t k = 0; k < links.size(); ++k ) {
+        const Link& link = links[k];
+        size_t i = bodies.slot[node_bodies[link.node1]];
+        real_t inv1 = bodies.inv_mass[i];
+        node_spin_rate[link.node1] += link.stiffness * squared_length( link.offset1 ) * bodies.inv_inertia[i];
+        if ( link.node2 == SPRING_ANCHOR ) {
+            node_rate[link.node1] += link.stiffness * inv1;
+            continue;
+        }
+        size_t j = bodies.slot[node_bodies[link.node2]];
+        real_t inv2 = bodies.inv_mass[j];
+        real_t across = link.stiffness * sqrt( inv1 * inv2 );
+        node_rate[link.node1] += link.stiffness * inv1 + across;
+        node_rate[link.node2] += link.stiffness * inv2 + across;
+        node_spin_rate[link.node2] += link.stiffness * squared_length( link.offset2 ) * bodies.inv_inertia[j];
+    }
+    real_t max_rate = *std::max_element( node_rate.begin(), node_rate.end() );
+    real_t max_spin_rate = *std::max_element( node_spin_rate.begin(), node_spin_rate.end() );
+    last_stiff = dt * dt * max_rate > SPRING_STIFF_PHASE * SPRING_STIFF_PHASE ||
+                 dt * dt * max_spin_rate > SPRING_SPIN_PHASE * SPRING_SPIN_PHASE;
+
+    // Linearize every spring around the start of the step, and solve
+    // starting from the velocity change of the last step if that solve
+    // converged. Backward Euler takes the forces at the end of the step,
+    // the midpoint rule halfway.
+    real_t h = dt;
+    real_t theta = last_stiff ? 1.0 : 0.5;
+    linearize( bodies, h, theta, false );
+    if ( !warm ) {
+        std::fill( delta_velocity.begin(), delta_velocity.end(), Vector3::Zero );
+    }
+    last_iterations = conjugate_gradient( &delta_velocity, settings );
+
+    // The midpoint rule only keeps the energy with the forces halfway
+    // through the step, which depend on the velocity change. Newton
+    // iterations correct it with the springs taken there.
+    if ( !last_stiff ) {
+        correction.resize( n );
+        for ( int k = 0; k < SPRING_NEWTON_ITERATIONS; ++k ) {
+            linearize( bodies, h, theta, true );
+            std::fill( correction.begin(), correction.end(), Vector3::Zero );
+            last_iterations += conjugate_gradient( &correction, settings );
+            for ( size_t i = 0; i < n; ++i ) {
+                delta_velocity[i] += correction[i];
+            }
+            real_t tolerance = settings.tolerance;
+            if ( dot_all( correction, correction ) <= tolerance * tolerance * dot_all( delta_velocity, delta_velocity ) ) {
+                break;
+            }
+        }
+    }
+
+    // Midpoint steps apply the first half of the change now, so the bodies
+    // move with the velocity halfway through the step, and the second half
+    // in finish()
+    real_t applied = last_stiff ? 1.0 : 0.5;
+    for ( size_t node = 0; node < n; ++node ) {
+        size_t i = bodies.slot[node_bodies[node]];
+        for ( int k = 0; k < 3; ++k ) {
+            bodies.velocity[k][i] += applied * delta_velocity[node][k];
+        }
+        if ( torque[node] != Vector3::Zero ) {
+            Vector3 dw = torque[node] * ( h * bodies.inv_inertia[i] );
+            for ( int k = 0; k < 3; ++k ) {
+                bodies.angular_velocity[k][i] += dw[k];
+            }
+        }
+    }
+}
+
+void SpringNetwork::finish( const SpringBodies& bodies )
+{
+    if ( last_stiff || delta_velocity.size() != node_bodies.size() ) {
+        return;
+    }
+    for ( size_t node = 0; node < node_bodies.size(); ++node ) {
+        size_t i = bodies.slot[node_bodies[node]];
+        for ( int k = 0; k < 3; ++k ) {
+            bodies.velocity[k][i] += 0.5 * delta_velocity[node][k];
+        }
+    }
+}
+
+real_t SpringNetwork::potential_energy( const SpringBodies& bodies ) const
+{
+    real_t energy = 0.0;
+    for ( size_t k = 0; k < links.size(); ++k ) {
+        const Link& link = links[k];
+        Vector3 p1, v1, p2, v2;
+        attachment( bodies, link.node1, link.offset1, &p1, &v1 );
+        attachment( bodies, link.node2, link.offset2, &p2, &v2 );
+        real_t stretch = length( p1 - p2 ) - link.rest_length;
+        energy += 0.5 * link.stiffness * stretch * stretch;
+    }
+    return energy;
+}
+
+} /* _462 */
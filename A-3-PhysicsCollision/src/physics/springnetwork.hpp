@@ -0,0 +1,218 @@
+/**
+ * @file springnetwork.hpp
+ * @brief Implicit integration of networks of damped springs.
+ *
+ * Stiff springs on light bodies, such as the threads of a cloth, oscillate
+ * much faster than any affordable time step, so integrating their forces
+ * explicitly blows up. SpringNetwork takes an implicit step instead: the
+ * velocity change of all attached bodies over the step is found by solving
+ * the sparse system
+ *
+ *     (M + t h D + t^2 h^2 K) dv = h f - t h^2 K v
+ *
+ * where f are the spring forces at the start of the step and K and D the
+ * stiffness and damping matrices of the springs. The system is symmetric
+ * positive definite, and is solved with a block Jacobi preconditioned
+ * conjugate gradient that never assembles the matrix: every spring only
+ * keeps the 3x3 block it adds between its two bodies.
+ *
+ * With t = 1/2 this is the midpoint rule. A few Newton iterations then
+ * retake the springs halfway through the step, and the bodies move with
+ * the velocity halfway, which keeps the energy of undamped springs, such
+ * as the strings of a pendulum, over any number of steps. It does so by
+ * keeping every mode, and modes far faster than the step, which a cloth
+ * has thousands of, ring on as noise. Networks whose fastest mode is that
+ * fast take a backward Euler step, t = 1, instead, which damps them out
+ * but drains energy from the slow motion too, the more the stiffer the
+ * springs and the longer the step: a Newton's cradle loses most of its
+ * energy within a minute.
+ */
+
+#ifndef _462_PHYSICS_SPRINGNETWORK_HPP_
+#define _462_PHYSICS_SPRINGNETWORK_HPP_
+
+#include "math/vector.hpp"
+#include "math/quaternion.hpp"
+#include "math/matrix.hpp"
+#include <vector>
+#include <unordered_map>
+
+namespace _462 {
+
+// body2 of a spring attached to a fixed point
+#define SPRING_ANCHOR ( ~0u )
+
+/**
+ * A damped spring between two bodies, or between a body and a fixed point.
+ */
+struct SpringLink
+{
+    // index of the first body
+    unsigned int body1;
+    // index of the second body, or SPRING_ANCHOR
+    unsigned int body2;
+    // attachment point in the frame of body1
+    Vector3 offset1;
+    // attachment point in the frame of body2, or the anchor in world space
+    Vector3 offset2;
+    // force per unit of stretch
+    real_t stiffness;
+    // length at which the spring pulls neither way
+    real_t rest_length;
+    // force per unit of stretching speed
+    real_t damping;
+};
+
+/**
+ * State of the bodies the springs refer to, as separate arrays indexed by
+ * slot. Springs refer to bodies by a fixed index that is mapped to the slot
+ * holding the body, so bodies may move between slots across steps.
+ */
+struct SpringBodies
+{
+    const real_t* position[3];
+    real_t* velocity[3];
+    // in the body frame
+    real_t* angular_velocity[3];
+    const Quaternion* orientation;
+    const real_t* inv_mass;
+    const real_t* inv_inertia;
+    // slot of every body index
+    const unsigned int* slot;
+};
+
+/**
+ * Tuning of SpringNetwork.
+ */
+struct SpringSettings
+{
+    // most conjugate gradient iterations per linear solve
+    int max_iterations;
+    // residual, relative to the right hand side, at which the solve stops
+    real_t tolerance;
+};
+
+class SpringNetwork
+{
+public:
+
+    SpringNetwork();
+
+    /**
+     * Removes all springs.
+     */
+    void clear();
+
+    /**
+     * Adds a spring. Springs must attach at least one body, so body1 is
+     * never SPRING_ANCHOR.
+     */
+    void add( const SpringLink& link );
+
+    size_t size() const { return links.size(); }
+    // bodies attached to any spring, and the index of each of them
+    size_t num_nodes() const { return node_bodies.size(); }
+    unsigned int node_body( size_t node ) const { return node_bodies[node]; }
+
+    /**
+     * Integrates the spring forces implicitly over dt, changing the linear
+     * velocities of the attached bodies. Springs attached off the center
+     * of a body also spin it; that torque is applied explicitly. A midpoint
+     * step only applies half of the velocity change, the bodies must then
+     * be moved over dt and finish() called.
+     */
+    void solve( const SpringBodies& bodies, real_t dt, const SpringSettings& settings );
+    /**
+     * Applies the rest of the velocity change of the last solve(), once the
+     * bodies have moved.
+     */
+    void finish( const SpringBodies& bodies );
+
+    // conjugate gradient iterations of the last solve, and the relative
+    // residual it stopped at
+    int iterations() const { return last_iterations; }
+    real_t residual() const { return last_residual; }
+    // whether the last solve reached the tolerance, rather than stopping at
+    // the iteration cap
+    bool converged() const { return last_converged; }
+    // whether the last solve took a backward Euler step
+    bool stiff() const { return last_stiff; }
+
+    /**
+     * Returns the energy stored in all springs.
+     */
+    real_t potential_energy( const SpringBodies& bodies ) const;
+
+private:
+
+    struct Link
+    {
+        // node indices, node2 may be SPRING_ANCHOR
+        unsigned int node1;
+        unsigned int node2;
+        Vector3 offset1;
+        Vector3 offset2;
+        real_t stiffness;
+        real_t rest_length;
+        real_t damping;
+    };
+
+    // The block a spring adds to the system, h D + h^2 K, is
+    // alpha I + beta d d^T for the spring direction d. Copies the nodes of
+    // the link, so the solver loops only touch the blocks.
+    struct Block
+    {
+        unsigned int node1;
+        unsigned int node2;
+        Vector3 direction;
+        real_t alpha;
+        real_t beta;
+    };
+
+    unsigned int add_node( unsigned int body );
+    void attachment( const SpringBodies& bodies, unsigned int node, const Vector3& offset,
+                     Vector3* point, Vector3* velocity ) const;
+    void halfway( unsigned int node, real_t h, Vector3* point, Vector3* velocity ) const;
+    void linearize( const SpringBodies& bodies, real_t h, real_t theta, bool at_halfway );
+    void multiply( const std::vector< Vector3 >& x, std::vector< Vector3 >* result ) const;
+    int conjugate_gradient( std::vector< Vector3 >* solution, const SpringSettings& settings );
+
+    std::vector< Link > links;
+    std::vector< unsigned int > node_bodies;
+    std::unordered_map< unsigned int, unsigned int > body_nodes;
+
+    // system of the solve in progress
+    std::vector< Block > blocks;
+    std::vector< real_t > node_mass;
+    // squared frequency bounds of the springs of every node, moving it and
+    // spinning it
+    std::vector< real_t > node_rate;
+    std::vector< real_t > node_spin_rate;
+    std::vector< Matrix3 > preconditioner;
+    std::vector< Vector3 > rhs;
+    // velocity change of every node. Kept to start the next solve from,
+    // since it changes little between steps.
+    std::vector< Vector3 > delta_velocity;
+    // Newton step of the velocity change, for midpoint steps
+    std::vector< Vector3 > correction;
+    // conjugate gradient vectors
+    std::vector< Vector3 > residuals;
+    std::vector< Vector3 > preconditioned;
+    std::vector< Vector3 > direction;
+    std::vector< Vector3 > product;
+    // torque of the springs in the body frame
+    std::vector< Vector3 > torque;
+
+    int last_iterations;
+    real_t last_residual;
+    bool last_converged;
+    bool last_stiff;
+
+    // no meaningful assignment or copy
+    SpringNetwork( const SpringNetwork& );
+    SpringNetwork& operator=( const SpringNetwork& );
+};
+
+} /* _462 */
+
+#endif /* _462_PHYSICS_SPRINGNETWORK_HPP_ */
@@ -0,0 +1,111 @@
+/**
+ * @file trace.cpp
+ * @brief Binary recording of the body state after every physics step.
+ */
+
+#include "physics/trace.hpp"
+#include <cstddef>
+#include <cstring>
+
+namespace _462 {
+
+static const char TRACE_MAGIC[8] = { '4', '6', '2', 'T', 'R', 'A', 'C', 'E' };
+
+struct TraceHeader
+{
+    char magic[8];
+    // sizeof( real_t ) of the build that recorded the trace
+    unsigned int real_size;
+    unsigned int frame_size;
+    unsigned int num_frames;
+    unsigned int reserved;
+    double time_step;
+};
+
+TraceFile::TraceFile()
+    : file( 0 ), writing( false ), size( 0 ), frames( 0 ), dt( 0.0 ) { }
+
+TraceFile::~TraceFile()
+{
+    close();
+}
+
+bool TraceFile::create( const char* filename, size_t frame_size, real_t time_step )
+{
+    close();
+    file = fopen( filename, "wb" );
+    if ( !file ) {
+        return false;
+    }
+    writing = true;
+    size = frame_size;
+    frames = 0;
+    dt = time_step;
+
+    // the frame count is filled in by close()
+    TraceHeader header;
+    memset( &header, 0, sizeof header );
+    memcpy( header.magic, TRACE_MAGIC, sizeof header.magic );
+    header.real_size = sizeof( real_t );
+    header.frame_size = unsigned( size );
+    header.time_step = dt;
+    return fwrite( &header, sizeof header, 1, file ) == 1;
+}
+
+bool TraceFile::open( const char* filename )
+{
+    close();
+    file = fopen( filename, "rb" );
+    if ( !file ) {
+        return false;
+    }
+    writing = false;
+
+    TraceHeader header;
+    if ( fread( &header, sizeof header, 1, file ) != 1 ||
+         memcmp( header.magic, TRACE_MAGIC, sizeof header.magic ) != 0 ||
+         header.real_size != sizeof( real_t ) ) {
+        close();
+        return false;
+    }
+    size = header.frame_size;
+    frames = header.num_frames;
+    dt = header.time_step;
+    return true;
+}
+
+void TraceFile::close()
+{
+    if ( !file ) {
+        return;
+    }
+    if ( writing ) {
+        unsigned int num_frames = unsigned( frames );
+        fseek( file, offsetof( TraceHeader, num_frames ), SEEK_SET );
+        fwrite( &num_frames, sizeof num_frames, 1, file );
+    }
+    fclose( file );
+    file = 0;
+}
+
+bool TraceFile::write_frame( const real_t* frame )
+{
+    if ( !file || !writing ) {
+        return false;
+    }
+    if ( size > 0 && fwrite( frame, sizeof( real_t ), size, file ) != size ) {
+        return false;
+    }
+    frames++;
+    return true;
+}
+
+bool TraceFile::read_frame( real_t* frame )
+{
+    if ( !file || writing ) {
+        return false;
+    }
+    return size == 0 || fread( frame, sizeof( real_t ), size, file ) == size;
+}
+
+} /* _462 */
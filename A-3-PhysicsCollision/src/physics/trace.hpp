@@ -0,0 +1,76 @@
+/**
+ * @file trace.hpp
+ * @brief Binary recording of the body state after every physics step.
+ *
+ * A trace is a small header followed by one frame per step, each frame
+ * being the raw real_t values of Physics::save_state. Values are stored in
+ * the native byte order and compared bit for bit, so a trace only replays
+ * on builds with the same real_t and floating point behaviour.
+ */
+
+#ifndef _462_PHYSICS_TRACE_HPP_
+#define _462_PHYSICS_TRACE_HPP_
+
+#include "math/math.hpp"
+#include <cstdio>
+
+namespace _462 {
+
+class TraceFile
+{
+public:
+
+    TraceFile();
+    ~TraceFile();
+
+    /**
+     * Creates a new trace for recording, replacing any existing file.
+     * Returns false on failure.
+     */
+    bool create( const char* filename, size_t frame_size, real_t time_step );
+
+    /**
+     * Opens an existing trace for replay. Returns false on failure or if
+     * the file is not a trace of this build.
+     */
+    bool open( const char* filename );
+
+    /**
+     * Finishes the trace. Called by the destructor.
+     */
+    void close();
+
+    // reals per frame
+    size_t frame_size() const { return size; }
+    // step size the trace was recorded with
+    real_t time_step() const { return dt; }
+    // frames written so far, or contained in an opened trace
+    size_t num_frames() const { return frames; }
+
+    /**
+     * Appends a frame of frame_size() reals. Returns false on failure.
+     */
+    bool write_frame( const real_t* frame );
+
+    /**
+     * Reads the next frame into frame. Returns false at the end of the
+     * trace or on failure.
+     */
+    bool read_frame( real_t* frame );
+
+private:
+
+    FILE* file;
+    bool writing;
+    size_t size;
+    size_t frames;
+    real_t dt;
+
+    // no meaningful assignment or copy
+    TraceFile( const TraceFile& );
+    TraceFile& operator=( const TraceFile& );
+};
+
+} /* _462 */
+
+#endif /* _462_PHYSICS_TRACE_HPP_ */
@@ -0,0 +1,157 @@
+/**
+ * @file triangletree.cpp
+ * @brief Bounding volume hierarchy over the static triangles of a scene.
+ */
+
+#include "physics/triangletree.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace _462 {
+
+// most triangles in a leaf of the tree
+#define TREE_LEAF_SIZE 4
+// deepest tree a query can walk. Median splits halve the triangles per
+// level, so this is never reached.
+#define TREE_MAX_DEPTH 64
+
+bool StaticTriangle::init( const Vector3& a, const Vector3& b, const Vector3& c )
+{
+    vertices[0] = a;
+    vertices[1] = b;
+    vertices[2] = c;
+    Vector3 n = cross( b - a, c - a );
+    if ( squared_length( n ) == 0.0 ) {
+        return false;
+    }
+    normal = normalize( n );
+    for ( int i = 0; i < 3; ++i ) {
+        edges[i] = vertices[( i + 1 ) % 3] - vertices[i];
+        inv_edge_length2[i] = 1.0 / squared_length( edges[i] );
+        edge_normals[i] = cross( normal, edges[i] );
+    }
+    return true;
+}
+
+// orders triangle indices by one coordinate of their centroids
+struct CentroidLess
+{
+    const Vector3* centroids;
+    int axis;
+
+    bool operator()( unsigned int lhs, unsigned int rhs ) const {
+        return centroids[lhs][axis] < centroids[rhs][axis];
+    }
+};
+
+TriangleTree::TriangleTree() { }
+
+void TriangleTree::clear()
+{
+    triangles.clear();
+    boxes.clear();
+    nodes.clear();
+    indices.clear();
+}
+
+int TriangleTree::add( const Vector3& a, const Vector3& b, const Vector3& c )
+{
+    StaticTriangle tri;
+    if ( !tri.init( a, b, c ) ) {
+        return -1;
+    }
+    AABB box;
+    box.min = vmin( a, vmin( b, c ) );
+    box.max = vmax( a, vmax( b, c ) );
+    triangles.push_back( tri );
+    boxes.push_back( box );
+    return int( triangles.size() - 1 );
+}
+
+void TriangleTree::build()
+{
+    size_t count = triangles.size();
+    nodes.clear();
+    indices.resize( count );
+    centroids.resize( count );
+    for ( size_t i = 0; i < count; ++i ) {
+        indices[i] = unsigned( i );
+        centroids[i] = ( boxes[i].min + boxes[i].max ) * 0.5;
+    }
+    if ( count == 0 ) {
+        return;
+    }
+
+    // a binary tree with leaves of at least one triangle
+    nodes.reserve( 2 * count );
+    nodes.resize( 1 );
+    build_node( 0, 0, count );
+
+    centroids.clear();
+}
+
+void TriangleTree::build_node( size_t node, size_t first, size_t count )
+{
+    AABB box = boxes[indices[first]];
+    AABB centers;
+    centers.min = centers.max = centroids[indices[first]];
+    for ( size_t i = first + 1; i < first + count; ++i ) {
+        box.min = vmin( box.min, boxes[indices[i]].min );
+        box.max = vmax( box.max, boxes[indices[i]].max );
+        centers.min = vmin( centers.min, centroids[indices[i]] );
+        centers.max = vmax( centers.max, centroids[indices[i]] );
+    }
+    nodes[node].box = box;
+
+    if ( count <= TREE_LEAF_SIZE ) {
+        nodes[node].first = unsigned( first );
+        nodes[node].count = unsigned( count );
+        return;
+    }
+
+    // split at the median centroid along the longest axis of the centroids
+    Vector3 extent = centers.max - centers.min;
+    CentroidLess less;
+    less.centroids = &centroids[0];
+    less.axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+    size_t half = count / 2;
+    std::nth_element( indices.begin() + first, indices.begin() + first + half,
+                      indices.begin() + first + count, less );
+
+    size_t children = nodes.size();
+    nodes.resize( children + 2 );
+    nodes[node].first = unsigned( children );
+    nodes[node].count = 0;
+    build_node( children, first, half );
+    build_node( children + 1, first + half, count - half );
+}
+
+void TriangleTree::query( const AABB& box, std::vector< unsigned int >* result ) const
+{
+    if ( nodes.empty() ) {
+        return;
+    }
+
+    unsigned int stack[TREE_MAX_DEPTH];
+    size_t top = 0;
+    stack[top++] = 0;
+    while ( top > 0 ) {
+        const Node& node = nodes[stack[--top]];
+        if ( !overlaps( node.box, box ) ) {
+            continue;
+        }
+        if ( node.count > 0 ) {
+            for ( unsigned int i = node.first; i < node.first + node.count; ++i ) {
+                if ( overlaps( boxes[indices[i]], box ) ) {
+                    result->push_back( indices[i] );
+                }
+            }
+        } else {
+            assert( top + 2 <= TREE_MAX_DEPTH );
+            stack[top++] = node.first + 1;
+            stack[top++] = node.first;
+        }
+    }
+}
+
+} /* _462 */
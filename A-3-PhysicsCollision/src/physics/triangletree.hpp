@@ -0,0 +1,113 @@
+/**
+ * @file triangletree.hpp
+ * @brief Bounding volume hierarchy over the static triangles of a scene.
+ *
+ * Static triangles never move, so everything the narrow phase needs about
+ * them (normal, edges, bounds) is computed once when the tree is built.
+ * The tree is then queried with the bounding box of every sphere.
+ */
+
+#ifndef _462_PHYSICS_TRIANGLETREE_HPP_
+#define _462_PHYSICS_TRIANGLETREE_HPP_
+
+#include "math/vector.hpp"
+#include "physics/broadphase.hpp"
+#include <vector>
+
+namespace _462 {
+
+/**
+ * A static triangle with the data of the contact and time of impact tests
+ * precomputed.
+ */
+struct StaticTriangle
+{
+    Vector3 vertices[3];
+    // unit normal, by the right hand rule over the vertex order
+    Vector3 normal;
+    // edge i runs from vertex i to vertex i + 1
+    Vector3 edges[3];
+    // 1 / squared length of every edge
+    real_t inv_edge_length2[3];
+    // perpendicular to edge i in the plane of the triangle, pointing inside
+    Vector3 edge_normals[3];
+
+    /**
+     * Computes the derived data from the vertices. Returns false if the
+     * triangle is degenerate and has no normal.
+     */
+    bool init( const Vector3& a, const Vector3& b, const Vector3& c );
+
+    /**
+     * Whether p projects onto the triangle.
+     */
+    bool contains( const Vector3& p ) const {
+        return dot( p - vertices[0], edge_normals[0] ) >= 0 &&
+               dot( p - vertices[1], edge_normals[1] ) >= 0 &&
+               dot( p - vertices[2], edge_normals[2] ) >= 0;
+    }
+};
+
+/**
+ * An AABB tree over static triangles. Triangles keep the index they were
+ * added with; the leaves refer to them through a separate index list.
+ */
+class TriangleTree
+{
+public:
+
+    TriangleTree();
+
+    /**
+     * Removes all triangles.
+     */
+    void clear();
+
+    /**
+     * Adds a triangle, which is only found by queries after the next
+     * build(). Degenerate triangles are dropped. Returns the index of the
+     * triangle, or -1 if it was dropped.
+     */
+    int add( const Vector3& a, const Vector3& b, const Vector3& c );
+
+    /**
+     * Builds the tree over all triangles added so far.
+     */
+    void build();
+
+    size_t size() const { return triangles.size(); }
+    const StaticTriangle& operator[]( size_t index ) const { return triangles[index]; }
+    const AABB& bounds( size_t index ) const { return boxes[index]; }
+
+    /**
+     * Appends the indices of all triangles whose bounds overlap the box,
+     * in no particular order.
+     */
+    void query( const AABB& box, std::vector< unsigned int >* result ) const;
+
+private:
+
+    struct Node
+    {
+        AABB box;
+        // inner nodes: index of the first of the two adjacent children.
+        // leaves: first entry in indices.
+        unsigned int first;
+        // triangles in a leaf, 0 for inner nodes
+        unsigned int count;
+    };
+
+    void build_node( size_t node, size_t first, size_t count );
+
+    std::vector< StaticTriangle > triangles;
+    std::vector< AABB > boxes;
+    std::vector< Node > nodes;
+    // triangle indices ordered by leaf
+    std::vector< unsigned int > indices;
+    // centroids of the triangles, only used while building
+    std::vector< Vector3 > centroids;
+};
+
+} /* _462 */
+
+#endif /* _462_PHYSICS_TRIANGLETREE_HPP_ */
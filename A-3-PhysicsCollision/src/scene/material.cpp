@@ -112,11 +112,15 @@ bool Material::create_gl_data()
 
 void Material::set_gl_state() const
 {
-    float arr[4];
-    arr[3] = 1.0; // alpha always 1.0
-
     // always bind, because if no texture this will set texture to nothing
     glBindTexture( GL_TEXTURE_2D, tex_handle );
+    set_gl_material();
+}
+
+void Material::set_gl_material() const
+{
+    float arr[4];
+    arr[3] = 1.0; // alpha always 1.0
 
     ambient.to_array( arr );
     glMaterialfv( GL_FRONT_AND_BACK, GL_AMBIENT,   arr );
@@ -128,6 +132,11 @@ void Material::set_gl_state() const
     glMaterialf( GL_FRONT_AND_BACK, GL_SHININESS, shininess );
 }
 
+GLuint Material::get_gl_texture() const
+{
+    return tex_handle;
+}
+
 void Material::reset_gl_state() const
 {
     glBindTexture( GL_TEXTURE_2D, 0 );
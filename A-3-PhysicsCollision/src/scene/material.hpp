@@ -68,6 +68,12 @@ public:
     /// sets all the gl state for this material
     void set_gl_state() const;
 
+    /// sets the gl material colors, but doesn't bind the texture
+    void set_gl_material() const;
+
+    /// the gl texture, 0 if the material has none
+    GLuint get_gl_texture() const;
+
     /// clears out setting that depend on this material, such as the texture.
     /// leaves other settings unchanged for efficiency.
     void reset_gl_state() const;
@@ -8,301 +8,721 @@
 
 #include "scene/mesh.hpp"
 #include "application/opengl.hpp"
+#include "application/mappedfile.hpp"
+#include "application/threadpool.hpp"
 #include <iostream>
 #include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
 #include <string>
-#include <fstream>
-#include <sstream>
-#include <map>
+#include <chrono>
+#include <sys/stat.h>
 
 namespace _462 {
 
+// OBJ files are split into chunks of about this many bytes, which are
+// parsed in parallel
+#define MESH_CHUNK_BYTES ( 4 << 20 )
+
+// the binary cache of a mesh is stored next to its OBJ file, with this
+// suffix appended to the name
+#define MESH_CACHE_SUFFIX ".cache"
+// bump whenever the layout or the meaning of the cache changes
+#define MESH_CACHE_VERSION 1
+#define MESH_CACHE_MAGIC 0x4d323634
+
+// indices of the position, normal, and texture coordinate of a face
+// vertex, counting from 0, or -1 for none
 struct TriIndex
 {
     int vertex;
     int normal;
     int tcoord;
 
-    bool operator<( const TriIndex& rhs ) const {
-        if ( vertex == rhs.vertex ) {
-            if ( normal == rhs.normal ) {
-                return tcoord < rhs.tcoord;
-            } else {
-                return normal < rhs.normal;
-            }
-        } else {
-            return vertex < rhs.vertex;
-        }
+    bool operator==( const TriIndex& rhs ) const {
+        return vertex == rhs.vertex && normal == rhs.normal && tcoord == rhs.tcoord;
     }
 };
 
-struct Face
+/**
+ * Maps every distinct TriIndex to the mesh vertex made for it, using open
+ * addressing with linear probing. Kept at most half full.
+ */
+class VertexTable
 {
-    TriIndex v[3];
-};
+public:
 
-enum ObjFormat
-{
-    VERTEX_ONLY = 1 << 0,
-    VERTEX_UV = 1 << 1,
-    VERTEX_NORMAL = 1 << 2,
-    VERTEX_UV_NORMAL = 1 << 3
-};
+    explicit VertexTable( size_t expected ) : count( 0 )
+    {
+        size_t capacity = 16;
+        while ( capacity < 2 * expected ) {
+            capacity *= 2;
+        }
+        slots.resize( capacity );
+        clear_slots();
+    }
 
-Mesh::Mesh()
-{
-    has_tcoords = false;
-    has_normals = false;
-}
+    /**
+     * Returns the vertex of key. If key is new, it is given vertex and
+     * inserted is set.
+     */
+    unsigned int insert( const TriIndex& key, unsigned int vertex, bool* inserted )
+    {
+        if ( 2 * ( count + 1 ) > slots.size() ) {
+            grow();
+        }
+        size_t mask = slots.size() - 1;
+        for ( size_t i = hash( key ) & mask; ; i = ( i + 1 ) & mask ) {
+            Slot& slot = slots[i];
+            if ( slot.vertex == EMPTY ) {
+                slot.key = key;
+                slot.vertex = vertex;
+                ++count;
+                *inserted = true;
+                return vertex;
+            }
+            if ( slot.key == key ) {
+                *inserted = false;
+                return slot.vertex;
+            }
+        }
+    }
 
-Mesh::~Mesh() { }
+private:
 
-bool Mesh::load()
-{
-    std::cout << "Loading mesh from '" << filename << "'..." << std::endl;
+    static const unsigned int EMPTY = ~0u;
 
-    std::string line;
-    std::ifstream file( filename.c_str() );
+    struct Slot
+    {
+        TriIndex key;
+        unsigned int vertex;
+    };
 
-    typedef std::vector< Vector3 > PositionList;
-    typedef std::vector< Vector3 > NormalList;
-    typedef std::vector< Vector2 > UVList;
-    typedef std::vector< Face > FaceList;
+    static size_t hash( const TriIndex& key )
+    {
+        unsigned long long h = unsigned( key.vertex ) * 0x9E3779B97F4A7C15ull;
+        h ^= unsigned( key.normal ) * 0xC2B2AE3D27D4EB4Full;
+        h ^= unsigned( key.tcoord ) * 0x165667B19E3779F9ull;
+        return size_t( h ^ ( h >> 32 ) );
+    }
 
-    static const char* scan_vertex = "%d";
-    static const char* scan_vertex_uv = "%d/%d";
-    static const char* scan_vertex_normal = "%d//%d";
-    static const char* scan_vertex_uv_normal = "%d/%d/%d";
+    void clear_slots()
+    {
+        for ( size_t i = 0; i < slots.size(); ++i ) {
+            slots[i].vertex = EMPTY;
+        }
+    }
 
-    TriIndex tri[4];
+    void grow()
+    {
+        std::vector< Slot > old( slots.size() * 2 );
+        old.swap( slots );
+        clear_slots();
+        size_t mask = slots.size() - 1;
+        for ( size_t k = 0; k < old.size(); ++k ) {
+            if ( old[k].vertex == EMPTY ) {
+                continue;
+            }
+            size_t i = hash( old[k].key ) & mask;
+            while ( slots[i].vertex != EMPTY ) {
+                i = ( i + 1 ) & mask;
+            }
+            slots[i] = old[k];
+        }
+    }
 
-    FaceList face_list;
-    PositionList position_list;
-    NormalList normal_list;
-    UVList uv_list;
+    std::vector< Slot > slots;
+    size_t count;
+};
 
-    int line_num = 0;
+static const double PowersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#define MAX_EXACT_POWER 22
+// more mantissa digits than this are dropped
+#define MAX_MANTISSA 1000000000000000000ull
 
-    std::string token;
+static inline bool is_blank( char c )
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
 
-    triangles.clear();
+static inline bool is_digit( char c )
+{
+    return unsigned( c - '0' ) < 10;
+}
 
-    ObjFormat format = VERTEX_ONLY;
+static inline const char* skip_blanks( const char* p, const char* end )
+{
+    while ( p < end && is_blank( *p ) ) {
+        ++p;
+    }
+    return p;
+}
 
-    typedef std::map< TriIndex, unsigned int > VertexMap;
-    VertexMap vertex_map;
+/**
+ * Parses a decimal real in [*cursor, end) and moves the cursor past it,
+ * without allocating. Powers of ten up to 1e22 are exact, so numbers with
+ * up to 15 significant digits convert exactly like strtod.
+ */
+static bool parse_real( const char** cursor, const char* end, real_t* out )
+{
+    const char* p = skip_blanks( *cursor, end );
+    bool negative = false;
+    if ( p < end && ( *p == '-' || *p == '+' ) ) {
+        negative = *p == '-';
+        ++p;
+    }
 
-    if ( !file.is_open() ) {
-        std::cout << "Error opening file '" << filename << "' for mesh loading.\n";
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    for ( ; p < end && is_digit( *p ); ++p, ++digits ) {
+        if ( mantissa < MAX_MANTISSA ) {
+            mantissa = mantissa * 10 + ( *p - '0' );
+        } else {
+            ++exponent;
+        }
+    }
+    if ( p < end && *p == '.' ) {
+        for ( ++p; p < end && is_digit( *p ); ++p, ++digits ) {
+            if ( mantissa < MAX_MANTISSA ) {
+                mantissa = mantissa * 10 + ( *p - '0' );
+                --exponent;
+            }
+        }
+    }
+    if ( digits == 0 ) {
+        return false;
+    }
+    if ( p < end && ( *p == 'e' || *p == 'E' ) ) {
+        const char* q = p + 1;
+        bool negative_exponent = false;
+        if ( q < end && ( *q == '-' || *q == '+' ) ) {
+            negative_exponent = *q == '-';
+            ++q;
+        }
+        if ( q < end && is_digit( *q ) ) {
+            int e = 0;
+            for ( ; q < end && is_digit( *q ); ++q ) {
+                if ( e < 10000 ) {
+                    e = e * 10 + ( *q - '0' );
+                }
+            }
+            exponent += negative_exponent ? -e : e;
+            p = q;
+        }
+    }
+    // the number must end at a blank or the end of the line
+    if ( p < end && !is_blank( *p ) ) {
         return false;
     }
 
-    while ( getline( file, line ) )
-    {
-        std::stringstream stream( line );
-        stream >> token;
-        line_num++;
+    double value = double( mantissa );
+    if ( exponent < 0 ) {
+        value = -exponent <= MAX_EXACT_POWER ? value / PowersOfTen[-exponent] : value * pow( 10.0, exponent );
+    } else if ( exponent > 0 ) {
+        value = exponent <= MAX_EXACT_POWER ? value * PowersOfTen[exponent] : value * pow( 10.0, exponent );
+    }
+    *out = negative ? -value : value;
+    *cursor = p;
+    return true;
+}
 
-        if ( token == "v" ) {
+// parses a face index, which may be negative
+static bool parse_index( const char** cursor, const char* end, int* out )
+{
+    const char* p = *cursor;
+    bool negative = p < end && *p == '-';
+    if ( negative ) {
+        ++p;
+    }
+    if ( p == end || !is_digit( *p ) ) {
+        return false;
+    }
+    int value = 0;
+    for ( ; p < end && is_digit( *p ); ++p ) {
+        value = value * 10 + ( *p - '0' );
+    }
+    *out = negative ? -value : value;
+    *cursor = p;
+    return true;
+}
 
-            Vector3 position;
-            stream >> position.x >> position.y >> position.z;
+// components of TriIndex, as flags
+enum IndexComponent
+{
+    COMPONENT_VERTEX = 1 << 0,
+    COMPONENT_NORMAL = 1 << 1,
+    COMPONENT_TCOORD = 1 << 2
+};
 
-            if ( stream.fail() ) {
-                std::cerr << "position syntax error on line " << line_num << std::endl;
-                return false;
-            }
+/**
+ * A range of lines of an OBJ file and everything parsed from it. Face
+ * indices are resolved against the whole file, except negative ones,
+ * which count back from the lists as they were at the face. Those are
+ * resolved against the chunk's own lists and listed in relative, to be
+ * offset once the sizes of the chunks before are known.
+ */
+struct ObjChunk
+{
+    const char* begin;
+    const char* end;
+
+    std::vector< Vector3 > positions;
+    std::vector< Vector3 > normals;
+    std::vector< Vector2 > tcoords;
+    // three per triangle
+    std::vector< TriIndex > corners;
+    // corner index times 4 plus the IndexComponent shift of every
+    // relative index
+    std::vector< size_t > relative;
+
+    // whether the chunk has a face, and what the first one had
+    bool has_face;
+    bool first_face_normals;
+    bool first_face_tcoords;
+
+    size_t num_lines;
+    // message and line (counted within the chunk) of the first error
+    const char* error;
+    size_t error_line;
+
+    // scratch of the face being parsed
+    std::vector< TriIndex > polygon;
+    std::vector< unsigned char > polygon_relative;
+};
 
-            position_list.push_back( position );
+// resolves one component of a face index, 0 meaning none
+static bool resolve_index( int index, size_t count, int component, int* out, unsigned char* relative )
+{
+    if ( index > 0 ) {
+        *out = index - 1;
+    } else if ( index < 0 ) {
+        *out = int( count ) + index;
+        *relative |= component;
+    } else if ( component == COMPONENT_VERTEX ) {
+        return false;
+    } else {
+        *out = -1;
+    }
+    return true;
+}
 
-        } else if ( token == "vn" ) {
-            Vector3 normal;
-            stream >> normal.x >> normal.y >> normal.z;
+static const char* parse_face( ObjChunk* chunk, const char* p, const char* end )
+{
+    std::vector< TriIndex >& polygon = chunk->polygon;
+    std::vector< unsigned char >& relative = chunk->polygon_relative;
+    polygon.clear();
+    relative.clear();
+
+    while ( true ) {
+        p = skip_blanks( p, end );
+        if ( p == end ) {
+            break;
+        }
 
-            if( stream.fail() ) {
-                std::cerr << "normal syntax error on line " << line_num << std::endl;
-                return false;
+        // v, v/t, v//n or v/t/n
+        int v, t = 0, n = 0;
+        if ( !parse_index( &p, end, &v ) ) {
+            return "face syntax error";
+        }
+        if ( p < end && *p == '/' ) {
+            ++p;
+            if ( p < end && *p != '/' && !parse_index( &p, end, &t ) ) {
+                return "face syntax error";
             }
-            normal_list.push_back( normal );
-
-        } else if ( token == "vt" ) {
-
-            Vector2 uv;
-            stream >> uv.x >> uv.y;
-
-            if ( stream.fail() ) {
-                std::cerr << "uv syntax error on line " << line_num << std::endl;
-                return false;
+            if ( p < end && *p == '/' ) {
+                ++p;
+                if ( !parse_index( &p, end, &n ) ) {
+                    return "face syntax error";
+                }
             }
+        }
+        if ( p < end && !is_blank( *p ) ) {
+            return "face syntax error";
+        }
 
-            uv_list.push_back( uv );
-
-        } else if ( token == "f" ) {
-
-            std::vector< std::string > face_tokens;
-            std::string vert;
+        TriIndex index;
+        unsigned char flags = 0;
+        if ( !resolve_index( v, chunk->positions.size(), COMPONENT_VERTEX, &index.vertex, &flags ) ) {
+            return "face has a vertex without position";
+        }
+        resolve_index( n, chunk->normals.size(), COMPONENT_NORMAL, &index.normal, &flags );
+        resolve_index( t, chunk->tcoords.size(), COMPONENT_TCOORD, &index.tcoord, &flags );
+        polygon.push_back( index );
+        relative.push_back( flags );
+    }
 
-            while ( true ) {
-                stream >> vert;
-                if( stream.fail() )
-                    break;
-                face_tokens.push_back( vert );
-            }
+    if ( polygon.size() < 3 ) {
+        return "face has fewer than 3 vertices";
+    }
+    if ( !chunk->has_face ) {
+        chunk->has_face = true;
+        chunk->first_face_normals = polygon[0].normal != -1;
+        chunk->first_face_tcoords = polygon[0].tcoord != -1;
+    }
 
-            // if it's the first time parsing a face, figure out the face format
-            if ( face_list.size() == 0 ) {
-                std::string token = face_tokens[0];
-
-                if ( token.find( "//" ) != std::string::npos ) {
-                    format = VERTEX_NORMAL;
-                    has_normals = true;
-                } else if ( token.find( '/' ) == std::string::npos ) {
-                    format = VERTEX_ONLY;
-                } else {
-                    size_t p1 = token.find( '/' );
-                    size_t p2 = token.rfind( '/' );
-                    if ( p1 == p2 ) {
-                        format = VERTEX_UV;
-                        has_tcoords = true;
-                    } else {
-                        format = VERTEX_UV_NORMAL;
-                        has_normals = true;
-                        has_tcoords = true;
+    // Fan out from the first vertex. Quads split into ( 0, 1, 2 ) and
+    // ( 2, 3, 0 ), the split of the old loader.
+    for ( size_t k = 2; k < polygon.size(); ++k ) {
+        size_t triangle[3] = { k - 1, k, 0 };
+        if ( k == 2 ) {
+            triangle[0] = 0;
+            triangle[1] = 1;
+            triangle[2] = 2;
+        }
+        for ( size_t j = 0; j < 3; ++j ) {
+            size_t i = triangle[j];
+            if ( relative[i] ) {
+                for ( int c = 0; c < 3; ++c ) {
+                    if ( relative[i] & ( 1 << c ) ) {
+                        chunk->relative.push_back( chunk->corners.size() * 4 + c );
                     }
                 }
             }
+            chunk->corners.push_back( polygon[i] );
+        }
+    }
+    return 0;
+}
 
-            size_t num_vertex;
-            num_vertex = face_tokens.size();
+// parses a line without its newline, returns an error message or null
+static const char* parse_line( ObjChunk* chunk, const char* p, const char* end )
+{
+    p = skip_blanks( p, end );
+    const char* keyword = p;
+    while ( p < end && !is_blank( *p ) ) {
+        ++p;
+    }
+    size_t length = p - keyword;
 
-            if ( num_vertex > 4 || num_vertex < 3 ) {
-                std::cerr << "Syntax error at line " << line_num
-                          << ", face has incorrect number of vertices" << std::endl;
-                return false;
-            }
+    if ( length == 1 && keyword[0] == 'v' ) {
+        Vector3 position;
+        if ( !parse_real( &p, end, &position.x ) || !parse_real( &p, end, &position.y ) || !parse_real( &p, end, &position.z ) ) {
+            return "position syntax error";
+        }
+        chunk->positions.push_back( position );
+    } else if ( length == 2 && keyword[0] == 'v' && keyword[1] == 'n' ) {
+        Vector3 normal;
+        if ( !parse_real( &p, end, &normal.x ) || !parse_real( &p, end, &normal.y ) || !parse_real( &p, end, &normal.z ) ) {
+            return "normal syntax error";
+        }
+        chunk->normals.push_back( normal );
+    } else if ( length == 2 && keyword[0] == 'v' && keyword[1] == 't' ) {
+        Vector2 uv;
+        if ( !parse_real( &p, end, &uv.x ) || !parse_real( &p, end, &uv.y ) ) {
+            return "uv syntax error";
+        }
+        chunk->tcoords.push_back( uv );
+    } else if ( length == 1 && keyword[0] == 'f' ) {
+        return parse_face( chunk, p, end );
+    }
+    // anything else, such as comments, groups and materials, is ignored
+    return 0;
+}
 
-            for ( size_t i = 0; i < num_vertex; ++i ) {
-                switch ( format )
-                {
-                case VERTEX_ONLY:
-                    sscanf( face_tokens[i].c_str(),
-                            scan_vertex,
-                            &tri[i].vertex );
-                    tri[i].normal = 0;
-                    tri[i].tcoord = 0;
-                    break;
-
-                case VERTEX_UV:
-                    sscanf( face_tokens[i].c_str(),
-                            scan_vertex_uv,
-                            &tri[i].vertex,
-                            &tri[i].tcoord );
-                    tri[i].normal = 0;
-                    break;
-
-                case VERTEX_NORMAL:
-                    sscanf( face_tokens[i].c_str(),
-                            scan_vertex_normal,
-                            &tri[i].vertex,
-                            &tri[i].normal );
-                    tri[i].tcoord = 0;
-                    break;
-
-                case VERTEX_UV_NORMAL:
-                    sscanf( face_tokens[i].c_str(),
-                            scan_vertex_uv_normal,
-                            &tri[i].vertex,
-                            &tri[i].tcoord,
-                            &tri[i].normal );
-                    break;
-
-                default:
-                    std::cerr << "Syntax error, unrecongnized face format at line "
-                              << line_num << std::endl;
-                    break;
-                }
-            }
+static void parse_chunk( ObjChunk* chunk )
+{
+    const char* p = chunk->begin;
+    const char* end = chunk->end;
+    while ( p < end ) {
+        const char* eol = static_cast< const char* >( memchr( p, '\n', end - p ) );
+        if ( !eol ) {
+            eol = end;
+        }
+        ++chunk->num_lines;
+        const char* error = parse_line( chunk, p, eol );
+        if ( error ) {
+            chunk->error = error;
+            chunk->error_line = chunk->num_lines;
+            return;
+        }
+        p = eol < end ? eol + 1 : end;
+    }
+}
 
-            for ( size_t i = 0; i < num_vertex; ++i ) {
-                tri[i].vertex--;
-                tri[i].normal--;
-                tri[i].tcoord--;
-            }
+static void parse_chunk_task( void* data, size_t index )
+{
+    parse_chunk( &static_cast< ObjChunk* >( data )[index] );
+}
 
-            Face f1 = { { tri[0], tri[1], tri[2] } };
-            face_list.push_back( f1 );
+/**
+ * Header of the binary mesh cache, followed by the vertices and the
+ * triangles as stored in Mesh.
+ */
+struct MeshCacheHeader
+{
+    unsigned int magic;
+    unsigned int version;
+    // sizes of the stored structs, which depend on real_t and the compiler
+    unsigned int vertex_size;
+    unsigned int triangle_size;
+    // size and modification time of the OBJ file the cache was made from
+    long long source_size;
+    long long source_time;
+    long long num_vertices;
+    long long num_triangles;
+    unsigned int has_normals;
+    unsigned int has_tcoords;
+};
 
-            if ( num_vertex == 4 ) {
-                Face f2 = { { tri[2], tri[3], tri[0] } };
-                face_list.push_back( f2 );
-            }
+Mesh::Mesh()
+{
+    has_tcoords = false;
+    has_normals = false;
+    vertex_buffer = 0;
+    index_buffer = 0;
+    num_indices = 0;
+}
 
-        } else if ( token == " " ) {
+Mesh::~Mesh()
+{
+    if ( vertex_buffer ) {
+        glDeleteBuffers( 1, &vertex_buffer );
+    }
+    if ( index_buffer ) {
+        glDeleteBuffers( 1, &index_buffer );
+    }
+}
 
-        } else {
-            //std::cerr << "Unknown token on line " << line_num << std::endl;
+bool Mesh::load()
+{
+    std::cout << "Loading mesh from '" << filename << "'..." << std::endl;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    struct stat info;
+    if ( stat( filename.c_str(), &info ) != 0 ) {
+        std::cout << "Error opening file '" << filename << "' for mesh loading.\n";
+        return false;
+    }
+    long long source_size = info.st_size;
+    long long source_time = info.st_mtime;
+    std::string cache_filename = filename + MESH_CACHE_SUFFIX;
+
+    bool cached = load_cache( cache_filename, source_size, source_time );
+    if ( !cached ) {
+        if ( !load_obj() ) {
+            return false;
         }
+        save_cache( cache_filename, source_size, source_time );
+    }
 
-        token.clear();
-        line.clear();
+    double ms = std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count();
+    std::cout << "Successfully loaded mesh '" << filename << "' (" << vertices.size() << " vertices, "
+              << triangles.size() << " triangles) in " << ms << " ms" << ( cached ? " from its cache" : "" ) << ".\n";
+    return true;
+}
+
+bool Mesh::load_obj()
+{
+    MappedFile file;
+    if ( !file.open( filename.c_str() ) ) {
+        std::cout << "Error opening file '" << filename << "' for mesh loading.\n";
+        return false;
     }
 
-    // verify index list sanity
+    // split the file into chunks at line ends
+    const char* data = file.data();
+    const char* end = data + file.size();
+    std::vector< ObjChunk > chunks( std::max( size_t( 1 ), file.size() / MESH_CHUNK_BYTES ) );
+    const char* p = data;
+    for ( size_t i = 0; i < chunks.size(); ++i ) {
+        ObjChunk& chunk = chunks[i];
+        chunk.begin = p;
+        if ( i + 1 < chunks.size() ) {
+            const char* eol = static_cast< const char* >( memchr( data + ( i + 1 ) * MESH_CHUNK_BYTES, '\n',
+                end - ( data + ( i + 1 ) * MESH_CHUNK_BYTES ) ) );
+            p = std::max( p, eol ? eol + 1 : end );
+        } else {
+            p = end;
+        }
+        chunk.end = p;
+        chunk.has_face = false;
+        chunk.first_face_normals = false;
+        chunk.first_face_tcoords = false;
+        chunk.num_lines = 0;
+        chunk.error = 0;
+        chunk.error_line = 0;
+    }
 
-    int num_vertex = position_list.size();
-    int num_normal = normal_list.size();
-    int num_tcoord = uv_list.size();
+    if ( chunks.size() > 1 ) {
+        ThreadPool pool;
+        pool.parallel_for( chunks.size(), parse_chunk_task, &chunks[0] );
+    } else {
+        parse_chunk( &chunks[0] );
+    }
 
-    for ( size_t i = 0; i < face_list.size(); ++i ) {
-        const Face& face = face_list[i];
-        for ( size_t j = 0; j < 3; ++j ) {
-            int vidx = face.v[j].vertex;
-            int nidx = face.v[j].normal;
-            int tidx = face.v[j].tcoord;
-
-            if (    vidx <  0 || vidx >= num_vertex
-                 || nidx < -1 || nidx >= num_normal
-                 || tidx < -1 || tidx >= num_tcoord ) {
-                std::cout << "Invalid index in face " << i << ".\n";
+    // Concatenate the chunks, offsetting the relative indices by the sizes
+    // of the lists before them
+    size_t num_lines = 0;
+    size_t num_positions = 0, num_normals = 0, num_tcoords = 0, num_corners = 0;
+    has_normals = false;
+    has_tcoords = false;
+    bool has_face = false;
+    for ( size_t i = 0; i < chunks.size(); ++i ) {
+        ObjChunk& chunk = chunks[i];
+        if ( chunk.error ) {
+            std::cerr << chunk.error << " on line " << num_lines + chunk.error_line << std::endl;
+            return false;
+        }
+        for ( size_t k = 0; k < chunk.relative.size(); ++k ) {
+            TriIndex& index = chunk.corners[chunk.relative[k] / 4];
+            switch ( chunk.relative[k] % 4 ) {
+            case 0:
+                index.vertex += int( num_positions );
+                break;
+            case 1:
+                index.normal += int( num_normals );
+                break;
+            default:
+                index.tcoord += int( num_tcoords );
+                break;
             }
         }
+        if ( chunk.has_face && !has_face ) {
+            has_face = true;
+            has_normals = chunk.first_face_normals;
+            has_tcoords = chunk.first_face_tcoords;
+        }
+        num_lines += chunk.num_lines;
+        num_positions += chunk.positions.size();
+        num_normals += chunk.normals.size();
+        num_tcoords += chunk.tcoords.size();
+        num_corners += chunk.corners.size();
     }
 
-    // build vertex list using map for shared vertices
-
-    triangles.reserve( face_list.size() );
-    vertices.reserve( face_list.size() * 2 );
+    std::vector< Vector3 > positions;
+    std::vector< Vector3 > normals;
+    std::vector< Vector2 > tcoords;
+    positions.reserve( num_positions );
+    normals.reserve( num_normals );
+    tcoords.reserve( num_tcoords );
+    for ( size_t i = 0; i < chunks.size(); ++i ) {
+        positions.insert( positions.end(), chunks[i].positions.begin(), chunks[i].positions.end() );
+        normals.insert( normals.end(), chunks[i].normals.begin(), chunks[i].normals.end() );
+        tcoords.insert( tcoords.end(), chunks[i].tcoords.begin(), chunks[i].tcoords.end() );
+        std::vector< Vector3 >().swap( chunks[i].positions );
+        std::vector< Vector3 >().swap( chunks[i].normals );
+        std::vector< Vector2 >().swap( chunks[i].tcoords );
+    }
 
-    // current vertex index, for creating new vertices
-    unsigned int vert_idx_counter = 0;
+    // Build the vertex list, two face vertices only being the same vertex
+    // if their position, normal and texture coordinate all are
+    triangles.clear();
+    vertices.clear();
+    triangles.reserve( num_corners / 3 );
+    vertices.reserve( num_positions );
+    VertexTable table( num_positions );
+    size_t face = 0;
+    for ( size_t i = 0; i < chunks.size(); ++i ) {
+        const std::vector< TriIndex >& corners = chunks[i].corners;
+        for ( size_t k = 0; k < corners.size(); k += 3, ++face ) {
+            MeshTriangle triangle;
+            for ( size_t j = 0; j < 3; ++j ) {
+                const TriIndex& index = corners[k + j];
+                if (    index.vertex <  0 || index.vertex >= int( num_positions )
+                     || index.normal < -1 || index.normal >= int( num_normals )
+                     || index.tcoord < -1 || index.tcoord >= int( num_tcoords ) ) {
+                    std::cerr << "Invalid index in face " << face << ".\n";
+                    triangles.clear();
+                    vertices.clear();
+                    return false;
+                }
 
-    for ( size_t i = 0; i < face_list.size(); ++i ) {
-        const Face& face = face_list[i];
-        MeshTriangle tri;
-        for ( size_t j = 0; j < 3; ++j ) {
-            // two vertices are only actually the same one if the vertex,
-            // normal, and tcoord are all the same. use the map to check this.
-            std::pair< VertexMap::iterator, bool > rv = vertex_map.insert( std::make_pair( face.v[j], vert_idx_counter ) );
-            if ( rv.second ) {
-                MeshVertex v;
-                v.position = position_list[face.v[j].vertex];
-                int nidx = face.v[j].normal;
-                v.normal = nidx == -1 ? Vector3::Zero : normal_list[nidx];
-                int tidx = face.v[j].tcoord;
-                v.tex_coord = tidx == -1 ? Vector2::Zero : uv_list[tidx];
-                vertices.push_back( v );
-                vert_idx_counter++;
+                bool inserted;
+                triangle.vertices[j] = table.insert( index, unsigned( vertices.size() ), &inserted );
+                if ( inserted ) {
+                    MeshVertex v;
+                    v.position = positions[index.vertex];
+                    v.normal = index.normal == -1 ? Vector3::Zero : normals[index.normal];
+                    v.tex_coord = index.tcoord == -1 ? Vector2::Zero : tcoords[index.tcoord];
+                    vertices.push_back( v );
+                }
             }
-
-            tri.vertices[j] = rv.first->second;
+            triangles.push_back( triangle );
         }
-        triangles.push_back( tri );
+    }
+    return true;
+}
+
+bool Mesh::load_cache( const std::string& cache_filename, long long source_size, long long source_time )
+{
+    MappedFile file;
+    if ( !file.open( cache_filename.c_str() ) || file.size() < sizeof( MeshCacheHeader ) ) {
+        return false;
+    }
+
+    MeshCacheHeader header;
+    memcpy( &header, file.data(), sizeof header );
+    if (    header.magic != MESH_CACHE_MAGIC
+         || header.version != MESH_CACHE_VERSION
+         || header.vertex_size != sizeof( MeshVertex )
+         || header.triangle_size != sizeof( MeshTriangle )
+         || header.source_size != source_size
+         || header.source_time != source_time
+         || header.num_vertices < 0 || header.num_triangles < 0 ) {
+        return false;
+    }
+    size_t vertex_bytes = size_t( header.num_vertices ) * sizeof( MeshVertex );
+    size_t triangle_bytes = size_t( header.num_triangles ) * sizeof( MeshTriangle );
+    if ( file.size() != sizeof header + vertex_bytes + triangle_bytes ) {
+        return false;
     }
 
-    std::cout << "Successfully loaded mesh '" << filename << "'.\n";
+    const char* data = file.data() + sizeof header;
+    vertices.resize( size_t( header.num_vertices ) );
+    triangles.resize( size_t( header.num_triangles ) );
+    if ( vertex_bytes ) {
+        memcpy( &vertices[0], data, vertex_bytes );
+    }
+    if ( triangle_bytes ) {
+        memcpy( &triangles[0], data + vertex_bytes, triangle_bytes );
+    }
+    has_normals = header.has_normals != 0;
+    has_tcoords = header.has_tcoords != 0;
     return true;
 }
 
+void Mesh::save_cache( const std::string& cache_filename, long long source_size, long long source_time ) const
+{
+    FILE* file = fopen( cache_filename.c_str(), "wb" );
+    if ( !file ) {
+        return;
+    }
+
+    MeshCacheHeader header;
+    memset( &header, 0, sizeof header );
+    header.version = MESH_CACHE_VERSION;
+    header.vertex_size = sizeof( MeshVertex );
+    header.triangle_size = sizeof( MeshTriangle );
+    header.source_size = source_size;
+    header.source_time = source_time;
+    header.num_vertices = vertices.size();
+    header.num_triangles = triangles.size();
+    header.has_normals = has_normals;
+    header.has_tcoords = has_tcoords;
+
+    // The magic is only written once everything else is, so a partly
+    // written cache is never loaded
+    bool ok = fwrite( &header, sizeof header, 1, file ) == 1;
+    if ( ok && !vertices.empty() ) {
+        ok = fwrite( &vertices[0], sizeof( MeshVertex ), vertices.size(), file ) == vertices.size();
+    }
+    if ( ok && !triangles.empty() ) {
+        ok = fwrite( &triangles[0], sizeof( MeshTriangle ), triangles.size(), file ) == triangles.size();
+    }
+    if ( ok ) {
+        header.magic = MESH_CACHE_MAGIC;
+        ok = fseek( file, 0, SEEK_SET ) == 0 && fwrite( &header, sizeof header, 1, file ) == 1;
+    }
+    if ( fclose( file ) != 0 || !ok ) {
+        remove( cache_filename.c_str() );
+    }
+}
+
 const MeshTriangle* Mesh::get_triangles() const
 {
     return triangles.empty() ? NULL : &triangles[0];
@@ -371,7 +791,7 @@ bool Mesh::create_gl_data()
     }
 
     // build vertex data
-    vertex_data.resize( vertices.size() * VERTEX_SIZE );
+    FloatList vertex_data( vertices.size() * VERTEX_SIZE );
     float* vertex = &vertex_data[0];
     for ( size_t i = 0; i < vertices.size(); ++i ) {
         vertices[i].tex_coord.to_array( vertex + 0 );
@@ -380,7 +800,7 @@ bool Mesh::create_gl_data()
         vertex += VERTEX_SIZE;
     }
     // build index data
-    index_data.resize( triangles.size() * 3 );
+    IndexList index_data( triangles.size() * 3 );
     unsigned int* index = &index_data[0];
 
     for ( size_t i = 0; i < triangles.size(); ++i ) {
@@ -389,14 +809,52 @@ bool Mesh::create_gl_data()
         index[2] = triangles[i].vertices[2];
         index += 3;
     }
+
+    // upload both once, they never change
+    if ( !vertex_buffer ) {
+        glGenBuffers( 1, &vertex_buffer );
+    }
+    if ( !index_buffer ) {
+        glGenBuffers( 1, &index_buffer );
+    }
+    if ( !vertex_buffer || !index_buffer ) {
+        return false;
+    }
+    glBindBuffer( GL_ARRAY_BUFFER, vertex_buffer );
+    glBufferData( GL_ARRAY_BUFFER, vertex_data.size() * sizeof vertex_data[0], &vertex_data[0], GL_STATIC_DRAW );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, index_buffer );
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, index_data.size() * sizeof index_data[0], &index_data[0], GL_STATIC_DRAW );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+    num_indices = index_data.size();
     return true;
 }
 
 void Mesh::render() const
 {
-    assert( index_data.size() > 0 );
-    glInterleavedArrays( GL_T2F_N3F_V3F, VERTEX_SIZE * sizeof vertex_data[0], &vertex_data[0] );
-    glDrawElements( GL_TRIANGLES, index_data.size(), GL_UNSIGNED_INT, &index_data[0] );
+    bind_gl_data();
+    draw();
+    unbind_gl_data();
+}
+
+void Mesh::bind_gl_data() const
+{
+    glBindBuffer( GL_ARRAY_BUFFER, vertex_buffer );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, index_buffer );
+    // offsets into the bound buffers
+    glInterleavedArrays( GL_T2F_N3F_V3F, VERTEX_SIZE * sizeof( float ), 0 );
+}
+
+void Mesh::draw() const
+{
+    assert( num_indices > 0 );
+    glDrawElements( GL_TRIANGLES, GLsizei( num_indices ), GL_UNSIGNED_INT, 0 );
+}
+
+void Mesh::unbind_gl_data()
+{
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
 }
 
 } /* _462 */
@@ -12,6 +12,7 @@
 #include "math/vector.hpp"
 
 #include <vector>
+#include <string>
 #include <cassert>
 
 namespace _462 {
@@ -67,8 +68,25 @@ public:
     /// Renders the mesh using opengl.
     void render() const;
 
+    /**
+     * Binds the vertex and index buffers for draw(). Drawing several
+     * instances binds once, then draws each.
+     */
+    void bind_gl_data() const;
+    void draw() const;
+    static void unbind_gl_data();
+
 private:
 
+    bool load_obj();
+    /**
+     * Loads the binary cache made from an OBJ file of the given size and
+     * modification time. Fails if the cache is missing, stale, or was
+     * written by an incompatible build.
+     */
+    bool load_cache( const std::string& cache_filename, long long source_size, long long source_time );
+    void save_cache( const std::string& cache_filename, long long source_size, long long source_time ) const;
+
     typedef std::vector< MeshTriangle > MeshTriangleList;
     typedef std::vector< MeshVertex > MeshVertexList;
 
@@ -84,10 +102,11 @@ private:
     typedef std::vector< float > FloatList;
     typedef std::vector< unsigned int > IndexList;
 
-    // the vertex data used for GL rendering
-    FloatList vertex_data;
-    // the index data used for GL rendering
-    IndexList index_data;
+    // GL buffers of the interleaved vertex data and of the indices,
+    // filled by create_gl_data
+    unsigned int vertex_buffer;
+    unsigned int index_buffer;
+    size_t num_indices;
 
     // prevent copy/assignment
     Mesh( const Mesh& );
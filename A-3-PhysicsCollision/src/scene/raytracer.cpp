@@ -0,0 +1,698 @@
+/**
+ * @file raytracer.cpp
+ * @brief Renders scenes on the cpu by ray tracing, without opengl.
+ */
+
+#include "scene/raytracer.hpp"
+#include "scene/scene.hpp"
+#include "scene/sphere.hpp"
+#include "scene/triangle.hpp"
+#include "scene/model.hpp"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <map>
+
+namespace _462 {
+
+// width and height of the square tiles handed to the threads, in pixels
+#define RAYTRACE_TILE_SIZE 32
+// most bounces a ray takes through reflections and refractions
+#define RAYTRACE_MAX_DEPTH 4
+// distance secondary rays start from their surface, so they don't hit it.
+// Floats round hit points coarser.
+#ifdef MATH_SINGLE_PRECISION
+#define RAYTRACE_EPSILON 1e-3
+#else
+#define RAYTRACE_EPSILON 1e-6
+#endif
+// the end of rays that don't stop at the far clip plane
+#define RAYTRACE_FAR std::numeric_limits< real_t >::max()
+// most boxes in a leaf of the trees
+#define RAYTRACE_LEAF_SIZE 4
+// deepest tree a ray can walk. Median splits halve the boxes per level, so
+// this is never reached.
+#define RAYTRACE_MAX_TREE_DEPTH 64
+
+struct Raytracer::Ray
+{
+    Vector3 origin;
+    // unit length, so distances along the ray are world distances
+    Vector3 direction;
+    real_t start;
+    real_t end;
+
+    Ray( const Vector3& o, const Vector3& d, real_t s, real_t e )
+        : origin( o ), direction( d ), start( s ), end( e ) { }
+};
+
+struct Raytracer::Hit
+{
+    real_t time;
+    PrimitiveType type;
+    // index into the triangles, models or spheres by type
+    size_t index;
+    // the triangle of the mesh, on models
+    size_t triangle;
+    // barycentric coordinates of vertices 1 and 2 on triangles
+    real_t beta, gamma;
+};
+
+// the colors of a surface point, blended from the vertex materials
+struct SurfaceMaterial
+{
+    Color3 ambient;
+    Color3 diffuse;
+    Color3 specular;
+    Color3 texture;
+    real_t refractive_index;
+};
+
+// whether the ray passes through the box between start and end, and the
+// time it enters
+static inline bool intersects_box( const AABB& box, const Vector3& origin,
+                                   const Vector3& inv_direction, real_t start, real_t end,
+                                   real_t* entry )
+{
+    for ( int i = 0; i < 3; ++i ) {
+        real_t t0 = ( box.min[i] - origin[i] ) * inv_direction[i];
+        real_t t1 = ( box.max[i] - origin[i] ) * inv_direction[i];
+        if ( t0 > t1 ) {
+            std::swap( t0, t1 );
+        }
+        start = std::max( start, t0 );
+        end = std::min( end, t1 );
+        if ( start > end ) {
+            return false;
+        }
+    }
+    *entry = start;
+    return true;
+}
+
+// Moller-Trumbore, returning the barycentric coordinates of b and c at the
+// hit
+static inline bool intersects_triangle( const Vector3& a, const Vector3& b, const Vector3& c,
+                                        const Vector3& origin, const Vector3& direction,
+                                        real_t start, real_t end,
+                                        real_t* time, real_t* beta, real_t* gamma )
+{
+    Vector3 edge1 = b - a;
+    Vector3 edge2 = c - a;
+    Vector3 p = cross( direction, edge2 );
+    real_t det = dot( edge1, p );
+    if ( det == 0.0 ) {
+        return false;
+    }
+    real_t inv_det = 1.0 / det;
+    Vector3 s = origin - a;
+    real_t u = dot( s, p ) * inv_det;
+    if ( u < 0.0 || u > 1.0 ) {
+        return false;
+    }
+    Vector3 q = cross( s, edge1 );
+    real_t v = dot( direction, q ) * inv_det;
+    if ( v < 0.0 || u + v > 1.0 ) {
+        return false;
+    }
+    real_t t = dot( edge2, q ) * inv_det;
+    if ( t < start || t > end ) {
+        return false;
+    }
+    *time = t;
+    *beta = u;
+    *gamma = v;
+    return true;
+}
+
+// hits the unit sphere at the origin with the ray mapped into its space.
+// The local direction isn't unit length, but the times are still those of
+// the world space ray.
+static inline bool intersects_unit_sphere( const Vector3& origin, const Vector3& direction,
+                                           real_t start, real_t end, real_t* time )
+{
+    real_t a = dot( direction, direction );
+    real_t b = dot( origin, direction );
+    real_t c = dot( origin, origin ) - 1.0;
+    real_t discriminant = b * b - a * c;
+    if ( discriminant < 0.0 ) {
+        return false;
+    }
+    real_t root = sqrt( discriminant );
+    real_t t = ( -b - root ) / a;
+    if ( t < start ) {
+        t = ( -b + root ) / a;
+    }
+    if ( t < start || t > end ) {
+        return false;
+    }
+    *time = t;
+    return true;
+}
+
+// bilinear lookup with wrapping, like the gl textures
+static Color3 sample_texture( const Material* material, const Vector2& tex_coord )
+{
+    int width, height;
+    material->get_texture_size( &width, &height );
+    if ( !material->get_texture_data() || width < 1 || height < 1 ) {
+        return Color3::White;
+    }
+    real_t x = ( tex_coord.x - floor( tex_coord.x ) ) * width - 0.5;
+    real_t y = ( tex_coord.y - floor( tex_coord.y ) ) * height - 0.5;
+    real_t fx = floor( x );
+    real_t fy = floor( y );
+    real_t wx = x - fx;
+    real_t wy = y - fy;
+    int x0 = ( int( fx ) + width ) % width;
+    int y0 = ( int( fy ) + height ) % height;
+    int x1 = ( x0 + 1 ) % width;
+    int y1 = ( y0 + 1 ) % height;
+    return material->get_texture_pixel( x0, y0 ) * ( ( 1 - wx ) * ( 1 - wy ) ) +
+           material->get_texture_pixel( x1, y0 ) * ( wx * ( 1 - wy ) ) +
+           material->get_texture_pixel( x0, y1 ) * ( ( 1 - wx ) * wy ) +
+           material->get_texture_pixel( x1, y1 ) * ( wx * wy );
+}
+
+// adds the material's colors at the point with the given weight. Missing
+// materials get gl's default one, which is what the opengl renderer shows.
+static void add_material( SurfaceMaterial* surface, const Material* material,
+                          const Vector2& tex_coord, real_t weight )
+{
+    if ( !material ) {
+        surface->ambient += Color3( 0.2, 0.2, 0.2 ) * weight;
+        surface->diffuse += Color3( 0.8, 0.8, 0.8 ) * weight;
+        surface->texture += Color3::White * weight;
+        return;
+    }
+    surface->ambient += material->ambient * weight;
+    surface->diffuse += material->diffuse * weight;
+    surface->specular += material->specular * weight;
+    surface->texture += sample_texture( material, tex_coord ) * weight;
+    surface->refractive_index += material->refractive_index * weight;
+}
+
+static Vector3 reflect( const Vector3& direction, const Vector3& normal )
+{
+    return direction - normal * ( 2 * dot( direction, normal ) );
+}
+
+void Raytracer::Tree::build( const std::vector< AABB >& boxes )
+{
+    size_t count = boxes.size();
+    nodes.clear();
+    indices.resize( count );
+    centroids.resize( count );
+    for ( size_t i = 0; i < count; ++i ) {
+        indices[i] = unsigned( i );
+        centroids[i] = ( boxes[i].min + boxes[i].max ) * 0.5;
+    }
+    if ( count == 0 ) {
+        return;
+    }
+
+    nodes.reserve( 2 * count );
+    nodes.resize( 1 );
+    build_node( boxes, 0, 0, count );
+
+    centroids.clear();
+}
+
+// orders box indices by one coordinate of their centroids
+struct RayCentroidLess
+{
+    const Vector3* centroids;
+    int axis;
+
+    bool operator()( unsigned int lhs, unsigned int rhs ) const {
+        return centroids[lhs][axis] < centroids[rhs][axis];
+    }
+};
+
+void Raytracer::Tree::build_node( const std::vector< AABB >& boxes, size_t node, size_t first, size_t count )
+{
+    AABB box = boxes[indices[first]];
+    AABB centers;
+    centers.min = centers.max = centroids[indices[first]];
+    for ( size_t i = first + 1; i < first + count; ++i ) {
+        box.min = vmin( box.min, boxes[indices[i]].min );
+        box.max = vmax( box.max, boxes[indices[i]].max );
+        centers.min = vmin( centers.min, centroids[indices[i]] );
+        centers.max = vmax( centers.max, centroids[indices[i]] );
+    }
+    nodes[node].box = box;
+
+    if ( count <= RAYTRACE_LEAF_SIZE ) {
+        nodes[node].first = unsigned( first );
+        nodes[node].count = unsigned( count );
+        return;
+    }
+
+    // split at the median centroid along the longest axis of the centroids
+    Vector3 extent = centers.max - centers.min;
+    RayCentroidLess less;
+    less.centroids = &centroids[0];
+    less.axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+    size_t half = count / 2;
+    std::nth_element( indices.begin() + first, indices.begin() + first + half,
+                      indices.begin() + first + count, less );
+
+    size_t children = nodes.size();
+    nodes.resize( children + 2 );
+    nodes[node].first = unsigned( children );
+    nodes[node].count = 0;
+    build_node( boxes, children, first, half );
+    build_node( boxes, children + 1, first + half, count - half );
+}
+
+Raytracer::Raytracer( size_t num_threads ) : scene( 0 ), pool( num_threads ), tiles_x( 0 ) { }
+
+Raytracer::~Raytracer() { }
+
+size_t Raytracer::num_threads() const
+{
+    return pool.num_threads();
+}
+
+
+void Raytracer::initialize( const Scene* scn )
+{
+    scene = scn;
+    triangles.clear();
+    models.clear();
+    mesh_trees.clear();
+    sphere_geometries.clear();
+
+    // models sharing a mesh share its tree
+    std::map< const Mesh*, size_t > mesh_tree_indices;
+    std::vector< AABB > model_boxes;
+
+    Geometry* const* geometries = scene->get_geometries();
+    for ( size_t i = 0; i < scene->num_geometries(); ++i ) {
+        const Geometry* geom = geometries[i];
+        Matrix4 transform;
+        Matrix3 normal_matrix;
+        make_transformation_matrix( &transform, geom->position, geom->orientation, geom->scale );
+        make_normal_matrix( &normal_matrix, transform );
+
+        if ( const Sphere* sphere = dynamic_cast< const Sphere* >( geom ) ) {
+            sphere_geometries.push_back( sphere );
+        } else if ( const Triangle* triangle = dynamic_cast< const Triangle* >( geom ) ) {
+            TracedTriangle traced;
+            for ( int k = 0; k < 3; ++k ) {
+                const Triangle::Vertex& v = triangle->vertices[k];
+                traced.vertices[k] = transform.transform_point( v.position );
+                traced.normals[k] = normalize( normal_matrix * v.normal );
+                traced.tex_coords[k] = v.tex_coord;
+                traced.materials[k] = v.material;
+            }
+            triangles.push_back( traced );
+        } else if ( const Model* model = dynamic_cast< const Model* >( geom ) ) {
+            const Mesh* mesh = model->mesh;
+            if ( !mesh || mesh->num_triangles() == 0 ) {
+                continue;
+            }
+
+            std::map< const Mesh*, size_t >::iterator it = mesh_tree_indices.find( mesh );
+            if ( it == mesh_tree_indices.end() ) {
+                const MeshVertex* vertices = mesh->get_vertices();
+                const MeshTriangle* mesh_triangles = mesh->get_triangles();
+                std::vector< AABB > boxes( mesh->num_triangles() );
+                for ( size_t t = 0; t < boxes.size(); ++t ) {
+                    const unsigned int* v = mesh_triangles[t].vertices;
+                    const Vector3& a = vertices[v[0]].position;
+                    const Vector3& b = vertices[v[1]].position;
+                    const Vector3& c = vertices[v[2]].position;
+                    boxes[t].min = vmin( a, vmin( b, c ) );
+                    boxes[t].max = vmax( a, vmax( b, c ) );
+                }
+                it = mesh_tree_indices.insert( std::make_pair( mesh, mesh_trees.size() ) ).first;
+                mesh_trees.push_back( Tree() );
+                mesh_trees.back().build( boxes );
+            }
+
+            TracedModel traced;
+            make_inverse_transformation_matrix( &traced.inverse, geom->position, geom->orientation, geom->scale );
+            traced.normal_matrix = normal_matrix;
+            traced.mesh = mesh;
+            traced.tree = it->second;
+            traced.material = model->material;
+            models.push_back( traced );
+
+            // the world box around the corners of the mesh's box
+            const AABB& local = mesh_trees[traced.tree].nodes[0].box;
+            Vector3 corners[8];
+            for ( int k = 0; k < 8; ++k ) {
+                corners[k] = Vector3( k & 1 ? local.max.x : local.min.x,
+                                      k & 2 ? local.max.y : local.min.y,
+                                      k & 4 ? local.max.z : local.min.z );
+            }
+            transform_points( transform, corners, corners, 8 );
+            AABB box;
+            box.min = box.max = corners[0];
+            for ( int k = 1; k < 8; ++k ) {
+                box.min = vmin( box.min, corners[k] );
+                box.max = vmax( box.max, corners[k] );
+            }
+            model_boxes.push_back( box );
+        }
+    }
+
+    std::vector< AABB > boxes( triangles.size() );
+    for ( size_t i = 0; i < triangles.size(); ++i ) {
+        const Vector3* v = triangles[i].vertices;
+        boxes[i].min = vmin( v[0], vmin( v[1], v[2] ) );
+        boxes[i].max = vmax( v[0], vmax( v[1], v[2] ) );
+    }
+    triangle_tree.build( boxes );
+    model_tree.build( model_boxes );
+}
+
+void Raytracer::raytrace( unsigned char* buffer, int width, int height )
+{
+    assert( scene && width > 0 && height > 0 );
+
+    // the spheres have moved since the last image
+    spheres.resize( sphere_geometries.size() );
+    std::vector< AABB > boxes( sphere_geometries.size() );
+    for ( size_t i = 0; i < sphere_geometries.size(); ++i ) {
+        const Sphere* sphere = sphere_geometries[i];
+        Vector3 scale = sphere->scale * sphere->radius;
+        Matrix4 transform;
+        make_transformation_matrix( &transform, sphere->position, sphere->orientation, scale );
+        make_inverse_transformation_matrix( &spheres[i].inverse, sphere->position, sphere->orientation, scale );
+        make_normal_matrix( &spheres[i].normal_matrix, transform );
+        spheres[i].material = sphere->material;
+
+        Vector3 extent = vabs( scale );
+        real_t radius = std::max( std::max( extent.x, extent.y ), extent.z );
+        boxes[i].min = sphere->position - Vector3( radius, radius, radius );
+        boxes[i].max = sphere->position + Vector3( radius, radius, radius );
+    }
+    sphere_tree.build( boxes );
+
+    const Camera& camera = scene->camera;
+    view.eye = camera.get_position();
+    view.forward = camera.get_direction();
+    view.up = camera.get_up();
+    view.right = normalize( cross( view.forward, view.up ) );
+    // the fov is vertical, and the aspect that of the image
+    real_t tan_y = tan( camera.get_fov_radians() / 2 );
+    view.up *= tan_y;
+    view.right *= tan_y * width / height;
+    view.width = width;
+    view.height = height;
+    view.buffer = buffer;
+
+    tiles_x = ( width + RAYTRACE_TILE_SIZE - 1 ) / RAYTRACE_TILE_SIZE;
+    size_t tiles_y = ( height + RAYTRACE_TILE_SIZE - 1 ) / RAYTRACE_TILE_SIZE;
+    pool.parallel_for( tiles_x * tiles_y, &Raytracer::trace_tile, this );
+}
+
+void Raytracer::trace_tile( void* data, size_t index )
+{
+    static_cast< Raytracer* >( data )->trace_tile( index );
+}
+
+void Raytracer::trace_tile( size_t tile )
+{
+    int x0 = int( tile % tiles_x ) * RAYTRACE_TILE_SIZE;
+    int y0 = int( tile / tiles_x ) * RAYTRACE_TILE_SIZE;
+    int x1 = std::min( x0 + RAYTRACE_TILE_SIZE, view.width );
+    int y1 = std::min( y0 + RAYTRACE_TILE_SIZE, view.height );
+
+    for ( int y = y0; y < y1; ++y ) {
+        // row 0 is the bottom of the image
+        real_t v = 2 * ( y + 0.5 ) / view.height - 1;
+        for ( int x = x0; x < x1; ++x ) {
+            real_t u = 2 * ( x + 0.5 ) / view.width - 1;
+            Vector3 direction = normalize( view.forward + view.right * u + view.up * v );
+            Ray ray( view.eye, direction, scene->camera.get_near_clip(), RAYTRACE_FAR );
+            Color3 color = trace( ray, scene->refractive_index, 0 );
+            color.to_array( view.buffer + 4 * ( size_t( y ) * view.width + x ) );
+        }
+    }
+}
+
+bool Raytracer::intersect_tree( const Tree& tree, PrimitiveType type, const Mesh* mesh,
+                                const Vector3& origin, const Vector3& direction,
+                                real_t start, real_t* end, Hit* hit ) const
+{
+    if ( tree.nodes.empty() ) {
+        return false;
+    }
+    Vector3 inv_direction( 1.0 / direction.x, 1.0 / direction.y, 1.0 / direction.z );
+    real_t entry;
+    if ( !intersects_box( tree.nodes[0].box, origin, inv_direction, start, *end, &entry ) ) {
+        return false;
+    }
+
+    const MeshVertex* vertices = mesh ? mesh->get_vertices() : 0;
+    const MeshTriangle* mesh_triangles = mesh ? mesh->get_triangles() : 0;
+
+    // nodes left to visit, and when the ray enters them
+    unsigned int stack[RAYTRACE_MAX_TREE_DEPTH];
+    real_t entries[RAYTRACE_MAX_TREE_DEPTH];
+    size_t top = 0;
+    stack[top] = 0;
+    entries[top] = entry;
+    ++top;
+    bool found = false;
+
+    while ( top > 0 ) {
+        --top;
+        // a hit found since the node was pushed may lie in front of it
+        if ( entries[top] > *end ) {
+            continue;
+        }
+        const Tree::Node& node = tree.nodes[stack[top]];
+
+        if ( node.count == 0 ) {
+            unsigned int children[2] = { node.first, node.first + 1 };
+            real_t times[2];
+            bool hits[2];
+            for ( int k = 0; k < 2; ++k ) {
+                hits[k] = intersects_box( tree.nodes[children[k]].box, origin, inv_direction,
+                                          start, *end, &times[k] );
+            }
+            // push the farther child first, so the nearer one is visited
+            // first and hits in it can skip the other
+            int nearer = hits[0] && hits[1] ? ( times[1] < times[0] ? 1 : 0 ) : ( hits[0] ? 0 : 1 );
+            int order[2] = { 1 - nearer, nearer };
+            for ( int k = 0; k < 2; ++k ) {
+                if ( hits[order[k]] ) {
+                    assert( top < RAYTRACE_MAX_TREE_DEPTH );
+                    stack[top] = children[order[k]];
+                    entries[top] = times[order[k]];
+                    ++top;
+                }
+            }
+            continue;
+        }
+
+        for ( unsigned int i = node.first; i < node.first + node.count; ++i ) {
+            unsigned int index = tree.indices[i];
+            real_t time = 0.0, beta = 0.0, gamma = 0.0;
+            bool hit_primitive = false;
+
+            switch ( type ) {
+            case PRIMITIVE_TRIANGLE: {
+                const Vector3* v = triangles[index].vertices;
+                hit_primitive = intersects_triangle( v[0], v[1], v[2], origin, direction,
+                                                     start, *end, &time, &beta, &gamma );
+                break;
+            }
+            case PRIMITIVE_MESH_TRIANGLE: {
+                const unsigned int* v = mesh_triangles[index].vertices;
+                hit_primitive = intersects_triangle( vertices[v[0]].position, vertices[v[1]].position,
+                                                     vertices[v[2]].position, origin, direction,
+                                                     start, *end, &time, &beta, &gamma );
+                break;
+            }
+            case PRIMITIVE_SPHERE: {
+                const Matrix4& inverse = spheres[index].inverse;
+                hit_primitive = intersects_unit_sphere( inverse.transform_point( origin ),
+                                                        inverse.transform_vector( direction ),
+                                                        start, *end, &time );
+                break;
+            }
+            case PRIMITIVE_MODEL: {
+                // the mesh's space is an affine map of the world, so times
+                // along the ray are the same in both
+                const TracedModel& model = models[index];
+                time = *end;
+                hit_primitive = intersect_tree( mesh_trees[model.tree], PRIMITIVE_MESH_TRIANGLE, model.mesh,
+                                                model.inverse.transform_point( origin ),
+                                                model.inverse.transform_vector( direction ),
+                                                start, &time, hit );
+                break;
+            }
+            }
+
+            if ( !hit_primitive ) {
+                continue;
+            }
+            if ( !hit ) {
+                return true;
+            }
+            *end = time;
+            found = true;
+            hit->time = time;
+            if ( type == PRIMITIVE_MESH_TRIANGLE ) {
+                hit->triangle = index;
+            } else {
+                hit->type = type;
+                hit->index = index;
+            }
+            // the mesh triangle already set them for models
+            if ( type != PRIMITIVE_MODEL && type != PRIMITIVE_SPHERE ) {
+                hit->beta = beta;
+                hit->gamma = gamma;
+            }
+        }
+    }
+    return found;
+}
+
+bool Raytracer::intersect( const Ray& ray, Hit* hit ) const
+{
+    real_t end = ray.end;
+    bool found = false;
+    found |= intersect_tree( triangle_tree, PRIMITIVE_TRIANGLE, 0, ray.origin, ray.direction, ray.start, &end, hit );
+    found |= intersect_tree( model_tree, PRIMITIVE_MODEL, 0, ray.origin, ray.direction, ray.start, &end, hit );
+    found |= intersect_tree( sphere_tree, PRIMITIVE_SPHERE, 0, ray.origin, ray.direction, ray.start, &end, hit );
+    return found;
+}
+
+bool Raytracer::occluded( const Ray& ray ) const
+{
+    real_t end = ray.end;
+    return intersect_tree( sphere_tree, PRIMITIVE_SPHERE, 0, ray.origin, ray.direction, ray.start, &end, 0 ) ||
+           intersect_tree( triangle_tree, PRIMITIVE_TRIANGLE, 0, ray.origin, ray.direction, ray.start, &end, 0 ) ||
+           intersect_tree( model_tree, PRIMITIVE_MODEL, 0, ray.origin, ray.direction, ray.start, &end, 0 );
+}
+
+Color3 Raytracer::trace( const Ray& ray, real_t refractive_index, size_t depth ) const
+{
+    Hit hit;
+    if ( !intersect( ray, &hit ) ) {
+        return scene->background_color;
+    }
+    return shade( ray, hit, refractive_index, depth );
+}
+
+Color3 Raytracer::shade( const Ray& ray, const Hit& hit, real_t refractive_index, size_t depth ) const
+{
+    Vector3 position = ray.origin + ray.direction * hit.time;
+    Vector3 normal;
+    SurfaceMaterial surface;
+    surface.ambient = surface.diffuse = surface.specular = surface.texture = Color3::Black;
+    surface.refractive_index = 0.0;
+    real_t weights[3] = { 1 - hit.beta - hit.gamma, hit.beta, hit.gamma };
+
+    if ( hit.type == PRIMITIVE_SPHERE ) {
+        const TracedSphere& sphere = spheres[hit.index];
+        Vector3 local = normalize( sphere.inverse.transform_point( position ) );
+        normal = normalize( sphere.normal_matrix * local );
+        // the texture wraps like on the gl sphere, longitude around y
+        // starting at +z, and latitude from the top
+        real_t lon = atan2( local.x, local.z ) / ( 2 * PI );
+        Vector2 tex_coord( lon < 0 ? lon + 1 : lon, 1 - acos( clamp( local.y, real_t( -1.0 ), real_t( 1.0 ) ) ) / PI );
+        add_material( &surface, sphere.material, tex_coord, 1.0 );
+    } else if ( hit.type == PRIMITIVE_MODEL ) {
+        const TracedModel& model = models[hit.index];
+        const MeshVertex* vertices = model.mesh->get_vertices();
+        const unsigned int* v = model.mesh->get_triangles()[hit.triangle].vertices;
+        Vector2 tex_coord = vertices[v[0]].tex_coord * weights[0] +
+                            vertices[v[1]].tex_coord * weights[1] +
+                            vertices[v[2]].tex_coord * weights[2];
+        // normals are only computed along with the gl data, so shade flat
+        // without them
+        Vector3 local_normal;
+        if ( model.mesh->are_normals_valid() ) {
+            local_normal = vertices[v[0]].normal * weights[0] +
+                           vertices[v[1]].normal * weights[1] +
+                           vertices[v[2]].normal * weights[2];
+        } else {
+            local_normal = cross( vertices[v[1]].position - vertices[v[0]].position,
+                                  vertices[v[2]].position - vertices[v[0]].position );
+        }
+        normal = normalize( model.normal_matrix * local_normal );
+        add_material( &surface, model.material, tex_coord, 1.0 );
+    } else {
+        const TracedTriangle& triangle = triangles[hit.index];
+        Vector2 tex_coord = triangle.tex_coords[0] * weights[0] +
+                            triangle.tex_coords[1] * weights[1] +
+                            triangle.tex_coords[2] * weights[2];
+        normal = normalize( triangle.normals[0] * weights[0] +
+                            triangle.normals[1] * weights[1] +
+                            triangle.normals[2] * weights[2] );
+        for ( int k = 0; k < 3; ++k ) {
+            add_material( &surface, triangle.materials[k], tex_coord, weights[k] );
+        }
+    }
+
+    // lighting is two sided like in the gl renderer, but refraction needs
+    // to know which side the ray came from
+    bool entering = dot( ray.direction, normal ) < 0;
+    if ( !entering ) {
+        normal = -normal;
+    }
+
+    Color3 color = Color3::Black;
+    if ( surface.refractive_index == 0.0 ) {
+        color += surface.ambient * scene->ambient_light;
+    }
+    const PointLight* lights = scene->get_lights();
+    for ( size_t i = 0; i < scene->num_lights(); ++i ) {
+        Vector3 to_light = lights[i].position - position;
+        real_t distance = length( to_light );
+        to_light *= 1.0 / distance;
+        real_t cosine = dot( normal, to_light );
+        if ( cosine <= 0.0 ) {
+            continue;
+        }
+        Ray shadow( position, to_light, RAYTRACE_EPSILON, distance );
+        if ( !occluded( shadow ) ) {
+            color += surface.diffuse * lights[i].get_color( distance ) * cosine;
+        }
+    }
+    color *= surface.texture;
+
+    if ( depth >= RAYTRACE_MAX_DEPTH ) {
+        return color;
+    }
+
+    Vector3 reflected = normalize( reflect( ray.direction, normal ) );
+    if ( surface.refractive_index == 0.0 ) {
+        if ( surface.specular != Color3::Black ) {
+            Ray ray_reflected( position, reflected, RAYTRACE_EPSILON, RAYTRACE_FAR );
+            color += surface.specular * surface.texture * trace( ray_reflected, refractive_index, depth + 1 );
+        }
+        return color;
+    }
+
+    // dielectric: split between reflection and refraction by schlick's
+    // approximation of the fresnel term
+    real_t n1 = refractive_index;
+    real_t n2 = entering ? surface.refractive_index : scene->refractive_index;
+    real_t ratio = n1 / n2;
+    real_t cos_i = -dot( ray.direction, normal );
+    real_t sin2_t = ratio * ratio * ( 1 - cos_i * cos_i );
+    Ray ray_reflected( position, reflected, RAYTRACE_EPSILON, RAYTRACE_FAR );
+    if ( sin2_t > 1.0 ) {
+        // total internal reflection
+        return color + trace( ray_reflected, n1, depth + 1 );
+    }
+    real_t cos_t = sqrt( 1 - sin2_t );
+    real_t r0 = ( n1 - n2 ) / ( n1 + n2 );
+    r0 *= r0;
+    real_t c = 1 - ( n1 <= n2 ? cos_i : cos_t );
+    real_t reflectance = r0 + ( 1 - r0 ) * c * c * c * c * c;
+    Vector3 refracted = normalize( ray.direction * ratio + normal * ( ratio * cos_i - cos_t ) );
+    Ray ray_refracted( position, refracted, RAYTRACE_EPSILON, RAYTRACE_FAR );
+    return color + trace( ray_reflected, n1, depth + 1 ) * reflectance +
+           trace( ray_refracted, n2, depth + 1 ) * ( 1 - reflectance );
+}
+
+} /* _462 */
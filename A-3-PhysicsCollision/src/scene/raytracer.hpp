@@ -0,0 +1,182 @@
+/**
+ * @file raytracer.hpp
+ * @brief Renders scenes on the cpu by ray tracing, without opengl.
+ */
+
+#ifndef _462_SCENE_RAYTRACER_HPP_
+#define _462_SCENE_RAYTRACER_HPP_
+
+#include "math/matrix.hpp"
+#include "math/color.hpp"
+#include "physics/broadphase.hpp"
+#include "application/threadpool.hpp"
+#include <vector>
+
+namespace _462 {
+
+class Scene;
+class Material;
+class Mesh;
+class Sphere;
+
+/**
+ * Ray traces a scene with direct lighting from its point lights, shadows,
+ * specular reflection and refraction. The image is split into tiles that
+ * the threads of a pool trace independently.
+ *
+ * Triangles and models are static in the simulation, so initialize()
+ * gathers them into bounding volume hierarchies once: one over the
+ * triangles of every mesh in its own space, shared by all models using the
+ * mesh, and one over the models and triangles of the scene. Spheres move,
+ * so they get a hierarchy of their own that every raytrace() rebuilds from
+ * their current positions.
+ */
+class Raytracer
+{
+public:
+
+    /**
+     * @param num_threads The number of threads tracing tiles, including the
+     *  caller. 0 picks the number of hardware threads.
+     */
+    explicit Raytracer( size_t num_threads = 0 );
+    ~Raytracer();
+
+    /**
+     * Prepares to trace the given scene, which must stay alive until the
+     * next call. Textures and meshes must be loaded, opengl data isn't
+     * needed. Triangles and models must not move after this call.
+     */
+    void initialize( const Scene* scene );
+
+    /**
+     * Traces the scene as it is now into width * height RGBA pixels, the
+     * bottom row first like the framebuffer, so it can be passed to
+     * imageio_save_image directly.
+     */
+    void raytrace( unsigned char* buffer, int width, int height );
+
+    size_t num_threads() const;
+
+private:
+
+    // a world space triangle geometry
+    struct TracedTriangle
+    {
+        Vector3 vertices[3];
+        Vector3 normals[3];
+        Vector2 tex_coords[3];
+        // the material of every vertex, any of which may be null
+        const Material* materials[3];
+    };
+
+    // maps world space into the space of a model's mesh and back
+    struct TracedModel
+    {
+        Matrix4 inverse;
+        Matrix3 normal_matrix;
+        const Mesh* mesh;
+        // index into the mesh trees
+        size_t tree;
+        const Material* material;
+    };
+
+    // maps world space onto the unit sphere at the origin and back
+    struct TracedSphere
+    {
+        Matrix4 inverse;
+        Matrix3 normal_matrix;
+        const Material* material;
+    };
+
+    /**
+     * A bounding volume hierarchy over boxes, which refers to them by the
+     * index they had in build(). Leaves list their boxes through a separate
+     * index list, like TriangleTree.
+     */
+    struct Tree
+    {
+        struct Node
+        {
+            AABB box;
+            // inner nodes: index of the first of the two adjacent children.
+            // leaves: first entry in indices.
+            unsigned int first;
+            // boxes in a leaf, 0 for inner nodes
+            unsigned int count;
+        };
+
+        void build( const std::vector< AABB >& boxes );
+        void build_node( const std::vector< AABB >& boxes, size_t node, size_t first, size_t count );
+
+        std::vector< Node > nodes;
+        std::vector< unsigned int > indices;
+        // centroids of the boxes, only used while building
+        std::vector< Vector3 > centroids;
+    };
+
+    // the world space frame of the current image
+    struct View
+    {
+        Vector3 eye;
+        Vector3 forward;
+        Vector3 right;
+        Vector3 up;
+        int width, height;
+        unsigned char* buffer;
+    };
+
+    // what the leaves of a tree refer to
+    enum PrimitiveType
+    {
+        PRIMITIVE_TRIANGLE,
+        PRIMITIVE_MODEL,
+        PRIMITIVE_SPHERE,
+        PRIMITIVE_MESH_TRIANGLE
+    };
+
+    struct Ray;
+    struct Hit;
+
+    static void trace_tile( void* data, size_t index );
+    void trace_tile( size_t tile );
+
+    /**
+     * Walks the tree front to back, testing the primitives in its leaves.
+     * Finds the closest hit before end and moves end to it, or with a null
+     * hit stops at the first one. Mesh triangles are those of the mesh.
+     */
+    bool intersect_tree( const Tree& tree, PrimitiveType type, const Mesh* mesh,
+                         const Vector3& origin, const Vector3& direction,
+                         real_t start, real_t* end, Hit* hit ) const;
+    // finds the closest hit between the ray's start and end
+    bool intersect( const Ray& ray, Hit* hit ) const;
+    // whether anything lies between the ray's start and end
+    bool occluded( const Ray& ray ) const;
+    Color3 trace( const Ray& ray, real_t refractive_index, size_t depth ) const;
+    Color3 shade( const Ray& ray, const Hit& hit, real_t refractive_index, size_t depth ) const;
+
+    const Scene* scene;
+    ThreadPool pool;
+
+    std::vector< TracedTriangle > triangles;
+    Tree triangle_tree;
+    std::vector< TracedModel > models;
+    Tree model_tree;
+    // the tree of every mesh used by a model
+    std::vector< Tree > mesh_trees;
+    std::vector< TracedSphere > spheres;
+    std::vector< const Sphere* > sphere_geometries;
+    Tree sphere_tree;
+
+    View view;
+    size_t tiles_x;
+
+    // no meaningful assignment or copy
+    Raytracer( const Raytracer& );
+    Raytracer& operator=( const Raytracer& );
+};
+
+} /* _462 */
+
+#endif /* _462_SCENE_RAYTRACER_HPP_ */
@@ -0,0 +1,156 @@
+/**
+ * @file renderqueue.cpp
+ * @brief Draws geometries sorted by the state they need.
+ */
+
+#include "scene/renderqueue.hpp"
+#include "scene/model.hpp"
+#include "scene/triangle.hpp"
+#include "scene/material.hpp"
+#include "scene/mesh.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace _462 {
+
+// gives a sphere around all the points, not the smallest but close
+static void bounding_sphere( const Vector3* points, size_t stride, size_t count,
+                             Vector3* center, real_t* radius )
+{
+    if ( count == 0 ) {
+        *center = Vector3::Zero;
+        *radius = 0.0;
+        return;
+    }
+    const char* base = reinterpret_cast< const char* >( points );
+    Vector3 lo = points[0];
+    Vector3 hi = points[0];
+    for ( size_t i = 1; i < count; ++i ) {
+        const Vector3& p = *reinterpret_cast< const Vector3* >( base + i * stride );
+        lo = Vector3( std::min( lo.x, p.x ), std::min( lo.y, p.y ), std::min( lo.z, p.z ) );
+        hi = Vector3( std::max( hi.x, p.x ), std::max( hi.y, p.y ), std::max( hi.z, p.z ) );
+    }
+    *center = ( lo + hi ) * 0.5;
+    real_t r2 = 0.0;
+    for ( size_t i = 0; i < count; ++i ) {
+        const Vector3& p = *reinterpret_cast< const Vector3* >( base + i * stride );
+        r2 = std::max( r2, squared_length( p - *center ) );
+    }
+    *radius = sqrt( r2 );
+}
+
+RenderQueue::RenderQueue() : sorted( true ) { }
+
+void RenderQueue::add_geometry( const Geometry* geometry )
+{
+    assert( geometry );
+    Item item;
+    item.geometry = geometry;
+    item.material = 0;
+    item.mesh = 0;
+    item.center = Vector3::Zero;
+    item.radius = 0.0;
+
+    const Model* model = dynamic_cast< const Model* >( geometry );
+    const Triangle* triangle = dynamic_cast< const Triangle* >( geometry );
+    if ( model && model->mesh && model->mesh->num_vertices() > 0 ) {
+        item.kind = KIND_MODEL;
+        item.material = model->material;
+        item.mesh = model->mesh;
+        bounding_sphere( &model->mesh->get_vertices()[0].position, sizeof( MeshVertex ),
+                         model->mesh->num_vertices(), &item.center, &item.radius );
+    } else if ( model ) {
+        // nothing to draw
+        return;
+    } else if ( triangle ) {
+        item.kind = KIND_TRIANGLE;
+        item.material = triangle->get_gl_material();
+        bounding_sphere( &triangle->vertices[0].position, sizeof( Triangle::Vertex ), 3,
+                         &item.center, &item.radius );
+    } else {
+        // unknown bounds, never culled
+        item.kind = KIND_OTHER;
+        item.radius = -1.0;
+    }
+    items.push_back( item );
+    sorted = false;
+}
+
+size_t RenderQueue::num_geometries() const
+{
+    return items.size();
+}
+
+bool RenderQueue::draws_before( const Item& lhs, const Item& rhs )
+{
+    if ( lhs.kind != rhs.kind ) {
+        return lhs.kind < rhs.kind;
+    }
+    GLuint lhs_texture = lhs.material ? lhs.material->get_gl_texture() : 0;
+    GLuint rhs_texture = rhs.material ? rhs.material->get_gl_texture() : 0;
+    if ( lhs_texture != rhs_texture ) {
+        return lhs_texture < rhs_texture;
+    }
+    if ( lhs.material != rhs.material ) {
+        return lhs.material < rhs.material;
+    }
+    return lhs.mesh < rhs.mesh;
+}
+
+void RenderQueue::render( const Frustum& frustum, RenderState* state )
+{
+    if ( !sorted ) {
+        // stable, so equal geometries keep the order they were added in
+        std::stable_sort( items.begin(), items.end(), draws_before );
+        sorted = true;
+    }
+
+    for ( size_t i = 0; i < items.size(); ++i ) {
+        const Item& item = items[i];
+        const Geometry& geom = *item.geometry;
+
+        if ( item.radius >= 0.0 ) {
+            const Vector3& s = geom.scale;
+            Vector3 scaled( s.x * item.center.x, s.y * item.center.y, s.z * item.center.z );
+            Vector3 center = geom.position + geom.orientation * scaled;
+            real_t radius = item.radius * std::max( std::max( fabs( s.x ), fabs( s.y ) ), fabs( s.z ) );
+            if ( !frustum.intersects_sphere( center, radius ) ) {
+                ++state->stats.culled;
+                continue;
+            }
+        }
+
+        Vector3 axis;
+        real_t angle;
+        glPushMatrix();
+        glTranslated( geom.position.x, geom.position.y, geom.position.z );
+        geom.orientation.to_axis_angle( &axis, &angle );
+        glRotated( angle * ( 180.0 / PI ), axis.x, axis.y, axis.z );
+        glScaled( geom.scale.x, geom.scale.y, geom.scale.z );
+
+        switch ( item.kind ) {
+        case KIND_MODEL:
+            state->set_material( item.material );
+            state->bind_mesh( item.mesh );
+            item.mesh->draw();
+            ++state->stats.draw_calls;
+            break;
+        case KIND_TRIANGLE:
+            state->set_material( item.material );
+            static_cast< const Triangle& >( geom ).draw();
+            ++state->stats.draw_calls;
+            break;
+        default:
+            // may change any state
+            geom.render();
+            state->invalidate();
+            ++state->stats.draw_calls;
+            break;
+        }
+
+        glPopMatrix();
+    }
+    state->bind_mesh( 0 );
+}
+
+} /* _462 */
@@ -0,0 +1,76 @@
+/**
+ * @file renderqueue.hpp
+ * @brief Draws geometries sorted by the state they need.
+ */
+
+#ifndef _462_SCENE_RENDERQUEUE_HPP_
+#define _462_SCENE_RENDERQUEUE_HPP_
+
+#include "scene/renderstate.hpp"
+#include "scene/geometry.hpp"
+#include "math/frustum.hpp"
+#include <vector>
+
+namespace _462 {
+
+class Material;
+class Mesh;
+
+/**
+ * Renders a fixed set of geometries other than spheres, which have their
+ * own renderer. The geometries are drawn grouped by kind, texture,
+ * material and mesh, so that a state cache skips most state changes, and
+ * every frame those whose bounding sphere is outside the view are skipped.
+ */
+class RenderQueue
+{
+public:
+
+    RenderQueue();
+
+    /**
+     * Adds a geometry. Models and triangles are drawn with the cache, any
+     * other geometry with its own render(). Geometries are not owned and
+     * must outlive the queue, and models' meshes must be loaded.
+     */
+    void add_geometry( const Geometry* geometry );
+    size_t num_geometries() const;
+
+    // draws the geometries in view. Expects the modelview matrix to hold
+    // the camera transform.
+    void render( const Frustum& frustum, RenderState* state );
+
+private:
+
+    enum Kind
+    {
+        KIND_MODEL,
+        KIND_TRIANGLE,
+        KIND_OTHER
+    };
+
+    struct Item
+    {
+        const Geometry* geometry;
+        Kind kind;
+        const Material* material;
+        const Mesh* mesh;
+        // bounding sphere in local space, the center unscaled
+        Vector3 center;
+        real_t radius;
+    };
+
+    static bool draws_before( const Item& lhs, const Item& rhs );
+
+    std::vector< Item > items;
+    // whether items are sorted, which needs the textures created
+    bool sorted;
+
+    // no meaningful assignment or copy
+    RenderQueue( const RenderQueue& );
+    RenderQueue& operator=( const RenderQueue& );
+};
+
+} /* _462 */
+
+#endif /* _462_SCENE_RENDERQUEUE_HPP_ */
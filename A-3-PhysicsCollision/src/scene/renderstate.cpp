@@ -0,0 +1,79 @@
+/**
+ * @file renderstate.cpp
+ * @brief Tracks bound GL state to skip redundant changes.
+ */
+
+#include "scene/renderstate.hpp"
+#include "scene/material.hpp"
+#include "scene/mesh.hpp"
+
+namespace _462 {
+
+RenderState::RenderState()
+{
+    invalidate();
+    reset_stats();
+}
+
+void RenderState::invalidate()
+{
+    material = 0;
+    material_valid = false;
+    texture = 0;
+    texture_valid = false;
+    mesh = 0;
+    mesh_valid = false;
+}
+
+void RenderState::reset_stats()
+{
+    stats.draw_calls = 0;
+    stats.state_changes = 0;
+    stats.culled = 0;
+}
+
+void RenderState::set_material( const Material* m )
+{
+    if ( !m ) {
+        bind_texture( 0 );
+        return;
+    }
+    if ( !material_valid || material != m ) {
+        m->set_gl_material();
+        material = m;
+        material_valid = true;
+        ++stats.state_changes;
+    }
+    bind_texture( m->get_gl_texture() );
+}
+
+void RenderState::bind_texture( GLuint t )
+{
+    if ( !texture_valid || texture != t ) {
+        glBindTexture( GL_TEXTURE_2D, t );
+        texture = t;
+        texture_valid = true;
+        ++stats.state_changes;
+    }
+}
+
+void RenderState::bind_mesh( const Mesh* m )
+{
+    if ( !mesh_valid || mesh != m ) {
+        if ( m ) {
+            m->bind_gl_data();
+        } else {
+            Mesh::unbind_gl_data();
+        }
+        mesh = m;
+        mesh_valid = true;
+        ++stats.state_changes;
+    }
+}
+
+GLuint RenderState::get_texture() const
+{
+    return texture;
+}
+
+} /* _462 */
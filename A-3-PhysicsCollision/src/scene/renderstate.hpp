@@ -0,0 +1,74 @@
+/**
+ * @file renderstate.hpp
+ * @brief Tracks bound GL state to skip redundant changes.
+ */
+
+#ifndef _462_SCENE_RENDERSTATE_HPP_
+#define _462_SCENE_RENDERSTATE_HPP_
+
+#include "application/opengl.hpp"
+#include <cstddef>
+
+namespace _462 {
+
+class Material;
+class Mesh;
+
+/**
+ * What was drawn in a frame.
+ */
+struct RenderStats
+{
+    size_t draw_calls;
+    // gl state actually changed, not counting changes skipped as redundant
+    size_t state_changes;
+    // objects skipped because they are outside the view
+    size_t culled;
+};
+
+/**
+ * Remembers the material, texture and mesh last bound, so binding the same
+ * again costs nothing. All changes to that state must go through the cache
+ * between calls to invalidate(), and everything drawn should be counted in
+ * the stats.
+ */
+class RenderState
+{
+public:
+
+    RenderState();
+
+    /**
+     * Forgets what is bound, at the start of a frame or after code outside
+     * the cache changed the state.
+     */
+    void invalidate();
+    void reset_stats();
+
+    /**
+     * Sets the colors and binds the texture of the material. A null
+     * material leaves the colors as they are and unbinds the texture.
+     */
+    void set_material( const Material* material );
+    void bind_texture( GLuint texture );
+    // binds the mesh's buffers, or unbinds any if null
+    void bind_mesh( const Mesh* mesh );
+
+    // the texture bound, valid unless invalidated since the last bind
+    GLuint get_texture() const;
+
+    RenderStats stats;
+
+private:
+
+    const Material* material;
+    bool material_valid;
+    GLuint texture;
+    bool texture_valid;
+    const Mesh* mesh;
+    bool mesh_valid;
+};
+
+} /* _462 */
+
+#endif /* _462_SCENE_RENDERSTATE_HPP_ */
@@ -19,7 +19,7 @@ PointLight::PointLight():
     attenuation.quadratic = 0;
 }
 
-inline Color3 PointLight::get_color(real_t distance) const {
+Color3 PointLight::get_color(real_t distance) const {
     return color * (1.0 / (attenuation.constant + attenuation.linear * distance + attenuation.quadratic * distance * distance));
 }
 
@@ -95,7 +95,7 @@ void Scene::reset()
     meshes.clear();
     point_lights.clear();
 
-    phys = Physics();
+    phys.reset();
     camera = Camera();
 
     background_color = Color3::Black;
@@ -125,7 +125,7 @@ void Scene::add_light( const PointLight& l )
 
 void Scene::update( real_t dt )
 {
-    phys.step( dt ); 
+    phys.update( dt );
 }
 
 
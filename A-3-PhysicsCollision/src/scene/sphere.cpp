@@ -8,35 +8,46 @@
 
 #include "scene/sphere.hpp"
 #include "application/opengl.hpp"
+#include <vector>
+#include <cassert>
 
 namespace _462 {
 
-#define SPHERE_NUM_LAT 80
-#define SPHERE_NUM_LON 100
+// latitude and longitude segments of every level of detail, finest first
+static const int LodSegments[][2] = {
+    { 80, 100 }, { 40, 50 }, { 20, 25 }, { 10, 14 }, { 6, 8 }
+};
+#define SPHERE_NUM_LODS ( sizeof LodSegments / sizeof LodSegments[0] )
 
-#define SPHERE_NUM_VERTICES ( ( SPHERE_NUM_LAT + 1 ) * ( SPHERE_NUM_LON + 1 ) )
-#define SPHERE_NUM_INDICES ( 6 * SPHERE_NUM_LAT * SPHERE_NUM_LON )
-// index of the x,y sphere where x is lat and y is lon
-#define SINDEX(x,y) ((x) * (SPHERE_NUM_LON + 1) + (y))
 #define VERTEX_SIZE 8
 #define TCOORD_OFFSET 0
 #define NORMAL_OFFSET 2
 #define VERTEX_OFFSET 5
 
-static unsigned int Indices[SPHERE_NUM_INDICES];
-static float Vertices[VERTEX_SIZE * SPHERE_NUM_VERTICES];
+struct SphereLod
+{
+    GLuint vertex_buffer;
+    GLuint index_buffer;
+    GLsizei num_indices;
+};
+
+static SphereLod Lods[SPHERE_NUM_LODS];
 
-static void init_sphere()
+// tessellates the unit sphere into lat by lon quads, indices fit in shorts
+static void tessellate( int num_lat, int num_lon,
+                        std::vector< float >* vertices, std::vector< unsigned short >* indices )
 {
-    static bool initialized = false;
-    if ( initialized )
-        return;
+    // index of the x,y vertex where x is lat and y is lon
+    #define SINDEX(x,y) ((x) * (num_lon + 1) + (y))
+
+    vertices->resize( VERTEX_SIZE * ( num_lat + 1 ) * ( num_lon + 1 ) );
+    indices->resize( 6 * num_lat * num_lon );
 
-    for ( int i = 0; i <= SPHERE_NUM_LAT; i++ ) {
-        for ( int j = 0; j <= SPHERE_NUM_LON; j++ ) {
-            real_t lat = real_t( i ) / SPHERE_NUM_LAT;
-            real_t lon = real_t( j ) / SPHERE_NUM_LON;
-            float* vptr = &Vertices[VERTEX_SIZE * SINDEX(i,j)];
+    for ( int i = 0; i <= num_lat; i++ ) {
+        for ( int j = 0; j <= num_lon; j++ ) {
+            real_t lat = real_t( i ) / num_lat;
+            real_t lon = real_t( j ) / num_lon;
+            float* vptr = &( *vertices )[VERTEX_SIZE * SINDEX(i,j)];
 
             vptr[TCOORD_OFFSET + 0] = lon;
             vptr[TCOORD_OFFSET + 1] = 1-lat;
@@ -51,14 +62,14 @@ static void init_sphere()
         }
     }
 
-    for ( int i = 0; i < SPHERE_NUM_LAT; i++ ) {
-        for ( int j = 0; j < SPHERE_NUM_LON; j++ ) {
-            unsigned int* iptr = &Indices[6 * ( SPHERE_NUM_LON * i + j )];
+    for ( int i = 0; i < num_lat; i++ ) {
+        for ( int j = 0; j < num_lon; j++ ) {
+            unsigned short* iptr = &( *indices )[6 * ( num_lon * i + j )];
 
-            unsigned int i00 = SINDEX(i,  j  );
-            unsigned int i10 = SINDEX(i+1,j  );
-            unsigned int i11 = SINDEX(i+1,j+1);
-            unsigned int i01 = SINDEX(i,  j+1);
+            unsigned short i00 = SINDEX(i,  j  );
+            unsigned short i10 = SINDEX(i+1,j  );
+            unsigned short i11 = SINDEX(i+1,j+1);
+            unsigned short i01 = SINDEX(i,  j+1);
 
             iptr[0] = i00;
             iptr[1] = i10;
@@ -69,7 +80,88 @@ static void init_sphere()
         }
     }
 
-    initialized = true;
+    #undef SINDEX
+}
+
+bool Sphere::create_gl_data()
+{
+    if ( Lods[0].vertex_buffer ) {
+        return true;
+    }
+
+    std::vector< float > vertices;
+    std::vector< unsigned short > indices;
+    for ( size_t lod = 0; lod < SPHERE_NUM_LODS; ++lod ) {
+        tessellate( LodSegments[lod][0], LodSegments[lod][1], &vertices, &indices );
+        assert( vertices.size() / VERTEX_SIZE <= 0xFFFF );
+
+        SphereLod& l = Lods[lod];
+        glGenBuffers( 1, &l.vertex_buffer );
+        glGenBuffers( 1, &l.index_buffer );
+        if ( !l.vertex_buffer || !l.index_buffer ) {
+            destroy_gl_data();
+            return false;
+        }
+        glBindBuffer( GL_ARRAY_BUFFER, l.vertex_buffer );
+        glBufferData( GL_ARRAY_BUFFER, vertices.size() * sizeof vertices[0], &vertices[0], GL_STATIC_DRAW );
+        glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, l.index_buffer );
+        glBufferData( GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof indices[0], &indices[0], GL_STATIC_DRAW );
+        l.num_indices = GLsizei( indices.size() );
+    }
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+    return true;
+}
+
+void Sphere::destroy_gl_data()
+{
+    for ( size_t lod = 0; lod < SPHERE_NUM_LODS; ++lod ) {
+        SphereLod& l = Lods[lod];
+        if ( l.vertex_buffer ) {
+            glDeleteBuffers( 1, &l.vertex_buffer );
+        }
+        if ( l.index_buffer ) {
+            glDeleteBuffers( 1, &l.index_buffer );
+        }
+        l.vertex_buffer = 0;
+        l.index_buffer = 0;
+        l.num_indices = 0;
+    }
+}
+
+size_t Sphere::num_lods()
+{
+    return SPHERE_NUM_LODS;
+}
+
+int Sphere::lod_segments( size_t lod )
+{
+    assert( lod < SPHERE_NUM_LODS );
+    return LodSegments[lod][1];
+}
+
+void Sphere::bind_lod( size_t lod )
+{
+    assert( lod < SPHERE_NUM_LODS && Lods[lod].vertex_buffer );
+    glBindBuffer( GL_ARRAY_BUFFER, Lods[lod].vertex_buffer );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, Lods[lod].index_buffer );
+    // offsets into the bound buffer
+    glInterleavedArrays( GL_T2F_N3F_V3F, VERTEX_SIZE * sizeof( float ), 0 );
+}
+
+void Sphere::draw_lod( size_t lod, size_t count )
+{
+    if ( count > 1 ) {
+        glDrawElementsInstancedARB( GL_TRIANGLES, Lods[lod].num_indices, GL_UNSIGNED_SHORT, 0, GLsizei( count ) );
+    } else {
+        glDrawElements( GL_TRIANGLES, Lods[lod].num_indices, GL_UNSIGNED_SHORT, 0 );
+    }
+}
+
+void Sphere::unbind_lod()
+{
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
 }
 
 Sphere::Sphere()
@@ -79,17 +171,15 @@ Sphere::~Sphere() {}
 
 void Sphere::render() const
 {
-    // create geometry if we haven't already
-    init_sphere();
-
     if ( material )
         material->set_gl_state();
 
     // just scale by radius and draw unit sphere
     glPushMatrix();
     glScaled( radius, radius, radius );
-    glInterleavedArrays( GL_T2F_N3F_V3F, VERTEX_SIZE * sizeof Vertices[0], Vertices );
-    glDrawElements( GL_TRIANGLES, SPHERE_NUM_INDICES, GL_UNSIGNED_INT, Indices );
+    bind_lod( 0 );
+    draw_lod( 0, 1 );
+    unbind_lod();
     glPopMatrix();
 
     if ( material )
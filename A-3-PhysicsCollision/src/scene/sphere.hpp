@@ -28,6 +28,28 @@ public:
     virtual ~Sphere();
     virtual void render() const;
 
+    /**
+     * Uploads the tessellations of the unit sphere into GL buffers, one per
+     * level of detail. Must be called before any sphere is rendered.
+     */
+    static bool create_gl_data();
+    static void destroy_gl_data();
+
+    // number of levels of detail, level 0 being the finest
+    static size_t num_lods();
+    // longitude segments of a level, which also set its silhouette error
+    static int lod_segments( size_t lod );
+    /**
+     * Binds the vertex and index buffers of a level and points the vertex,
+     * normal and texture coordinate arrays into them.
+     */
+    static void bind_lod( size_t lod );
+    /**
+     * Draws the bound level, instanced count times if count > 1.
+     */
+    static void draw_lod( size_t lod, size_t count );
+    static void unbind_lod();
+
 };
 
 } /* _462 */
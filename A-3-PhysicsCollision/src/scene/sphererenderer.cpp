@@ -0,0 +1,392 @@
+/**
+ * @file sphererenderer.cpp
+ * @brief Draws many spheres with few draw calls.
+ */
+
+#include "scene/sphererenderer.hpp"
+#include "application/opengl.hpp"
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <cstdio>
+
+namespace _462 {
+
+// largest distance, in pixels, between the silhouette of a tessellated
+// sphere and the true circle
+#define SPHERE_LOD_ERROR 0.5
+
+// floats per instance: position, orientation (x, y, z, w) and scale
+#define INSTANCE_SIZE 10
+#define INSTANCE_POSITION 0
+#define INSTANCE_ORIENTATION 3
+#define INSTANCE_SCALE 7
+
+// level of detail of spheres outside the view
+#define SPHERE_CULLED 0xff
+
+// most lights the shader handles, as many as the fixed function pipeline
+#define MAX_SHADER_LIGHTS 8
+
+// Transforms the unit sphere by the instance attributes, then lights every
+// vertex the way the fixed function pipeline does for point lights and a
+// viewer at infinity. NUM_LIGHTS is defined in front of the source, a
+// constant loop count is much cheaper than a uniform one for software
+// rasterizers.
+static const char* VertexShader =
+    "attribute vec3 instance_position;\n"
+    "attribute vec4 instance_orientation;\n"
+    "attribute vec3 instance_scale;\n"
+    "varying vec4 color;\n"
+    "vec3 rotate( vec4 q, vec3 v )\n"
+    "{\n"
+    "    return v + 2.0 * cross( q.xyz, cross( q.xyz, v ) + q.w * v );\n"
+    "}\n"
+    "void main()\n"
+    "{\n"
+    "    vec3 world = rotate( instance_orientation, gl_Vertex.xyz * instance_scale ) + instance_position;\n"
+    "    vec4 eye = gl_ModelViewMatrix * vec4( world, 1.0 );\n"
+    "    vec3 n = normalize( gl_NormalMatrix * rotate( instance_orientation, gl_Normal / instance_scale ) );\n"
+    "    vec4 c = gl_FrontLightModelProduct.sceneColor;\n"
+    "    for ( int i = 0; i < NUM_LIGHTS; ++i ) {\n"
+    "        vec3 l = gl_LightSource[i].position.xyz - eye.xyz;\n"
+    "        float d = length( l );\n"
+    "        l /= d;\n"
+    "        float attenuation = 1.0 / ( gl_LightSource[i].constantAttenuation +\n"
+    "            d * ( gl_LightSource[i].linearAttenuation + d * gl_LightSource[i].quadraticAttenuation ) );\n"
+    "        float nl = dot( n, l );\n"
+    "        vec4 term = gl_FrontLightProduct[i].ambient;\n"
+    "        if ( nl > 0.0 ) {\n"
+    "            float nh = max( dot( n, normalize( l + vec3( 0.0, 0.0, 1.0 ) ) ), 0.0 );\n"
+    "            term += nl * gl_FrontLightProduct[i].diffuse;\n"
+    "            term += pow( nh, gl_FrontMaterial.shininess ) * gl_FrontLightProduct[i].specular;\n"
+    "        }\n"
+    "        c += attenuation * term;\n"
+    "    }\n"
+    "    color = vec4( clamp( c.rgb, 0.0, 1.0 ), gl_FrontMaterial.diffuse.a );\n"
+    "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+    "    gl_Position = gl_ProjectionMatrix * eye;\n"
+    "}\n";
+
+// modulates by the texture, like GL_MODULATE
+static const char* FragmentShader =
+    "uniform sampler2D tex;\n"
+    "uniform bool textured;\n"
+    "varying vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = textured ? color * texture2D( tex, gl_TexCoord[0].st ) : color;\n"
+    "}\n";
+
+static GLuint compile_shader( GLenum type, const char* header, const char* source )
+{
+    const char* sources[2] = { header, source };
+    GLuint shader = glCreateShader( type );
+    glShaderSource( shader, 2, sources, 0 );
+    glCompileShader( shader );
+
+    GLint status;
+    glGetShaderiv( shader, GL_COMPILE_STATUS, &status );
+    if ( !status ) {
+        char log[1024];
+        glGetShaderInfoLog( shader, sizeof log, 0, log );
+        std::cerr << "Error compiling sphere shader: " << log << std::endl;
+        glDeleteShader( shader );
+        return 0;
+    }
+    return shader;
+}
+
+SphereRenderer::SphereRenderer()
+    : instance_buffer( 0 ), instancing( true ), instancing_supported( false ),
+      program( 0 ), program_lights( 0 ),
+      position_location( -1 ), orientation_location( -1 ), scale_location( -1 ),
+      textured_location( -1 ) { }
+
+SphereRenderer::~SphereRenderer()
+{
+    destroy_gl_data();
+}
+
+bool SphereRenderer::create_gl_data()
+{
+    if ( !Sphere::create_gl_data() ) {
+        return false;
+    }
+    instancing_supported = GLEW_VERSION_2_0 && GLEW_ARB_instanced_arrays && GLEW_ARB_draw_instanced;
+    if ( instancing_supported ) {
+        glGenBuffers( 1, &instance_buffer );
+        instancing_supported = instance_buffer != 0;
+    }
+    if ( !instancing_supported ) {
+        std::cout << "Instanced sphere rendering not available, drawing spheres one by one.\n";
+    }
+    return true;
+}
+
+bool SphereRenderer::create_program( size_t num_lights )
+{
+    if ( program ) {
+        glDeleteProgram( program );
+        program = 0;
+    }
+
+    char header[64];
+    sprintf( header, "#version 120\n#define NUM_LIGHTS %d\n", int( num_lights ) );
+    GLuint vertex = compile_shader( GL_VERTEX_SHADER, header, VertexShader );
+    GLuint fragment = compile_shader( GL_FRAGMENT_SHADER, header, FragmentShader );
+    if ( vertex && fragment ) {
+        program = glCreateProgram();
+        glAttachShader( program, vertex );
+        glAttachShader( program, fragment );
+        glLinkProgram( program );
+    }
+    // the program keeps them alive while attached
+    glDeleteShader( vertex );
+    glDeleteShader( fragment );
+    if ( !program ) {
+        return false;
+    }
+
+    GLint status;
+    glGetProgramiv( program, GL_LINK_STATUS, &status );
+    if ( !status ) {
+        char log[1024];
+        glGetProgramInfoLog( program, sizeof log, 0, log );
+        std::cerr << "Error linking sphere shader: " << log << std::endl;
+        glDeleteProgram( program );
+        program = 0;
+        return false;
+    }
+
+    position_location = glGetAttribLocation( program, "instance_position" );
+    orientation_location = glGetAttribLocation( program, "instance_orientation" );
+    scale_location = glGetAttribLocation( program, "instance_scale" );
+    textured_location = glGetUniformLocation( program, "textured" );
+    glUseProgram( program );
+    glUniform1i( glGetUniformLocation( program, "tex" ), 0 );
+    glUseProgram( 0 );
+    program_lights = num_lights;
+    return true;
+}
+
+void SphereRenderer::destroy_gl_data()
+{
+    if ( program ) {
+        glDeleteProgram( program );
+        program = 0;
+    }
+    if ( instance_buffer ) {
+        glDeleteBuffers( 1, &instance_buffer );
+        instance_buffer = 0;
+    }
+    instancing_supported = false;
+}
+
+void SphereRenderer::add_sphere( const Sphere* sphere )
+{
+    assert( sphere );
+    MaterialList::iterator i = std::find( materials.begin(), materials.end(), sphere->material );
+    sphere_materials.push_back( unsigned( i - materials.begin() ) );
+    if ( i == materials.end() ) {
+        materials.push_back( sphere->material );
+    }
+    spheres.push_back( sphere );
+}
+
+size_t SphereRenderer::num_spheres() const
+{
+    return spheres.size();
+}
+
+void SphereRenderer::set_instancing( bool enabled )
+{
+    instancing = enabled;
+}
+
+bool SphereRenderer::get_instancing() const
+{
+    return instancing;
+}
+
+bool SphereRenderer::is_instancing_supported() const
+{
+    return instancing_supported;
+}
+
+void SphereRenderer::select_lods( const Camera& camera, const Frustum& frustum, int viewport_height,
+                                  RenderState* state )
+{
+    size_t num_lods = Sphere::num_lods();
+    size_t num_groups = num_lods * materials.size();
+    const Vector3& eye = camera.get_position();
+    real_t pixels_per_unit = viewport_height / ( 2 * tan( camera.get_fov_radians() / 2 ) );
+
+    sphere_lods.resize( spheres.size() );
+    group_start.assign( num_groups + 1, 0 );
+    for ( size_t i = 0; i < spheres.size(); ++i ) {
+        const Sphere* sphere = spheres[i];
+        const Vector3& s = sphere->scale;
+        real_t radius = sphere->radius * std::max( std::max( fabs( s.x ), fabs( s.y ) ), fabs( s.z ) );
+        if ( !frustum.intersects_sphere( sphere->position, radius ) ) {
+            sphere_lods[i] = SPHERE_CULLED;
+            ++state->stats.culled;
+            continue;
+        }
+        real_t distance = length( sphere->position - eye );
+
+        // A level of n segments strays radius * ( 1 - cos( PI / n ) ) from
+        // the silhouette. Spheres around the eye take the finest.
+        size_t lod = 0;
+        if ( distance > radius ) {
+            real_t pixels = radius * pixels_per_unit / ( distance - radius );
+            real_t c = std::max( real_t( 1 - SPHERE_LOD_ERROR / pixels ), real_t( -1.0 ) );
+            real_t segments = PI / acos( c );
+            lod = num_lods - 1;
+            while ( lod > 0 && Sphere::lod_segments( lod ) < segments ) {
+                --lod;
+            }
+        }
+        sphere_lods[i] = static_cast< unsigned char >( lod );
+        group_start[lod * materials.size() + sphere_materials[i] + 1]++;
+    }
+
+    // counting sort by group
+    for ( size_t g = 0; g < num_groups; ++g ) {
+        group_start[g + 1] += group_start[g];
+    }
+    order.resize( group_start[num_groups] );
+    std::vector< unsigned int > next( group_start.begin(), group_start.end() - 1 );
+    for ( size_t i = 0; i < spheres.size(); ++i ) {
+        if ( sphere_lods[i] == SPHERE_CULLED ) {
+            continue;
+        }
+        order[next[sphere_lods[i] * materials.size() + sphere_materials[i]]++] = unsigned( i );
+    }
+}
+
+void SphereRenderer::render( const Camera& camera, const Frustum& frustum, int viewport_height,
+                             size_t num_lights, RenderState* state )
+{
+    select_lods( camera, frustum, viewport_height, state );
+    if ( order.empty() ) {
+        return;
+    }
+
+    // the shader is built for the number of lights
+    num_lights = std::min( num_lights, size_t( MAX_SHADER_LIGHTS ) );
+    if ( instancing && instancing_supported && ( !program || program_lights != num_lights ) ) {
+        if ( !create_program( num_lights ) ) {
+            std::cout << "Instanced sphere rendering failed, drawing spheres one by one.\n";
+            instancing_supported = false;
+        }
+    }
+
+    if ( instancing && instancing_supported ) {
+        render_instanced( state );
+    } else {
+        render_single( state );
+    }
+}
+
+void SphereRenderer::render_instanced( RenderState* state )
+{
+    // refill the instance buffer in drawing order
+    instance_data.resize( order.size() * INSTANCE_SIZE );
+    for ( size_t k = 0; k < order.size(); ++k ) {
+        const Sphere* sphere = spheres[order[k]];
+        float* out = &instance_data[k * INSTANCE_SIZE];
+        sphere->position.to_array( out + INSTANCE_POSITION );
+        const Quaternion& q = sphere->orientation;
+        out[INSTANCE_ORIENTATION + 0] = float( q.x );
+        out[INSTANCE_ORIENTATION + 1] = float( q.y );
+        out[INSTANCE_ORIENTATION + 2] = float( q.z );
+        out[INSTANCE_ORIENTATION + 3] = float( q.w );
+        ( sphere->scale * sphere->radius ).to_array( out + INSTANCE_SCALE );
+    }
+    glBindBuffer( GL_ARRAY_BUFFER, instance_buffer );
+    glBufferData( GL_ARRAY_BUFFER, instance_data.size() * sizeof instance_data[0], &instance_data[0], GL_STREAM_DRAW );
+
+    // the instance buffer and the program
+    glUseProgram( program );
+    state->stats.state_changes += 2;
+    GLint locations[3] = { position_location, orientation_location, scale_location };
+    for ( int a = 0; a < 3; ++a ) {
+        glEnableVertexAttribArray( locations[a] );
+        glVertexAttribDivisorARB( locations[a], 1 );
+    }
+
+    GLsizei stride = INSTANCE_SIZE * sizeof( float );
+    for ( size_t lod = 0; lod < Sphere::num_lods(); ++lod ) {
+        bool bound = false;
+        for ( size_t m = 0; m < materials.size(); ++m ) {
+            size_t group = lod * materials.size() + m;
+            size_t first = group_start[group];
+            size_t count = group_start[group + 1] - first;
+            if ( count == 0 ) {
+                continue;
+            }
+            if ( !bound ) {
+                Sphere::bind_lod( lod );
+                ++state->stats.state_changes;
+                bound = true;
+            }
+
+            state->set_material( materials[m] );
+            glUniform1i( textured_location, state->get_texture() != 0 );
+
+            // point the instance attributes at the group
+            glBindBuffer( GL_ARRAY_BUFFER, instance_buffer );
+            const char* base = reinterpret_cast< const char* >( first * stride );
+            glVertexAttribPointer( position_location, 3, GL_FLOAT, GL_FALSE, stride, base + INSTANCE_POSITION * sizeof( float ) );
+            glVertexAttribPointer( orientation_location, 4, GL_FLOAT, GL_FALSE, stride, base + INSTANCE_ORIENTATION * sizeof( float ) );
+            glVertexAttribPointer( scale_location, 3, GL_FLOAT, GL_FALSE, stride, base + INSTANCE_SCALE * sizeof( float ) );
+            Sphere::draw_lod( lod, count );
+            ++state->stats.draw_calls;
+        }
+    }
+
+    for ( int a = 0; a < 3; ++a ) {
+        glVertexAttribDivisorARB( locations[a], 0 );
+        glDisableVertexAttribArray( locations[a] );
+    }
+    glUseProgram( 0 );
+    Sphere::unbind_lod();
+}
+
+void SphereRenderer::render_single( RenderState* state )
+{
+    for ( size_t lod = 0; lod < Sphere::num_lods(); ++lod ) {
+        bool bound = false;
+        for ( size_t m = 0; m < materials.size(); ++m ) {
+            size_t group = lod * materials.size() + m;
+            if ( group_start[group] == group_start[group + 1] ) {
+                continue;
+            }
+            if ( !bound ) {
+                Sphere::bind_lod( lod );
+                ++state->stats.state_changes;
+                bound = true;
+            }
+            state->set_material( materials[m] );
+            for ( size_t k = group_start[group]; k < group_start[group + 1]; ++k ) {
+                const Sphere* sphere = spheres[order[k]];
+                Vector3 axis;
+                real_t angle;
+
+                glPushMatrix();
+                glTranslated( sphere->position.x, sphere->position.y, sphere->position.z );
+                sphere->orientation.to_axis_angle( &axis, &angle );
+                glRotated( angle * ( 180.0 / PI ), axis.x, axis.y, axis.z );
+                Vector3 scale = sphere->scale * sphere->radius;
+                glScaled( scale.x, scale.y, scale.z );
+                Sphere::draw_lod( lod, 1 );
+                glPopMatrix();
+            }
+            state->stats.draw_calls += group_start[group + 1] - group_start[group];
+        }
+    }
+    Sphere::unbind_lod();
+}
+
+} /* _462 */
@@ -0,0 +1,105 @@
+/**
+ * @file sphererenderer.hpp
+ * @brief Draws many spheres with few draw calls.
+ */
+
+#ifndef _462_SCENE_SPHERERENDERER_HPP_
+#define _462_SCENE_SPHERERENDERER_HPP_
+
+#include "scene/sphere.hpp"
+#include "scene/renderstate.hpp"
+#include "math/camera.hpp"
+#include "math/frustum.hpp"
+#include <vector>
+
+namespace _462 {
+
+/**
+ * Renders a fixed set of spheres. Every frame the spheres outside the view
+ * are culled, and each other sphere gets the coarsest
+ * tessellation whose silhouette stays within half a pixel of a true circle,
+ * and the spheres are grouped by level of detail and material. When the GL
+ * supports instancing, every group is drawn with a single instanced draw
+ * call, the sphere transforms coming from a per-instance buffer refilled
+ * each frame and a small shader that reproduces the fixed function
+ * lighting. Otherwise every sphere is drawn with its own call from the
+ * static buffers.
+ */
+class SphereRenderer
+{
+public:
+
+    SphereRenderer();
+    ~SphereRenderer();
+
+    /**
+     * Creates the sphere buffers and, if supported, the instance buffer.
+     * Requires a GL context. Returns false only if the buffers can't be
+     * created; without instancing rendering just takes more calls.
+     */
+    bool create_gl_data();
+    void destroy_gl_data();
+
+    // spheres are not owned and must outlive the renderer
+    void add_sphere( const Sphere* sphere );
+    size_t num_spheres() const;
+
+    // whether groups are drawn with instancing, if it is supported
+    void set_instancing( bool enabled );
+    bool get_instancing() const;
+    bool is_instancing_supported() const;
+
+    /**
+     * Draws all spheres in the frustum as seen by camera in a viewport of
+     * the given height, lit by the first num_lights GL lights. Materials are
+     * set through the state, which counts what was drawn. Expects the
+     * modelview matrix to hold the camera transform.
+     */
+    void render( const Camera& camera, const Frustum& frustum, int viewport_height,
+                 size_t num_lights, RenderState* state );
+
+private:
+
+    bool create_program( size_t num_lights );
+    void select_lods( const Camera& camera, const Frustum& frustum, int viewport_height,
+                      RenderState* state );
+    void render_instanced( RenderState* state );
+    void render_single( RenderState* state );
+
+    typedef std::vector< const Sphere* > SphereList;
+    typedef std::vector< const Material* > MaterialList;
+
+    SphereList spheres;
+    // distinct materials of the spheres, and the index of each sphere's
+    MaterialList materials;
+    std::vector< unsigned int > sphere_materials;
+
+    // visible spheres sorted by group, lod major, and the first sphere of
+    // every group followed by the total
+    std::vector< unsigned int > order;
+    std::vector< unsigned int > group_start;
+    // level of detail of every sphere this frame, or culled
+    std::vector< unsigned char > sphere_lods;
+
+    // per instance position, orientation and scale, in order
+    std::vector< float > instance_data;
+    GLuint instance_buffer;
+
+    bool instancing;
+    bool instancing_supported;
+    // the instancing shader, built for program_lights lights
+    GLuint program;
+    size_t program_lights;
+    GLint position_location;
+    GLint orientation_location;
+    GLint scale_location;
+    GLint textured_location;
+
+    // no meaningful assignment or copy
+    SphereRenderer( const SphereRenderer& );
+    SphereRenderer& operator=( const SphereRenderer& );
+};
+
+} /* _462 */
+
+#endif /* _462_SCENE_SPHERERENDERER_HPP_ */
@@ -20,33 +20,44 @@ Triangle::Triangle()
 Triangle::~Triangle() { }
 
 void Triangle::render() const
+{
+    const Material* material = get_gl_material();
+    if ( material )
+        material->set_gl_state();
+
+    draw();
+
+    if ( material )
+        material->reset_gl_state();
+}
+
+const Material* Triangle::get_gl_material() const
 {
     bool materials_nonnull = true;
     for ( int i = 0; i < 3; ++i )
         materials_nonnull = materials_nonnull && vertices[i].material;
 
     // this doesn't interpolate materials. Ah well.
-    if ( materials_nonnull )
-        vertices[0].material->set_gl_state();
+    return materials_nonnull ? vertices[0].material : 0;
+}
 
+void Triangle::draw() const
+{
     glBegin(GL_TRIANGLES);
 
-    glNormal3dv( &vertices[0].normal.x );
-    glTexCoord2dv( &vertices[0].tex_coord.x );
-    glVertex3dv( &vertices[0].position.x );
+    glNormal3d( vertices[0].normal.x, vertices[0].normal.y, vertices[0].normal.z );
+    glTexCoord2d( vertices[0].tex_coord.x, vertices[0].tex_coord.y );
+    glVertex3d( vertices[0].position.x, vertices[0].position.y, vertices[0].position.z );
 
-    glNormal3dv( &vertices[1].normal.x );
-    glTexCoord2dv( &vertices[1].tex_coord.x );
-    glVertex3dv( &vertices[1].position.x);
+    glNormal3d( vertices[1].normal.x, vertices[1].normal.y, vertices[1].normal.z );
+    glTexCoord2d( vertices[1].tex_coord.x, vertices[1].tex_coord.y );
+    glVertex3d( vertices[1].position.x, vertices[1].position.y, vertices[1].position.z );
 
-    glNormal3dv( &vertices[2].normal.x );
-    glTexCoord2dv( &vertices[2].tex_coord.x );
-    glVertex3dv( &vertices[2].position.x);
+    glNormal3d( vertices[2].normal.x, vertices[2].normal.y, vertices[2].normal.z );
+    glTexCoord2d( vertices[2].tex_coord.x, vertices[2].tex_coord.y );
+    glVertex3d( vertices[2].position.x, vertices[2].position.y, vertices[2].position.z );
 
     glEnd();
-
-    if ( materials_nonnull )
-        vertices[0].material->reset_gl_state();
 }
 
 
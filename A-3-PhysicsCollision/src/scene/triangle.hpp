@@ -41,6 +41,12 @@ public:
     virtual ~Triangle();
     virtual void render() const;
 
+    // draws the vertices without setting any material state
+    void draw() const;
+
+    // the material render() uses, null if any vertex has none
+    const Material* get_gl_material() const;
+
 };
 
 
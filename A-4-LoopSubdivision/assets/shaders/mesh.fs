@@ -1,10 +1,18 @@
 #version 330 core
 out vec4 FragColor;
 
+in vec3 Normal;
+
 uniform vec4 color;
+uniform bool shade;
 
 void main()
 {
-    FragColor = color;
+    if (!shade) {
+        FragColor = color;
+        return;
+    }
+    // light from the camera
+    float diffuse = abs(normalize(Normal).z);
+    FragColor = vec4(color.rgb * (0.3f + 0.7f * diffuse), color.a);
 }
-
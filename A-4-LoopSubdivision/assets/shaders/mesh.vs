@@ -1,5 +1,8 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+
+out vec3 Normal;
 
 uniform mat4 model;
 uniform mat4 view;
@@ -7,5 +10,6 @@ uniform mat4 projection;
 
 void main()
 {
+    Normal = mat3(view * model) * aNormal;
     gl_Position = projection * view * model * vec4(aPos, 1.0f);
 }
@@ -6,6 +6,12 @@
 #include <fstream>
 #include <vector>
 #include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/random.hpp>
@@ -13,43 +19,126 @@
 
 #include "util/raii.hpp"
 #include "util/log.h"
+#include "util/stopwatch.hpp"
+#include "util/threadpool.hpp"
 #include "framework/Shader.hpp"
 #include "framework/Object.hpp"
 #include "framework/GUI.hpp"
 
-struct vertex_t;
-struct edge_t;
-struct face_t;
+// Half-edge mesh of triangles, in flat arrays indexed by 32-bit IDs.
+// The half-edges of face f are 3f, 3f+1 and 3f+2 in order, so the next and
+// previous half-edges and the face of a half-edge are computed, not stored.
+struct mesh_t {
+    static constexpr uint32_t invalid = 0xFFFFFFFF;
+
+    // per vertex
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> vertexEdges; // Edge which starts from this vertex
+    // per half-edge
+    std::vector<uint32_t> edgeVertices; // Vertex this edge starts from
+    std::vector<uint32_t> twins; // invalid on a boundary
+    std::vector<uint8_t> creases; // A crease (or boundary)
+    // per face
+    std::vector<glm::vec3> normals;
+
+    static uint32_t Next(uint32_t edge) { return edge % 3 == 2 ? edge - 2 : edge + 1; }
+    static uint32_t Prev(uint32_t edge) { return edge % 3 == 0 ? edge + 2 : edge - 1; }
+    static uint32_t Face(uint32_t edge) { return edge / 3; }
+
+    size_t VertexCount() const { return this->positions.size(); }
+    size_t EdgeCount() const { return this->edgeVertices.size(); }
+    size_t FaceCount() const { return this->normals.size(); }
+
+    void Resize(size_t vertexCount, size_t faceCount)
+    {
+        this->positions.resize(vertexCount);
+        this->vertexEdges.assign(vertexCount, invalid);
+        this->edgeVertices.resize(faceCount * 3);
+        this->twins.assign(faceCount * 3, invalid);
+        this->creases.assign(faceCount * 3, 0);
+        this->normals.resize(faceCount);
+    }
 
-struct vertex_t {
-    uint32_t ID = 0;
-    glm::vec3 position = glm::vec3(0, 0, 0);
-    edge_t *belong = nullptr; // Edge which starts from this vertex
+    size_t Bytes() const
+    {
+        return this->positions.capacity() * sizeof(glm::vec3)
+            + this->vertexEdges.capacity() * sizeof(uint32_t)
+            + this->edgeVertices.capacity() * sizeof(uint32_t)
+            + this->twins.capacity() * sizeof(uint32_t)
+            + this->creases.capacity() * sizeof(uint8_t)
+            + this->normals.capacity() * sizeof(glm::vec3);
+    }
 };
 
-struct edge_t {
-    uint32_t ID = 0;
-    bool crease = false; // A crease (or boundary)
-    vertex_t *vertex = nullptr;
-    edge_t *twin = nullptr;
-    edge_t *next = nullptr;
-    edge_t *prev = nullptr;
-    face_t *belong = nullptr;
+// Sparse rows giving each vertex of a subdivision level as a weighted sum of
+// the control (level 0) vertices, in compressed row form
+struct stencil_t {
+    std::vector<uint32_t> offsets; // row i is entries offsets[i] to offsets[i+1]
+    std::vector<uint32_t> indices; // control vertex of each entry
+    std::vector<float> weights;
+
+    size_t Bytes() const
+    {
+        return this->offsets.capacity() * sizeof(uint32_t)
+            + this->indices.capacity() * sizeof(uint32_t)
+            + this->weights.capacity() * sizeof(float);
+    }
 };
 
-struct face_t {
-    uint32_t ID = 0;
-    glm::vec3 normal = glm::vec3(0, 0, 0);
-    edge_t *edge = nullptr; // Edge of this face
+// Accumulates a weighted sum of stencil rows into a new row
+struct stencil_row_t {
+    std::vector<float> sums; // per control vertex
+    std::vector<uint8_t> marks;
+    std::vector<uint32_t> used;
+
+    explicit stencil_row_t(size_t controlCount) : sums(controlCount, 0.0f), marks(controlCount, 0) {}
+
+    // Adds weight times a row of the stencil, or times a control vertex when
+    // the stencil is null
+    void Add(const stencil_t *stencil, uint32_t row, float weight)
+    {
+        if (stencil == nullptr) {
+            this->AddEntry(row, weight);
+            return;
+        }
+        for (uint32_t i = stencil->offsets[row]; i < stencil->offsets[row + 1]; i++)
+            this->AddEntry(stencil->indices[i], weight * stencil->weights[i]);
+    }
+
+    void AddEntry(uint32_t control, float weight)
+    {
+        if (!this->marks[control]) {
+            this->marks[control] = 1;
+            this->used.push_back(control);
+        }
+        this->sums[control] += weight;
+    }
+
+    // Appends the row to the stencil in control vertex order, ending it with
+    // its offset, and starts over
+    void Flush(stencil_t &stencil)
+    {
+        std::sort(this->used.begin(), this->used.end());
+        for (uint32_t control : this->used) {
+            stencil.indices.push_back(control);
+            stencil.weights.push_back(this->sums[control]);
+            this->sums[control] = 0.0f;
+            this->marks[control] = 0;
+        }
+        this->used.clear();
+        stencil.offsets.push_back(stencil.indices.size());
+    }
 };
 
-struct mesh_t {
-    uint32_t uuid_v;
-    uint32_t uuid_e;
-    uint32_t uuid_f;
-    std::vector<vertex_t> vertices;
-    std::vector<edge_t> edges;
-    std::vector<face_t> faces;
+// What a level is drawn from: each vertex once as its position and normal,
+// and the vertices of each face as indices into them
+struct vertex_data_t {
+    std::vector<GLfloat> vertices;
+    std::vector<GLuint> indices;
+
+    size_t VertexBytes() const { return this->vertices.size() * sizeof(GLfloat); }
+    size_t IndexBytes() const { return this->indices.size() * sizeof(GLuint); }
+    size_t Bytes() const { return this->VertexBytes() + this->IndexBytes(); }
 };
 
 class Mesh : public Object, public GUIHandler
@@ -59,9 +148,52 @@ public:
     Shader shader;
     VAO_raii VAO;
     VBO_raii VBO;
+    VBO_raii EBO;
+    VAO_raii nextVAO; // level being uploaded, swapped in once complete
+    VBO_raii nextVBO;
+    VBO_raii nextEBO;
+    size_t drawCount = 0; // indices in EBO
+    int shownLevel = -1; // level whose faces are in EBO
+    std::vector<double> uploadTimes; // per level, ms spent uploading it
+    std::vector<size_t> uploadBytes; // per level, size of its buffers
+    threadpool_t pool;
     std::string meshPath;
     std::vector<mesh_t> meshs;
+    std::vector<stencil_t> stencils; // stencils[i] refines the control mesh to level i, none for level 0
+    std::vector<uint8_t> stale; // levels whose positions lag behind the control mesh
+    std::vector<glm::vec3> restPositions; // control mesh before the animation
+    glm::vec3 restCenter = glm::vec3(0, 0, 0);
+    std::atomic<bool> animate{false};
+    std::atomic<double> stencilTime{0};
+    std::atomic<int> levelCount{0}; // size of meshs, for the GUI
     int curr = 0;
+
+    // Levels are built by a worker thread along with the vertex data to show
+    // them, which the render thread then uploads a slice per frame. The
+    // worker holds meshMutex while it changes meshs or stencils, so the
+    // render thread only ever tries to lock it.
+    enum { JOB_NONE, JOB_STENCILS, JOB_DISPLAY, JOB_PREFETCH };
+    std::thread worker;
+    std::mutex meshMutex;
+    std::mutex requestMutex; // guards the fields below, and writes to curr
+    std::condition_variable wake;
+    size_t generation = 0; // bumped whenever there may be work to do
+    bool quit = false;
+    int requested = 0; // level the viewer should show
+    bool prefetch = true; // build the level after the shown one in advance
+    size_t prefetchFaceLimit = 1 << 21;
+    int readyLevel = -1; // level of readyData, -1 for none
+    vertex_data_t readyData;
+    int uploadLevel = -1; // level of uploadData, -1 for none
+    vertex_data_t uploadData;
+    size_t uploadOffset = 0; // bytes of uploadData already uploaded, vertices first
+    double uploadTime = 0;
+    size_t uploadBudget = 8 << 20; // bytes uploaded per frame
+    std::atomic<int> workJob{JOB_NONE};
+    std::atomic<int> workLevel{0};
+    std::atomic<int> progress{0};
+    std::atomic<int> progressTotal{1};
+
     int oldKeyQState = GLFW_RELEASE;
     int oldKeyEState = GLFW_RELEASE;
     int nowKeyQState = GLFW_RELEASE;
@@ -85,340 +217,917 @@ public:
     {
         this->enableGUI = enableGUI;
     }
+    // Threads subdividing the mesh, 0 for one per hardware thread
+    void SetThreadCount(size_t threadCount)
+    {
+        this->pool.resize(threadCount);
+    }
+
+    ~Mesh()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->requestMutex);
+            this->quit = true;
+        }
+        this->wake.notify_all();
+        if (this->worker.joinable())
+            this->worker.join();
+    }
 
     void Setup() {
+        std::lock_guard<std::mutex> meshLock(this->meshMutex);
+        stopwatch_t total;
+        stopwatch_t stage;
         this->shader.Setup();
         auto pair = this->LoadMeshfile(this->meshPath, boundingBoxSize);
         std::vector<std::array<double, 3>> vertices = pair.first;
         std::vector<std::array<int, 3>> faces = pair.second;
+        double loadTime = stage.lap();
 
-        this->curr = 0;
+        {
+            std::lock_guard<std::mutex> lock(this->requestMutex);
+            this->curr = 0;
+            this->requested = 0;
+            this->readyLevel = -1;
+        }
         this->meshs.resize(1);
+        this->levelCount = 1;
+        this->stencils.clear();
+        this->stale.assign(1, 0);
+        this->restPositions.clear();
         mesh_t &mesh = this->meshs[0];
-        mesh.vertices.resize(vertices.size());
-        mesh.faces.resize(faces.size());
-        mesh.edges.resize(faces.size() * 3);
+        mesh.Resize(vertices.size(), faces.size());
         for (size_t i = 0; i < vertices.size(); i++) {
             std::array<double, 3> positions = vertices[i];
-            vertex_t &vertex = mesh.vertices[i];
-            vertex.position.x = positions[0];
-            vertex.position.y = positions[1];
-            vertex.position.z = positions[2];
-            vertex.ID = mesh.uuid_v++;
+            mesh.positions[i].x = positions[0];
+            mesh.positions[i].y = positions[1];
+            mesh.positions[i].z = positions[2];
         }
 
-        std::map<const vertex_t *, bool> associated;
         for (size_t i = 0; i < faces.size(); i++) {
-            std::array<int, 3> vertexs = faces[i];
-            vertex_t &vertex0 = mesh.vertices[vertexs[0]];
-            vertex_t &vertex1 = mesh.vertices[vertexs[1]];
-            vertex_t &vertex2 = mesh.vertices[vertexs[2]];
-
-            face_t &face = mesh.faces[i];
-            edge_t &edge0 = mesh.edges[i * 3 + 0];
-            edge_t &edge1 = mesh.edges[i * 3 + 1];
-            edge_t &edge2 = mesh.edges[i * 3 + 2];
-
-            face.edge = &edge0;
-            edge0.vertex = &vertex0;
-            edge1.vertex = &vertex1;
-            edge2.vertex = &vertex2;
-            if (!associated[&vertex0]) {
-                vertex0.belong = &edge0;
-                associated[&vertex0] = true;
+            for (uint32_t k = 0; k < 3; k++) {
+                uint32_t edge = i * 3 + k;
+                uint32_t vertex = faces[i][k];
+                if (vertex >= vertices.size())
+                    throw std::runtime_error("A face refers to a vertex out of range");
+                mesh.edgeVertices[edge] = vertex;
+                if (mesh.vertexEdges[vertex] == mesh_t::invalid)
+                    mesh.vertexEdges[vertex] = edge;
             }
-            if (!associated[&vertex1]) {
-                vertex1.belong = &edge1;
-                associated[&vertex1] = true;
-            }
-            if (!associated[&vertex2]) {
-                vertex2.belong = &edge2;
-                associated[&vertex2] = true;
-            }
-
-            edge0.next = &edge1;
-            edge1.next = &edge2;
-            edge2.next = &edge0;
-            edge0.prev = &edge2;
-            edge1.prev = &edge0;
-            edge2.prev = &edge1;
-            edge0.belong = &face;
-            edge1.belong = &face;
-            edge2.belong = &face;
-            face.ID = mesh.uuid_f++;
-            edge0.ID = mesh.uuid_e++;
-            edge1.ID = mesh.uuid_e++;
-            edge2.ID = mesh.uuid_e++;
         }
+        double buildTime = stage.lap();
 
         this->SetNormal(mesh);
+        double normalTime = stage.lap();
         this->FindTwin(mesh);
+        double twinTime = stage.lap();
         this->SetCrease(mesh);
+        double creaseTime = stage.lap();
 
-        log_debug("Mesh \"%s\" has %d vertices %d faces", this->meshPath.c_str(), vertices.size(), faces.size());
+        log_debug("Mesh \"%s\" has %zu vertices %zu faces", this->meshPath.c_str(), vertices.size(), faces.size());
+        this->shownLevel = -1;
         this->OffloadCurrentMesh();
         this->guard.set();
+        if (!this->worker.joinable())
+            this->worker = std::thread(&Mesh::Work, this);
+        log_debug("Mesh \"%s\" setup %.2f ms (load %.2f, build %.2f, normal %.2f, twin %.2f, crease %.2f, upload %.2f)",
+            this->meshPath.c_str(), total.elapsed(), loadTime, buildTime, normalTime, twinTime, creaseTime, stage.lap()
+        );
     }
 
+    // Asks for the level acc away from the last one asked for. The worker
+    // builds it, and it shows once uploaded.
     void TrySwitchMesh(int acc)
     {
-        int targetIndex = this->curr + acc;
+        std::lock_guard<std::mutex> lock(this->requestMutex);
+        int targetIndex = this->requested + acc;
         if (targetIndex < 0)
             return;
+        this->requested = targetIndex;
+        this->generation++;
+        this->wake.notify_one();
+    }
+
+    void SetPrefetch(bool prefetch)
+    {
+        std::lock_guard<std::mutex> lock(this->requestMutex);
+        this->prefetch = prefetch;
+        this->generation++;
+        this->wake.notify_one();
+    }
+
+    void Work()
+    {
+        size_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(this->requestMutex);
+                this->wake.wait(lock, [&] { return this->quit || this->generation != seen; });
+                if (this->quit)
+                    return;
+                seen = this->generation;
+            }
+            while (this->WorkOnce()) {}
+        }
+    }
+
+    // Runs the most urgent job: stencils the animation needs, then the
+    // level asked for, then the one after the shown level. Returns false
+    // when there is none.
+    bool WorkOnce()
+    {
+        std::lock_guard<std::mutex> meshLock(this->meshMutex);
+        std::unique_lock<std::mutex> lock(this->requestMutex);
+        if (this->quit)
+            return false;
+        int job = JOB_NONE;
+        int level = this->requested;
+        if (this->animate && level >= 1 && (int)this->stencils.size() <= level) {
+            job = JOB_STENCILS;
+        } else if (level != this->curr && level != this->readyLevel && level != this->uploadLevel) {
+            job = JOB_DISPLAY;
+        } else if (this->prefetch && !this->animate && level == this->curr && (int)this->meshs.size() == level + 1
+            && this->meshs[level].FaceCount() * 4 <= this->prefetchFaceLimit) {
+            job = JOB_PREFETCH;
+            level++;
+        }
+        if (job == JOB_NONE)
+            return false;
+        lock.unlock();
+
+        // 5 stages per level subdivided, 1 per stencil level, 1 for the data
+        int missing = std::max<int>(level + 1 - this->meshs.size(), 0);
+        this->progress = 0;
+        this->progressTotal = missing * 5 + (job == JOB_STENCILS ? level + 1 - this->stencils.size() : 1);
+        this->workLevel = level;
+        this->workJob = job;
+        try {
+            if (job == JOB_STENCILS) {
+                this->BuildStencils(level);
+            } else {
+                this->Subdivide(level);
+            }
+            if (job == JOB_DISPLAY) {
+                this->Refresh(level);
+                vertex_data_t data = this->BuildVertexData(this->meshs[level]);
+                lock.lock();
+                this->readyLevel = level;
+                std::swap(this->readyData, data);
+                lock.unlock();
+            }
+        } catch (std::exception &e) {
+            log_error("Mesh \"%s\" failed to build level %d: %s", this->meshPath.c_str(), level, e.what());
+            lock.lock();
+            this->requested = this->curr;
+            this->prefetch = false;
+            this->animate = false;
+            lock.unlock();
+        }
+        this->workJob = JOB_NONE;
+        return true;
+    }
+
+    // Generates the levels up to the given one which don't exist yet
+    void Subdivide(int level)
+    {
+        for (int i = this->meshs.size(); i <= level; i++) {
+            this->Refresh(i - 1);
+            this->meshs.resize(i + 1);
+            this->stale.resize(i + 1, 0);
+            // generate new mesh
+            this->LoopSubdivision(this->meshs[i-1], this->meshs[i], i);
+            this->levelCount = this->meshs.size();
+        }
+    }
+
+    // Derives the stencils of the levels up to the given one. They depend on
+    // the topology and the crease flags only, so they are kept until another
+    // mesh is loaded, and crease flags stay as they were here when the
+    // control mesh moves.
+    void BuildStencils(int level)
+    {
+        if (level < (int)this->stencils.size())
+            return;
+        stopwatch_t watch;
+        this->Subdivide(level);
+        int first = std::max<int>(this->stencils.size(), 1);
+        this->stencils.resize(level + 1);
+        size_t entries = 0;
+        size_t bytes = 0;
+        for (int i = first; i <= level; i++) {
+            this->BuildStencil(this->meshs[i-1], this->meshs[i], i > 1 ? &this->stencils[i-1] : nullptr, this->stencils[i]);
+            entries += this->stencils[i].indices.size();
+            bytes += this->stencils[i].Bytes();
+            this->progress++;
+        }
+        log_debug("Mesh \"%s\" stencils of levels %d to %d: %zu entries %.1f MiB in %.2f ms",
+            this->meshPath.c_str(), first, level, entries, bytes / 1048576.0, watch.elapsed()
+        );
+    }
+
+    // Derives the rows of the fine level from those of the coarse one, or
+    // from the control vertices when the coarse mesh is the control mesh and
+    // previous is null. Rows follow the rules of ComputeOddPosition and
+    // EvenWeights. The odd vertex of each coarse half-edge is the start of
+    // its second fine half.
+    void BuildStencil(const mesh_t &coarse, const mesh_t &fine, const stencil_t *previous, stencil_t &stencil)
+    {
+        size_t controlCount = this->meshs[0].VertexCount();
+        std::vector<uint32_t> odds(coarse.EdgeCount());
+        this->pool.parallel_for(coarse.EdgeCount(), grain, [&](size_t begin, size_t end) {
+            for (uint32_t i = begin; i < end; i++)
+                odds[i] = fine.edgeVertices[mesh_t::Face(i) * 12 + secondHalf[i % 3]];
+        });
 
-        if (targetIndex >= this->meshs.size()) {
-            int oldSize = this->meshs.size();
-            int newSize = targetIndex + 1;
-            this->meshs.resize(newSize);
-            for (int i = oldSize; i < newSize; i++) {
-                // generate new mesh
-                mesh_t &oldMesh = this->meshs[i-1];
-                mesh_t &newMesh = this->meshs[i];
-                newMesh.vertices.reserve(oldMesh.vertices.size() * 8);
-                newMesh.faces.reserve(oldMesh.faces.size() * 8);
-                newMesh.edges.reserve(oldMesh.edges.size() * 8);
-                this->LoopSubdivision(oldMesh, newMesh);
+        stencil.offsets.assign(1, 0);
+        stencil.indices.clear();
+        stencil.weights.clear();
+
+        // odd vertex
+        std::vector<stencil_t> chunks((coarse.EdgeCount() + grain - 1) / grain);
+        this->pool.parallel_for(coarse.EdgeCount(), grain, [&](size_t begin, size_t end) {
+            stencil_t &chunk = chunks[begin / grain];
+            stencil_row_t row(controlCount);
+            for (uint32_t i = begin; i < end; i++) {
+                uint32_t twin = coarse.twins[i];
+                if (twin != mesh_t::invalid && twin < i)
+                    continue;
+                uint32_t a = coarse.edgeVertices[i];
+                uint32_t b = coarse.edgeVertices[mesh_t::Next(i)];
+                if (twin == mesh_t::invalid || coarse.creases[i]) {
+                    row.Add(previous, a, 1.0f / 2.0f);
+                    row.Add(previous, b, 1.0f / 2.0f);
+                } else {
+                    row.Add(previous, a, 3.0f / 8.0f);
+                    row.Add(previous, b, 3.0f / 8.0f);
+                    row.Add(previous, coarse.edgeVertices[mesh_t::Prev(i)], 1.0f / 8.0f);
+                    row.Add(previous, coarse.edgeVertices[mesh_t::Prev(twin)], 1.0f / 8.0f);
+                }
+                row.Flush(chunk);
+            }
+        });
+        this->AppendRows(stencil, chunks);
+
+        // even vertex, on top of the odd rows
+        chunks.assign((coarse.VertexCount() + grain - 1) / grain, stencil_t());
+        this->pool.parallel_for(coarse.VertexCount(), grain, [&](size_t begin, size_t end) {
+            stencil_t &chunk = chunks[begin / grain];
+            stencil_row_t row(controlCount);
+            std::vector<uint32_t> neighbour;
+            for (uint32_t i = begin; i < end; i++) {
+                float oddWeight = 0;
+                float selfWeight = this->EvenWeights(coarse, i, odds, neighbour, oddWeight);
+                row.Add(previous, i, selfWeight);
+                for (uint32_t odd : neighbour)
+                    row.Add(&stencil, odd, oddWeight);
+                row.Flush(chunk);
             }
+        });
+        this->AppendRows(stencil, chunks);
+    }
+
+    void AppendRows(stencil_t &stencil, const std::vector<stencil_t> &chunks)
+    {
+        for (const stencil_t &chunk : chunks) {
+            uint32_t base = stencil.indices.size();
+            for (uint32_t end : chunk.offsets)
+                stencil.offsets.push_back(base + end);
+            stencil.indices.insert(stencil.indices.end(), chunk.indices.begin(), chunk.indices.end());
+            stencil.weights.insert(stencil.weights.end(), chunk.weights.begin(), chunk.weights.end());
         }
-        this->curr = targetIndex;
+    }
+
+    // Brings a level up to date with the control mesh through its stencil
+    void Refresh(int level)
+    {
+        if (level >= (int)this->stale.size() || !this->stale[level])
+            return;
+        stopwatch_t watch;
+        const stencil_t &stencil = this->stencils[level];
+        const std::vector<glm::vec3> &control = this->meshs[0].positions;
+        mesh_t &mesh = this->meshs[level];
+        this->pool.parallel_for(mesh.VertexCount(), grain, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
+                for (uint32_t j = stencil.offsets[i]; j < stencil.offsets[i + 1]; j++)
+                    position += stencil.weights[j] * control[stencil.indices[j]];
+                mesh.positions[i] = position;
+            }
+        });
+        this->SetNormal(mesh);
+        this->stale[level] = 0;
+        this->stencilTime = watch.elapsed();
+    }
+
+    // Moves the control vertices. Levels with a stencil follow them when
+    // they are next shown, the others are dropped and subdivided again.
+    void Deform(const std::vector<glm::vec3> &positions)
+    {
+        mesh_t &control = this->meshs[0];
+        if (positions.size() != control.VertexCount())
+            throw std::runtime_error("Control positions do not match the mesh");
+        control.positions = positions;
+        this->SetNormal(control);
+        size_t kept = std::max<size_t>(this->stencils.size(), 1);
+        if (this->meshs.size() > kept)
+            this->meshs.resize(kept);
+        this->levelCount = this->meshs.size();
+        this->stale.assign(this->meshs.size(), 1);
+        this->stale[0] = 0;
+        {
+            std::lock_guard<std::mutex> lock(this->requestMutex);
+            this->curr = std::min<int>(this->curr, this->meshs.size() - 1);
+        }
+        this->Refresh(this->curr);
         this->OffloadCurrentMesh();
     }
 
-    void OffloadCurrentMesh()
+    // Animates the control mesh, refined through stencils which the worker
+    // builds up to the level asked for
+    void SetAnimate(bool animate)
+    {
+        std::lock_guard<std::mutex> lock(this->requestMutex);
+        this->animate = animate;
+        this->generation++;
+        this->wake.notify_one();
+    }
+
+    void SetRestPositions()
     {
-        mesh_t &mesh = this->meshs[this->curr];
-        std::vector<GLfloat> fdata;
-        for (size_t i = 0; i < mesh.faces.size(); i++) {
-            face_t &face = mesh.faces[i];
-            edge_t &edge0 = *face.edge;
-            edge_t &edge1 = *edge0.next;
-            edge_t &edge2 = *edge0.prev;
-            vertex_t &vertex0 = *edge0.vertex;
-            vertex_t &vertex1 = *edge1.vertex;
-            vertex_t &vertex2 = *edge2.vertex;
+        if (!this->restPositions.empty())
+            return;
+        this->restPositions = this->meshs[0].positions;
+        this->restCenter = glm::vec3(0, 0, 0);
+        for (const glm::vec3 &position : this->restPositions)
+            this->restCenter += position / (float)this->restPositions.size();
+    }
 
-            fdata.push_back(vertex0.position.x); fdata.push_back(vertex0.position.y); fdata.push_back(vertex0.position.z);
-            fdata.push_back(vertex1.position.x); fdata.push_back(vertex1.position.y); fdata.push_back(vertex1.position.z);
-            fdata.push_back(vertex2.position.x); fdata.push_back(vertex2.position.y); fdata.push_back(vertex2.position.z);
+    // One frame of the animation, skipped while the worker holds the mesh or
+    // lacks the stencils of a level that is shown or about to be
+    void StepAnimation(double now)
+    {
+        std::unique_lock<std::mutex> meshLock(this->meshMutex, std::try_to_lock);
+        if (!meshLock)
+            return;
+        int level = 0;
+        {
+            std::lock_guard<std::mutex> lock(this->requestMutex);
+            level = std::max(std::max(this->curr, this->requested), this->uploadLevel);
+        }
+        if (level > 0 && (int)this->stencils.size() <= level)
+            return;
+        this->SetRestPositions();
+        this->Deform(this->AnimatedPositions(now));
+    }
+
+    // The control mesh swollen around its vertical axis by a wave running up
+    std::vector<glm::vec3> AnimatedPositions(double now)
+    {
+        std::vector<glm::vec3> positions = this->restPositions;
+        for (glm::vec3 &position : positions) {
+            float phase = 3.0 * now - (position.y - this->restCenter.y) * 2.0 * M_PI / this->boundingBoxSize;
+            float swell = 1.0f + 0.1f * sin(phase);
+            position.x = this->restCenter.x + (position.x - this->restCenter.x) * swell;
+            position.z = this->restCenter.z + (position.z - this->restCenter.z) * swell;
+        }
+        return positions;
+    }
+
+    // Refines frames of the animation to the given level both by subdividing
+    // the deformed control mesh again and through the stencils, and logs the
+    // time each takes and how far apart their vertices end up
+    void BenchmarkStencils(int level, int frames)
+    {
+        std::lock_guard<std::mutex> meshLock(this->meshMutex);
+        this->SetRestPositions();
+        stopwatch_t watch;
+        this->BuildStencils(level);
+        double buildTime = watch.lap();
+
+        double rebuildTime = 0;
+        double refreshTime = 0;
+        float maxError = 0;
+        for (int frame = 0; frame < frames; frame++) {
+            std::vector<glm::vec3> positions = this->AnimatedPositions(frame / 60.0);
+            watch.reset();
+            std::vector<mesh_t> rebuilt(level + 1);
+            rebuilt[0] = this->meshs[0];
+            rebuilt[0].positions = positions;
+            this->SetNormal(rebuilt[0]);
+            this->SetCrease(rebuilt[0]);
+            for (int i = 1; i <= level; i++)
+                this->LoopSubdivision(rebuilt[i-1], rebuilt[i], i);
+            rebuildTime += watch.lap();
+
+            this->meshs[0].positions = positions;
+            this->stale.assign(this->meshs.size(), 1);
+            this->stale[0] = 0;
+            this->Refresh(level);
+            refreshTime += watch.lap();
+
+            const mesh_t &mesh = this->meshs[level];
+            for (size_t i = 0; i < mesh.VertexCount(); i++)
+                maxError = std::max(maxError, glm::length(mesh.positions[i] - rebuilt[level].positions[i]));
+        }
+        log_info("Mesh \"%s\" level %d over %d frames: rebuild %.2f ms, stencils %.2f ms per frame "
+            "(built once in %.2f ms), largest difference %g",
+            this->meshPath.c_str(), level, frames, rebuildTime / frames, refreshTime / frames, buildTime, maxError
+        );
+        this->Deform(this->restPositions);
+    }
+
+    // Sum of the normals of the faces around a vertex, walked as in
+    // EvenWeights, so a vertex shared by two fans only gets one of them
+    glm::vec3 VertexNormal(const mesh_t &mesh, uint32_t vertex)
+    {
+        uint32_t belong = mesh.vertexEdges[vertex];
+        if (belong == mesh_t::invalid)
+            return glm::vec3(0, 0, 0);
+
+        glm::vec3 sum = glm::vec3(0, 0, 0);
+        uint32_t find = belong;
+        do {
+            sum += mesh.normals[mesh_t::Face(find)];
+            if (mesh.twins[find] == mesh_t::invalid) {
+                uint32_t findBack = mesh_t::Prev(belong);
+                while (mesh.twins[findBack] != mesh_t::invalid) {
+                    sum += mesh.normals[mesh_t::Face(mesh.twins[findBack])];
+                    findBack = mesh_t::Prev(mesh.twins[findBack]);
+                }
+                break;
+            }
+            find = mesh_t::Next(mesh.twins[find]);
+        } while (find != belong);
+
+        if (glm::length(sum) == 0.0f)
+            return mesh.normals[mesh_t::Face(belong)];
+        return glm::normalize(sum);
+    }
+
+    vertex_data_t BuildVertexData(const mesh_t &mesh)
+    {
+        vertex_data_t data;
+        data.vertices.resize(mesh.VertexCount() * 6);
+        this->pool.parallel_for(mesh.VertexCount(), grain, [&](size_t begin, size_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                const glm::vec3 &position = mesh.positions[i];
+                glm::vec3 normal = this->VertexNormal(mesh, i);
+                GLfloat *vertex = &data.vertices[i * 6];
+                vertex[0] = position.x; vertex[1] = position.y; vertex[2] = position.z;
+                vertex[3] = normal.x; vertex[4] = normal.y; vertex[5] = normal.z;
+            }
+        });
+        data.indices.assign(mesh.edgeVertices.begin(), mesh.edgeVertices.end());
+        return data;
+    }
+
+    // Position at location 0 and normal at location 1 of the bound VAO
+    void SetVertexAttributes()
+    {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(1);
+    }
+
+    void RecordUpload(int level, size_t bytes, double time)
+    {
+        if ((int)this->uploadTimes.size() <= level) {
+            this->uploadTimes.resize(level + 1, 0);
+            this->uploadBytes.resize(level + 1, 0);
+        }
+        this->uploadTimes[level] = time;
+        this->uploadBytes[level] = bytes;
+    }
+
+    // Uploads the current level at once. When it is the level already shown,
+    // only the vertices moved, so the faces are kept.
+    void OffloadCurrentMesh()
+    {
+        stopwatch_t watch;
+        vertex_data_t data = this->BuildVertexData(this->meshs[this->curr]);
+        if (this->shownLevel == this->curr && this->drawCount == data.indices.size()) {
+            glBindBuffer(GL_ARRAY_BUFFER, this->VBO.get());
+            glBufferSubData(GL_ARRAY_BUFFER, 0, data.VertexBytes(), data.vertices.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            this->RecordUpload(this->curr, data.Bytes(), watch.elapsed());
+            return;
         }
 
         this->VAO.destroy();
         this->VBO.destroy();
+        this->EBO.destroy();
         this->VAO.create(1);
         this->VBO.create(1);
+        this->EBO.create(1);
 
         glBindVertexArray(this->VAO.get());
         glBindBuffer(GL_ARRAY_BUFFER, this->VBO.get());
-        glBufferData(GL_ARRAY_BUFFER, fdata.size() * sizeof(GLfloat), fdata.data(), GL_STATIC_DRAW);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
-        glEnableVertexAttribArray(0);
+        glBufferData(GL_ARRAY_BUFFER, data.VertexBytes(), data.vertices.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO.get());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.IndexBytes(), data.indices.data(), GL_STATIC_DRAW);
+        this->SetVertexAttributes();
         glBindVertexArray(0);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
+        this->drawCount = data.indices.size();
+        this->shownLevel = this->curr;
+        this->RecordUpload(this->curr, data.Bytes(), watch.elapsed());
     }
 
-    void LoopSubdivision(mesh_t &coarse, mesh_t &fine)
+    // Uploads a slice of the vertex data the worker prepared, and shows its
+    // level once all of it is on the GPU
+    void PollUpload()
     {
-        std::map<const edge_t *, vertex_t *> odds;
-        std::map<const vertex_t *, vertex_t *> evens;
+        stopwatch_t watch;
+        if (this->uploadLevel < 0) {
+            std::lock_guard<std::mutex> lock(this->requestMutex);
+            if (this->readyLevel < 0)
+                return;
+            if (this->readyLevel != this->requested) {
+                // asked for another level meanwhile
+                this->readyLevel = -1;
+                this->readyData = vertex_data_t();
+                this->generation++;
+                this->wake.notify_one();
+                return;
+            }
+            this->uploadLevel = this->readyLevel;
+            std::swap(this->uploadData, this->readyData);
+            this->uploadOffset = 0;
+            this->uploadTime = 0;
+            this->readyLevel = -1;
 
-        // odd vertex
-        for (int i = 0; i < coarse.edges.size(); i++) {
-            edge_t &edge = coarse.edges[i];
-            if (odds[&edge])
-                continue;
-            fine.vertices.resize(fine.vertices.size() + 1);
-            vertex_t &odd = fine.vertices.back();
-            odd.position = this->ComputeOddPosition(edge);
-            odd.ID = fine.uuid_v++;
-            odds[&edge] = &odd;
-            if (edge.twin != nullptr)
-                odds[edge.twin] = &odd;
+            this->nextVAO.destroy();
+            this->nextVBO.destroy();
+            this->nextEBO.destroy();
+            this->nextVAO.create(1);
+            this->nextVBO.create(1);
+            this->nextEBO.create(1);
+            glBindVertexArray(this->nextVAO.get());
+            glBindBuffer(GL_ARRAY_BUFFER, this->nextVBO.get());
+            glBufferData(GL_ARRAY_BUFFER, this->uploadData.VertexBytes(), NULL, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->nextEBO.get());
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->uploadData.IndexBytes(), NULL, GL_STATIC_DRAW);
+            this->SetVertexAttributes();
+            glBindVertexArray(0);
         }
-        // even vertex
-        uint32_t vertex_count_old = 0;
-        for (int i = 0; i < coarse.vertices.size(); i++) {
-            vertex_t &vertex = coarse.vertices[i];
-            edge_t *find = vertex.belong;
-            std::vector<vertex_t> neighbour;
-            do {
-                neighbour.push_back(*odds[find]);
-                if (find->twin == nullptr) {
-                    edge_t *findBack = vertex.belong->prev;
-                    while (findBack != nullptr) {
-                        neighbour.push_back(*odds[findBack]);
-                        if (findBack->twin == nullptr)
-                            break;
-                        findBack = findBack->twin->prev;
-                    }
-                    break;
-                }
-                find = find->twin->next;
-            } while (find != vertex.belong);
 
-            vertex_t even;
-            even = vertex;
-            even.position = this->RecomputeEvenPosition(even, odds, neighbour);
-            even.ID = fine.uuid_v++;
-            fine.vertices.push_back(even);
-            evens[&coarse.vertices[i]] = &fine.vertices.back();
+        // the element buffer binding belongs to the VAO, so it stays bound
+        glBindVertexArray(this->nextVAO.get());
+        glBindBuffer(GL_ARRAY_BUFFER, this->nextVBO.get());
+        size_t vertexBytes = this->uploadData.VertexBytes();
+        size_t budget = this->uploadBudget;
+        while (budget > 0 && this->uploadOffset < this->uploadData.Bytes()) {
+            size_t count = 0;
+            if (this->uploadOffset < vertexBytes) {
+                count = std::min(budget, vertexBytes - this->uploadOffset);
+                glBufferSubData(GL_ARRAY_BUFFER, this->uploadOffset, count,
+                    (const char*)this->uploadData.vertices.data() + this->uploadOffset);
+            } else {
+                size_t offset = this->uploadOffset - vertexBytes;
+                count = std::min(budget, this->uploadData.IndexBytes() - offset);
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, count,
+                    (const char*)this->uploadData.indices.data() + offset);
+            }
+            this->uploadOffset += count;
+            budget -= count;
         }
-        // remesh
-        for (int i = 0; i < coarse.faces.size(); i++) {
-            face_t &face = coarse.faces[i];
-            edge_t e[4][3];
-            edge_t &e_origin = *face.edge;
-            edge_t &e_previous = *e_origin.prev;
-            edge_t &e_next = *e_origin.next;
-
-            e[0][0].vertex = odds[&e_origin];
-            e[0][1].vertex = evens[e_next.vertex];
-            e[0][2].vertex = odds[&e_next];
-
-            e[1][0].vertex = odds[&e_next];
-            e[1][1].vertex = evens[e_previous.vertex];
-            e[1][2].vertex = odds[&e_previous];
-
-            e[2][0].vertex = odds[&e_previous];
-            e[2][1].vertex = evens[e_origin.vertex];
-            e[2][2].vertex = odds[&e_origin];
-
-            e[3][0].vertex = odds[&e_origin];
-            e[3][1].vertex = odds[&e_next];
-            e[3][2].vertex = odds[&e_previous];
-
-            for (uint32_t i = 0; i < 4; i++) {
-                fine.edges.push_back(e[i][0]);
-                fine.edges.push_back(e[i][1]);
-                fine.edges.push_back(e[i][2]);
-                fine.faces.resize(fine.faces.size() + 1);
-                edge_t &e0 = fine.edges[fine.edges.size() - 3];
-                edge_t &e1 = fine.edges[fine.edges.size() - 2];
-                edge_t &e2 = fine.edges[fine.edges.size() - 1];
-                face_t &fine_face = fine.faces.back();
-                e0.belong = &fine_face;
-                e1.belong = &fine_face;
-                e2.belong = &fine_face;
-                e0.next = &e1;
-                e1.next = &e2;
-                e2.next = &e0;
-                e0.prev = &e2;
-                e1.prev = &e0;
-                e2.prev = &e1;
-                fine_face.edge = &e0;
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        this->uploadTime += watch.elapsed();
+        if (this->uploadOffset < this->uploadData.Bytes())
+            return;
+
+        this->VAO.swap(this->nextVAO);
+        this->VBO.swap(this->nextVBO);
+        this->EBO.swap(this->nextEBO);
+        this->nextVAO.destroy();
+        this->nextVBO.destroy();
+        this->nextEBO.destroy();
+        this->drawCount = this->uploadData.indices.size();
+        this->shownLevel = this->uploadLevel;
+        this->RecordUpload(this->uploadLevel, this->uploadData.Bytes(), this->uploadTime);
+        this->uploadData = vertex_data_t();
+
+        std::lock_guard<std::mutex> lock(this->requestMutex);
+        this->curr = this->uploadLevel;
+        this->uploadLevel = -1;
+        this->generation++;
+        this->wake.notify_one();
+    }
+
+    // The fine mesh gets one odd vertex per coarse edge, numbered in the
+    // order of the first of its half-edges, followed by one even vertex per
+    // coarse vertex. Coarse face f, whose half-edges 3f, 3f+1 and 3f+2 start
+    // at A, B and C, is split into fine faces
+    //
+    //     4f+0: mAB B mBC
+    //     4f+1: mBC C mCA
+    //     4f+2: mCA A mAB
+    //     4f+3: mAB mBC mCA
+    //
+    // so each coarse half-edge is halved into a first and a second fine one.
+    // Every stage writes each output element from exactly one loop item, so
+    // the stages run in parallel on the pool and produce the same mesh
+    // whatever the number of threads.
+    static constexpr uint32_t firstHalf[3] = { 7, 1, 4 };
+    static constexpr uint32_t secondHalf[3] = { 0, 3, 6 };
+    static constexpr uint32_t oddEdge[3] = { 0, 2, 5 };
+    static constexpr size_t grain = 4096;
+
+    void LoopSubdivision(const mesh_t &coarse, mesh_t &fine, int level)
+    {
+        stopwatch_t total;
+        stopwatch_t stage;
+
+        // odd vertex, numbered by a prefix sum over the half-edges which come
+        // before their twin
+        std::vector<uint32_t> odds(coarse.EdgeCount());
+        std::vector<uint32_t> chunkOdds((coarse.EdgeCount() + grain - 1) / grain + 1, 0);
+        this->pool.parallel_for(coarse.EdgeCount(), grain, [&](size_t begin, size_t end) {
+            uint32_t count = 0;
+            for (uint32_t i = begin; i < end; i++)
+                count += coarse.twins[i] == mesh_t::invalid || coarse.twins[i] > i;
+            chunkOdds[begin / grain + 1] = count;
+        });
+        for (size_t i = 1; i < chunkOdds.size(); i++)
+            chunkOdds[i] += chunkOdds[i - 1];
+        uint32_t oddCount = chunkOdds.back();
+        fine.Resize(oddCount + coarse.VertexCount(), coarse.FaceCount() * 4);
+        this->pool.parallel_for(coarse.EdgeCount(), grain, [&](size_t begin, size_t end) {
+            uint32_t odd = chunkOdds[begin / grain];
+            for (uint32_t i = begin; i < end; i++) {
+                uint32_t twin = coarse.twins[i];
+                if (twin == mesh_t::invalid || twin > i) {
+                    odds[i] = odd++;
+                    fine.positions[odds[i]] = this->ComputeOddPosition(coarse, i);
+                }
+            }
+        });
+        this->pool.parallel_for(coarse.EdgeCount(), grain, [&](size_t begin, size_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                uint32_t twin = coarse.twins[i];
+                if (twin != mesh_t::invalid && twin < i)
+                    odds[i] = odds[twin];
             }
+        });
+        double oddTime = stage.lap();
+        this->progress++;
 
-            odds[&e_origin]->belong = &fine.edges[fine.edges.size() - 12];
-            odds[&e_next]->belong = &fine.edges[fine.edges.size() - 10];
-            odds[&e_previous]->belong = &fine.edges[fine.edges.size() - 7];
-            evens[e_next.vertex]->belong = &fine.edges[fine.edges.size() - 11];
-            evens[e_previous.vertex]->belong = &fine.edges[fine.edges.size() - 8];
-            evens[e_origin.vertex]->belong = &fine.edges[fine.edges.size() - 5];
-        }
+        // even vertex
+        this->pool.parallel_for(coarse.VertexCount(), grain, [&](size_t begin, size_t end) {
+            std::vector<uint32_t> neighbour;
+            for (uint32_t i = begin; i < end; i++)
+                fine.positions[oddCount + i] = this->RecomputeEvenPosition(coarse, fine, i, odds, neighbour);
+        });
+        double evenTime = stage.lap();
+        this->progress++;
+
+        // remesh
+        this->pool.parallel_for(coarse.FaceCount(), grain, [&](size_t begin, size_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                uint32_t oddAB = odds[i * 3 + 0];
+                uint32_t oddBC = odds[i * 3 + 1];
+                uint32_t oddCA = odds[i * 3 + 2];
+                uint32_t evenA = oddCount + coarse.edgeVertices[i * 3 + 0];
+                uint32_t evenB = oddCount + coarse.edgeVertices[i * 3 + 1];
+                uint32_t evenC = oddCount + coarse.edgeVertices[i * 3 + 2];
+                const uint32_t corners[12] = {
+                    oddAB, evenB, oddBC,
+                    oddBC, evenC, oddCA,
+                    oddCA, evenA, oddAB,
+                    oddAB, oddBC, oddCA,
+                };
+                uint32_t base = i * 12;
+                std::copy(corners, corners + 12, fine.edgeVertices.begin() + base);
+
+                // inner edges pair up with the center face, outer ones with
+                // the halves of the coarse twin
+                fine.twins[base + 2] = base + 9;
+                fine.twins[base + 9] = base + 2;
+                fine.twins[base + 5] = base + 10;
+                fine.twins[base + 10] = base + 5;
+                fine.twins[base + 8] = base + 11;
+                fine.twins[base + 11] = base + 8;
+                for (uint32_t k = 0; k < 3; k++) {
+                    uint32_t twin = coarse.twins[i * 3 + k];
+                    if (twin == mesh_t::invalid)
+                        continue;
+                    uint32_t twinBase = mesh_t::Face(twin) * 12;
+                    fine.twins[base + firstHalf[k]] = twinBase + secondHalf[twin % 3];
+                    fine.twins[base + secondHalf[k]] = twinBase + firstHalf[twin % 3];
+                }
+            }
+        });
+        // Each fine vertex starts the half-edge it got from the last coarse
+        // face around it. An odd vertex takes one leaving it in that face,
+        // which for mAB is the second half mAB->B of the coarse edge and for
+        // mBC and mCA the inner edges mBC->mAB and mCA->mBC. An even vertex
+        // takes the first half of the coarse half-edge leaving it.
+        this->pool.parallel_for(coarse.EdgeCount(), grain, [&](size_t begin, size_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                uint32_t twin = coarse.twins[i];
+                if (twin != mesh_t::invalid && twin < i)
+                    continue;
+                uint32_t last = twin != mesh_t::invalid && twin > i ? twin : i;
+                fine.vertexEdges[odds[i]] = mesh_t::Face(last) * 12 + oddEdge[last % 3];
+            }
+        });
+        std::vector<std::atomic<uint32_t>> lastEdges(coarse.VertexCount()); // plus one, 0 for none
+        this->pool.parallel_for(coarse.EdgeCount(), grain, [&](size_t begin, size_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                std::atomic<uint32_t> &last = lastEdges[coarse.edgeVertices[i]];
+                uint32_t seen = last.load(std::memory_order_relaxed);
+                while (seen < i + 1 && !last.compare_exchange_weak(seen, i + 1, std::memory_order_relaxed));
+            }
+        });
+        this->pool.parallel_for(coarse.VertexCount(), grain, [&](size_t begin, size_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                uint32_t last = lastEdges[i].load(std::memory_order_relaxed);
+                if (last != 0)
+                    fine.vertexEdges[oddCount + i] = mesh_t::Face(last - 1) * 12 + firstHalf[(last - 1) % 3];
+            }
+        });
+        double remeshTime = stage.lap();
+        this->progress++;
 
-        this->FindTwin(fine);
         this->SetNormal(fine);
+        double normalTime = stage.lap();
+        this->progress++;
         this->SetCrease(fine);
-        log_debug("Mesh \"%s\" subdivision %d vertices %d faces",
-            this->meshPath.c_str(), fine.vertices.size(), fine.faces.size()
+        double creaseTime = stage.lap();
+        this->progress++;
+        log_debug("Mesh \"%s\" subdivision level %d: %zu vertices %zu faces %.1f MiB in %.2f ms on %zu threads "
+            "(odd %.2f, even %.2f, remesh %.2f, normal %.2f, crease %.2f)",
+            this->meshPath.c_str(), level, fine.VertexCount(), fine.FaceCount(), fine.Bytes() / 1048576.0,
+            total.elapsed(), this->pool.size(), oddTime, evenTime, remeshTime, normalTime, creaseTime
         );
     }
 
-    glm::vec3 ComputeOddPosition(const edge_t &edge)
+    glm::vec3 ComputeOddPosition(const mesh_t &mesh, uint32_t edge)
     {
-        if (edge.twin == nullptr || edge.crease) {
-            vertex_t *a = edge.vertex;
-            vertex_t *b = edge.next->vertex;
-            return (a->position + b->position) / 2.0f;
+        uint32_t twin = mesh.twins[edge];
+        const glm::vec3 &a = mesh.positions[mesh.edgeVertices[edge]];
+        const glm::vec3 &b = mesh.positions[mesh.edgeVertices[mesh_t::Next(edge)]];
+        if (twin == mesh_t::invalid || mesh.creases[edge]) {
+            return (a + b) / 2.0f;
         } else {
-            vertex_t *a = edge.vertex;
-            vertex_t *b = edge.next->vertex;
-            vertex_t *c = edge.prev->vertex;
-            vertex_t *d = edge.twin->prev->vertex;
-            return (3.0f / 8.0f) * (a->position + b->position) + (1.0f / 8.0f) * (c->position + d->position);
+            const glm::vec3 &c = mesh.positions[mesh.edgeVertices[mesh_t::Prev(edge)]];
+            const glm::vec3 &d = mesh.positions[mesh.edgeVertices[mesh_t::Prev(twin)]];
+            return (3.0f / 8.0f) * (a + b) + (1.0f / 8.0f) * (c + d);
         }
     }
 
-    glm::vec3 RecomputeEvenPosition(vertex_t &even, std::map<const edge_t *, vertex_t *> &odds, const std::vector<vertex_t> &neighbour)
+    // The even vertex is selfWeight times the coarse vertex plus oddWeight
+    // times each of the odd vertices put in neighbour, which are found by
+    // walking around the coarse vertex. neighbour is scratch space, passed in
+    // so it is allocated once per level.
+    float EvenWeights(const mesh_t &coarse, uint32_t vertex, const std::vector<uint32_t> &odds,
+        std::vector<uint32_t> &neighbour, float &oddWeight)
     {
-        edge_t *edge = even.belong;
-        if (edge->twin == nullptr || edge->crease) {
-            vertex_t *a = odds[edge];
-            vertex_t *b = odds[edge->prev];
-            return (1.0f / 8.0f) * (a->position + b->position) + (3.0f / 4.0f) * even.position;
-        } else {
-            float n = (float)neighbour.size();
-            float beta = 0;
-            /* Loop's suggestion for beta */
-            float x = (3.0 / 8.0 + 1.0 / 4.0 * cos(2.0 * M_PI / n));
-            beta = (1.0 / n) * (5.0 / 8.0 - x * x);
-            /* Warren's suggestion for beta */
-            // if (neighbour.size() == 3)
-            //     beta = 3.0 / 16.0;
-            // else if (neighbour.size() > 3)
-            //     beta = 3.0 / (8.0 * n);
-            // else
-            //     throw std::runtime_error("you should not come here 4.0.0");
-            glm::vec3 sum = glm::vec3(0.0f, 0.0f, 0.0f);
-            for (int i = 0; i < neighbour.size(); i++)
-                sum += neighbour[i].position;
-            return even.position * (1.0f - n * beta) + sum * beta;
+        neighbour.clear();
+        oddWeight = 0;
+        uint32_t belong = coarse.vertexEdges[vertex];
+        if (belong == mesh_t::invalid)
+            return 1.0f;
+
+        if (coarse.twins[belong] == mesh_t::invalid || coarse.creases[belong]) {
+            neighbour.push_back(odds[belong]);
+            neighbour.push_back(odds[mesh_t::Prev(belong)]);
+            oddWeight = 1.0f / 8.0f;
+            return 3.0f / 4.0f;
         }
+
+        uint32_t find = belong;
+        do {
+            neighbour.push_back(odds[find]);
+            if (coarse.twins[find] == mesh_t::invalid) {
+                uint32_t findBack = mesh_t::Prev(belong);
+                while (true) {
+                    neighbour.push_back(odds[findBack]);
+                    if (coarse.twins[findBack] == mesh_t::invalid)
+                        break;
+                    findBack = mesh_t::Prev(coarse.twins[findBack]);
+                }
+                break;
+            }
+            find = mesh_t::Next(coarse.twins[find]);
+        } while (find != belong);
+
+        float n = (float)neighbour.size();
+        float beta = 0;
+        /* Loop's suggestion for beta */
+        float x = (3.0 / 8.0 + 1.0 / 4.0 * cos(2.0 * M_PI / n));
+        beta = (1.0 / n) * (5.0 / 8.0 - x * x);
+        /* Warren's suggestion for beta */
+        // if (neighbour.size() == 3)
+        //     beta = 3.0 / 16.0;
+        // else if (neighbour.size() > 3)
+        //     beta = 3.0 / (8.0 * n);
+        // else
+        //     throw std::runtime_error("you should not come here 4.0.0");
+        oddWeight = beta;
+        return 1.0f - n * beta;
+    }
+
+    // Moves a coarse vertex among the odd vertices around it, which must
+    // already be placed in the fine mesh
+    glm::vec3 RecomputeEvenPosition(const mesh_t &coarse, const mesh_t &fine, uint32_t vertex,
+        const std::vector<uint32_t> &odds, std::vector<uint32_t> &neighbour)
+    {
+        float oddWeight = 0;
+        float selfWeight = this->EvenWeights(coarse, vertex, odds, neighbour, oddWeight);
+        glm::vec3 sum = glm::vec3(0.0f, 0.0f, 0.0f);
+        for (int i = 0; i < neighbour.size(); i++)
+            sum += fine.positions[neighbour[i]];
+        return coarse.positions[vertex] * selfWeight + sum * oddWeight;
     }
 
+    // Links the two half-edges running in opposite directions over each edge.
+    // Half-edges are sorted on the (min, max) vertex pair of their edge, so
+    // the ones over the same edge end up next to each other. An edge is
+    // manifold when exactly two half-edges of opposite directions share it.
+    // The half-edges of any other edge keep no twin, so they are treated as
+    // boundaries, and are reported. Subdivision derives the twins of the fine
+    // mesh from the coarse ones, so only the loaded mesh needs this.
     void FindTwin(mesh_t &mesh)
     {
-        for (size_t i = 0; i < mesh.edges.size(); i++) {
-            edge_t &ei = mesh.edges[i];
-            for (size_t j = i + 1; j < mesh.edges.size(); j++) {
-                edge_t &ej = mesh.edges[j];
-                if (ei.twin)
-                    break;
-                if (ej.twin)
+        std::vector<std::pair<uint64_t, uint32_t>> keys(mesh.EdgeCount());
+        for (uint32_t i = 0; i < mesh.EdgeCount(); i++) {
+            uint64_t a = mesh.edgeVertices[i];
+            uint64_t b = mesh.edgeVertices[mesh_t::Next(i)];
+            keys[i].first = std::min(a, b) << 32 | std::max(a, b);
+            keys[i].second = i;
+        }
+        std::sort(keys.begin(), keys.end());
+
+        size_t nonManifold = 0;
+        for (size_t i = 0; i < keys.size(); ) {
+            size_t j = i + 1;
+            while (j < keys.size() && keys[j].first == keys[i].first)
+                j++;
+            uint32_t ei = keys[i].second;
+            if (j - i == 2) {
+                uint32_t ej = keys[i + 1].second;
+                if (mesh.edgeVertices[ei] == mesh.edgeVertices[mesh_t::Next(ej)]) {
+                    mesh.twins[ei] = ej;
+                    mesh.twins[ej] = ei;
+                    i = j;
                     continue;
-                if (ei.vertex == ej.next->vertex && ej.vertex == ei.next->vertex) {
-                    ei.twin = &ej;
-                    ej.twin = &ei;
                 }
             }
+            if (j - i > 1) {
+                log_trace("Mesh \"%s\" edge (%u, %u) is shared by %zu faces%s",
+                    this->meshPath.c_str(), mesh.edgeVertices[ei], mesh.edgeVertices[mesh_t::Next(ei)], j - i,
+                    j - i == 2 ? " of opposite orientation" : ""
+                );
+                nonManifold++;
+            }
+            i = j;
+        }
+        if (nonManifold > 0) {
+            log_warn("Mesh \"%s\" has %zu non-manifold edges, subdividing them as boundaries",
+                this->meshPath.c_str(), nonManifold
+            );
         }
     }
 
     void SetNormal(mesh_t &mesh)
     {
-        for (size_t i = 0; i < mesh.faces.size(); i++) {
-            face_t &face = mesh.faces[i];
-            glm::vec3 p0 = face.edge->vertex->position;
-            glm::vec3 p1 = face.edge->next->vertex->position;
-            glm::vec3 p2 = face.edge->prev->vertex->position;
-            glm::vec3 normal = glm::cross(p0 - p1, p0 - p2);
-            if (glm::length(normal) == 0.0)
-                throw std::runtime_error("A normal length is 0");
-            face.normal = glm::normalize(normal);
-        }
+        this->pool.parallel_for(mesh.FaceCount(), grain, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                glm::vec3 p0 = mesh.positions[mesh.edgeVertices[i * 3 + 0]];
+                glm::vec3 p1 = mesh.positions[mesh.edgeVertices[i * 3 + 1]];
+                glm::vec3 p2 = mesh.positions[mesh.edgeVertices[i * 3 + 2]];
+                glm::vec3 normal = glm::cross(p0 - p1, p0 - p2);
+                if (glm::length(normal) == 0.0)
+                    throw std::runtime_error("A normal length is 0");
+                mesh.normals[i] = glm::normalize(normal);
+            }
+        });
     }
 
+    // The crease flags of both halves of an edge are written by the lower one
     void SetCrease(mesh_t &mesh)
     {
-        std::map<const edge_t *, bool> checked;
-        for (int i= 0; i < mesh.edges.size(); i++) {
-            edge_t *edge = &mesh.edges[i];
-            if (checked[edge])
-                continue;
+        this->pool.parallel_for(mesh.EdgeCount(), grain, [&](size_t begin, size_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                uint32_t twin = mesh.twins[i];
+                if (twin == mesh_t::invalid) {
+                    mesh.creases[i] = true;
+                    continue;
+                }
+                if (twin < i)
+                    continue;
 
-            glm::vec3 normal0 = glm::normalize(edge->belong->normal);
-            glm::vec3 normal1 = glm::normalize(edge->twin->belong->normal);
-            double degrees = glm::degrees(glm::acos(glm::dot(normal0, normal1)));
+                glm::vec3 normal0 = glm::normalize(mesh.normals[mesh_t::Face(i)]);
+                glm::vec3 normal1 = glm::normalize(mesh.normals[mesh_t::Face(twin)]);
+                double degrees = glm::degrees(glm::acos(glm::dot(normal0, normal1)));
 
-            if (degrees >= 150) {
-                edge->crease = true;
-                edge->twin->crease = true;
-            } else {
-                edge->crease = false;
-                edge->twin->crease = false;
+                mesh.creases[i] = degrees >= 150;
+                mesh.creases[twin] = degrees >= 150;
             }
-            checked[edge] = true;
-            checked[edge->twin] = true;
-        }
+        });
     }
 
     std::pair<std::vector<std::array<double, 3>>, std::vector<std::array<int, 3>>>
@@ -511,6 +1220,9 @@ public:
 
     virtual void Render(double now, double lastRenderTime, const glm::mat4 &view, const glm::mat4 &projection) {
         this->guard.ensure();
+        this->PollUpload();
+        if (this->animate)
+            this->StepAnimation(now);
         this->shader.use();
 
         glm::mat4 model = glm::mat4(1.0f);
@@ -521,14 +1233,18 @@ public:
 
         glBindVertexArray(this->VAO.get());
         this->shader.setVec4("color", this->color);
-        glDrawArrays(GL_TRIANGLES, 0, this->meshs[curr].faces.size() * 3);
+        this->shader.setBool("shade", true);
+        glDrawElements(GL_TRIANGLES, this->drawCount, GL_UNSIGNED_INT, 0);
 
+        // the wireframe draws the same buffers again, unshaded
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
         {
             this->shader.setVec4("color", glm::vec4(1, 1, 1, 1.0f));
-            glDrawArrays(GL_TRIANGLES, 0, this->meshs[curr].faces.size() * 3);
+            this->shader.setBool("shade", false);
+            glDrawElements(GL_TRIANGLES, this->drawCount, GL_UNSIGNED_INT, 0);
         }
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        glBindVertexArray(0);
     }
 
     virtual void RenderGUI(double now, double lastTime, GLFWwindow *window)
@@ -543,7 +1259,36 @@ public:
         ImGui::Begin("Tips", NULL, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoSavedSettings);
         ImGui::Text("Press Q to switch to coarse mesh");
         ImGui::Text("Press E to switch to fine mesh (Loop Subdivision)");
-        ImGui::Text("Current mesh index: %d of %d", (int)this->curr+1, (int)this->meshs.size());
+        ImGui::Text("Current mesh index: %d of %d", (int)this->curr+1, (int)this->levelCount);
+        int job = this->workJob;
+        if (job != JOB_NONE) {
+            const char *names[] = { "", "Building stencils to", "Subdividing", "Prefetching" };
+            ImGui::Text("%s level %d", names[job], this->workLevel + 1);
+            ImGui::ProgressBar(this->progress / (float)std::max<int>(this->progressTotal, 1));
+        }
+        if (this->uploadLevel >= 0) {
+            ImGui::Text("Uploading level %d", this->uploadLevel + 1);
+            ImGui::ProgressBar(this->uploadOffset / (float)this->uploadData.Bytes());
+        }
+        for (size_t i = 0; i < this->uploadBytes.size(); i++) {
+            if (this->uploadBytes[i] == 0)
+                continue;
+            ImGui::Text("Level %d: %.2f MiB on GPU, uploaded in %.2f ms%s", (int)i + 1,
+                this->uploadBytes[i] / 1048576.0, this->uploadTimes[i], (int)i == this->shownLevel ? " (shown)" : "");
+        }
+        bool prefetch = false;
+        {
+            std::lock_guard<std::mutex> lock(this->requestMutex);
+            prefetch = this->prefetch;
+        }
+        if (ImGui::Checkbox("Prefetch next level", &prefetch))
+            this->SetPrefetch(prefetch);
+        bool animate = this->animate;
+        if (ImGui::Checkbox("Animate control mesh", &animate))
+            this->SetAnimate(animate);
+        if (this->animate) {
+            ImGui::Text("Stencils refine it in %.2f ms", (double)this->stencilTime);
+        }
         ImGui::End();
     }
 
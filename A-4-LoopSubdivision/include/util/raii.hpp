@@ -9,6 +9,7 @@
 // 全小写名字，这么短的单词驼峰太奇怪了
 
 #include <string>
+#include <utility>
 
 struct guard_t
 {
@@ -60,6 +61,12 @@ public:
     VAO_raii() {}
     ~VAO_raii() { this->destroy(); }
 
+    void swap(VAO_raii &other) {
+        std::swap(this->res, other.res);
+        std::swap(this->valid, other.valid);
+        std::swap(this->num, other.num);
+    }
+
     void create(int num) {
         unsigned int id;
         glGenVertexArrays(num, &id);
@@ -84,6 +91,12 @@ public:
     VBO_raii() {}
     ~VBO_raii() { this->destroy(); }
 
+    void swap(VBO_raii &other) {
+        std::swap(this->res, other.res);
+        std::swap(this->valid, other.valid);
+        std::swap(this->num, other.num);
+    }
+
     void create(int num) {
         unsigned int id;
         glGenBuffers(1, &id);
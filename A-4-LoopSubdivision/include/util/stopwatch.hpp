@@ -0,0 +1,21 @@
+#pragma once
+
+#include <chrono>
+
+// Wall clock timing of the stages of some work, in milliseconds
+struct stopwatch_t
+{
+protected:
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+public:
+    void reset() { this->start = std::chrono::steady_clock::now(); }
+    double elapsed() const {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - this->start).count();
+    }
+    // Time since the last lap (or reset), and starts the next one
+    double lap() {
+        double ms = this->elapsed();
+        this->reset();
+        return ms;
+    }
+};
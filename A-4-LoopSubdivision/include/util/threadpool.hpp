@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads which run the chunks of a loop together with
+// the calling thread. Loops run one at a time: parallel_for returns once every
+// chunk has, and callers on other threads wait for their turn. Which thread
+// runs which chunk is unspecified, so chunks must only write disjoint data.
+class threadpool_t
+{
+    std::vector<std::thread> workers;
+    std::mutex loopMutex; // held by the caller for the whole loop
+    std::mutex mutex;
+    std::condition_variable wake; // a loop started, or workers should quit
+    std::condition_variable done; // the last worker finished the loop
+    size_t generation = 0;
+    size_t busy = 0;
+    bool quit = false;
+
+    const std::function<void(size_t, size_t)> *func = nullptr;
+    size_t count = 0;
+    size_t grain = 1;
+    std::atomic<size_t> next{0};
+    std::exception_ptr error;
+
+    void work()
+    {
+        size_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->wake.wait(lock, [&] { return this->generation != seen || this->quit; });
+                if (this->quit)
+                    return;
+                seen = this->generation;
+            }
+            this->run();
+            std::lock_guard<std::mutex> lock(this->mutex);
+            if (--this->busy == 0)
+                this->done.notify_one();
+        }
+    }
+
+    void run()
+    {
+        while (true) {
+            size_t begin = this->next.fetch_add(this->grain);
+            if (begin >= this->count)
+                return;
+            try {
+                (*this->func)(begin, std::min(begin + this->grain, this->count));
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                if (!this->error)
+                    this->error = std::current_exception();
+                this->next = this->count;
+            }
+        }
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->quit = true;
+        }
+        this->wake.notify_all();
+        for (std::thread &worker : this->workers)
+            worker.join();
+        this->workers.clear();
+    }
+
+public:
+    // threadCount counts the caller too, 0 picks the number of hardware threads
+    explicit threadpool_t(size_t threadCount = 0) { this->resize(threadCount); }
+    ~threadpool_t() { this->stop(); }
+    threadpool_t(const threadpool_t &) = delete;
+    threadpool_t &operator=(const threadpool_t &) = delete;
+
+    size_t size() const { return this->workers.size() + 1; }
+
+    void resize(size_t threadCount)
+    {
+        std::lock_guard<std::mutex> loopLock(this->loopMutex);
+        this->stop();
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        this->quit = false;
+        for (size_t i = 1; i < threadCount; i++)
+            this->workers.emplace_back(&threadpool_t::work, this);
+    }
+
+    // Calls func(begin, end) on consecutive chunks of grain items covering
+    // [0, count), and rethrows the first exception one of them threw
+    void parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)> &func)
+    {
+        grain = std::max<size_t>(grain, 1);
+        std::lock_guard<std::mutex> loopLock(this->loopMutex);
+        if (this->workers.empty() || count <= grain) {
+            for (size_t begin = 0; begin < count; begin += grain)
+                func(begin, std::min(begin + grain, count));
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->func = &func;
+            this->count = count;
+            this->grain = grain;
+            this->next = 0;
+            this->error = nullptr;
+            this->busy = this->workers.size();
+            this->generation++;
+        }
+        this->wake.notify_all();
+        this->run();
+
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->done.wait(lock, [&] { return this->busy == 0; });
+        if (this->error)
+            std::rethrow_exception(this->error);
+    }
+};
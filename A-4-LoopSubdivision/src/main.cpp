@@ -20,7 +20,9 @@
 #include "Mesh.hpp"
 #include "SmileBox.hpp"
 
-int main() {
+int main(int argc, char **argv) {
+    // -b: compare refining the animated cow by subdivision and by stencils, then quit
+    bool benchmark = argc > 1 && strcmp(argv[1], "-b") == 0;
     GLint success = 0;
     Window window(&success, "A-4-LoopSubdivision", 800, 600);
     if (success != 1) {
@@ -42,6 +44,10 @@ int main() {
     cow.SetBoundingBoxSize(10.0);
     cow.MoveTo(glm::vec3(0, 0, -20));
     cow.Setup();
+    if (benchmark) {
+        cow.BenchmarkStencils(4, 10);
+        return 0;
+    }
     window.AddObject(&cow);
 
     Mesh teddy;